@@ -5,6 +5,7 @@
 # using the Unix 'time' program using the sum of the user and system time for
 # the script.
 
+import os
 import re
 import subprocess
 from datetime import date
@@ -47,7 +48,20 @@ def medianTime(name):
     return times[len(times) / 2]
 
 
+# The startup-image benchmark loads a bytecode image of the core library. It
+# goes here instead of next to core.fin so that finch doesn't start using it
+# to load the core library for the other benchmarks.
+subprocess.check_call(['../build/Release/finch', '--compile',
+                       '../lib/core.fin', 'startup-image.fnb'])
+
 lexerTime = medianTime('lexer')
 fibTime = medianTime('fib')
-print 'date          lexer     fib'
-print '{0}  {1:6}s {2:6}s'.format(date.today(), lexerTime, fibTime)
+compileTime = medianTime('compile')
+sourceTime = medianTime('startup-source')
+imageTime = medianTime('startup-image')
+concatTime = medianTime('concat')
+os.remove('startup-image.fnb')
+print 'date          lexer     fib  compile  startup (source / image)  concat'
+print '{0}  {1:6}s {2:6}s {3:6}s  {4:6}s / {5:6}s  {6:6}s'.format(
+    date.today(), lexerTime, fibTime, compileTime, sourceTime, imageTime,
+    concatTime)
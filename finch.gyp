@@ -44,10 +44,13 @@
       'src/Interpreter',
     ],
     'sources': [
+      'src/Base/Allocator.cpp',
+      'src/Base/Allocator.h',
       'src/Base/Array.h',
       'src/Base/Dictionary.h',
       'src/Base/FinchString.cpp',
       'src/Base/FinchString.h',
+      'src/Base/Handle.h',
       'src/Base/Macros.h',
       'src/Base/Queue.h',
       'src/Base/Ref.h',
@@ -56,8 +59,12 @@
       'src/Base/StringTable.h',
       'src/Compiler/Block.cpp',
       'src/Compiler/Block.h',
+      'src/Compiler/BytecodeImage.cpp',
+      'src/Compiler/BytecodeImage.h',
       'src/Compiler/Compiler.cpp',
       'src/Compiler/Compiler.h',
+      'src/Compiler/Optimizer.cpp',
+      'src/Compiler/Optimizer.h',
       'src/finch.1',
       'src/IErrorReporter.h',
       'src/IInterpreterHost.h',
@@ -66,20 +73,27 @@
       'src/Interpreter/Fiber.h',
       'src/Interpreter/FileLineReader.cpp',
       'src/Interpreter/FileLineReader.h',
+      'src/Interpreter/Heap.cpp',
+      'src/Interpreter/Heap.h',
       'src/Interpreter/Objects/ArrayObject.h',
       'src/Interpreter/Objects/BlockObject.h',
       'src/Interpreter/Objects/BlockObject.cpp',
+      'src/Interpreter/Objects/DictionaryObject.cpp',
+      'src/Interpreter/Objects/DictionaryObject.h',
       'src/Interpreter/Objects/DynamicObject.cpp',
       'src/Interpreter/Objects/DynamicObject.h',
       'src/Interpreter/Objects/FiberObject.h',
-      'src/Interpreter/Objects/NumberObject.h',
       'src/Interpreter/Objects/Object.cpp',
       'src/Interpreter/Objects/Object.h',
+      'src/Interpreter/Objects/Shape.cpp',
+      'src/Interpreter/Objects/Shape.h',
       'src/Interpreter/Objects/StringObject.h',
       'src/Interpreter/Primitives/ArrayPrimitives.cpp',
       'src/Interpreter/Primitives/ArrayPrimitives.h',
       'src/Interpreter/Primitives/BlockPrimitives.cpp',
       'src/Interpreter/Primitives/BlockPrimitives.h',
+      'src/Interpreter/Primitives/DictionaryPrimitives.cpp',
+      'src/Interpreter/Primitives/DictionaryPrimitives.h',
       'src/Interpreter/Primitives/FiberPrimitives.cpp',
       'src/Interpreter/Primitives/FiberPrimitives.h',
       'src/Interpreter/Primitives/IoPrimitives.cpp',
@@ -92,12 +106,18 @@
       'src/Interpreter/Primitives/StringPrimitives.h',
       'src/Interpreter/Primitives.cpp',
       'src/Interpreter/Primitives.h',
+      'src/Interpreter/RegisterStack.cpp',
+      'src/Interpreter/RegisterStack.h',
+      'src/Interpreter/Snapshot.cpp',
+      'src/Interpreter/Snapshot.h',
       'src/Interpreter/Upvalue.cpp',
       'src/Interpreter/Upvalue.h',
       'src/Interpreter.cpp',
       'src/Interpreter.h',
       'src/ReplLineReader.cpp',
       'src/ReplLineReader.h',
+      'src/Standalone.cpp',
+      'src/Standalone.h',
       'src/StandaloneInterpreterHost.cpp',
       'src/StandaloneInterpreterHost.h',
       'src/Syntax/AST/ArrayExpr.h',
@@ -148,24 +168,64 @@
         'src/Test',
       ],
       'sources': [
+        'src/Test/AllocatorTests.cpp',
+        'src/Test/AllocatorTests.h',
         'src/Test/ArrayTests.cpp',
         'src/Test/ArrayTests.h',
+        'src/Test/BytecodeImageTests.cpp',
+        'src/Test/BytecodeImageTests.h',
+        'src/Test/CompilerTests.cpp',
+        'src/Test/CompilerTests.h',
+        'src/Test/DictionaryTests.cpp',
+        'src/Test/DictionaryTests.h',
+        'src/Test/HandleTests.cpp',
+        'src/Test/HandleTests.h',
+        'src/Test/IdTableTests.cpp',
+        'src/Test/IdTableTests.h',
+        'src/Test/InterpreterTests.cpp',
+        'src/Test/InterpreterTests.h',
         'src/Test/LexerTests.cpp',
         'src/Test/LexerTests.h',
+        'src/Test/OptimizerTests.cpp',
+        'src/Test/OptimizerTests.h',
         'src/Test/QueueTests.cpp',
         'src/Test/QueueTests.h',
         'src/Test/RefTests.cpp',
         'src/Test/RefTests.h',
+        'src/Test/RegisterStackTests.cpp',
+        'src/Test/RegisterStackTests.h',
+        'src/Test/SnapshotTests.cpp',
+        'src/Test/SnapshotTests.h',
         'src/Test/StackTests.cpp',
         'src/Test/StackTests.h',
+        'src/Test/StandaloneTests.cpp',
+        'src/Test/StandaloneTests.h',
+        'src/Test/StringTableTests.cpp',
+        'src/Test/StringTableTests.h',
         'src/Test/StringTests.cpp',
         'src/Test/StringTests.h',
         'src/Test/Test.cpp',
         'src/Test/Test.h',
+        'src/Test/TestHost.h',
         'src/Test/TestMain.cpp',
         'src/Test/TokenTests.cpp',
         'src/Test/TokenTests.h'
       ],
     },
+    {
+      'target_name': 'micro_benchmarks',
+      'type': 'executable',
+      'include_dirs': [
+        'src/Benchmark',
+      ],
+      'sources': [
+        'src/Benchmark/Benchmark.h',
+        'src/Benchmark/BenchmarkMain.cpp',
+        'src/Benchmark/HandleBenchmark.cpp',
+        'src/Benchmark/HandleBenchmark.h',
+        'src/Benchmark/IdTableBenchmark.cpp',
+        'src/Benchmark/IdTableBenchmark.h',
+      ],
+    },
   ],
 }
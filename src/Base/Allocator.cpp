@@ -0,0 +1,139 @@
+#include "Allocator.h"
+#include "IInterpreterHost.h"
+
+namespace Finch
+{
+    // The largest request each small size class serves. Spaced closely at the
+    // small end where most objects are and more coarsely above that.
+    static const int sClassSizes[Allocator::NUM_SIZE_CLASSES] =
+    {
+        16, 32, 48, 64, 80, 96, 112, 128,
+        160, 192, 224, 256, 320, 384, 448, 512
+    };
+
+    Allocator::Allocator(IInterpreterHost & host)
+    :   mHost(host),
+        mSlabs(NULL)
+    {
+        for (int i = 0; i <= NUM_SIZE_CLASSES; i++)
+        {
+            Pool & pool = mPools[i];
+            pool.allocator = this;
+            pool.freeList = NULL;
+            pool.next = NULL;
+            pool.end = NULL;
+
+            // The last pool is for large allocations and doesn't have a size.
+            int size = (i < NUM_SIZE_CLASSES) ? sClassSizes[i] : 0;
+            pool.chunkSize = (size > 0) ? HEADER_SIZE + size : 0;
+            pool.stats.size = size;
+            pool.stats.numSlabs = 0;
+            pool.stats.numLive = 0;
+            pool.stats.numAllocations = 0;
+        }
+
+        // Find the smallest class that fits each step.
+        int sizeClass = 0;
+        for (size_t step = 0; step <= MAX_SMALL_SIZE / GRANULARITY; step++)
+        {
+            while (static_cast<size_t>(sClassSizes[sizeClass]) < step * GRANULARITY)
+            {
+                sizeClass++;
+            }
+
+            mSizeClasses[step] = static_cast<unsigned char>(sizeClass);
+        }
+    }
+
+    Allocator::~Allocator()
+    {
+        while (mSlabs != NULL)
+        {
+            void * slab = mSlabs;
+            mSlabs = *static_cast<void **>(slab);
+            mHost.Free(slab);
+        }
+    }
+
+    void * Allocator::Allocate(size_t size)
+    {
+        Pool * pool;
+        char * chunk;
+
+        if (size > MAX_SMALL_SIZE)
+        {
+            pool = &mPools[NUM_SIZE_CLASSES];
+            chunk = static_cast<char *>(mHost.Allocate(HEADER_SIZE + size));
+        }
+        else
+        {
+            pool = &mPools[mSizeClasses[(size + GRANULARITY - 1) / GRANULARITY]];
+
+            if (pool->freeList != NULL)
+            {
+                // Reuse a freed chunk.
+                chunk = static_cast<char *>(pool->freeList) - HEADER_SIZE;
+                pool->freeList = *static_cast<void **>(pool->freeList);
+            }
+            else
+            {
+                if (static_cast<size_t>(pool->end - pool->next) < pool->chunkSize)
+                {
+                    AllocateSlab(*pool);
+                }
+
+                chunk = pool->next;
+                pool->next += pool->chunkSize;
+            }
+        }
+
+        pool->stats.numLive++;
+        pool->stats.numAllocations++;
+
+        *reinterpret_cast<Pool **>(chunk) = pool;
+        return chunk + HEADER_SIZE;
+    }
+
+    void Allocator::Free(void * data)
+    {
+        if (data == NULL) return;
+
+        char * chunk = static_cast<char *>(data) - HEADER_SIZE;
+        Pool * pool = *reinterpret_cast<Pool **>(chunk);
+
+        pool->stats.numLive--;
+
+        if (pool->chunkSize == 0)
+        {
+            // Large allocations go right back to the host.
+            pool->allocator->mHost.Free(chunk);
+        }
+        else
+        {
+            *static_cast<void **>(data) = pool->freeList;
+            pool->freeList = data;
+        }
+    }
+
+    const AllocatorStats & Allocator::GetStats(int sizeClass) const
+    {
+        ASSERT_RANGE(sizeClass, NUM_SIZE_CLASSES + 1);
+        return mPools[sizeClass].stats;
+    }
+
+    void Allocator::AllocateSlab(Pool & pool)
+    {
+        char * slab = static_cast<char *>(mHost.Allocate(SLAB_SIZE));
+
+        // Link it in so it can be freed later.
+        *reinterpret_cast<void **>(slab) = mSlabs;
+        mSlabs = slab;
+
+        // Whatever is left of the previous slab is wasted, but it's always
+        // smaller than one chunk.
+        pool.next = slab + SLAB_HEADER_SIZE;
+        pool.end = slab + SLAB_SIZE;
+        pool.stats.numSlabs++;
+    }
+}
+
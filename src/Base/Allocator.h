@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstddef>
+
+#include "Macros.h"
+
+// Use this inside a class declaration to make instances of the class come from
+// an Allocator. Instances must then be created using
+// `new (allocator) ClassName(...)`, and deleting them returns their memory to
+// the allocator they came from. Note that this starts a public section.
+#define USE_ALLOCATOR                                                       \
+    public:                                                                 \
+        static void * operator new(size_t size, Allocator & allocator)      \
+        {                                                                   \
+            return allocator.Allocate(size);                                \
+        }                                                                   \
+                                                                            \
+        static void operator delete(void * data, Allocator & allocator)     \
+        {                                                                   \
+            Allocator::Free(data);                                          \
+        }                                                                   \
+                                                                            \
+        static void operator delete(void * data)                            \
+        {                                                                   \
+            Allocator::Free(data);                                          \
+        }
+
+namespace Finch
+{
+    class IInterpreterHost;
+
+    // Counters for one of an Allocator's size classes. Lets the host monitor
+    // how the interpreter is using memory.
+    struct AllocatorStats
+    {
+        // The largest allocation in bytes that this size class serves. Zero
+        // for the class of large allocations that go straight to the host.
+        int size;
+
+        // The number of slabs this class has requested from the host.
+        int numSlabs;
+
+        // The number of allocations that haven't been freed yet.
+        int numLive;
+
+        // The total number of allocations made from this class.
+        int numAllocations;
+    };
+
+    // Provides the memory for the interpreter's objects and their storage.
+    // Small requests are rounded up to one of a fixed set of size classes.
+    // Each class carves fixed-size chunks out of large slabs and keeps freed
+    // chunks on a free list for reuse, so allocation is usually just a
+    // pointer bump or list pop. Slabs and large requests come from the
+    // IInterpreterHost, which gives the host control over all of the memory
+    // the interpreter uses.
+    //
+    // Every chunk is preceded by a pointer to the pool it came from. That
+    // lets Free() work without being told the size or the allocator, which
+    // is what class-specific operator delete and Handle<T> need.
+    class Allocator
+    {
+    public:
+        // The number of size classes for small allocations. Stats for large
+        // allocations come after them.
+        static const int NUM_SIZE_CLASSES = 16;
+
+        Allocator(IInterpreterHost & host);
+
+        // Returns every slab to the host. Anything still allocated from it is
+        // invalid after this.
+        ~Allocator();
+
+        // Allocates a chunk of memory at least the given size. The memory is
+        // aligned for any type that needs at most eight-byte alignment.
+        void * Allocate(size_t size);
+
+        // Returns memory previously allocated by an Allocator to it. Does
+        // nothing if given NULL.
+        static void Free(void * data);
+
+        // Gets the counters for the given size class. Indexes from zero to
+        // NUM_SIZE_CLASSES - 1 are the small size classes in increasing
+        // size. NUM_SIZE_CLASSES is for large allocations.
+        const AllocatorStats & GetStats(int sizeClass) const;
+
+    private:
+        struct Pool
+        {
+            Allocator *    allocator;
+
+            // The size of each chunk including its header, or zero if this is
+            // the pool for large allocations.
+            size_t         chunkSize;
+
+            // Freed chunks, linked through the memory after their headers.
+            void *         freeList;
+
+            // The unused end of the pool's current slab.
+            char *         next;
+            char *         end;
+
+            AllocatorStats stats;
+        };
+
+        // The number of bytes before the data in each chunk.
+        static const size_t HEADER_SIZE = 8;
+
+        // The number of bytes at the start of each slab used to link the
+        // slabs together. Keeps the chunks after it sixteen-byte aligned.
+        static const size_t SLAB_HEADER_SIZE = 16;
+
+        // The number of bytes requested from the host for each slab.
+        static const size_t SLAB_SIZE = 16 * 1024;
+
+        // Small size classes are looked up in steps of this many bytes.
+        static const size_t GRANULARITY = 16;
+
+        // The largest request that comes from a size class.
+        static const size_t MAX_SMALL_SIZE = 512;
+
+        void AllocateSlab(Pool & pool);
+
+        IInterpreterHost & mHost;
+
+        Pool mPools[NUM_SIZE_CLASSES + 1];
+
+        // Maps a small request size, in steps of GRANULARITY, to its pool.
+        unsigned char mSizeClasses[MAX_SMALL_SIZE / GRANULARITY + 1];
+
+        // Every slab this allocator has made, linked through their first
+        // bytes.
+        void * mSlabs;
+
+        NO_COPY(Allocator);
+    };
+}
+
@@ -1,13 +1,17 @@
 #pragma once
 
 #include <iostream>
+#include <new>
 
+#include "Allocator.h"
 #include "Macros.h"
 
 namespace Finch
 {
     // A resizable dynamic array class. Array items must support copying and
-    // a default constructor.
+    // a default constructor. By default, the items are stored on the C++
+    // heap. An array can instead be given an Allocator to get its storage
+    // from.
     template <class T>
     class Array
     {
@@ -15,13 +19,24 @@ namespace Finch
         Array()
         :   mCount(0),
             mCapacity(0),
-            mItems(NULL)
+            mItems(NULL),
+            mAllocator(NULL)
         {}
         
         Array(int capacity)
         :   mCount(0),
             mCapacity(0),
-            mItems(NULL)
+            mItems(NULL),
+            mAllocator(NULL)
+        {
+            EnsureCapacity(capacity);
+        }
+
+        Array(Allocator & allocator, int capacity)
+        :   mCount(0),
+            mCapacity(0),
+            mItems(NULL),
+            mAllocator(&allocator)
         {
             EnsureCapacity(capacity);
         }
@@ -29,7 +44,8 @@ namespace Finch
         Array(int size, const T & fillWith)
         :   mCount(0),
             mCapacity(0),
-            mItems(NULL)
+            mItems(NULL),
+            mAllocator(NULL)
         {
             EnsureCapacity(size);
             
@@ -44,7 +60,8 @@ namespace Finch
         Array(const Array<T> & array)
         :   mCount(0),
             mCapacity(0),
-            mItems(NULL)
+            mItems(NULL),
+            mAllocator(NULL)
         {
             AddAll(array);
         }
@@ -97,7 +114,8 @@ namespace Finch
         // Removes all items from the array.
         void Clear()
         {
-            if (mItems != NULL) delete [] mItems;
+            FreeItems(mItems, mCapacity);
+            mItems = NULL;
             mCount = 0;
             mCapacity = 0;
         }
@@ -210,7 +228,7 @@ namespace Finch
             }
         
             // create the new array
-            T* newItems = new T[capacity];
+            T* newItems = AllocateItems(capacity);
             
             // copy the items over
             for (int i = 0; i < mCount; i++)
@@ -219,18 +237,52 @@ namespace Finch
             }
             
             // delete the old one
-            delete [] mItems;
+            FreeItems(mItems, mCapacity);
             mItems = newItems;
             
             mCapacity = capacity;
         }
         
+        T* AllocateItems(int capacity)
+        {
+            if (mAllocator == NULL) return new T[capacity];
+            
+            T* items = static_cast<T*>(mAllocator->Allocate(sizeof(T) * capacity));
+            for (int i = 0; i < capacity; i++)
+            {
+                new (&items[i]) T();
+            }
+            
+            return items;
+        }
+        
+        void FreeItems(T* items, int capacity)
+        {
+            if (items == NULL) return;
+            
+            if (mAllocator == NULL)
+            {
+                delete [] items;
+                return;
+            }
+            
+            for (int i = 0; i < capacity; i++)
+            {
+                items[i].~T();
+            }
+            
+            Allocator::Free(items);
+        }
+        
         static const int MIN_CAPACITY = 16;
         static const int GROW_FACTOR  = 2;
         
-        int mCount;
-        int mCapacity;
-        T*  mItems;
+        int         mCount;
+        int         mCapacity;
+        T*          mItems;
+        
+        // Where the items are allocated from, or NULL to use the C++ heap.
+        Allocator * mAllocator;
     };
 }
 
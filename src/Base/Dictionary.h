@@ -6,9 +6,10 @@
 
 namespace Finch
 {
-    // A dictionary mapping keys to values. Uses a dynamically-grown hashtable.
-    // Both TKey and TValue must have default constructors as well as support
-    // copying. TKey must also have a HashCode() method.
+    // A dictionary mapping keys to values. Uses a dynamically-grown hashtable
+    // with open addressing and linear probing. Both TKey and TValue must have
+    // default constructors as well as support copying. TKey must also have a
+    // HashCode() method and an == operator.
     template <class TKey, class TValue>
     class Dictionary
     {
@@ -16,6 +17,7 @@ namespace Finch
         Dictionary()
         :   mTable(NULL),
             mCount(0),
+            mNumDeleted(0),
             mTableSize(0)
         {}
         
@@ -27,11 +29,29 @@ namespace Finch
             }
         }
         
-        // Looks up the value associated with the given key. Returns a null
-        // reference if the key was not found.
-        bool Find(const TKey & key, TValue * value)
+        // Gets the number of items in the dictionary.
+        int Count() const { return mCount; }
+        
+        // Gets the number of slots in the underlying hash table. Together with
+        // GetSlot(), this allows iterating over every item in the dictionary.
+        int NumSlots() const { return mTableSize; }
+        
+        // Gets the key and value in the given slot of the underlying hash
+        // table. Returns false if the slot is empty.
+        bool GetSlot(int slot, TKey * key, TValue * value) const
+        {
+            if (mTable[slot].state != SLOT_FULL) return false;
+            
+            *key = mTable[slot].key;
+            *value = mTable[slot].value;
+            return true;
+        }
+        
+        // Looks up the value associated with the given key. Returns false if
+        // the key was not found.
+        bool Find(const TKey & key, TValue * value) const
         {
-            int index = FindIndex(key);            
+            int index = FindIndex(key);
             
             if (index == -1) return false;
             
@@ -39,28 +59,34 @@ namespace Finch
             return true;
         }
         
-        // Inserts the given value at the given key.
+        // Inserts the given value at the given key, replacing the value that
+        // was there if the key is already present.
         void Insert(const TKey & key, const TValue & value)
         {
-            mCount++;
+            int index = FindIndex(key);
+            if (index != -1)
+            {
+                mTable[index].value = value;
+                return;
+            }
+            
             EnsureCapacity();
             
-            // figure out where to insert it in the table. use open addressing
-            // and basic linear probing
-            int index = static_cast<int>(key.HashCode() & 0x7fffffff) % mTableSize;
-
-            // note that we shouldn't have to worry about an infinite loop here
-            // the previous call will ensure there are open spaces in the table
-            //### bob: hack. using .Length() here assumes TKey is string
-            while ((mTable[index].key.Length() > 0) &&
-                   (mTable[index].key != key))
+            // the key isn't present, so it can go in the first slot that
+            // doesn't hold an item, including one an item was removed from.
+            // there's always at least one empty slot, so this stops.
+            index = static_cast<int>(key.HashCode() & 0x7fffffff) % mTableSize;
+            while (mTable[index].state == SLOT_FULL)
             {
                 index = (index + 1) % mTableSize;
             }
             
-            // insert it into the table
+            if (mTable[index].state == SLOT_DELETED) mNumDeleted--;
+            
             mTable[index].key   = key;
             mTable[index].value = value;
+            mTable[index].state = SLOT_FULL;
+            mCount++;
         }
         
         // Replaces the value at the given key. If the key is not already
@@ -88,26 +114,39 @@ namespace Finch
             // not found
             if (index == -1) return false;
             
-            // remove the item
+            // leave a tombstone so that probes for keys that collided with
+            // this one keep going past it
             mTable[index].key   = TKey();
             mTable[index].value = TValue();
+            mTable[index].state = SLOT_DELETED;
             
             mCount--;
+            mNumDeleted++;
             return true;
         }
         
         // Removes all items from the Dictionary.
         void Clear()
         {
+            if (mTable != NULL) delete [] mTable;
+            
+            mTable = NULL;
             mCount = 0;
+            mNumDeleted = 0;
             mTableSize = 0;
-            delete [] mTable;
         }
         
     private:
+        enum SlotState
+        {
+            SLOT_EMPTY,
+            SLOT_FULL,
+            SLOT_DELETED
+        };
+        
         // Gets the index of the item with the given key in the table, or -1
         // if not found.
-        int FindIndex(const TKey & key)
+        int FindIndex(const TKey & key) const
         {
             // can't find it in an empty table
             if (mTableSize == 0) return -1;
@@ -116,27 +155,34 @@ namespace Finch
             
             while (true)
             {
-                // stop if we found it
-                if (mTable[index].key == key) return index;
-                
                 // if we found an empty slot, the item must not be in the table
-                //### bob: hack. using .Length() here assumes TKey is string
-                if (mTable[index].key.Length() == 0) return -1;
+                if (mTable[index].state == SLOT_EMPTY) return -1;
+                
+                // stop if we found it
+                if ((mTable[index].state == SLOT_FULL) &&
+                    (mTable[index].key == key)) return index;
                 
                 // try the next slot
                 index = (index + 1) % mTableSize;
             }
         }
         
+        // Makes sure there's room to add one more item.
         void EnsureCapacity()
         {
-            // only resize if we're too full
-            if (mCount <= mTableSize * MAX_LOAD_PERCENT / 100) return;
-
-            // figure out the new table size
+            // tombstones fill up the table as much as items do since probes
+            // have to walk past them
+            int maxUsed = mTableSize * MAX_LOAD_PERCENT / 100;
+            if (mCount + mNumDeleted + 1 <= maxUsed) return;
+            
+            // if it's mostly tombstones, rebuilding it at the same size is
+            // enough to get rid of them
             int oldSize = mTableSize;
-            mTableSize = MIN_CAPACITY;
-            if (oldSize >= MIN_CAPACITY)
+            if (mTableSize < MIN_CAPACITY)
+            {
+                mTableSize = MIN_CAPACITY;
+            }
+            else if (mCount + 1 > maxUsed / 2)
             {
                 mTableSize = oldSize * GROW_FACTOR;
             }
@@ -144,14 +190,15 @@ namespace Finch
             // create the new hashtable
             Pair * oldTable = mTable;
             mTable = new Pair[mTableSize];
+            mCount = 0;
+            mNumDeleted = 0;
             
             // move the existing items over
             if (oldTable != NULL)
             {
                 for (int i = 0; i < oldSize; i++)
                 {
-                    //### bob: hack. using .Length() here assumes TKey is string
-                    if (oldTable[i].key.Length() > 0)
+                    if (oldTable[i].state == SLOT_FULL)
                     {
                         Insert(oldTable[i].key, oldTable[i].value);
                     }
@@ -161,8 +208,8 @@ namespace Finch
             }
         }
         
-        // What percentage of the table should be filled with values before
-        // it is resized.
+        // What percentage of the table should be used by items or tombstones
+        // before it is resized.
         static const int MAX_LOAD_PERCENT = 75;
         
         static const int MIN_CAPACITY = 16;
@@ -170,62 +217,100 @@ namespace Finch
 
         struct Pair
         {
-            TKey   key;
-            TValue value;
+            TKey      key;
+            TValue    value;
+            SlotState state;
+            
+            Pair() : state(SLOT_EMPTY) {}
         };
         
         Pair * mTable;
-        int    mCount;     // number of items stored in the table
-        int    mTableSize; // size of the table itself
+        int    mCount;      // number of items stored in the table
+        int    mNumDeleted; // number of slots holding tombstones
+        int    mTableSize;  // size of the table itself
         
         NO_COPY(Dictionary);
     };
 
-    // TODO(bob): Total hack. Copy and pasting Dictionary so that we can use
-    // int keys is lame!
-    // A dictionary mapping non-negative ints to values. Uses a
-    // dynamically-grown hashtable. TValue must have a default constructor as
-    // well as support copying.
+    // A dictionary mapping non-negative ints (usually StringIds) to values.
+    // TValue must have a default constructor as well as support copying.
+    //
+    // Uses a hashtable with open addressing and linear probing whose size is
+    // always a power of two, so slots are found with a mask instead of a
+    // division. Since ids are handed out in order, the ids themselves are
+    // used as the hash. Most tables only hold a few items, so a small table
+    // is stored right in the object and only moved to the heap when it
+    // outgrows that.
     template <class TValue>
     class IdTable
     {
     public:
         IdTable()
-        :   mTable(NULL),
+        :   mSlots(NULL),
+            mNumSlots(0),
             mCount(0),
-            mTableSize(0)
+            mNumDeleted(0)
         {}
         
         ~IdTable()
         {
-            if (mTable != NULL)
+            if (mSlots != NULL)
             {
-                delete [] mTable;
+                delete [] mSlots;
             }
         }
         
-        // Looks up the value associated with the given key. Returns a null
-        // reference if the key was not found.
-        bool Find(StringId key, TValue * value)
+        // Gets the number of items in the table.
+        int Count() const { return mCount; }
+        
+        // Gets the number of slots in the underlying hash table. Together with
+        // GetSlot(), this allows iterating over every value in the table.
+        int NumSlots() const { return mNumSlots; }
+        
+        // Gets the value in the given slot of the underlying hash table.
+        // Returns false if the slot is empty.
+        bool GetSlot(int slot, TValue * value) const
+        {
+            if (mSlots[slot].key < 0) return false;
+            
+            *value = mSlots[slot].value;
+            return true;
+        }
+        
+        // Gets the key and value in the given slot of the underlying hash
+        // table. Returns false if the slot is empty.
+        bool GetSlot(int slot, StringId * key, TValue * value) const
         {
-            int index = FindIndex(key);            
+            if (mSlots[slot].key < 0) return false;
+            
+            *key = mSlots[slot].key;
+            *value = mSlots[slot].value;
+            return true;
+        }
+        
+        // Looks up the value associated with the given key. Returns false if
+        // the key was not found.
+        bool Find(StringId key, TValue * value) const
+        {
+            int index = FindIndex(key);
             
             if (index == -1) return false;
             
-            *value = mTable[index].value;
+            *value = mSlots[index].value;
             return true;
         }
         
         // Does a reverse look-up to find a key with the given value. May be
         // slow. If there are multiple keys with the same value, chooses one
         // arbitrarily. Returns `-1` if not found.
-        StringId FindKeyForValue(const TValue & value)
+        StringId FindKeyForValue(const TValue & value) const
         {
-            for (int i = 0; i < mTableSize; i++)
+            for (int i = 0; i < mNumSlots; i++)
             {
-                if (mTable[i].value == value)
+                // Empty slots may hold any value.
+                if ((mSlots[i].key >= 0) && (mSlots[i].value == value))
                 {
-                    return mTable[i].key;
+                    return mSlots[i].key;
                 }
             }
             
@@ -233,27 +318,21 @@ namespace Finch
             return NO_STRING;
         }
         
-        // Inserts the given value at the given key.
+        // Inserts the given value at the given key, replacing the value that
+        // was there if the key is already present.
         void Insert(StringId key, const TValue & value)
         {
-            mCount++;
-            EnsureCapacity();
-            
-            // figure out where to insert it in the table. use open addressing
-            // and basic linear probing
-            int index = static_cast<int>(key & 0x7fffffff) % mTableSize;
+            ASSERT(key >= 0, "IdTable keys cannot be negative.");
             
-            // note that we shouldn't have to worry about an infinite loop here
-            // the previous call will ensure there are open spaces in the table
-            while ((mTable[index].key != NO_STRING) &&
-                   (mTable[index].key != key))
+            int index = FindIndex(key);
+            if (index != -1)
             {
-                index = (index + 1) % mTableSize;
+                mSlots[index].value = value;
+                return;
             }
             
-            // insert it into the table
-            mTable[index].key   = key;
-            mTable[index].value = value;
+            EnsureCapacity();
+            Add(key, value);
         }
         
         // Replaces the value at the given key. If the key is not already
@@ -267,7 +346,7 @@ namespace Finch
             if (index == -1) return false;
             
             // replace the value
-            mTable[index].value = value;
+            mSlots[index].value = value;
             
             return true;
         }
@@ -281,95 +360,133 @@ namespace Finch
             // not found
             if (index == -1) return false;
             
-            // remove the item
-            mTable[index].key   = NO_STRING;
-            mTable[index].value = TValue();
+            // leave a tombstone so that probes for keys that collided with
+            // this one keep going past it
+            mSlots[index].key   = DELETED;
+            mSlots[index].value = TValue();
             
             mCount--;
+            mNumDeleted++;
             return true;
         }
         
-        // Removes all items from the Dictionary.
+        // Removes all items from the table.
         void Clear()
         {
+            delete [] mSlots;
+            
+            mSlots = NULL;
+            mNumSlots = 0;
             mCount = 0;
-            mTableSize = 0;
-            delete [] mTable;
+            mNumDeleted = 0;
         }
         
     private:
+        // Marks a slot whose item was removed. Ids are never negative, so
+        // this can't collide with one.
+        static const StringId DELETED = -2;
+        
+        struct Pair
+        {
+            StringId    key;
+            TValue      value;
+            
+            Pair() : key(NO_STRING), value() {}
+        };
+        
         // Gets the index of the item with the given key in the table, or -1
         // if not found.
-        int FindIndex(StringId key)
+        int FindIndex(StringId key) const
         {
             // can't find it in an empty table
-            if (mTableSize == 0) return -1;
+            if (mNumSlots == 0) return -1;
             
-            int index = static_cast<int>(key & 0x7fffffff) % mTableSize;
+            int mask = mNumSlots - 1;
+            int index = key & mask;
             
             while (true)
             {
                 // stop if we found it
-                if (mTable[index].key == key) return index;
+                if (mSlots[index].key == key) return index;
                 
-                // if we found an empty slot, the item must not be in the table
-                if (mTable[index].key == NO_STRING) return -1;
+                // if we found an empty slot, the item must not be in the
+                // table. tombstones don't stop the probe.
+                if (mSlots[index].key == NO_STRING) return -1;
                 
                 // try the next slot
-                index = (index + 1) % mTableSize;
+                index = (index + 1) & mask;
             }
         }
         
-        void EnsureCapacity()
+        // Adds an item whose key isn't in the table yet. There must be room
+        // for it.
+        void Add(StringId key, const TValue & value)
         {
-            // only resize if we're too full
-            if (mCount <= mTableSize * MAX_LOAD_PERCENT / 100) return;
+            int mask = mNumSlots - 1;
+            int index = key & mask;
             
-            // figure out the new table size
-            int oldSize = mTableSize;
-            mTableSize = MIN_CAPACITY;
-            if (oldSize >= MIN_CAPACITY)
+            // it can go in any slot without an item, including a tombstone.
+            // there's always at least one empty slot, so this stops.
+            while (mSlots[index].key >= 0)
             {
-                mTableSize = oldSize * GROW_FACTOR;
+                index = (index + 1) & mask;
             }
             
-            // create the new hashtable
-            Pair * oldTable = mTable;
-            mTable = new Pair[mTableSize];
+            if (mSlots[index].key == DELETED) mNumDeleted--;
+            
+            mSlots[index].key   = key;
+            mSlots[index].value = value;
+            mCount++;
+        }
+        
+        // Makes sure there's room to add one more item.
+        void EnsureCapacity()
+        {
+            // tombstones fill up the table as much as items do since probes
+            // have to walk past them
+            int maxUsed = mNumSlots * MAX_LOAD_PERCENT / 100;
+            if (mCount + mNumDeleted + 1 <= maxUsed) return;
+            
+            // if it's mostly tombstones, rebuilding it at the same size is
+            // enough to get rid of them
+            int size = mNumSlots;
+            if (mCount + 1 > maxUsed / 2)
+            {
+                size = (size < MIN_CAPACITY) ? MIN_CAPACITY : size * GROW_FACTOR;
+            }
             
             // move the existing items over
-            if (oldTable != NULL)
+            Pair * oldSlots = mSlots;
+            int oldSize = mNumSlots;
+            
+            mSlots = new Pair[size];
+            mNumSlots = size;
+            mCount = 0;
+            mNumDeleted = 0;
+            
+            for (int i = 0; i < oldSize; i++)
             {
-                for (int i = 0; i < oldSize; i++)
+                if (oldSlots[i].key >= 0)
                 {
-                    if (oldTable[i].key != NO_STRING)
-                    {
-                        Insert(oldTable[i].key, oldTable[i].value);
-                    }
+                    Add(oldSlots[i].key, oldSlots[i].value);
                 }
-                
-                delete [] oldTable;
             }
+            
+            delete [] oldSlots;
         }
         
-        // What percentage of the table should be filled with values before
-        // it is resized.
+        // What percentage of the table should be used by items or tombstones
+        // before it is resized.
         static const int MAX_LOAD_PERCENT = 75;
         
+        // Table sizes must be powers of two.
         static const int MIN_CAPACITY = 16;
         static const int GROW_FACTOR  = 2;
         
-        struct Pair
-        {
-            StringId    key;
-            TValue      value;
-            
-            Pair() : key(NO_STRING) {}
-        };
-        
-        Pair * mTable;
-        int    mCount;     // number of items stored in the table
-        int    mTableSize; // size of the table itself
+        Pair * mSlots;
+        int    mNumSlots;   // size of the table itself
+        int    mCount;      // number of items stored in the table
+        int    mNumDeleted; // number of slots holding tombstones
         
         NO_COPY(IdTable);
     };
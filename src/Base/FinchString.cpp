@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <cstring>
+#include <new>
 
 #include "Macros.h"
 #include "FinchString.h"
@@ -9,13 +10,165 @@ namespace Finch
 {
     const char * String::sEmptyString = "";
     
-    String::StringData::StringData(const char * text)
-    :   chars(text)
+    String::StringData * String::StringData::Create(const char * text, int length)
     {
-        length = strlen(text);
-        hashCode = Fnv1Hash(text);
+        StringData * data = Allocate(length);
+        memcpy(data->inlineChars, text, length);
+        return data;
+    }
+
+    String::StringData * String::StringData::Allocate(int length)
+    {
+        // inlineChars already has room for the terminator
+        void * memory = ::operator new(sizeof(StringData) + length);
+        StringData * data = new (memory) StringData(length, 0);
+        data->inlineChars[length] = '\0';
+        data->chars = data->inlineChars;
+        return data;
+    }
+
+    String::StringData * String::StringData::Concat(
+        const Handle<StringData> & left, const Handle<StringData> & right)
+    {
+        int depth = left->depth;
+        if (right->depth > depth) depth = right->depth;
+
+        StringData * data = new (::operator new(sizeof(StringData)))
+            StringData(left->length + right->length, depth + 1);
+        data->left = left;
+        data->right = right;
+        return data;
+    }
+
+    // The shortest a rope of each depth can be and still be balanced, and
+    // the shortest piece that goes in each slot of the rebalancing forest.
+    // These are the Fibonacci numbers, starting from 1, 2.
+    static const int sMinBalancedLength[] =
+    {
+        1, 2, 3, 5, 8, 13, 21, 34, 55, 89, 144, 233, 377, 610, 987, 1597,
+        2584, 4181, 6765, 10946, 17711, 28657, 46368, 75025, 121393, 196418,
+        317811, 514229, 832040, 1346269, 2178309, 3524578, 5702887, 9227465,
+        14930352, 24157817, 39088169, 63245986, 102334155, 165580141,
+        267914296, 433494437, 701408733, 1134903170, 1836311903
+    };
+
+    Handle<String::StringData> String::StringData::Rebalance(
+        const Handle<StringData> & rope)
+    {
+        // This is the algorithm from "Ropes: an Alternative to Strings" by
+        // Boehm, Atkinson and Plass. Slot i of the forest holds a balanced
+        // piece at least sMinBalancedLength[i] long, and every piece in it
+        // comes before the pieces in the slots below it.
+        Handle<StringData> forest[RopeForestSize];
+        AddToForest(rope, forest);
+
+        Handle<StringData> result;
+        for (int i = 0; i < RopeForestSize; i++)
+        {
+            result = Join(forest[i], result);
+        }
+
+        return result;
     }
     
+    String::StringData::StringData(int length, int depth)
+    :   length(length),
+        depth(depth),
+        chars(NULL),
+        hasHash(false),
+        hashCode(0)
+    {}
+
+    String::StringData::~StringData()
+    {
+        if ((chars != NULL) && (chars != inlineChars)) delete [] chars;
+    }
+
+    void String::StringData::Flatten() const
+    {
+        char * buffer = new char[length + 1];
+        CopyTo(buffer);
+        buffer[length] = '\0';
+
+        chars = buffer;
+        depth = 0;
+        left.Clear();
+        right.Clear();
+    }
+
+    void String::StringData::CopyTo(char * dest) const
+    {
+        if (chars != NULL)
+        {
+            memcpy(dest, chars, length);
+        }
+        else
+        {
+            left->CopyTo(dest);
+            right->CopyTo(dest + left->length);
+        }
+    }
+
+    bool String::StringData::IsBalanced() const
+    {
+        return (depth < RopeForestSize) &&
+               (length >= sMinBalancedLength[depth]);
+    }
+
+    void String::StringData::AddToForest(const Handle<StringData> & rope,
+                                         Handle<StringData> * forest)
+    {
+        if (rope->IsBalanced())
+        {
+            AddBalancedToForest(rope, forest);
+        }
+        else
+        {
+            AddToForest(rope->left, forest);
+            AddToForest(rope->right, forest);
+        }
+    }
+
+    void String::StringData::AddBalancedToForest(
+        const Handle<StringData> & piece, Handle<StringData> * forest)
+    {
+        // gather up the pieces too short to go in the piece's slot
+        Handle<StringData> shorter;
+        int i = 0;
+        while ((i < RopeForestSize - 1) &&
+               (piece->length >= sMinBalancedLength[i + 1]))
+        {
+            shorter = Join(forest[i], shorter);
+            forest[i].Clear();
+            i++;
+        }
+
+        // then keep concatenating until it finds a slot it fits in
+        Handle<StringData> inserted = Join(shorter, piece);
+        while (true)
+        {
+            inserted = Join(forest[i], inserted);
+            forest[i].Clear();
+
+            if ((i == RopeForestSize - 1) ||
+                (inserted->length < sMinBalancedLength[i + 1]))
+            {
+                forest[i] = inserted;
+                return;
+            }
+
+            i++;
+        }
+    }
+
+    Handle<String::StringData> String::StringData::Join(
+        const Handle<StringData> & left, const Handle<StringData> & right)
+    {
+        if (left.IsNull()) return right;
+        if (right.IsNull()) return left;
+        return Handle<StringData>(Concat(left, right));
+    }
+
     String String::Format(const char* format, ...)
     {
         char result[FormattedStringMax];
@@ -31,18 +184,12 @@ namespace Finch
     }
     
     String::String(const char* chars)
-    {
-        Init(chars, false);
-    }
+    :   mData(StringData::Create(chars, strlen(chars)))
+    {}
     
     String::String(char c)
-    {
-        char chars[2];
-        chars[0] = c;
-        chars[1] = '\0';
-        
-        Init(chars, false);
-    }
+    :   mData(StringData::Create(&c, 1))
+    {}
     
     bool String::operator <(const String & other) const
     {
@@ -85,7 +232,7 @@ namespace Finch
         ASSERT_RANGE(index, Length() + 1); // allow accessing the terminator
 
         if (mData.IsNull()) return sEmptyString[0];
-        return mData->chars[index];
+        return mData->Chars()[index];
     }
     
     String String::operator +(const String & other) const
@@ -114,7 +261,7 @@ namespace Finch
     {
         if (mData.IsNull()) return sEmptyString;
         
-        return mData->chars;
+        return mData->Chars();
     }
 
     int String::Length() const
@@ -131,10 +278,11 @@ namespace Finch
         // Keep the start index in bounds.
         if (startIndex >= Length()) startIndex = Length() - 1;
         
-        const char* found = strstr(mData->chars + startIndex, other.CString());
+        const char* chars = mData->Chars();
+        const char* found = strstr(chars + startIndex, other.CString());
         if (found == NULL) return -1;
         
-        return static_cast<int>(found - mData->chars);
+        return static_cast<int>(found - chars);
     }
 
     String String::Replace(const String & from, const String & to) const
@@ -165,7 +313,7 @@ namespace Finch
     {
         if (mData.IsNull()) return EmptyStringHash;
 
-        return mData->hashCode;
+        return mData->Hash();
     }
 
     int String::CompareTo(const String & other) const
@@ -184,10 +332,9 @@ namespace Finch
         ASSERT_RANGE(startIndex, Length());
         
         int length = Length() - startIndex;
-        char* heap = new char[length + 1];
-        strcpy(heap, CString() + startIndex);
+        if (length == 0) return String();
         
-        return String(heap, true);
+        return String(StringData::Create(CString() + startIndex, length));
     }
     
     String String::Substring(int startIndex, int count) const
@@ -206,47 +353,47 @@ namespace Finch
         ASSERT_RANGE(startIndex, Length());
         ASSERT(startIndex + count <= Length(), "Range must not go past end of string.");
         
-        char* heap = new char[count + 1];
-        strncpy(heap, CString() + startIndex, count);
-        heap[count] = '\0';
+        if (count == 0) return String();
         
-        return String(heap, true);
+        return String(StringData::Create(CString() + startIndex, count));
     }
 
     String::String(const String & left, const String & right)
     {
-        // make a new buffer on the heap
-        int length = left.Length() + right.Length();
-        char* heap = new char[length + 1];
-        
-        // concatenate the strings
-        strcpy(heap, left.CString());
-        strcpy(&heap[left.Length()], right.CString());
-        
-        Init(heap, true);
-    }
-    
-    String::String(const char * text, bool isOnHeap)
-    {
-        Init(text, isOnHeap);
-    }
-        
-    void String::Init(const char * text, bool isOnHeap)
-    {
-        if (isOnHeap)
+        if (left.mData.IsNull())
+        {
+            mData = right.mData;
+        }
+        else if (right.mData.IsNull())
         {
-            mData = Ref<StringData>(new StringData(text));
+            mData = left.mData;
+        }
+        else if (left.Length() + right.Length() >= MinRopeLength)
+        {
+            mData = Handle<StringData>(StringData::Concat(left.mData,
+                                                          right.mData));
+            
+            if (mData->depth > MaxRopeDepth)
+            {
+                mData = StringData::Rebalance(mData);
+            }
         }
         else
         {
-            // hoist it onto the heap
-            int length = strlen(text);
-            char * heap = new char[length + 1];
-            strcpy(heap, text);
+            // copy both sides into a new leaf
+            int length = left.Length() + right.Length();
+            StringData * data = StringData::Allocate(length);
+            memcpy(data->inlineChars, left.CString(), left.Length());
+            memcpy(data->inlineChars + left.Length(), right.CString(),
+                   right.Length());
             
-            mData = Ref<StringData>(new StringData(heap));
+            mData = Handle<StringData>(data);
         }
     }
+    
+    String::String(StringData * data)
+    :   mData(data)
+    {}
 
     unsigned int String::Fnv1Hash(const char * text)
     {
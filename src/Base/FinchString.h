@@ -2,15 +2,19 @@
 
 #include <iostream>
 
-#include "Ref.h"
+#include "Handle.h"
 
 namespace Finch
 {
     using std::ostream;
     
-    // Reference-counted heap-allocated immutable string class.
+    // Reference-counted heap-allocated immutable string class. Concatenation
+    // is lazy for long strings, so building one up a piece at a time with +
+    // doesn't copy it each time.
     class String
     {
+        friend class StringTests;
+        
     public:
         // Creates a new string using the given C-style format string and a
         // number of arguments to be formatted.
@@ -22,10 +26,6 @@ namespace Finch
 
         explicit String(char c);
 
-        String(const String & other)
-        :   mData(other.mData)
-        {}
-        
         // Comparison operators.
         bool         operator < (const String & other) const;
         bool         operator <=(const String & other) const;
@@ -68,20 +68,120 @@ namespace Finch
         static unsigned int Fnv1Hash(const char * text);
         
     private:
-        struct StringData
+        // The characters of a string. A leaf holds its characters inline,
+        // right after the struct in the same allocation. Concatenating long
+        // strings instead makes a rope node that refers to both halves and
+        // only copies them into a buffer of its own the first time its
+        // characters are needed.
+        struct StringData : public RefCounted
         {
-            StringData(const char * text);
-            
-            int          length;
-            const char * chars;
-            int          hashCode;
+            // Creates a leaf holding a copy of the given characters.
+            static StringData * Create(const char * text, int length);
+
+            // Creates a leaf with room for the given number of characters
+            // and fills in the terminator. The caller fills in the rest.
+            static StringData * Allocate(int length);
+
+            // Creates a rope node for the concatenation of two strings.
+            static StringData * Concat(const Handle<StringData> & left,
+                                       const Handle<StringData> & right);
+
+            // Creates a balanced rope with the same characters as the given
+            // one, without copying any of them.
+            static Handle<StringData> Rebalance(
+                const Handle<StringData> & rope);
+
+            ~StringData();
+
+            // Gets the characters, flattening the rope if needed.
+            const char * Chars() const
+            {
+                if (chars == NULL) Flatten();
+                return chars;
+            }
+
+            unsigned int Hash() const
+            {
+                if (!hasHash)
+                {
+                    hashCode = Fnv1Hash(Chars());
+                    hasHash = true;
+                }
+
+                return hashCode;
+            }
+
+            // Nodes are allocated with room for their characters, so they
+            // can't come from a plain new.
+            static void operator delete(void * data) { ::operator delete(data); }
+
+            int                          length;
+
+            // How many rope nodes deep this is. Zero for leaves and ropes
+            // that have been flattened.
+            mutable int                  depth;
+
+            // NULL for a rope until it has been flattened.
+            mutable const char *         chars;
+
+            mutable bool                 hasHash;
+            mutable unsigned int         hashCode;
+
+            // The two halves of an unflattened rope. Cleared once it has
+            // been flattened.
+            mutable Handle<StringData>   left;
+            mutable Handle<StringData>   right;
+
+            // A leaf's characters continue past the end of the struct.
+            char                         inlineChars[1];
+
+        private:
+            StringData(int length, int depth);
+
+            // Copies the characters into a buffer of the node's own and lets
+            // go of the halves.
+            void Flatten() const;
+
+            // Writes the characters to dest without flattening this node.
+            void CopyTo(char * dest) const;
+
+            // Whether the node is at least as long as a Fibonacci tree of
+            // its depth. Rebalance() leaves these as they are.
+            bool IsBalanced() const;
+
+            // Adds the pieces of a rope to the forest built by Rebalance(),
+            // walking down to its balanced subtrees.
+            static void AddToForest(const Handle<StringData> & rope,
+                                    Handle<StringData> * forest);
+
+            // Adds a balanced piece to the forest, concatenating it with the
+            // shorter pieces before it.
+            static void AddBalancedToForest(const Handle<StringData> & piece,
+                                            Handle<StringData> * forest);
+
+            // Concatenates two pieces of the forest, either of which may be
+            // missing.
+            static Handle<StringData> Join(const Handle<StringData> & left,
+                                           const Handle<StringData> & right);
         };
-        
+
+        // Concatenations shorter than this are copied right away. Ropes only
+        // pay for themselves on long strings.
+        static const int MinRopeLength = 64;
+
+        // Ropes are rebalanced once they get this deep, which bounds the
+        // recursion needed to flatten or free one. Rebalancing reuses the
+        // balanced parts, so building a string one piece at a time only
+        // revisits the pieces added since the last time.
+        static const int MaxRopeDepth = 256;
+
+        // The number of slots in the forest used to rebalance a rope: one
+        // for each Fibonacci number up to the longest possible string.
+        static const int RopeForestSize = 45;
+
         String(const String & left, const String & right);
-        String(const char * text, bool isOnHeap);
-        
-        void Init(const char * text, bool isOnHeap);
-        
+        explicit String(StringData * data);
+
         static const int FormattedStringMax = 512;
         
         // The hash code of a zero-character string. This constant comes from
@@ -90,7 +190,7 @@ namespace Finch
         
         static const char * sEmptyString;
         
-        Ref<StringData> mData;
+        Handle<StringData> mData;
     };
     
     bool operator ==(const char * left, const String & right);
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <iostream>
+
+#include "Macros.h"
+
+namespace Finch
+{
+    template <class T> class Handle;
+
+    // Base class for objects that are owned by Handle<T>s. The count lives in
+    // the object itself, so a Handle is a single pointer and copying one only
+    // touches the object it refers to.
+    class RefCounted
+    {
+    public:
+        RefCounted()
+        :   mRefCount(0)
+        {}
+
+        // A copy of an object starts out with no references to it.
+        RefCounted(const RefCounted & other)
+        :   mRefCount(0)
+        {}
+
+        RefCounted & operator =(const RefCounted & other) { return *this; }
+
+    private:
+        template <class T> friend class Handle;
+
+        mutable int mRefCount;
+    };
+
+    // Intrusive reference-counted smart pointer. T must derive from
+    // RefCounted. Unlike Ref<T>, which links every copy into a ring, this is
+    // the size of a raw pointer and copying or destroying one only changes
+    // the count in the referred object.
+    template <class T>
+    class Handle
+    {
+    public:
+        // Constructs a new null pointer.
+        Handle()
+        :   mObj(NULL)
+        {}
+
+        // Takes ownership of the given raw pointer. As with Ref<T>, wrap the
+        // pointer as soon as it's allocated and only use it through Handles
+        // from then on.
+        explicit Handle(T * obj)
+        :   mObj(obj)
+        {
+            Retain();
+        }
+
+        Handle(const Handle<T> & other)
+        :   mObj(other.mObj)
+        {
+            Retain();
+        }
+
+#if __cplusplus >= 201103L
+        // Moving a handle takes its reference without touching the count.
+        Handle(Handle<T> && other)
+        :   mObj(other.mObj)
+        {
+            other.mObj = NULL;
+        }
+
+        Handle<T> & operator =(Handle<T> && other)
+        {
+            if (&other != this)
+            {
+                Release();
+                mObj = other.mObj;
+                other.mObj = NULL;
+            }
+
+            return *this;
+        }
+#endif
+
+        ~Handle() { Release(); }
+
+        T & operator *() const { return *mObj; }
+        T * operator ->() const { return mObj; }
+
+        // Handles are equal if they refer to the same object.
+        bool operator ==(const Handle<T> & other) const
+        {
+            return mObj == other.mObj;
+        }
+
+        bool operator !=(const Handle<T> & other) const
+        {
+            return mObj != other.mObj;
+        }
+
+        Handle<T> & operator =(const Handle<T> & other)
+        {
+            // Take the new reference before dropping the old one, in case
+            // the old object is what holds the other handle.
+            T * obj = other.mObj;
+            if (obj != NULL) obj->mRefCount++;
+
+            Release();
+            mObj = obj;
+            return *this;
+        }
+
+        // Gets whether or not this handle is pointing to null.
+        bool IsNull() const { return mObj == NULL; }
+
+        // Clears the handle. If this was the last reference to the referred
+        // object, it will be deallocated.
+        void Clear()
+        {
+            Release();
+            mObj = NULL;
+        }
+
+    private:
+        void Retain()
+        {
+            if (mObj != NULL) mObj->mRefCount++;
+        }
+
+        void Release()
+        {
+            if ((mObj != NULL) && (--mObj->mRefCount == 0)) Destroy(mObj);
+        }
+
+        // Freeing the object is the rare case, so it's kept out of line. That
+        // also keeps the compiler from seeing a delete inlined next to other
+        // handles' counts, which it can't tell are for different owners.
+        NO_INLINE static void Destroy(T * obj) { delete obj; }
+
+        T * mObj;
+    };
+
+    template <class T>
+    std::ostream& operator<<(std::ostream& cout, const Handle<T> & handle)
+    {
+        if (handle.IsNull())
+        {
+            cout << "(nullref)";
+        }
+        else
+        {
+            cout << *handle;
+        }
+
+        return cout;
+    }
+}
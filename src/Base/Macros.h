@@ -47,6 +47,14 @@ typedef int StringId;
 
 #define NO_STRING (-1)
 
+// Keeps the compiler from inlining a function, for cold paths that shouldn't
+// bloat the hot code around their call sites.
+#ifdef __GNUC__
+#define NO_INLINE __attribute__((noinline))
+#else
+#define NO_INLINE
+#endif
+
 // Use this inside a class declaration to prevent the compiler from creating
 // the default copy constructor and assignment operators for the class. Note
 // that starts a private section, so you should either use this at the end of
@@ -2,25 +2,72 @@
 
 namespace Finch
 {
+    StringTable::StringTable()
+    :   mStrings(),
+        mSlots(MIN_SLOTS, NO_STRING)
+    {
+    }
+    
     StringId StringTable::Add(const String & string)
     {
         // See if the string is already in the table. We must ensure each string
         // only appears once in the table so that we can reliably compare
         // strings just by index.
-        // TODO(bob): This is O(n). Optimize using a hashtable.
-        for (int i = 0; i < mStrings.Count(); i++)
-        {
-            if (mStrings[i] == string) return i;
-        }
+        int slot = FindSlot(string);
+        if (mSlots[slot] != NO_STRING) return mSlots[slot];
 
         // Not in the table, so add it.
         mStrings.Add(string);
-        return mStrings.Count() - 1;
+        StringId id = mStrings.Count() - 1;
+        mSlots[slot] = id;
+        
+        if (mStrings.Count() > mSlots.Count() * MAX_LOAD_PERCENT / 100)
+        {
+            Grow();
+        }
+        
+        return id;
     }
     
     String StringTable::Find(StringId id)
     {
         return mStrings[id];
     }
+    
+    int StringTable::FindSlot(const String & string) const
+    {
+        // The table size is a power of two, so masking is the same as modulo.
+        int mask = mSlots.Count() - 1;
+        int slot = static_cast<int>(string.HashCode()) & mask;
+        
+        // Linear probe until we find the string or an empty slot. The load
+        // factor ensures there is always an empty slot.
+        while (true)
+        {
+            StringId id = mSlots[slot];
+            if (id == NO_STRING) return slot;
+            
+            // String equality compares the cached hash codes first, so this
+            // only does a full comparison on a real match.
+            if (mStrings[id] == string) return slot;
+            
+            slot = (slot + 1) & mask;
+        }
+    }
+    
+    void StringTable::Grow()
+    {
+        mSlots = Array<StringId>(mSlots.Count() * 2, NO_STRING);
+        
+        // Rehash. We don't need to compare strings here since they are all
+        // known to be distinct.
+        int mask = mSlots.Count() - 1;
+        for (StringId id = 0; id < mStrings.Count(); id++)
+        {
+            int slot = static_cast<int>(mStrings[id].HashCode()) & mask;
+            while (mSlots[slot] != NO_STRING) slot = (slot + 1) & mask;
+            mSlots[slot] = id;
+        }
+    }
 }
 
@@ -11,6 +11,8 @@ namespace Finch
     class StringTable
     {
     public:
+        StringTable();
+        
         // Adds the given string to the table if not already present, and
         // returns its ID.
         StringId Add(const String & string);
@@ -18,8 +20,30 @@ namespace Finch
         // Looks up the string with the given ID in the table.
         String Find(StringId id);
         
+        // Gets the number of strings in the table.
+        int Count() const { return mStrings.Count(); }
+        
     private:
+        // Gets the index in mSlots where the given string is, or where it
+        // should be inserted if it isn't in the table yet.
+        int FindSlot(const String & string) const;
+        
+        // Doubles the size of the hash index and rehashes every string.
+        void Grow();
+        
+        // What percentage of the hash index should be filled before it is
+        // resized.
+        static const int MAX_LOAD_PERCENT = 75;
+        
+        static const int MIN_SLOTS = 64;
+        
+        // The interned strings, indexed by ID.
         Array<String> mStrings;
+        
+        // Open-addressed hash index into mStrings, keyed by the strings'
+        // cached hash codes. Each slot contains a StringId, or NO_STRING if
+        // empty. The size is always a power of two.
+        Array<StringId> mSlots;
     };
 }
 
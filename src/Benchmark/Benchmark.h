@@ -0,0 +1,36 @@
+#pragma once
+
+#include <ctime>
+#include <iostream>
+
+namespace Finch
+{
+    using std::cout;
+    using std::endl;
+
+    // Base class for the microbenchmarks. These time small pieces of the
+    // implementation on their own and print the results. They depend on the
+    // machine, so they're kept out of the unit tests.
+    class Benchmark
+    {
+    protected:
+        // How many times each measurement is taken. The fastest run is the
+        // one reported, since the slower ones are the machine doing
+        // something else.
+        static const int NumRuns = 5;
+
+        // Returns the value in a way the compiler can't see through, so that
+        // work depending on it can't be moved out of a timing loop.
+        static int Opaque(int value)
+        {
+            static volatile int zero = 0;
+            return value + zero;
+        }
+
+        // Gets the number of seconds since the given clock() time.
+        static double SecondsSince(clock_t start)
+        {
+            return static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+        }
+    };
+}
@@ -0,0 +1,16 @@
+#include <iostream>
+
+#include "HandleBenchmark.h"
+#include "IdTableBenchmark.h"
+
+// Runs the microbenchmarks. Build the Release configuration to get
+// meaningful numbers.
+int main (int argc, char * const argv[])
+{
+    using namespace Finch;
+
+    HandleBenchmark::Run();
+    IdTableBenchmark::Run();
+
+    return 0;
+}
@@ -0,0 +1,59 @@
+#include "HandleBenchmark.h"
+#include "Handle.h"
+#include "Ref.h"
+
+namespace Finch
+{
+    // Something for the pointers to point at.
+    class Pointee : public RefCounted
+    {
+    };
+
+    void HandleBenchmark::Run()
+    {
+        BenchmarkCopies();
+    }
+
+    template <class Pointer>
+    double HandleBenchmark::TimeCopies(const Pointer & source,
+                                       Pointer * copies, int numCopies,
+                                       int rounds)
+    {
+        double best = 0;
+        for (int run = 0; run < NumRuns; run++)
+        {
+            clock_t start = clock();
+
+            for (int round = 0; round < rounds; round++)
+            {
+                for (int i = 0; i < numCopies; i++) copies[i] = source;
+                for (int i = 0; i < numCopies; i++) copies[i] = Pointer();
+            }
+
+            double time = SecondsSince(start);
+            if ((run == 0) || (time < best)) best = time;
+        }
+
+        return best;
+    }
+
+    void HandleBenchmark::BenchmarkCopies()
+    {
+        const int numCopies = 1000;
+        const int rounds = 1000;
+
+        Ref<Pointee> ref(new Pointee());
+        Ref<Pointee> * refs = new Ref<Pointee>[numCopies];
+        double refTime = TimeCopies(ref, refs, numCopies, rounds);
+        delete [] refs;
+
+        Handle<Pointee> handle(new Pointee());
+        Handle<Pointee> * handles = new Handle<Pointee>[numCopies];
+        double handleTime = TimeCopies(handle, handles, numCopies, rounds);
+        delete [] handles;
+
+        double perCopy = 1000000000.0 / (numCopies * rounds);
+        cout << "Copying and destroying a Ref: " << refTime * perCopy
+             << "ns, a Handle: " << handleTime * perCopy << "ns" << endl;
+    }
+}
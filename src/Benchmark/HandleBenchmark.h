@@ -0,0 +1,23 @@
+#pragma once
+
+#include "Benchmark.h"
+
+namespace Finch
+{
+    class HandleBenchmark : public Benchmark
+    {
+    public:
+        static void Run();
+
+    private:
+        // Times copying and destroying Ref<T>s against Handle<T>s.
+        static void BenchmarkCopies();
+
+        // Copies source into every element of copies and then clears them
+        // again, a number of times, and returns how long the fastest run
+        // took.
+        template <class Pointer>
+        static double TimeCopies(const Pointer & source, Pointer * copies,
+                                 int numCopies, int rounds);
+    };
+}
@@ -0,0 +1,182 @@
+#include "IdTableBenchmark.h"
+#include "Dictionary.h"
+
+namespace Finch
+{
+    void IdTableBenchmark::Run()
+    {
+        BenchmarkLookups();
+    }
+
+    // The lookup and insertion parts of the IdTable from before tombstones
+    // were added, kept to compare against.
+    class BaselineIdTable
+    {
+    public:
+        BaselineIdTable()
+        :   mTable(NULL),
+            mCount(0),
+            mTableSize(0)
+        {}
+
+        ~BaselineIdTable()
+        {
+            delete [] mTable;
+        }
+
+        bool Find(StringId key, int * value) const
+        {
+            if (mTableSize == 0) return false;
+
+            int index = static_cast<int>(key & 0x7fffffff) % mTableSize;
+            while (true)
+            {
+                if (mTable[index].key == key)
+                {
+                    *value = mTable[index].value;
+                    return true;
+                }
+
+                if (mTable[index].key == NO_STRING) return false;
+
+                index = (index + 1) % mTableSize;
+            }
+        }
+
+        void Insert(StringId key, int value)
+        {
+            mCount++;
+            EnsureCapacity();
+
+            int index = static_cast<int>(key & 0x7fffffff) % mTableSize;
+            while ((mTable[index].key != NO_STRING) &&
+                   (mTable[index].key != key))
+            {
+                index = (index + 1) % mTableSize;
+            }
+
+            mTable[index].key   = key;
+            mTable[index].value = value;
+        }
+
+    private:
+        struct Pair
+        {
+            StringId key;
+            int      value;
+
+            Pair() : key(NO_STRING), value(0) {}
+        };
+
+        void EnsureCapacity()
+        {
+            if (mCount <= mTableSize * 75 / 100) return;
+
+            int oldSize = mTableSize;
+            mTableSize = (oldSize >= 16) ? oldSize * 2 : 16;
+
+            Pair * oldTable = mTable;
+            mTable = new Pair[mTableSize];
+
+            for (int i = 0; i < oldSize; i++)
+            {
+                if (oldTable[i].key != NO_STRING)
+                {
+                    Insert(oldTable[i].key, oldTable[i].value);
+                }
+            }
+
+            delete [] oldTable;
+        }
+
+        Pair * mTable;
+        int    mCount;
+        int    mTableSize;
+
+        NO_COPY(BaselineIdTable);
+    };
+
+    template <class Table>
+    double IdTableBenchmark::TimeLookups(const Table & table, int first,
+                                         int step, int numIds, int rounds,
+                                         int * found)
+    {
+        double best = 0;
+        for (int run = 0; run < NumRuns; run++)
+        {
+            clock_t start = clock();
+
+            // sum into a local so the compiler doesn't have to assume
+            // writing to found changes the table
+            int value;
+            int sum = 0;
+            for (int round = 0; round < rounds; round++)
+            {
+                // every round finds the same things, so the compiler would
+                // otherwise do the lookups once and reuse them
+                for (int i = Opaque(first); i < numIds; i += step)
+                {
+                    if (table.Find(i, &value)) sum += value;
+                }
+            }
+
+            *found += sum;
+
+            double time = SecondsSince(start);
+            if ((run == 0) || (time < best)) best = time;
+        }
+
+        return best;
+    }
+
+    void IdTableBenchmark::BenchmarkLookups()
+    {
+        const int numIds = 64;
+        const int rounds = 200000;
+
+        IdTable<int> table;
+        BaselineIdTable baseline;
+
+        // only the even ids are in the tables. the odd ones were added to
+        // IdTable and removed again, like methods that were undefined.
+        for (int i = 0; i < numIds; i++)
+        {
+            table.Insert(i, 1);
+            if (i % 2 == 0)
+            {
+                baseline.Insert(i, 1);
+            }
+            else
+            {
+                table.Remove(i);
+            }
+        }
+
+        int found = 0;
+        double tableHits = TimeLookups(table, 0, 2, numIds, rounds, &found);
+        double baselineHits = TimeLookups(baseline, 0, 2, numIds, rounds,
+                                          &found);
+        double tableMisses = TimeLookups(table, 1, 2, numIds, rounds, &found);
+        double baselineMisses = TimeLookups(baseline, 1, 2, numIds, rounds,
+                                            &found);
+        double tableBoth = TimeLookups(table, 0, 1, numIds, rounds, &found);
+        double baselineBoth = TimeLookups(baseline, 0, 1, numIds, rounds,
+                                          &found);
+
+        // both tables find every even id in the hits and the mixed runs
+        if (found != 4 * (numIds / 2) * rounds * NumRuns)
+        {
+            cout << "IdTable lookups found the wrong items." << endl;
+        }
+
+        double perLookup = 1000000000.0 / (numIds / 2 * rounds);
+        cout << "IdTable lookup hits: " << tableHits * perLookup
+             << "ns, baseline: " << baselineHits * perLookup << "ns" << endl;
+        cout << "IdTable lookup misses: " << tableMisses * perLookup
+             << "ns, baseline: " << baselineMisses * perLookup << "ns"
+             << endl;
+        cout << "IdTable lookups of both: " << tableBoth * perLookup / 2
+             << "ns, baseline: " << baselineBoth * perLookup / 2 << "ns"
+             << endl;
+    }
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "Benchmark.h"
+
+namespace Finch
+{
+    class IdTableBenchmark : public Benchmark
+    {
+    public:
+        static void Run();
+
+    private:
+        // Times looking up ids in IdTable against the table it replaced,
+        // which probed using a modulus and had no tombstones.
+        static void BenchmarkLookups();
+
+        // Looks up every step'th id starting at first, a number of times,
+        // and returns how long the fastest run took. Adds the values it
+        // found to found so the lookups can't be skipped.
+        template <class Table>
+        static double TimeLookups(const Table & table, int first, int step,
+                                  int numIds, int rounds, int * found);
+    };
+}
@@ -1,7 +1,8 @@
 #include "Block.h"
+#include "Heap.h"
 
 #ifdef DEBUG
-#include "Environment.h"
+#include "Interpreter.h"
 #endif
 
 namespace Finch
@@ -10,19 +11,28 @@ namespace Finch
     :   mMethodId(methodId),
         mParams(params),
         mCode(),
+        mMessageCaches(),
+        mFieldCaches(),
         mConstants(),
-        mNumRegisters(0)
+        mNumRegisters(0),
+        mNumUpvalues(0),
+        mBorrowedParams(0),
+        mMarkedCollection(-1)
     {
     }
 
     int Block::AddConstant(const Value & object)
     {
-        // TODO(bob): Unify duplicates.
+        // Values compare by bits, so this unifies equal numbers and the same
+        // string literal, which the interpreter shares across blocks.
+        int index = mConstants.IndexOf(object);
+        if (index != -1) return index;
+        
         mConstants.Add(object);
         return mConstants.Count() - 1;
     }
     
-    int Block::AddBlock(Ref<Block> block)
+    int Block::AddBlock(const Handle<Block> & block)
     {
         mBlocks.Add(block);
         return mBlocks.Count() - 1;
@@ -31,46 +41,325 @@ namespace Finch
     // Writes an instruction.
     void Block::Write(OpCode op, int a, int b, int c)
     {
-        ASSERT_RANGE(a, 256);
-        ASSERT_RANGE(b, 256);
-        ASSERT_RANGE(c, 256);
+        ASSERT((a >= 0) && (b >= 0) && (c >= 0),
+               "Operands cannot be negative.");
+        
+        // Figure out how many extra bytes the widest operand needs.
+        int shift = 0;
+        while (((a | b | c) >> (shift + 8)) != 0) shift += 8;
+        
+        // Write the high bytes as prefixes, most significant first.
+        for (; shift > 0; shift -= 8)
+        {
+            mCode.Add(Encode(OP_WIDE, a >> shift, b >> shift, c >> shift));
+        }
+        
+        mCode.Add(Encode(op, a, b, c));
+        
+        // Give message sends a slot for their inline cache. OP_GUARD_LOGIC
+        // and OP_GUARD_IF use one to remember receivers they have already
+        // checked.
+        if (((op >= OP_MESSAGE_0) && (op <= OP_TAIL_MESSAGE_10)) ||
+            (op == OP_GUARD_LOGIC) || (op == OP_GUARD_IF))
+        {
+            while (mMessageCaches.Count() < mCode.Count())
+            {
+                mMessageCaches.Add(MessageCache());
+            }
+        }
+        
+        // And field accesses for theirs.
+        if ((op == OP_GET_FIELD) || (op == OP_SET_FIELD))
+        {
+            while (mFieldCaches.Count() < mCode.Count())
+            {
+                mFieldCaches.Add(FieldCache());
+            }
+        }
+    }
+
+    int Block::WriteJump(OpCode op, int b)
+    {
+        // Leave room for a 16-bit offset. The optimizer shrinks it later.
+        Write(op, 0xffff, b);
+        return mCode.Count() - 1;
+    }
+    
+    void Block::PatchJump(int jump)
+    {
+        int offset = mCode.Count() - (jump + 1);
         
-        Instruction instruction = (op << 24) |
-                                  ((a & 0xff) << 16) |
-                                  ((b & 0xff) << 8) |
-                                  (c & 0xff);
+        // Spread the offset over operand A of the jump and its prefixes.
+        int i = jump;
+        for (int shift = 0; shift < 32; shift += 8, i--)
+        {
+            mCode[i] = (mCode[i] & 0xff00ffff) | (((offset >> shift) & 0xff) << 16);
+            if ((i == 0) || (DECODE_OP(mCode[i - 1]) != OP_WIDE)) break;
+        }
         
-        mCode.Add(instruction);
+        ASSERT((offset >> (8 * (jump - i + 1))) == 0, "Jump is too far.");
+    }
+    
+    void Block::WriteLoop(int target)
+    {
+        // The offset is from the end of the loop instruction, so it depends on
+        // how many prefixes it ends up with.
+        int size = 1;
+        while (Size(mCode.Count() + size - target, 0, 0) != size) size++;
+        
+        Write(OP_LOOP, mCode.Count() + size - target);
     }
 
+    Instruction Block::Encode(OpCode op, int a, int b, int c)
+    {
+        return (op << 24) |
+               ((a & 0xff) << 16) |
+               ((b & 0xff) << 8) |
+               (c & 0xff);
+    }
+    
+    int Block::Size(int a, int b, int c)
+    {
+        int size = 1;
+        while (((a | b | c) >> (size * 8)) != 0) size++;
+        return size;
+    }
+    
+    void Block::ClearCode()
+    {
+        mCode.Clear();
+        mMessageCaches.Clear();
+        mFieldCaches.Clear();
+    }
+    
+    void Block::Decode(Array<DecodedInstruction> & code) const
+    {
+        // Map the start of each instruction (including its prefixes) to its
+        // index, and remember where each one ends.
+        Array<int> indexes(mCode.Count() + 1, -1);
+        Array<int> ends;
+        
+        int a = 0;
+        int b = 0;
+        int c = 0;
+        int start = 0;
+        for (int i = 0; i < mCode.Count(); i++)
+        {
+            OpCode op = OriginalOp(i);
+            a = (a << 8) | DECODE_A(mCode[i]);
+            b = (b << 8) | DECODE_B(mCode[i]);
+            c = (c << 8) | DECODE_C(mCode[i]);
+            
+            if (op == OP_WIDE) continue;
+            
+            indexes[start] = code.Count();
+            ends.Add(i + 1);
+            
+            DecodedInstruction decoded = { op, a, b, c };
+            code.Add(decoded);
+            
+            a = 0;
+            b = 0;
+            c = 0;
+            start = i + 1;
+        }
+        
+        // Turn the jump offsets into indexes.
+        for (int i = 0; i < code.Count(); i++)
+        {
+            DecodedInstruction & instruction = code[i];
+            if (!IsJump(instruction.op)) continue;
+            
+            int target = (instruction.op == OP_LOOP) ?
+                         ends[i] - instruction.a : ends[i] + instruction.a;
+            instruction.a = indexes[target];
+            
+            ASSERT(instruction.a != -1, "Jump must be to an instruction.");
+        }
+    }
+    
+    void Block::Encode(const Array<DecodedInstruction> & code)
+    {
+        // A jump needs more prefixes the further it goes, which pushes the
+        // instructions after it further along, which can make other jumps go
+        // further. Start with every jump as short as possible and lengthen
+        // them until they all fit. The sizes only grow, so this finishes.
+        Array<int> sizes;
+        for (int i = 0; i < code.Count(); i++)
+        {
+            const DecodedInstruction & instruction = code[i];
+            sizes.Add(IsJump(instruction.op) ?
+                      Size(0, instruction.b, instruction.c) :
+                      Size(instruction.a, instruction.b, instruction.c));
+        }
+        
+        Array<int> starts(code.Count() + 1, 0);
+        Array<int> offsets(code.Count(), 0);
+        bool changed = true;
+        while (changed)
+        {
+            for (int i = 0; i < code.Count(); i++)
+            {
+                starts[i + 1] = starts[i] + sizes[i];
+            }
+            
+            changed = false;
+            for (int i = 0; i < code.Count(); i++)
+            {
+                const DecodedInstruction & instruction = code[i];
+                if (!IsJump(instruction.op)) continue;
+                
+                offsets[i] = (instruction.op == OP_LOOP) ?
+                             starts[i + 1] - starts[instruction.a] :
+                             starts[instruction.a] - starts[i + 1];
+                
+                int size = Size(offsets[i], instruction.b, instruction.c);
+                if (size != sizes[i])
+                {
+                    sizes[i] = size;
+                    changed = true;
+                }
+            }
+        }
+        
+        ClearCode();
+        for (int i = 0; i < code.Count(); i++)
+        {
+            const DecodedInstruction & instruction = code[i];
+            int a = IsJump(instruction.op) ? offsets[i] : instruction.a;
+            Write(instruction.op, a, instruction.b, instruction.c);
+        }
+    }
+    
+    bool Block::IsJump(OpCode op)
+    {
+        switch (op)
+        {
+            case OP_JUMP:
+            case OP_LOOP:
+            case OP_JUMP_IF_FALSE:
+            case OP_GUARD_ETHER:
+            case OP_GUARD_LOGIC:
+            case OP_GUARD_IF:
+                return true;
+                
+            default:
+                return false;
+        }
+    }
+    
+    OpCode Block::OriginalOp(int ip) const
+    {
+        OpCode op = DECODE_OP(mCode[ip]);
+        if ((op >= OP_SEND_PRIMITIVE) && (op <= OP_SET_ACCESSOR))
+        {
+            return static_cast<OpCode>(OP_MESSAGE_0 +
+                                       mMessageCaches[ip].numArgs);
+        }
+        
+        return op;
+    }
+    
+    void Block::Quicken(int ip, OpCode op) const
+    {
+        mCode[ip] = (mCode[ip] & 0x00ffffff) | (op << 24);
+    }
+    
+    bool Block::IsGetter() const
+    {
+        // Looks for "GET_FIELD name -> r, END r" with no wide operands.
+        if (mCode.Count() != 2) return false;
+        if (mParams.Count() != 0) return false;
+        
+        return (DECODE_OP(mCode[0]) == OP_GET_FIELD) &&
+               (DECODE_OP(mCode[1]) == OP_END) &&
+               (DECODE_B(mCode[0]) == DECODE_A(mCode[1]));
+    }
+    
+    bool Block::IsSetter() const
+    {
+        // Looks for "SET_FIELD name <- 0, END 0" with no wide operands.
+        if (mCode.Count() != 2) return false;
+        if (mParams.Count() != 1) return false;
+        
+        return (DECODE_OP(mCode[0]) == OP_SET_FIELD) &&
+               (DECODE_OP(mCode[1]) == OP_END) &&
+               (DECODE_B(mCode[0]) == 0) &&
+               (DECODE_A(mCode[1]) == 0);
+    }
+    
     void Block::MarkTailCall()
     {
-        // Must have an instruction.
-        if (mCode.Count() == 0) return;
+        // Walk the instructions, folding in any wide prefixes, and remember
+        // the last send and the register it writes its result to.
+        int send = -1;
+        int dest = -1;
         
-        Instruction instruction = mCode[-1];
-        OpCode op = DECODE_OP(instruction);
-        int args = (instruction & 0x00ffffff);
+        int a = 0;
+        int c = 0;
+        for (int i = 0; i < mCode.Count(); i++)
+        {
+            OpCode op = DECODE_OP(mCode[i]);
+            a = (a << 8) | DECODE_A(mCode[i]);
+            c = (c << 8) | DECODE_C(mCode[i]);
+            
+            if (op == OP_WIDE) continue;
+            
+            // A send whose result is returned by the OP_END right after it is
+            // in tail position. With inlined control flow, that may not be the
+            // end of the block.
+            if ((op == OP_END) && (send != -1) && (a == dest))
+            {
+                int numArgs = DECODE_OP(mCode[send]) - OP_MESSAGE_0;
+                OpCode tailOp = static_cast<OpCode>(OP_TAIL_MESSAGE_0 + numArgs);
+                mCode[send] = (tailOp << 24) | (mCode[send] & 0x00ffffff);
+            }
+            
+            if ((op >= OP_MESSAGE_0) && (op <= OP_MESSAGE_10))
+            {
+                send = i;
+                dest = c;
+            }
+            else
+            {
+                send = -1;
+            }
+            
+            a = 0;
+            c = 0;
+        }
+    }
+
+    void Block::Mark(Heap & heap) const
+    {
+        if (mMarkedCollection == heap.CollectionNumber()) return;
+        mMarkedCollection = heap.CollectionNumber();
+        
+        for (int i = 0; i < mConstants.Count(); i++)
+        {
+            heap.Mark(mConstants[i]);
+        }
         
-        if ((op >= OP_MESSAGE_0) && (op <= OP_MESSAGE_10))
+        for (int i = 0; i < mMessageCaches.Count(); i++)
         {
-            int numArgs = op - OP_MESSAGE_0;
-            OpCode tailOp = static_cast<OpCode>(OP_TAIL_MESSAGE_0 + numArgs);
-            mCode[-1] = (tailOp << 24) | args;
+            heap.Mark(mMessageCaches[i].key);
+            heap.Mark(mMessageCaches[i].method);
+        }
+        
+        for (int i = 0; i < mBlocks.Count(); i++)
+        {
+            mBlocks[i]->Mark(heap);
         }
     }
 
 #ifdef DEBUG
-    void Block::DumpInstruction(Environment & environment, const String & prefix, Instruction instruction)
+    void Block::DumpInstruction(Interpreter & interpreter, const String & prefix,
+                                OpCode op, int a, int b, int c)
     {
         using namespace std;
         
         cout << prefix;
         
-        OpCode op = DECODE_OP(instruction);
-        int a = DECODE_A(instruction);
-        int b = DECODE_B(instruction);
-        int c = DECODE_C(instruction);
         switch (op)
         {
             case OP_CONSTANT:
@@ -78,6 +367,7 @@ namespace Finch
                 break;
             case OP_BLOCK:
                 cout << "BLOCK        " << a << " -> " << b;
+                if (c == 1) cout << " (stack)";
                 break;
             case OP_OBJECT:
                 cout << "OBJECT       " << a;
@@ -105,7 +395,40 @@ namespace Finch
             case OP_MESSAGE_8:
             case OP_MESSAGE_9:
             case OP_MESSAGE_10:
-                cout << "MESSAGE_" << (op - OP_MESSAGE_0) << "   '" << environment.Strings().Find(a) << "' " << b << " -> " << c;
+                cout << "MESSAGE_" << (op - OP_MESSAGE_0) << "   '" << interpreter.FindString(a) << "' " << b << " -> " << c;
+                break;
+            case OP_ADD:
+            case OP_SUBTRACT:
+            case OP_MULTIPLY:
+            case OP_DIVIDE:
+            case OP_EQUAL:
+            case OP_NOT_EQUAL:
+            case OP_LESS:
+            case OP_GREATER:
+            case OP_LESS_EQUAL:
+            case OP_GREATER_EQUAL:
+            case OP_AT:
+            case OP_AT_PUT:
+                cout << "FAST_MESSAGE '" << interpreter.FindString(a) << "' " << b << " -> " << c;
+                break;
+            case OP_SEND_PRIMITIVE:
+            case OP_SEND_METHOD:
+            case OP_GET_ACCESSOR:
+            case OP_SET_ACCESSOR:
+                cout << "QUICK_MESSAGE '" << interpreter.FindString(a) << "' " << b << " -> " << c;
+                break;
+            case OP_TAIL_MESSAGE_0:
+            case OP_TAIL_MESSAGE_1:
+            case OP_TAIL_MESSAGE_2:
+            case OP_TAIL_MESSAGE_3:
+            case OP_TAIL_MESSAGE_4:
+            case OP_TAIL_MESSAGE_5:
+            case OP_TAIL_MESSAGE_6:
+            case OP_TAIL_MESSAGE_7:
+            case OP_TAIL_MESSAGE_8:
+            case OP_TAIL_MESSAGE_9:
+            case OP_TAIL_MESSAGE_10:
+                cout << "TAIL_MESSAGE_" << (op - OP_TAIL_MESSAGE_0) << " '" << interpreter.FindString(a) << "' " << b;
                 break;
             case OP_GET_UPVALUE:
                 cout << "GET_UPVALUE  " << a << " -> " << b;
@@ -114,10 +437,10 @@ namespace Finch
                 cout << "SET_UPVALUE  " << a << " -> " << b;
                 break;
             case OP_GET_FIELD:
-                cout << "GET_FIELD    '" << environment.Strings().Find(a) << "' -> " << b;
+                cout << "GET_FIELD    '" << interpreter.FindString(a) << "' -> " << b;
                 break;
             case OP_SET_FIELD:
-                cout << "SET_FIELD    '" << environment.Strings().Find(a) << "' <- " << b;
+                cout << "SET_FIELD    '" << interpreter.FindString(a) << "' <- " << b;
                 break;
             case OP_GET_GLOBAL:
                 cout << "GET_GLOBAL   " << a << " -> " << b;
@@ -126,10 +449,10 @@ namespace Finch
                 cout << "SET_GLOBAL   " << a << " <- " << b;
                 break;
             case OP_DEF_METHOD:
-                cout << "DEF_METHOD   '" << environment.Strings().Find(a) << "' " << b << " -> " << c;
+                cout << "DEF_METHOD   '" << interpreter.FindString(a) << "' " << b << " -> " << c;
                 break;
             case OP_DEF_FIELD:
-                cout << "DEF_FIELD    '" << environment.Strings().Find(a) << "' " << b << " -> " << c;
+                cout << "DEF_FIELD    '" << interpreter.FindString(a) << "' " << b << " -> " << c;
                 break;
             case OP_END:
                 cout << "END          " << a;
@@ -137,6 +460,30 @@ namespace Finch
             case OP_RETURN:
                 cout << "RETURN       m" << a << " ^ " << b;
                 break;
+            case OP_JUMP:
+                cout << "JUMP         +" << a;
+                break;
+            case OP_LOOP:
+                cout << "LOOP         -" << a;
+                break;
+            case OP_JUMP_IF_FALSE:
+                cout << "JUMP_IF_NOT  " << b << " +" << a;
+                break;
+            case OP_GUARD_ETHER:
+                cout << "GUARD_ETHER  +" << a;
+                break;
+            case OP_GUARD_LOGIC:
+                cout << "GUARD_LOGIC  " << b << " +" << a;
+                break;
+            case OP_GUARD_IF:
+                cout << "GUARD_IF     " << b << " +" << a;
+                break;
+            case OP_CLOSE_UPVALUES:
+                cout << "CLOSE_UPVAL  " << a;
+                break;
+            case OP_BORROW:
+                cout << "BORROW       " << a << " " << b;
+                break;
             case OP_CAPTURE_LOCAL:   // A = register of local
                 cout << "CAP_LOCAL    " << a;
                 break;
@@ -151,15 +498,29 @@ namespace Finch
         // Dump the child block too.
         if (op == OP_BLOCK)
         {
-            mBlocks[a]->DebugDump(environment, prefix + "  ");
+            mBlocks[a]->DebugDump(interpreter, prefix + "  ");
         }
     }
     
-    void Block::DebugDump(Environment & environment, const String & prefix)
+    void Block::DebugDump(Interpreter & interpreter, const String & prefix)
     {
         for (int i = 0; i < mCode.Count(); i++)
         {
-            DumpInstruction(environment, prefix, mCode[i]);
+            Instruction instruction = mCode[i];
+            int a = DECODE_A(instruction);
+            int b = DECODE_B(instruction);
+            int c = DECODE_C(instruction);
+            
+            // Fold any wide prefixes into the operands.
+            while (DECODE_OP(instruction) == OP_WIDE)
+            {
+                instruction = mCode[++i];
+                a = (a << 8) | DECODE_A(instruction);
+                b = (b << 8) | DECODE_B(instruction);
+                c = (c << 8) | DECODE_C(instruction);
+            }
+            
+            DumpInstruction(interpreter, prefix, DECODE_OP(instruction), a, b, c);
         }
     }
 #endif
@@ -6,7 +6,7 @@
 #include "FinchString.h"
 #include "Macros.h"
 #include "Object.h"
-#include "Ref.h"
+#include "Handle.h"
 
 #define DECODE_OP(inst) (static_cast<OpCode>((inst & 0xff000000) >> 24))
 #define DECODE_A(inst)  ((inst & 0x00ff0000) >> 16)
@@ -15,6 +15,9 @@
 
 namespace Finch
 {
+    class Heap;
+    class Shape;
+    
     // TODO(bob): We expect this to be 32 bits. Is there a better way to specify
     // this?
     typedef unsigned int Instruction;
@@ -22,7 +25,9 @@ namespace Finch
     enum OpCode
     {
         OP_CONSTANT,        // A = index of constant, B = dest register
-        OP_BLOCK,           // A = index of example, B = dest register
+        OP_BLOCK,           // A = index of example, B = dest register,
+                            // C = 1 if the block can go on the fiber's
+                            // stack (see OP_BORROW)
         OP_OBJECT,          // A = parent register and dest register
         OP_ARRAY,           // A = initial capacity, B = dest register
         OP_ARRAY_ELEMENT,   // A = element register, B = dest array register
@@ -39,6 +44,35 @@ namespace Finch
         OP_MESSAGE_8,
         OP_MESSAGE_9,
         OP_MESSAGE_10,
+
+        // Superinstructions for the most common sends. The operands are the
+        // same as OP_MESSAGE_1 (OP_MESSAGE_2 for OP_AT_PUT). When the
+        // receiver and arguments are numbers (or an array and an index) and
+        // the built-in methods haven't been overridden, the operation is done
+        // inline. Otherwise they behave exactly like a normal send.
+        OP_ADD,
+        OP_SUBTRACT,
+        OP_MULTIPLY,
+        OP_DIVIDE,
+        OP_EQUAL,
+        OP_NOT_EQUAL,
+        OP_LESS,
+        OP_GREATER,
+        OP_LESS_EQUAL,
+        OP_GREATER_EQUAL,
+        OP_AT,
+        OP_AT_PUT,
+
+        // Quickened forms of OP_MESSAGE_n. These never come from the compiler.
+        // Instead, the fiber rewrites a send into one of these once its
+        // inline cache has found the method, so that the next time it can
+        // skip straight to it. They check that the cache still applies and
+        // turn back into a normal send if it doesn't.
+        OP_SEND_PRIMITIVE,  // Calls the cached primitive.
+        OP_SEND_METHOD,     // Calls the cached method.
+        OP_GET_ACCESSOR,    // Does what a method like "x { _x }" does.
+        OP_SET_ACCESSOR,    // Does what a method like "x: v { _x <- v }" does.
+
         OP_TAIL_MESSAGE_0,
         OP_TAIL_MESSAGE_1,
         OP_TAIL_MESSAGE_2,
@@ -66,17 +100,110 @@ namespace Finch
         OP_RETURN,        // A = method id to return from,
                           // B = register with value to return
         
+        // Jumps. The offset counts instructions (including any OP_WIDE
+        // prefixes) from the one after the jump. The compiler uses these to
+        // inline the control flow messages like if:then: and while:do:.
+        OP_JUMP,            // A = offset to jump forward
+        OP_LOOP,            // A = offset to jump back
+        OP_JUMP_IF_FALSE,   // A = offset to jump forward unless B is true,
+                            // B = register of condition
+        
+        // Guards in front of inlined control flow. If the messages the code
+        // was inlined from might not do what the core library does any more,
+        // they jump forward to code that sends the message normally.
+        OP_GUARD_ETHER,     // A = offset to jump forward unless Ether and
+                            // the control flow methods are the core ones
+        OP_GUARD_LOGIC,     // A = offset to jump forward unless B responds
+                            // to and: and or: with the core methods,
+                            // B = register of receiver
+        OP_GUARD_IF,        // A = offset to jump forward unless B is false,
+                            // nil or responds to if-true:else: with the
+                            // core method, B = register of condition
+        
+        // Closes the upvalues for the registers starting at A. Used when a
+        // local in an inlined block has been captured, so that the next
+        // iteration or the next use of its register gets a fresh variable.
+        OP_CLOSE_UPVALUES,  // A = first register to close
+        
+        // Comes right before a message send whose receiver or arguments may
+        // be blocks on the fiber's stack instead of the heap. The compiler
+        // puts a literal block there when it's only passed to a send. This
+        // moves any of them that the method being called might hold on to
+        // over to the heap, and lends the rest to the call.
+        OP_BORROW,          // A = receiver register of the send,
+                            // B = number of arguments
+        
         // TODO(bob): These are pseudo-ops that only appear following an
         // OP_BLOCK instruction. If we want to minimize the number of ops, we
         // could reuse existing opcodes for these.
         OP_CAPTURE_LOCAL,   // A = register of local
-        OP_CAPTURE_UPVALUE  // A = index of upvalue
+        OP_CAPTURE_UPVALUE, // A = index of upvalue
+        
+        // Prefix for an instruction with an operand too big to fit in eight
+        // bits. A, B and C hold the next eight bits up of the following
+        // instruction's A, B and C. Prefixes can be chained for operands that
+        // need more than 16 bits, most significant bits first.
+        OP_WIDE
+    };
+    
+    // An instruction with any OP_WIDE prefixes folded into its operands. In
+    // this form, a jump's offset is replaced by the index of the instruction
+    // it jumps to.
+    struct DecodedInstruction
+    {
+        OpCode op;
+        int    a;
+        int    b;
+        int    c;
+    };
+    
+    // A monomorphic inline cache for a single message send instruction. It
+    // remembers which method the last receiver used so that sending the same
+    // message to the same kind of receiver again can skip walking the parent
+    // chain. The key is the value whose method table decides how the receiver
+    // responds: see Value::DispatchKey().
+    struct MessageCache
+    {
+        MessageCache()
+        :   key(),
+            epoch(-1),
+            method(),
+            primitive(NULL),
+            numArgs(0)
+        {}
+        
+        Value           key;
+        
+        // The value of Interpreter::MethodEpoch() when this was filled in.
+        // If any method has been added since then, the cache is stale.
+        int             epoch;
+        
+        Value           method;
+        PrimitiveMethod primitive;
+        
+        // The number of arguments the send passes. Quickened instructions
+        // don't encode it in their opcode.
+        int             numArgs;
+    };
+    
+    // An inline cache for a single field access instruction. Remembers the
+    // shape of the last object whose own field was accessed and which slot
+    // the field was in.
+    struct FieldCache
+    {
+        FieldCache()
+        :   shape(NULL),
+            slot(-1)
+        {}
+        
+        const Shape * shape;
+        int           slot;
     };
         
     // A compiled block. This contains the state that all blocks created from
     // evaluating the same chunk of code share: the compiled bytecode, constant
     // table etc. It does not contain the closure: that's owned by BlockObject.
-    class Block
+    class Block : public RefCounted
     {
     public:
         // Method ID for blocks that are not methods.
@@ -96,41 +223,138 @@ namespace Finch
         int  NumUpvalues() const { return mNumUpvalues; }
         void SetNumUpvalues(int numUpvalues) { mNumUpvalues = numUpvalues; }
         
-        // Adds the given object to the constant pool and returns its index.
+        // Gets whether a block on the caller's stack can be passed for the
+        // given parameter. That's true when the parameter is only ever sent
+        // messages or passed to other sends, which OP_BORROW then checks.
+        // Bit n of the mask is set for parameter n.
+        bool BorrowsParam(int param) const
+        {
+            return (param < MAX_BORROWED_PARAMS) &&
+                   ((mBorrowedParams & (1 << param)) != 0);
+        }
+        
+        int  BorrowedParams() const { return mBorrowedParams; }
+        void SetBorrowedParams(int params) { mBorrowedParams = params; }
+        
+        // Only this many parameters fit in the borrowed parameter mask.
+        static const int MAX_BORROWED_PARAMS = 30;
+        
+        // Adds the given object to the constant pool and returns its index. If
+        // the pool already has it, returns the existing index.
         int AddConstant(const Value & object);
         
         // Gets the constant at the given index in the constant pool.
         const Value & GetConstant(int index) const { return mConstants[index]; }
         
+        int NumConstants() const { return mConstants.Count(); }
+        
         // Adds the given block to the pool and returns its index.
-        int AddBlock(Ref<Block> block);
+        int AddBlock(const Handle<Block> & block);
         
         // Gets the child block at the given index in the pool.
-        const Ref<Block> GetBlock(int index) const { return mBlocks[index]; }
+        const Handle<Block> & GetBlock(int index) const { return mBlocks[index]; }
+        
+        int NumBlocks() const { return mBlocks.Count(); }
         
         // Gets the bytecode for this block.
         const Array<Instruction> & Code() const { return mCode; }
         
-        // Writes an instruction.
+        // Gets the opcode the compiler wrote for the instruction at the given
+        // index, undoing any quickening.
+        OpCode OriginalOp(int ip) const;
+        
+        // Rewrites the opcode of the message send at the given index, keeping
+        // its operands. Like the inline caches, this is an optimization that
+        // doesn't change what the code does, so it's allowed on a const
+        // block.
+        void Quicken(int ip, OpCode op) const;
+        
+        // Gets whether this block does nothing but return one of its
+        // receiver's fields. If so, the field instruction is the first one.
+        bool IsGetter() const;
+        
+        // Gets whether this block does nothing but set one of its receiver's
+        // fields to its only parameter and return it. If so, the field
+        // instruction is the first one.
+        bool IsSetter() const;
+        
+        // Gets the inline cache for the message (or guard)
+        // instruction at the given index in the bytecode.
+        MessageCache & GetMessageCache(int ip) const { return mMessageCaches[ip]; }
+        
+        // Gets the inline cache for the field instruction at the given index
+        // in the bytecode.
+        FieldCache & GetFieldCache(int ip) const { return mFieldCaches[ip]; }
+        
+        // Writes an instruction. Operands that don't fit in eight bits are
+        // handled by writing OP_WIDE prefixes before the instruction.
         void Write(OpCode op, int a = 0xff, int b = 0xff, int c = 0xff);
         
-        // If the last instruction is a MESSAGE, translates it to a tail call.
+        // Writes a forward jump whose offset will be filled in by PatchJump().
+        // Returns the index to pass to that.
+        int  WriteJump(OpCode op, int b = 0xff);
+        
+        // Makes the jump written by WriteJump() jump to the next instruction
+        // that will be written.
+        void PatchJump(int jump);
+        
+        // Writes an OP_LOOP back to the instruction at the given index.
+        void WriteLoop(int target);
+        
+        // Removes all of the instructions so that the code can be rewritten.
+        void ClearCode();
+        
+        // Decodes the bytecode into the given array, undoing any quickening.
+        void Decode(Array<DecodedInstruction> & code) const;
+        
+        // Replaces the bytecode with the given decoded instructions, working
+        // out the prefixes and offsets the jumps need.
+        void Encode(const Array<DecodedInstruction> & code);
+        
+        static bool IsJump(OpCode op);
+        
+        // Translates each MESSAGE whose result is what the OP_END right after
+        // it returns to a tail call.
         void MarkTailCall();
         
+        // Marks the constants and cached values used by this block and the
+        // blocks it contains.
+        void Mark(Heap & heap) const;
+        
 #ifdef DEBUG
-        void DumpInstruction(Environment & environment, const String & prefix, Instruction instruction);
-        void DebugDump(Environment & environment, const String & prefix);
+        void DumpInstruction(Interpreter & interpreter, const String & prefix,
+                             OpCode op, int a, int b, int c);
+        void DebugDump(Interpreter & interpreter, const String & prefix);
 #endif
         
+        USE_ALLOCATOR
+        
     private:
+        static Instruction Encode(OpCode op, int a, int b, int c);
+        
+        // Gets how many instructions Write() uses for the given operands.
+        static int Size(int a, int b, int c);
+        
         int                 mMethodId;
         Array<String>       mParams;
-        Array<Instruction>  mCode;
+        // Mutable so that message sends can be quickened.
+        mutable Array<Instruction> mCode;
+        // Parallel to mCode, but only up to the last message instruction.
+        mutable Array<MessageCache> mMessageCaches;
+        // Parallel to mCode, but only up to the last field instruction.
+        mutable Array<FieldCache>   mFieldCaches;
         Array<Value>        mConstants;
         // Blocks contained within this one.
-        Array<Ref<Block> >  mBlocks;
+        Array<Handle<Block> >  mBlocks;
         int                 mNumRegisters;
         int                 mNumUpvalues;
+        int                 mBorrowedParams;
+        
+        // The last collection that marked this block. Lots of BlockObjects
+        // can share one Block, so this avoids marking it over and over.
+        mutable int         mMarkedCollection;
+        
+        NO_COPY(Block);
     };
 }
 
@@ -0,0 +1,463 @@
+#include <cstring>
+#include <sstream>
+
+#include "BytecodeImage.h"
+#include "Compiler.h"
+#include "IInterpreterHost.h"
+#include "Interpreter.h"
+
+namespace Finch
+{
+    // The first bytes of every image.
+    static const char sMagic[] = { 'F', 'N', 'C', 'H' };
+    
+    // The kinds of constants in an image.
+    enum ConstantType
+    {
+        CONSTANT_NUMBER,
+        CONSTANT_STRING
+    };
+    
+    // Gets whether operand A of the given instruction is a string ID.
+    static bool IsStringOperand(OpCode op)
+    {
+        return ((op >= OP_MESSAGE_0) && (op <= OP_TAIL_MESSAGE_10)) ||
+               (op == OP_GET_FIELD) || (op == OP_SET_FIELD) ||
+               (op == OP_DEF_METHOD) || (op == OP_DEF_FIELD);
+    }
+    
+    // Gets whether operand A of the given instruction is a global index.
+    static bool IsGlobalOperand(OpCode op)
+    {
+        return (op == OP_GET_GLOBAL) || (op == OP_SET_GLOBAL);
+    }
+    
+    void BytecodeImage::Write(Interpreter & interpreter, const Block & block,
+                              std::ostream & stream)
+    {
+        BytecodeImage image(interpreter);
+        
+        // The tables are filled in while writing the blocks, but need to come
+        // before them, so write the blocks to a buffer first.
+        std::stringstream blocks;
+        image.WriteBlock(blocks, block);
+        
+        stream.write(sMagic, sizeof(sMagic));
+        WriteInt(stream, VERSION);
+        image.WriteTables(stream);
+        
+        stream << blocks.rdbuf();
+    }
+    
+    Handle<Block> BytecodeImage::Read(Interpreter & interpreter,
+                                   std::istream & stream)
+    {
+        BytecodeImage image(interpreter);
+        
+        if (!IsImage(stream))
+        {
+            interpreter.GetHost().Error("Not a bytecode image.");
+            return Handle<Block>();
+        }
+        
+        stream.ignore(sizeof(sMagic));
+        if (ReadInt(stream) != VERSION)
+        {
+            interpreter.GetHost().Error(
+                "Bytecode image was written by a different version of Finch.");
+            return Handle<Block>();
+        }
+        
+        Handle<Block> block;
+        if (image.ReadTables(stream)) block = image.ReadBlock(stream);
+        
+        if (block.IsNull())
+        {
+            interpreter.GetHost().Error("Bytecode image is corrupt.");
+        }
+        
+        return block;
+    }
+    
+    bool BytecodeImage::IsImage(std::istream & stream)
+    {
+        char magic[sizeof(sMagic)];
+        std::streampos start = stream.tellg();
+        
+        stream.read(magic, sizeof(magic));
+        bool isImage = stream && (memcmp(magic, sMagic, sizeof(sMagic)) == 0);
+        
+        stream.clear();
+        stream.seekg(start);
+        return isImage;
+    }
+    
+    BytecodeImage::BytecodeImage(Interpreter & interpreter)
+    :   mInterpreter(interpreter),
+        mStrings(),
+        mGlobals(),
+        mMethods(),
+        mNumMethods(0),
+        mStringIds(),
+        mGlobalIds(),
+        mMethodIds()
+    {}
+    
+    int BytecodeImage::MapString(StringId id)
+    {
+        return mStrings.Add(mInterpreter.FindString(id));
+    }
+    
+    void BytecodeImage::WriteTables(std::ostream & stream)
+    {
+        WriteInt(stream, mStrings.Count());
+        for (int i = 0; i < mStrings.Count(); i++)
+        {
+            WriteString(stream, mStrings.Find(i));
+        }
+        
+        WriteInt(stream, mGlobals.Count());
+        for (int i = 0; i < mGlobals.Count(); i++)
+        {
+            WriteString(stream, mGlobals.Find(i));
+        }
+        
+        WriteInt(stream, mNumMethods);
+    }
+    
+    bool BytecodeImage::ReadTables(std::istream & stream)
+    {
+        int numStrings = ReadInt(stream);
+        for (int i = 0; i < numStrings && stream; i++)
+        {
+            mStringIds.Add(mInterpreter.AddString(ReadString(stream)));
+        }
+        
+        int numGlobals = ReadInt(stream);
+        for (int i = 0; i < numGlobals && stream; i++)
+        {
+            mGlobalIds.Add(mInterpreter.DefineGlobal(ReadString(stream)));
+        }
+        
+        // Give each method in the image a new ID so that they don't collide
+        // with methods that have already been compiled.
+        int numMethods = ReadInt(stream);
+        for (int i = 0; i < numMethods && stream; i++)
+        {
+            mMethodIds.Add(Compiler::NewMethodId());
+        }
+        
+        return !stream.fail();
+    }
+    
+    void BytecodeImage::WriteBlock(std::ostream & stream, const Block & block)
+    {
+        WriteInt(stream, MapMethodId(block.MethodId()));
+        
+        WriteInt(stream, block.Params().Count());
+        for (int i = 0; i < block.Params().Count(); i++)
+        {
+            WriteString(stream, block.Params()[i]);
+        }
+        
+        WriteInt(stream, block.NumRegisters());
+        WriteInt(stream, block.NumUpvalues());
+        WriteInt(stream, block.BorrowedParams());
+        
+        WriteInt(stream, block.NumConstants());
+        for (int i = 0; i < block.NumConstants(); i++)
+        {
+            // The compiler only makes number and string constants.
+            const Value & constant = block.GetConstant(i);
+            if (constant.IsNumber())
+            {
+                WriteInt(stream, CONSTANT_NUMBER);
+                WriteDouble(stream, constant.AsNumber());
+            }
+            else
+            {
+                WriteInt(stream, CONSTANT_STRING);
+                WriteString(stream, constant.AsString());
+            }
+        }
+        
+        WriteInt(stream, block.NumBlocks());
+        for (int i = 0; i < block.NumBlocks(); i++)
+        {
+            WriteBlock(stream, *block.GetBlock(i));
+        }
+        
+        // Decoding folds the OP_WIDE prefixes into the instructions they
+        // widen, turns jump offsets into instruction indexes and undoes any
+        // quickening, so sends are written the way the compiler wrote them.
+        Array<DecodedInstruction> code;
+        block.Decode(code);
+        
+        WriteInt(stream, code.Count());
+        
+        for (int i = 0; i < code.Count(); i++)
+        {
+            OpCode op = code[i].op;
+            int a = code[i].a;
+            int b = code[i].b;
+            int c = code[i].c;
+            
+            if (IsStringOperand(op))
+            {
+                a = MapString(a);
+            }
+            else if (IsGlobalOperand(op))
+            {
+                a = mGlobals.Add(mInterpreter.FindGlobalName(a));
+            }
+            else if (op == OP_RETURN)
+            {
+                a = MapMethodId(a);
+            }
+            
+            WriteInt(stream, op);
+            WriteInt(stream, a);
+            WriteInt(stream, b);
+            WriteInt(stream, c);
+        }
+    }
+    
+    int BytecodeImage::MapMethodId(int methodId)
+    {
+        if (methodId == Block::BLOCK_METHOD_ID) return methodId;
+        
+        int index;
+        if (!mMethods.Find(methodId, &index))
+        {
+            index = mNumMethods++;
+            mMethods.Insert(methodId, index);
+        }
+        
+        return index;
+    }
+    
+    Handle<Block> BytecodeImage::ReadBlock(std::istream & stream)
+    {
+        int methodId;
+        if (!ReadMethodId(stream, &methodId)) return Handle<Block>();
+        
+        Array<String> params;
+        int numParams = ReadInt(stream);
+        for (int i = 0; i < numParams && stream; i++)
+        {
+            params.Add(ReadString(stream));
+        }
+        
+        Handle<Block> block = Handle<Block>(new (mInterpreter.GetAllocator())
+                                      Block(methodId, params));
+        
+        block->SetNumRegisters(ReadInt(stream));
+        block->SetNumUpvalues(ReadInt(stream));
+        block->SetBorrowedParams(ReadInt(stream));
+        
+        int numConstants = ReadInt(stream);
+        for (int i = 0; i < numConstants && stream; i++)
+        {
+            switch (ReadInt(stream))
+            {
+                case CONSTANT_NUMBER:
+                    block->AddConstant(mInterpreter.NewNumber(ReadDouble(stream)));
+                    break;
+                    
+                case CONSTANT_STRING:
+                    block->AddConstant(
+                        mInterpreter.StringLiteral(ReadString(stream)));
+                    break;
+                    
+                default:
+                    return Handle<Block>();
+            }
+        }
+        
+        int numBlocks = ReadInt(stream);
+        for (int i = 0; i < numBlocks && stream; i++)
+        {
+            Handle<Block> child = ReadBlock(stream);
+            if (child.IsNull()) return Handle<Block>();
+            
+            block->AddBlock(child);
+        }
+        
+        Array<DecodedInstruction> code;
+        int numInstructions = ReadInt(stream);
+        for (int i = 0; i < numInstructions && stream; i++)
+        {
+            int op = ReadInt(stream);
+            int a = ReadInt(stream);
+            int b = ReadInt(stream);
+            int c = ReadInt(stream);
+            
+            if ((op < 0) || (op >= OP_WIDE)) return Handle<Block>();
+            
+            // Quickened sends only exist at runtime.
+            if ((op >= OP_SEND_PRIMITIVE) && (op <= OP_SET_ACCESSOR))
+            {
+                return Handle<Block>();
+            }
+            if ((a < 0) || (b < 0) || (c < 0)) return Handle<Block>();
+            
+            if (IsStringOperand(static_cast<OpCode>(op)))
+            {
+                if (a >= mStringIds.Count()) return Handle<Block>();
+                a = mStringIds[a];
+            }
+            else if (IsGlobalOperand(static_cast<OpCode>(op)))
+            {
+                if (a >= mGlobalIds.Count()) return Handle<Block>();
+                a = mGlobalIds[a];
+            }
+            else if (op == OP_RETURN)
+            {
+                if (a >= mMethodIds.Count()) return Handle<Block>();
+                a = mMethodIds[a];
+            }
+            else if (Block::IsJump(static_cast<OpCode>(op)))
+            {
+                if (a >= numInstructions) return Handle<Block>();
+            }
+            
+            DecodedInstruction instruction = { static_cast<OpCode>(op), a, b, c };
+            code.Add(instruction);
+        }
+        
+        if (!stream) return Handle<Block>();
+        
+        // The interpreter decodes the send after an OP_BORROW, so make sure
+        // there is one and that it uses the registers the OP_BORROW checks.
+        for (int i = 0; i < code.Count(); i++)
+        {
+            if (code[i].op != OP_BORROW) continue;
+            if (i + 1 == code.Count()) return Handle<Block>();
+            
+            const DecodedInstruction & send = code[i + 1];
+            int numArgs;
+            if ((send.op >= OP_MESSAGE_0) && (send.op <= OP_MESSAGE_10))
+            {
+                numArgs = send.op - OP_MESSAGE_0;
+            }
+            else if ((send.op >= OP_TAIL_MESSAGE_0) &&
+                     (send.op <= OP_TAIL_MESSAGE_10))
+            {
+                numArgs = send.op - OP_TAIL_MESSAGE_0;
+            }
+            else
+            {
+                return Handle<Block>();
+            }
+            
+            if ((code[i].a != send.b) || (code[i].b != numArgs))
+            {
+                return Handle<Block>();
+            }
+        }
+        
+        // Encoding works out the prefixes and jump offsets again.
+        block->Encode(code);
+        
+        return block;
+    }
+    
+    bool BytecodeImage::ReadStringId(std::istream & stream, StringId * id)
+    {
+        int index = ReadInt(stream);
+        if ((index < 0) || (index >= mStringIds.Count())) return false;
+        
+        *id = mStringIds[index];
+        return true;
+    }
+    
+    bool BytecodeImage::ReadMethodId(std::istream & stream, int * methodId)
+    {
+        int index = ReadInt(stream);
+        if (index == Block::BLOCK_METHOD_ID)
+        {
+            *methodId = index;
+            return true;
+        }
+        
+        if ((index < 0) || (index >= mMethodIds.Count())) return false;
+        
+        *methodId = mMethodIds[index];
+        return true;
+    }
+    
+    void BytecodeImage::WriteInt(std::ostream & stream, int value)
+    {
+        // Always little-endian, so images work on any machine.
+        unsigned int bits = static_cast<unsigned int>(value);
+        char bytes[4];
+        for (int i = 0; i < 4; i++)
+        {
+            bytes[i] = static_cast<char>((bits >> (i * 8)) & 0xff);
+        }
+        
+        stream.write(bytes, sizeof(bytes));
+    }
+    
+    void BytecodeImage::WriteDouble(std::ostream & stream, double value)
+    {
+        unsigned int halves[2];
+        memcpy(halves, &value, sizeof(value));
+        
+        // Write the low half first, to match WriteInt().
+        const unsigned int one = 1;
+        bool isLittleEndian = *reinterpret_cast<const char *>(&one) == 1;
+        WriteInt(stream, halves[isLittleEndian ? 0 : 1]);
+        WriteInt(stream, halves[isLittleEndian ? 1 : 0]);
+    }
+    
+    void BytecodeImage::WriteString(std::ostream & stream, const String & value)
+    {
+        WriteInt(stream, value.Length());
+        stream.write(value.CString(), value.Length());
+    }
+    
+    int BytecodeImage::ReadInt(std::istream & stream)
+    {
+        unsigned char bytes[4];
+        stream.read(reinterpret_cast<char *>(bytes), sizeof(bytes));
+        if (!stream) return -1;
+        
+        unsigned int bits = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            bits |= static_cast<unsigned int>(bytes[i]) << (i * 8);
+        }
+        
+        return static_cast<int>(bits);
+    }
+    
+    double BytecodeImage::ReadDouble(std::istream & stream)
+    {
+        unsigned int low = static_cast<unsigned int>(ReadInt(stream));
+        unsigned int high = static_cast<unsigned int>(ReadInt(stream));
+        
+        const unsigned int one = 1;
+        bool isLittleEndian = *reinterpret_cast<const char *>(&one) == 1;
+        
+        unsigned int halves[2];
+        halves[isLittleEndian ? 0 : 1] = low;
+        halves[isLittleEndian ? 1 : 0] = high;
+        
+        double value;
+        memcpy(&value, halves, sizeof(value));
+        return value;
+    }
+    
+    String BytecodeImage::ReadString(std::istream & stream)
+    {
+        int length = ReadInt(stream);
+        if (length <= 0) return String();
+        
+        Array<char> chars(length + 1, '\0');
+        stream.read(&chars[0], length);
+        
+        return String(&chars[0]);
+    }
+}
+
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <iostream>
+
+#include "Array.h"
+#include "Block.h"
+#include "Dictionary.h"
+#include "Macros.h"
+#include "Handle.h"
+#include "StringTable.h"
+
+namespace Finch
+{
+    class Interpreter;
+    
+    // Reads and writes compiled Blocks as bytecode images, so that source
+    // code can be compiled once and then loaded later without lexing,
+    // parsing or compiling it again.
+    //
+    // String IDs, global indexes and method IDs are only meaningful within
+    // the interpreter that compiled the code, so an image carries its own
+    // tables of interned strings, global names and methods. Operands that
+    // refer to them are stored as indexes into those tables and are mapped
+    // to the loading interpreter's IDs when the image is read.
+    //
+    // An image contains:
+    //
+    // - The magic number and format version.
+    // - The interned strings used by message, field and method names.
+    // - The names of the globals the code refers to.
+    // - The number of distinct method IDs.
+    // - The top-level block. Each block has its method ID, parameter names,
+    //   register and upvalue counts, constants, contained blocks and
+    //   instructions.
+    //
+    // Instructions are stored with their operands at full width, and jumps
+    // with the index of the instruction they go to, so images don't depend on
+    // how many OP_WIDE prefixes the code needs.
+    class BytecodeImage
+    {
+    public:
+        // Writes the given top-level block and the blocks it contains to the
+        // stream.
+        static void Write(Interpreter & interpreter, const Block & block,
+                          std::ostream & stream);
+        
+        // Reads a block written by Write(). Returns a null reference and
+        // reports an error through the host if the image is invalid.
+        static Handle<Block> Read(Interpreter & interpreter, std::istream & stream);
+        
+        // Returns true if the stream starts with the magic number of a
+        // bytecode image. Does not consume any of it.
+        static bool IsImage(std::istream & stream);
+        
+        // The rest of this is for formats that embed blocks in a larger file,
+        // like heap snapshots. They use one BytecodeImage for the whole file
+        // so that its blocks and other data share the same tables.
+        BytecodeImage(Interpreter & interpreter);
+        
+        // Writes the block and the blocks it contains, adding any strings,
+        // globals and methods they use to the tables.
+        void WriteBlock(std::ostream & stream, const Block & block);
+        
+        // Adds the given string to the table and returns its index in it.
+        int  MapString(StringId id);
+        
+        // Writes the tables. Must come before anything that refers to them.
+        void WriteTables(std::ostream & stream);
+        
+        // Reads the tables written by WriteTables(), mapping everything in
+        // them to the interpreter's IDs. Returns false if they're invalid.
+        bool ReadTables(std::istream & stream);
+        
+        // Reads a block written by WriteBlock(). Returns a null reference if
+        // it's invalid.
+        Handle<Block> ReadBlock(std::istream & stream);
+        
+        // Reads an index written by MapString() and gets the interpreter's
+        // ID for it. Returns false if it's invalid.
+        bool ReadStringId(std::istream & stream, StringId * id);
+        
+        static void   WriteInt(std::ostream & stream, int value);
+        static void   WriteDouble(std::ostream & stream, double value);
+        static void   WriteString(std::ostream & stream, const String & value);
+        static int    ReadInt(std::istream & stream);
+        static double ReadDouble(std::istream & stream);
+        static String ReadString(std::istream & stream);
+        
+    private:
+        // Bumped whenever the format or the instruction set changes.
+        static const int VERSION = 7;
+        
+        int  MapMethodId(int methodId);
+        bool ReadMethodId(std::istream & stream, int * methodId);
+        
+        Interpreter & mInterpreter;
+        
+        // When writing, the strings and global names in the image.
+        StringTable   mStrings;
+        StringTable   mGlobals;
+        
+        // When writing, maps each method ID to its index in the image.
+        IdTable<int>  mMethods;
+        int           mNumMethods;
+        
+        // When reading, maps the image's indexes to the interpreter's IDs.
+        Array<StringId> mStringIds;
+        Array<int>      mGlobalIds;
+        Array<int>      mMethodIds;
+        
+        NO_COPY(BytecodeImage);
+    };
+}
+
@@ -9,6 +9,7 @@
 #include "NameExpr.h"
 #include "NumberExpr.h"
 #include "ObjectExpr.h"
+#include "Optimizer.h"
 #include "ReturnExpr.h"
 #include "SelfExpr.h"
 #include "SequenceExpr.h"
@@ -21,7 +22,7 @@ namespace Finch
 {
     int Compiler::sNextMethodId = 1;
     
-    Ref<Block> Compiler::CompileTopLevel(Interpreter & interpreter, const Expr & expr)
+    Handle<Block> Compiler::CompileTopLevel(Interpreter & interpreter, const Expr & expr)
     {
         Array<String> params;
         Compiler compiler(interpreter, NULL);
@@ -29,7 +30,7 @@ namespace Finch
         
         /*
         // TODO(bob): Testing!
-        compiler.mBlock->DebugDump(environment, "");
+        compiler.mBlock->DebugDump(interpreter, "");
         */
         
         return compiler.mBlock;
@@ -41,14 +42,19 @@ namespace Finch
         mBlock(),
         mInUseRegisters(0),
         mLocals(),
+        mScopeStart(0),
+        mCapturedLocals(),
+        mInlineControlFlow((parent == NULL) || parent->mInlineControlFlow),
         mObjectLiterals(),
+        mObjectLiteralBase(0),
         mHasReturn(false)
     {}
 
     void Compiler::Compile(int methodId, const Array<String> & params,
                            const Expr & expr)
     {
-        mBlock = Ref<Block>(new Block(methodId, params));
+        mBlock = Handle<Block>(new (mInterpreter.GetAllocator())
+                            Block(methodId, params));
         
         // Reserve registers for the params. These have to go first because the
         // caller will place them here.
@@ -58,28 +64,23 @@ namespace Finch
             mLocals.Add(params[i]);
         }
         
-        // TODO(bob): Instead of having an explicit register for the return,
-        // which is often redundant since the result will be in some previous
-        // register anyway many times, maybe pass a special DONT_CARE register
-        // and have the visitors know to provide a register as needed and then
-        // set some mReturnRegister member variable that we then use for the
-        // END instruction.
-        // Result register goes after params.
+        // Result register goes after params. It's often redundant since the
+        // result is already in some other register, but the optimizer will
+        // coalesce it away when it is.
         int resultRegister = ReserveRegister();
         // TODO(bob): Hackish. Add a fake local for it so that the indices in
         // mLocals correctly map local names -> register.
         mLocals.Add("(return)");
         
         expr.Accept(*this, resultRegister);
+        mBlock->Write(OP_END, resultRegister);
         
-        // TODO(bob): Not enabled yet because the VM doesn't support it.
-        // Need to figure out how it's going to work with the register window
-        // stuff for passing arguments.
-        /*
-        if (!mHasReturn) mBlock->MarkTailCall();
-        */
+        Optimizer::Optimize(*mBlock);
         
-        mBlock->Write(OP_END, resultRegister);
+        // If the block ends in a message send, turn it into a tail call so the
+        // callee can reuse this block's callframe. Methods that contain a
+        // return can't do this since the return needs to find their frame.
+        if (!mHasReturn) mBlock->MarkTailCall();
         
         // Now that all upvalues for this block are known (and its contained
         // blocks have also been compiled, which due to closure flattening may
@@ -89,10 +90,10 @@ namespace Finch
     
     void Compiler::Visit(const ArrayExpr & expr, int dest)
     {
+        int array = ReserveIfDiscarded(dest);
+        
         // Create the empty array.
-        // TODO(bob): Only allows arrays up to 255 elements. Should use two
-        // registers for size.
-        mBlock->Write(OP_ARRAY, expr.Elements().Count(), dest);
+        mBlock->Write(OP_ARRAY, expr.Elements().Count(), array);
         
         // Write the instructions to add each item.
         int elementReg = ReserveRegister();
@@ -102,51 +103,88 @@ namespace Finch
             expr.Elements()[i]->Accept(*this, elementReg);
             
             // Now add it to the array.
-            mBlock->Write(OP_ARRAY_ELEMENT, elementReg, dest);
+            mBlock->Write(OP_ARRAY_ELEMENT, elementReg, array);
         }
         ReleaseRegister();
+        
+        ReleaseIfDiscarded(dest);
     }
     
     void Compiler::Visit(const BindExpr & expr, int dest)
     {
+        int target = ReserveIfDiscarded(dest);
+        
         // Evaluate the object that stuff is being bound to.
-        expr.Target()->Accept(*this, dest);
+        expr.Target()->Accept(*this, target);
         
         // Bind the definitions.
-        CompileDefinitions(expr, dest);
+        CompileDefinitions(expr, target);
+        
+        ReleaseIfDiscarded(dest);
     }
     
     void Compiler::Visit(const BlockExpr & expr, int dest)
     {
+        // Creating a block has no side effects.
+        if (dest == DISCARD_REGISTER) return;
+        
         CompileNestedBlock(Block::BLOCK_METHOD_ID, expr, dest);
     }
     
     void Compiler::Visit(const MessageExpr & expr, int dest)
     {
+        if (CompileInlined(expr, dest)) return;
+        
+        // If the result isn't needed, a single send can put it in its own
+        // receiver register. A cascade needs the receiver for the later sends,
+        // so it gets a register for the result.
+        int result = dest;
+        if ((dest == DISCARD_REGISTER) && (expr.Messages().Count() > 1))
+        {
+            result = ReserveRegister();
+        }
+        
         // Load the receiver.
         int receiverReg = ReserveRegister();
         expr.Receiver()->Accept(*this, receiverReg);
+        if (result == DISCARD_REGISTER) result = receiverReg;
         
         // Compile each of the message sends.
         for (int i = 0; i < expr.Messages().Count(); i++)
         {
             const MessageSend & message = expr.Messages()[i];
+            OpCode op = MessageOp(message.GetName(),
+                                  message.GetArguments().Count());
             
-            // Compile the arguments.
+            // Compile the arguments. Literal blocks passed to a normal send
+            // start out on the fiber's stack.
+            bool borrows = false;
             for (int arg = 0; arg < message.GetArguments().Count(); arg++)
             {
                 int argReg = ReserveRegister();
-                message.GetArguments()[arg]->Accept(*this, argReg);
+                const Expr & argExpr = *message.GetArguments()[arg];
+                const BlockExpr * blockArg = argExpr.AsBlockExpr();
+                if ((op <= OP_MESSAGE_10) && (blockArg != NULL))
+                {
+                    CompileNestedBlock(Block::BLOCK_METHOD_ID, *blockArg,
+                                       argReg, true);
+                    borrows = true;
+                }
+                else
+                {
+                    argExpr.Accept(*this, argReg);
+                }
             }
             
             // Compile the message send.
-            // TODO(bob): Right now, we're only giving 8-bits to the name, which
-            // will run out quickly.
             StringId messageId = mInterpreter.AddString(message.GetName());
-            OpCode op = static_cast<OpCode>(OP_MESSAGE_0 +
-                message.GetArguments().Count());
-            
-            mBlock->Write(op, messageId, receiverReg, dest);
+            if (borrows)
+            {
+                mBlock->Write(OP_BORROW, receiverReg,
+                              message.GetArguments().Count());
+            }
+
+            mBlock->Write(op, messageId, receiverReg, result);
             
             // Free the argument registers.
             for (int arg = 0; arg < message.GetArguments().Count(); arg++)
@@ -157,21 +195,30 @@ namespace Finch
         
         // Free the receiver register.
         ReleaseRegister();
+        
+        if ((dest == DISCARD_REGISTER) && (expr.Messages().Count() > 1))
+        {
+            ReleaseRegister();
+        }
     }
     
     void Compiler::Visit(const NameExpr & expr, int dest)
     {
-        if (mParent == NULL)
+        // Even a discarded name needs a register since reading an undefined
+        // global is an error. The optimizer removes any other discarded reads.
+        int target = ReserveIfDiscarded(dest);
+        
+        if (IsTopLevel())
         {
             // Accessing a top-level name, so it's a global.
             int index = mInterpreter.DefineGlobal(expr.Name());
-            mBlock->Write(OP_GET_GLOBAL, index, dest);
+            mBlock->Write(OP_GET_GLOBAL, index, target);
         }
         else if (Expr::IsField(expr.Name()))
         {
             // Accessing a field.
             StringId index = mInterpreter.AddString(expr.Name());
-            mBlock->Write(OP_GET_FIELD, index, dest);
+            mBlock->Write(OP_GET_FIELD, index, target);
         }
         else
         {
@@ -185,12 +232,12 @@ namespace Finch
             if (isLocal)
             {
                 // Copy the local to the destination register.
-                mBlock->Write(OP_MOVE, index, dest);
+                mBlock->Write(OP_MOVE, index, target);
             }
             else if (resolvedUpvalue.IsValid())
             {
                 // Load the upvalue into the destination register.
-                mBlock->Write(OP_GET_UPVALUE, resolvedUpvalue.Slot(), dest);
+                mBlock->Write(OP_GET_UPVALUE, resolvedUpvalue.Slot(), target);
             }
             else
             {
@@ -199,28 +246,36 @@ namespace Finch
                 // as long as the name is initialized before it's actually
                 // accessed at runtime, this will work.
                 int index = mInterpreter.DefineGlobal(expr.Name());
-                mBlock->Write(OP_GET_GLOBAL, index, dest);
+                mBlock->Write(OP_GET_GLOBAL, index, target);
             }
         }
+        
+        ReleaseIfDiscarded(dest);
     }
         
     void Compiler::Visit(const NumberExpr & expr, int dest)
     {
+        if (dest == DISCARD_REGISTER) return;
+        
         Value number = mInterpreter.NewNumber(expr.GetValue());
         CompileConstant(number, dest);
     }
     
     void Compiler::Visit(const ObjectExpr & expr, int dest)
     {
+        int object = ReserveIfDiscarded(dest);
+        
         // Compile the parent. It will go into the same register that we'll
         // put the new object into.
-        expr.Parent()->Accept(*this, dest);
-        mBlock->Write(OP_OBJECT, dest);
+        expr.Parent()->Accept(*this, object);
+        mBlock->Write(OP_OBJECT, object);
         
         // Keep track of the fact that we're inside an object literal.
-        mObjectLiterals.Push(dest);
-        CompileDefinitions(expr, dest);
+        mObjectLiterals.Push(object);
+        CompileDefinitions(expr, object);
         mObjectLiterals.Pop();
+        
+        ReleaseIfDiscarded(dest);
     }
     
     void Compiler::Visit(const ReturnExpr & expr, int dest)
@@ -233,9 +288,11 @@ namespace Finch
         }
         
         // Compile the return value.
-        expr.Result()->Accept(*this, dest);
+        int result = ReserveIfDiscarded(dest);
+        expr.Result()->Accept(*this, result);
         
-        mBlock->Write(OP_RETURN, method->mBlock->MethodId(), dest);
+        mBlock->Write(OP_RETURN, method->mBlock->MethodId(), result);
+        ReleaseIfDiscarded(dest);
         
         // Disable tail calls for the method.
         method->mHasReturn = true;
@@ -243,9 +300,11 @@ namespace Finch
     
     void Compiler::Visit(const SelfExpr & expr, int dest)
     {
+        if (dest == DISCARD_REGISTER) return;
+        
         // If we're inside an object literal, `self` is statically bound to
         // the enclosing object.
-        if (mObjectLiterals.Count() > 0)
+        if (mObjectLiterals.Count() > mObjectLiteralBase)
         {
             int selfReg = mObjectLiterals.Peek();
             mBlock->Write(OP_MOVE, selfReg, dest);
@@ -259,18 +318,19 @@ namespace Finch
     
     void Compiler::Visit(const SequenceExpr & expr, int dest)
     {
-        // Compile each expression.
-        for (int i = 0; i < expr.Expressions().Count(); i++)
+        // Compile each expression. Only the last one's result is used.
+        int last = expr.Expressions().Count() - 1;
+        for (int i = 0; i < last; i++)
         {
-            // TODO(bob): Use DISCARD_REGISTER for all but last expr and make
-            // compiler use that to avoid some unnecessary work.
-            expr.Expressions()[i]->Accept(*this, dest);
+            expr.Expressions()[i]->Accept(*this, DISCARD_REGISTER);
         }
+        
+        if (last >= 0) expr.Expressions()[last]->Accept(*this, dest);
     }
     
     void Compiler::Visit(const SetExpr & expr, int dest)
     {
-        if (mParent == NULL)
+        if (IsTopLevel())
         {
             // Globals behave the same with <- and <--.
             CompileSetGlobal(expr.Name(), *expr.Value(), dest);
@@ -291,21 +351,31 @@ namespace Finch
             
             if (isLocal)
             {
-                // Evaluate the value directly into the local.
-                expr.Value()->Accept(*this, index);
+                // Evaluate the value before storing it, since it may read the
+                // local's old value after it has started writing the new one,
+                // like "list <-- #[item, list]" does. The optimizer writes it
+                // straight into the local when it can.
+                int value = ReserveRegister();
+                expr.Value()->Accept(*this, value);
+                mBlock->Write(OP_MOVE, value, index);
+                if (dest != DISCARD_REGISTER) mBlock->Write(OP_MOVE, value, dest);
+                ReleaseRegister();
             }
             else if (resolvedUpvalue.IsValid())
             {
                 // Evaluate the value.
-                expr.Value()->Accept(*this, dest);
+                int value = ReserveIfDiscarded(dest);
+                expr.Value()->Accept(*this, value);
                 
                 // Store the upvalue.
-                mBlock->Write(OP_SET_UPVALUE, resolvedUpvalue.Slot(), dest);
+                mBlock->Write(OP_SET_UPVALUE, resolvedUpvalue.Slot(), value);
+                ReleaseIfDiscarded(dest);
             }
             else
             {
                 // Evaluate the value.
-                expr.Value()->Accept(*this, dest);
+                int value = ReserveIfDiscarded(dest);
+                expr.Value()->Accept(*this, value);
                 
                 // See if a global with this name exists.
                 int index = mInterpreter.FindGlobal(expr.Name());
@@ -314,15 +384,18 @@ namespace Finch
                 if (index != -1)
                 {
                     // We're compiling a top-level expression, so define it as a global.
-                    mBlock->Write(OP_SET_GLOBAL, index, dest);
+                    mBlock->Write(OP_SET_GLOBAL, index, value);
                 }
+                ReleaseIfDiscarded(dest);
             }
         }
     }
     
     void Compiler::Visit(const StringExpr & expr, int dest)
     {
-        Value string = mInterpreter.NewString(expr.GetValue());
+        if (dest == DISCARD_REGISTER) return;
+        
+        Value string = mInterpreter.StringLiteral(expr.GetValue());
         CompileConstant(string, dest);
     }
     
@@ -332,7 +405,7 @@ namespace Finch
         // implementation doesn't totally work (for one thing, it doesn't
         // assign anything to dest, and it isn't clear what it *should* assign),
         // but it gets the test to pass.
-        int local = mLocals.IndexOf(expr.Name());
+        int local = FindLocal(expr.Name());
         if (local != -1)
         {
             mLocals[local] = "";
@@ -341,7 +414,7 @@ namespace Finch
     
     void Compiler::Visit(const VarExpr & expr, int dest)
     {
-        if (mParent == NULL)
+        if (IsTopLevel())
         {
             // We're at the top level, so it's a global.
             CompileSetGlobal(expr.Name(), *expr.Value(), dest);
@@ -352,9 +425,10 @@ namespace Finch
         }
         else
         {
-            // Doing <- on an existing name just assigns.
-            int local = mLocals.IndexOf(expr.Name());
-            if (local == -1) {
+            // Doing <- on an existing name just assigns, unless it's outside
+            // the inlined block being compiled, which gets its own.
+            int local = FindLocal(expr.Name());
+            if (local < mScopeStart) {
                 // Create a new local.
                 local = ReserveRegister();
                 mLocals.Add(expr.Name());
@@ -363,14 +437,23 @@ namespace Finch
                 // at register 0. NameExpr assumes that.
                 ASSERT(local == mLocals.Count() - 1,
                     "Local should be in right register.");
+                
+                // Evaluate the value and store in the local.
+                expr.Value()->Accept(*this, local);
+            }
+            else
+            {
+                // The value may refer to the local's old value, so evaluate it
+                // first. See Visit(SetExpr).
+                int value = ReserveRegister();
+                expr.Value()->Accept(*this, value);
+                mBlock->Write(OP_MOVE, value, local);
+                ReleaseRegister();
             }
-            
-            // Evaluate the value and store in the local.
-            expr.Value()->Accept(*this, local);
             
             // Also copy to the destination register.
             // Handles cases like: foo: bar <- baz
-            mBlock->Write(OP_MOVE, local, dest);
+            if (dest != DISCARD_REGISTER) mBlock->Write(OP_MOVE, local, dest);
         }
     }
     
@@ -392,7 +475,7 @@ namespace Finch
         }
         
         // See if the name is defined here.
-        int local = compiler->mLocals.IndexOf(name);
+        int local = compiler->FindLocal(name);
         if (local != -1)
         {
             if (compiler == this)
@@ -439,29 +522,34 @@ namespace Finch
     void Compiler::CompileSetGlobal(const String & name, const Expr & value, int dest)
     {
         // Evaluate the value.
-        value.Accept(*this, dest);
+        int valueReg = ReserveIfDiscarded(dest);
+        value.Accept(*this, valueReg);
         
         // We're compiling a top-level expression, so define it as a global.
         int index = mInterpreter.DefineGlobal(name);
-        mBlock->Write(OP_SET_GLOBAL, index, dest);
+        mBlock->Write(OP_SET_GLOBAL, index, valueReg);
+        ReleaseIfDiscarded(dest);
     }
     
     void Compiler::CompileSetField(const String & name, const Expr & value, int dest)
     {
-        value.Accept(*this, dest);
+        int valueReg = ReserveIfDiscarded(dest);
+        value.Accept(*this, valueReg);
         
         StringId nameId = mInterpreter.AddString(name);
-        mBlock->Write(OP_SET_FIELD, nameId, dest);
+        mBlock->Write(OP_SET_FIELD, nameId, valueReg);
+        ReleaseIfDiscarded(dest);
     }
 
-    void Compiler::CompileNestedBlock(int methodId, const BlockExpr & block, int dest)
+    void Compiler::CompileNestedBlock(int methodId, const BlockExpr & block, int dest,
+                                      bool onStack)
     {
         Compiler compiler(mInterpreter, this);
         compiler.Compile(methodId, block.Params(), *block.Body());
         
         int index = mBlock->AddBlock(compiler.mBlock);
         
-        mBlock->Write(OP_BLOCK, index, dest);
+        mBlock->Write(OP_BLOCK, index, dest, onStack ? 1 : 0xff);
 
         // Capture the upvalues.
         for (int i = 0; i < compiler.mUpvalues.Count(); i++)
@@ -471,6 +559,7 @@ namespace Finch
             {
                 // Closing over a local.
                 mBlock->Write(OP_CAPTURE_LOCAL, upvalue.Index());
+                mCapturedLocals.Add(upvalue.Index());
             }
             else
             {
@@ -482,8 +571,6 @@ namespace Finch
     
     void Compiler::CompileConstant(const Value & constant, int dest)
     {
-        // TODO(bob): Should check for duplicates. Only need one copy of any
-        // given constant.
         int index = mBlock->AddConstant(constant);
         mBlock->Write(OP_CONSTANT, index, dest);
     }
@@ -503,10 +590,8 @@ namespace Finch
                 BlockExpr & body = static_cast<BlockExpr &>(
                     *definition.GetBody());
                 
-                CompileNestedBlock(sNextMethodId++, body, value);
+                CompileNestedBlock(NewMethodId(), body, value);
                 
-                // TODO(bob): Right now, we're only giving 8-bits to the name,
-                // which will run out quickly.
                 mBlock->Write(OP_DEF_METHOD, name, value, dest);
             }
             else
@@ -520,6 +605,420 @@ namespace Finch
         }
     }
     
+    bool Compiler::CompileInlined(const MessageExpr & expr, int dest)
+    {
+        // A cascade needs its receiver for the later sends, so only a single
+        // send is inlined.
+        if (!mInlineControlFlow || (expr.Messages().Count() != 1)) return false;
+        
+        const MessageSend & message = expr.Messages()[0];
+        const Array<Ref<Expr> > & args = message.GetArguments();
+        String name = message.GetName();
+        
+        bool isEther = false;
+        bool isLogic = false;
+        if ((name == "if:then:") && IsBlockLiteral(args[1], 0))
+        {
+            isEther = true;
+        }
+        else if ((name == "if:then:else:") &&
+                 IsBlockLiteral(args[1], 0) && IsBlockLiteral(args[2], 0))
+        {
+            isEther = true;
+        }
+        else if ((name == "while:do:") &&
+                 IsBlockLiteral(args[0], 0) && IsBlockLiteral(args[1], 0))
+        {
+            isEther = true;
+        }
+        else if ((name == "from:to:do:") && IsBlockLiteral(args[2], 1))
+        {
+            isEther = true;
+        }
+        else if (((name == "and:") || (name == "or:")) &&
+                 IsBlockLiteral(args[0], 0))
+        {
+            isLogic = true;
+        }
+        
+        if (isEther && !IsEther(*expr.Receiver())) return false;
+        if (!isEther && !isLogic) return false;
+        
+        // The inlined code and the fallback both need somewhere to put the
+        // result, and it has to be below any registers a send might clobber.
+        int result = ReserveIfDiscarded(dest);
+        
+        if (isLogic)
+        {
+            CompileInlinedLogic(expr, result, dest);
+        }
+        else
+        {
+            int guard = mBlock->WriteJump(OP_GUARD_ETHER);
+            
+            if (name == "while:do:")
+            {
+                CompileInlinedWhile(message, result, dest);
+            }
+            else if (name == "from:to:do:")
+            {
+                CompileInlinedFromTo(message, result, dest);
+            }
+            else
+            {
+                CompileInlinedIf(message, result, dest);
+            }
+            
+            int done = mBlock->WriteJump(OP_JUMP);
+            mBlock->PatchJump(guard);
+            
+            int ether = ReserveRegister();
+            CompileGlobal("Ether", ether);
+            CompileFallback(message, ether, result);
+            ReleaseRegister();
+            
+            mBlock->PatchJump(done);
+        }
+        
+        ReleaseIfDiscarded(dest);
+        return true;
+    }
+    
+    void Compiler::CompileInlinedIf(const MessageSend & message, int result,
+                                    int dest)
+    {
+        // Like if-true:else:, only true itself picks the then branch. Any
+        // other condition picks the else branch, unless it has its own
+        // if-true:else: to decide.
+        const Array<Ref<Expr> > & args = message.GetArguments();
+        int condition = ReserveRegister();
+        args[0]->Accept(*this, condition);
+        int toElse = mBlock->WriteJump(OP_JUMP_IF_FALSE, condition);
+        
+        int branchDest = (dest == DISCARD_REGISTER) ? DISCARD_REGISTER : result;
+        CompileInlinedBody(*args[1]->AsBlockExpr(), NULL, branchDest);
+        
+        int done = mBlock->WriteJump(OP_JUMP);
+        mBlock->PatchJump(toElse);
+        int guard = mBlock->WriteJump(OP_GUARD_IF, condition);
+        
+        if (args.Count() == 3)
+        {
+            CompileInlinedBody(*args[2]->AsBlockExpr(), NULL, branchDest);
+        }
+        else if (dest != DISCARD_REGISTER)
+        {
+            CompileGlobal("nil", result);
+        }
+        
+        int elseDone = mBlock->WriteJump(OP_JUMP);
+        mBlock->PatchJump(guard);
+        CompileConditionFallback(message, condition, result);
+        
+        mBlock->PatchJump(done);
+        mBlock->PatchJump(elseDone);
+        ReleaseRegister();
+    }
+    
+    void Compiler::CompileInlinedWhile(const MessageSend & message, int result,
+                                       int dest)
+    {
+        const Array<Ref<Expr> > & args = message.GetArguments();
+        int loop = mBlock->Code().Count();
+        
+        int condition = ReserveRegister();
+        CompileInlinedBody(*args[0]->AsBlockExpr(), NULL, condition);
+        int exit = mBlock->WriteJump(OP_JUMP_IF_FALSE, condition);
+        
+        CompileInlinedBody(*args[1]->AsBlockExpr(), NULL, DISCARD_REGISTER);
+        mBlock->WriteLoop(loop);
+        
+        mBlock->PatchJump(exit);
+        int guard = mBlock->WriteJump(OP_GUARD_IF, condition);
+        if (dest != DISCARD_REGISTER) CompileGlobal("nil", result);
+        
+        int done = mBlock->WriteJump(OP_JUMP);
+        mBlock->PatchJump(guard);
+        CompileConditionFallback(message, condition, result);
+        
+        mBlock->PatchJump(done);
+        ReleaseRegister();
+    }
+    
+    void Compiler::CompileInlinedFromTo(const MessageSend & message, int result,
+                                        int dest)
+    {
+        // This does what from:to:do: and from:to:step:do: in the core library
+        // do: count up or down by one while the counter is <= the end.
+        const Array<Ref<Expr> > & args = message.GetArguments();
+        int counter = ReserveRegister();
+        args[0]->Accept(*this, counter);
+        int end = ReserveRegister();
+        args[1]->Accept(*this, end);
+        int step = ReserveRegister();
+        
+        StringId lessEqual = mInterpreter.AddString("<=");
+        StringId plus = mInterpreter.AddString("+");
+        int left = ReserveRegister();
+        int right = ReserveRegister();
+        
+        mBlock->Write(OP_MOVE, counter, left);
+        mBlock->Write(OP_MOVE, end, right);
+        mBlock->Write(OP_LESS_EQUAL, lessEqual, left, left);
+        int down = mBlock->WriteJump(OP_JUMP_IF_FALSE, left);
+        CompileConstant(mInterpreter.NewNumber(1), step);
+        int up = mBlock->WriteJump(OP_JUMP);
+        mBlock->PatchJump(down);
+        CompileConstant(mInterpreter.NewNumber(-1), step);
+        mBlock->PatchJump(up);
+        
+        int loop = mBlock->Code().Count();
+        mBlock->Write(OP_MOVE, counter, left);
+        mBlock->Write(OP_MOVE, end, right);
+        mBlock->Write(OP_LESS_EQUAL, lessEqual, left, left);
+        int exit = mBlock->WriteJump(OP_JUMP_IF_FALSE, left);
+        ReleaseRegister();
+        ReleaseRegister();
+        
+        // The block gets a copy of the counter, so changing it doesn't change
+        // the loop.
+        int param = mInUseRegisters;
+        mBlock->Write(OP_MOVE, counter, param);
+        CompileInlinedBody(*args[2]->AsBlockExpr(), &param, DISCARD_REGISTER);
+        
+        left = ReserveRegister();
+        right = ReserveRegister();
+        mBlock->Write(OP_MOVE, counter, left);
+        mBlock->Write(OP_MOVE, step, right);
+        mBlock->Write(OP_ADD, plus, left, counter);
+        ReleaseRegister();
+        ReleaseRegister();
+        mBlock->WriteLoop(loop);
+        
+        mBlock->PatchJump(exit);
+        ReleaseRegister();
+        ReleaseRegister();
+        ReleaseRegister();
+        
+        if (dest != DISCARD_REGISTER) CompileGlobal("nil", result);
+    }
+    
+    void Compiler::CompileInlinedLogic(const MessageExpr & expr, int result,
+                                       int dest)
+    {
+        // This does what and: and or: in the core library do: send true? to
+        // the receiver, then to the argument's result if that decides it.
+        const MessageSend & message = expr.Messages()[0];
+        bool isAnd = message.GetName() == "and:";
+        StringId isTrue = mInterpreter.AddString("true?");
+        
+        int receiver = ReserveRegister();
+        expr.Receiver()->Accept(*this, receiver);
+        int guard = mBlock->WriteJump(OP_GUARD_LOGIC, receiver);
+        
+        mBlock->Write(OP_MESSAGE_0, isTrue, receiver, receiver);
+        int toShortCircuit = mBlock->WriteJump(OP_JUMP_IF_FALSE, receiver);
+        
+        // If it's and:, the receiver was true so the argument decides.
+        // Otherwise, the receiver was true so the answer is true.
+        if (isAnd)
+        {
+            CompileInlinedBody(*message.GetArguments()[0]->AsBlockExpr(), NULL,
+                               receiver);
+            mBlock->Write(OP_MESSAGE_0, isTrue, receiver, result);
+        }
+        else if (dest != DISCARD_REGISTER)
+        {
+            CompileGlobal("true", result);
+        }
+        
+        int done = mBlock->WriteJump(OP_JUMP);
+        mBlock->PatchJump(toShortCircuit);
+        
+        if (!isAnd)
+        {
+            CompileInlinedBody(*message.GetArguments()[0]->AsBlockExpr(), NULL,
+                               receiver);
+            mBlock->Write(OP_MESSAGE_0, isTrue, receiver, result);
+        }
+        else if (dest != DISCARD_REGISTER)
+        {
+            CompileGlobal("false", result);
+        }
+        
+        int done2 = mBlock->WriteJump(OP_JUMP);
+        mBlock->PatchJump(guard);
+        CompileFallback(message, receiver, result);
+        
+        mBlock->PatchJump(done);
+        mBlock->PatchJump(done2);
+        ReleaseRegister();
+    }
+    
+    void Compiler::CompileFallback(const MessageSend & message, int receiver,
+                                   int result, int firstArg)
+    {
+        // This only runs once the guard has failed, so inlining the control
+        // flow in it again would just be wasted code.
+        bool inlineControlFlow = mInlineControlFlow;
+        mInlineControlFlow = false;
+        
+        const Array<Ref<Expr> > & args = message.GetArguments();
+        for (int i = 0; i < args.Count(); i++)
+        {
+            int arg = ReserveRegister();
+            if ((i == 0) && (firstArg != -1))
+            {
+                mBlock->Write(OP_MOVE, firstArg, arg);
+            }
+            else
+            {
+                args[i]->Accept(*this, arg);
+            }
+        }
+        
+        StringId messageId = mInterpreter.AddString(message.GetName());
+        mBlock->Write(MessageOp(message.GetName(), args.Count()), messageId,
+                      receiver, result);
+        
+        for (int i = 0; i < args.Count(); i++) ReleaseRegister();
+        
+        mInlineControlFlow = inlineControlFlow;
+    }
+    
+    void Compiler::CompileConditionFallback(const MessageSend & message,
+                                            int condition, int result)
+    {
+        // The condition has already been evaluated, so this picks up where
+        // the core library's method would be after evaluating it, by sending
+        // it to if:then: or if:then:else:. For while:do:, the then branch
+        // runs the body and goes on with the loop.
+        const Array<Ref<Expr> > & args = message.GetArguments();
+        Array<Ref<Expr> > branches;
+        if (message.GetName() == "while:do:")
+        {
+            Array<Ref<Expr> > loop;
+            loop.Add(args[1]->AsBlockExpr()->Body());
+            loop.Add(Ref<Expr>(new MessageExpr(Ref<Expr>(new NameExpr("Ether")),
+                                               message.GetName(), args)));
+            
+            branches.Add(Ref<Expr>(new BlockExpr(Array<String>(),
+                Ref<Expr>(new SequenceExpr(loop)))));
+        }
+        else
+        {
+            for (int i = 1; i < args.Count(); i++) branches.Add(args[i]);
+        }
+        
+        Array<Ref<Expr> > ifArgs;
+        ifArgs.Add(Ref<Expr>());
+        ifArgs.AddAll(branches);
+        MessageSend send((branches.Count() == 2) ? "if:then:else:" : "if:then:",
+                         ifArgs);
+        
+        int ether = ReserveRegister();
+        CompileGlobal("Ether", ether);
+        CompileFallback(send, ether, result, condition);
+        ReleaseRegister();
+    }
+    
+    void Compiler::CompileInlinedBody(const BlockExpr & block,
+                                      const int * params, int dest)
+    {
+        Scope scope;
+        BeginScope(&scope);
+        
+        for (int i = 0; i < block.Params().Count(); i++)
+        {
+            int param = ReserveRegister();
+            mLocals.Add(block.Params()[i]);
+            ASSERT(param == params[i], "Parameter should be in right register.");
+            (void)param;
+        }
+        
+        block.Body()->Accept(*this, dest);
+        EndScope(scope);
+    }
+    
+    void Compiler::BeginScope(Scope * scope)
+    {
+        scope->numRegisters = mInUseRegisters;
+        scope->numLocals = mLocals.Count();
+        scope->scopeStart = mScopeStart;
+        scope->objectLiteralBase = mObjectLiteralBase;
+        
+        // New locals go in the next free register, so fill the gap with
+        // names nothing can refer to.
+        while (mLocals.Count() < mInUseRegisters) mLocals.Add("");
+        
+        mScopeStart = mLocals.Count();
+        mObjectLiteralBase = mObjectLiterals.Count();
+    }
+    
+    void Compiler::EndScope(const Scope & scope)
+    {
+        // The scope's registers are about to be reused, so any closures that
+        // captured its locals need their own copies.
+        int lowest = -1;
+        int count = 0;
+        for (int i = 0; i < mCapturedLocals.Count(); i++)
+        {
+            int local = mCapturedLocals[i];
+            if (local < mScopeStart)
+            {
+                mCapturedLocals[count++] = local;
+            }
+            else if ((lowest == -1) || (local < lowest))
+            {
+                lowest = local;
+            }
+        }
+        
+        mCapturedLocals.Truncate(count);
+        if (lowest != -1) mBlock->Write(OP_CLOSE_UPVALUES, lowest);
+        
+        while (mInUseRegisters > scope.numRegisters) ReleaseRegister();
+        mLocals.Truncate(scope.numLocals);
+        mScopeStart = scope.scopeStart;
+        mObjectLiteralBase = scope.objectLiteralBase;
+    }
+    
+    void Compiler::CompileGlobal(const char * name, int dest)
+    {
+        int index = mInterpreter.DefineGlobal(name);
+        mBlock->Write(OP_GET_GLOBAL, index, dest);
+    }
+    
+    bool Compiler::IsBlockLiteral(const Ref<Expr> & arg, int numParams)
+    {
+        const BlockExpr * block = arg->AsBlockExpr();
+        return (block != NULL) && (block->Params().Count() == numParams);
+    }
+    
+    bool Compiler::IsEther(const Expr & receiver)
+    {
+        const NameExpr * name = receiver.AsNameExpr();
+        if ((name == NULL) || (name->Name() != "Ether")) return false;
+        
+        for (Compiler * compiler = this; compiler != NULL;
+             compiler = compiler->mParent)
+        {
+            if (compiler->FindLocal("Ether") != -1) return false;
+        }
+        
+        return true;
+    }
+    
+    int Compiler::FindLocal(const String & name) const
+    {
+        for (int i = mLocals.Count() - 1; i >= 0; i--)
+        {
+            if (mLocals[i] == name) return i;
+        }
+        
+        return -1;
+    }
+    
     Compiler * Compiler::GetEnclosingMethod()
     {
         Compiler * compiler = this;
@@ -532,6 +1031,30 @@ namespace Finch
         return compiler;
     }
     
+    OpCode Compiler::MessageOp(const String & name, int numArgs)
+    {
+        if (numArgs == 1)
+        {
+            if (name == "+")   return OP_ADD;
+            if (name == "-")   return OP_SUBTRACT;
+            if (name == "*")   return OP_MULTIPLY;
+            if (name == "/")   return OP_DIVIDE;
+            if (name == "=")   return OP_EQUAL;
+            if (name == "!=")  return OP_NOT_EQUAL;
+            if (name == "<")   return OP_LESS;
+            if (name == ">")   return OP_GREATER;
+            if (name == "<=")  return OP_LESS_EQUAL;
+            if (name == ">=")  return OP_GREATER_EQUAL;
+            if (name == "at:") return OP_AT;
+        }
+        else if ((numArgs == 2) && (name == "at:put:"))
+        {
+            return OP_AT_PUT;
+        }
+    
+        return static_cast<OpCode>(OP_MESSAGE_0 + numArgs);
+    }
+    
     int Compiler::ReserveRegister()
     {
         mInUseRegisters++;
@@ -548,5 +1071,16 @@ namespace Finch
     {
         mInUseRegisters--;
     }
+    
+    int Compiler::ReserveIfDiscarded(int dest)
+    {
+        if (dest == DISCARD_REGISTER) return ReserveRegister();
+        return dest;
+    }
+    
+    void Compiler::ReleaseIfDiscarded(int dest)
+    {
+        if (dest == DISCARD_REGISTER) ReleaseRegister();
+    }
 }
 
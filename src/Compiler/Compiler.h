@@ -5,6 +5,7 @@
 #include "Array.h"
 #include "Block.h"
 #include "Expr.h"
+#include "Handle.h"
 #include "Macros.h"
 #include "IExprCompiler.h"
 #include "Object.h"
@@ -14,13 +15,17 @@
 namespace Finch
 {
     class DefineExpr;
+    class MessageSend;
     
     class Compiler : private IExprCompiler
     {
     public:
         // Compiles the given expression to a new top-level block. Used for
         // compiling REPL expressions.
-        static Ref<Block> CompileTopLevel(Interpreter & interpreter, const Expr & expr);
+        static Handle<Block> CompileTopLevel(Interpreter & interpreter, const Expr & expr);
+        
+        // Gets a method ID that hasn't been used by any other method.
+        static int NewMethodId() { return sNextMethodId++; }
         
     private:
         class Upvalue
@@ -51,6 +56,15 @@ namespace Finch
             int  mSlot;
         };
         
+        // What an inlined block's scope puts back when it ends.
+        struct Scope
+        {
+            int numRegisters;
+            int numLocals;
+            int scopeStart;
+            int objectLiteralBase;
+        };
+        
         // Every expression except the last in a sequence discards its result
         // value. This special register number is used to avoid some unnecessary
         // instructions if we know the result will be trashed anyway.
@@ -82,26 +96,102 @@ namespace Finch
             Upvalue * outResolvedUpvalue);
         void CompileSetGlobal(const String & name, const Expr & value, int dest);
         void CompileSetField(const String & name, const Expr & value, int dest);
-        void CompileNestedBlock(int methodId, const BlockExpr & block, int dest);
+        
+        // Compiles a block literal. If onStack is true, the block is only
+        // used as an argument to the send right after it, so the fiber can
+        // keep it on its stack unless OP_BORROW finds that it escapes.
+        void CompileNestedBlock(int methodId, const BlockExpr & block, int dest,
+                                bool onStack = false);
         void CompileConstant(const Value & constant, int dest);
         void CompileDefinitions(const DefineExpr & expr, int dest);
+        
+        // Compiles a send of one of the control flow messages whose block
+        // arguments are literals (if:then:, while:do: and so on) to jumps,
+        // with a guard that sends the message normally if Ether or the core
+        // methods have been changed. Returns false without writing anything
+        // if the send isn't one of those.
+        bool CompileInlined(const MessageExpr & expr, int dest);
+        void CompileInlinedIf(const MessageSend & message, int result, int dest);
+        void CompileInlinedWhile(const MessageSend & message, int result, int dest);
+        void CompileInlinedFromTo(const MessageSend & message, int result, int dest);
+        void CompileInlinedLogic(const MessageExpr & expr, int result, int dest);
+        
+        // Compiles the normal send that inlined code falls back to. The
+        // receiver must already be in its register. If firstArg isn't -1,
+        // the first argument has already been evaluated into that register.
+        void CompileFallback(const MessageSend & message, int receiver,
+                             int result, int firstArg = -1);
+        
+        // Compiles the send an inlined if:then: or while:do: falls back to
+        // when its condition has its own if-true:else:.
+        void CompileConditionFallback(const MessageSend & message,
+                                      int condition, int result);
+        
+        // Compiles the body of a literal block in place, with its parameters
+        // in the given registers. Any upvalues it captures are closed at the
+        // end, so each time it's run gets fresh variables.
+        void CompileInlinedBody(const BlockExpr & block, const int * params,
+                                int dest);
+        
+        void BeginScope(Scope * scope);
+        void EndScope(const Scope & scope);
+        
+        // Writes the value of one of the built-in globals, like nil.
+        void CompileGlobal(const char * name, int dest);
+        
+        // Gets whether the argument is a literal block with the given number
+        // of parameters.
+        static bool IsBlockLiteral(const Ref<Expr> & arg, int numParams);
+        
+        // Gets whether the receiver is Ether and not some local named that.
+        bool IsEther(const Expr & receiver);
+        
+        // Gets the index of the innermost local with the given name, or -1.
+        int FindLocal(const String & name) const;
+        
+        // Gets whether names here are globals. That's only true at the top
+        // level, outside of any inlined block.
+        bool IsTopLevel() const { return (mParent == NULL) && (mScopeStart == 0); }
 
         Compiler * GetEnclosingMethod();
 
+        // Gets the opcode for sending the given message: a superinstruction
+        // if it has one, otherwise the plain send for its argument count.
+        static OpCode MessageOp(const String & name, int numArgs);
+
         int ReserveRegister();
         void ReleaseRegister();
         
+        // Gets a register to evaluate into for an expression that needs one
+        // even if its result is discarded. Returns dest unless it's
+        // DISCARD_REGISTER, in which case it reserves a scratch register that
+        // ReleaseIfDiscarded() frees.
+        int ReserveIfDiscarded(int dest);
+        void ReleaseIfDiscarded(int dest);
+        
         static int sNextMethodId;
         
         Interpreter & mInterpreter;
         // The compiler for the block containing the block this one is compiling
         // or NULL if this is compiling a top-level block.
         Compiler * mParent;
-        Ref<Block> mBlock;
+        Handle<Block> mBlock;
         int mInUseRegisters;
         
-        // Names of local variables declared in this block.
+        // Names of local variables declared in this block. The index of each
+        // is its register.
         Array<String> mLocals;
+        
+        // The first local in the innermost inlined block being compiled, or
+        // zero if there isn't one.
+        int mScopeStart;
+        
+        // The registers of locals that nested blocks have captured.
+        Array<int> mCapturedLocals;
+        
+        // Whether to inline control flow messages. Code that only runs once
+        // the guard has failed doesn't bother.
+        bool mInlineControlFlow;
         Array<Upvalue> mUpvalues;
         
         // Registers containing the currently enclosing object literals. Within
@@ -109,6 +199,11 @@ namespace Finch
         // will refer to the enclosing object and not the current dynamically
         // bound self.
         Stack<int> mObjectLiterals;
+        
+        // How many of mObjectLiterals are outside the innermost inlined
+        // block. A block literal doesn't see them, so neither does its
+        // inlined body.
+        int mObjectLiteralBase;
 
         // `true` if this method contains a `return` expression or contains a
         // block that does. Used to disable tail call elimination in methods
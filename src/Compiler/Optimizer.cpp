@@ -0,0 +1,802 @@
+#include "Optimizer.h"
+
+namespace Finch
+{
+    OptimizerStats Optimizer::sStats = { 0, 0, 0, 0 };
+
+    void Optimizer::Optimize(Block & block)
+    {
+        sStats.instructionsBefore += block.Code().Count();
+        sStats.registersBefore += block.NumRegisters();
+
+        Optimizer optimizer(block);
+        optimizer.Decode();
+
+        // Each pass can open up more work for the others, so keep going until
+        // none of them finds anything.
+        bool changed = true;
+        while (changed)
+        {
+            changed = optimizer.PropagateCopies();
+            changed = optimizer.CoalesceMoves() || changed;
+            changed = optimizer.RemoveDeadStores() || changed;
+            changed = optimizer.ThreadJumps() || changed;
+        }
+
+        optimizer.CompactRegisters();
+        optimizer.FindBorrowedParams();
+        optimizer.Encode();
+
+        sStats.instructionsAfter += block.Code().Count();
+        sStats.registersAfter += block.NumRegisters();
+    }
+
+    void Optimizer::ResetStats()
+    {
+        sStats.instructionsBefore = 0;
+        sStats.instructionsAfter = 0;
+        sStats.registersBefore = 0;
+        sStats.registersAfter = 0;
+    }
+
+    Optimizer::Optimizer(Block & block)
+    :   mBlock(block),
+        mCode(),
+        mNumRegisters(block.NumRegisters()),
+        mCaptured(block.NumRegisters(), false),
+        mLiveOut(),
+        mMaxLiveAfter(),
+        mIsTarget()
+    {}
+
+    void Optimizer::Decode()
+    {
+        mBlock.Decode(mCode);
+
+        for (int i = 0; i < mCode.Count(); i++)
+        {
+            if (mCode[i].op == OP_CAPTURE_LOCAL) mCaptured[mCode[i].a] = true;
+        }
+    }
+
+    void Optimizer::Encode()
+    {
+        mBlock.Encode(mCode);
+        mBlock.SetNumRegisters(mNumRegisters);
+    }
+
+    bool Optimizer::PropagateCopies()
+    {
+        FindLiveRegisters();
+        FindJumpTargets();
+
+        // For each register, the register it's currently a copy of, or -1.
+        Array<int> copyOf(mNumRegisters, -1);
+        bool changed = false;
+
+        for (int i = 0; i < mCode.Count(); i++)
+        {
+            Op & op = mCode[i];
+
+            // Copies made on the way here may not have been made on the way
+            // from a jump.
+            if (mIsTarget[i])
+            {
+                for (int reg = 0; reg < mNumRegisters; reg++) copyOf[reg] = -1;
+            }
+
+            int * operands[4];
+            int numOperands = ReplaceableReads(op, operands);
+            for (int j = 0; j < numOperands; j++)
+            {
+                int source = copyOf[*operands[j]];
+                if (source == -1) continue;
+
+                *operands[j] = source;
+                changed = true;
+            }
+
+            // A send with no arguments can use the original as its receiver,
+            // as long as nothing that's still needed lives in the registers
+            // above it that the callee will now overwrite.
+            if ((NumArgs(op.op) == 0) && (copyOf[op.b] != -1) &&
+                (mMaxLiveAfter[i] <= copyOf[op.b]))
+            {
+                op.b = copyOf[op.b];
+                changed = true;
+            }
+
+            // Forget any copies this instruction invalidates.
+            int written = WrittenRegister(op);
+            int clobbered = IsMessage(op.op) ? op.b : mNumRegisters;
+            for (int reg = 0; reg < mNumRegisters; reg++)
+            {
+                if ((reg == written) || (reg > clobbered) ||
+                    (copyOf[reg] == written) || (copyOf[reg] > clobbered))
+                {
+                    copyOf[reg] = -1;
+                }
+            }
+
+            if ((op.op == OP_MOVE) && (op.a != op.b) &&
+                !mCaptured[op.a] && !mCaptured[op.b])
+            {
+                copyOf[op.b] = op.a;
+            }
+        }
+
+        return changed;
+    }
+
+    bool Optimizer::CoalesceMoves()
+    {
+        FindJumpTargets();
+        bool changed = false;
+
+        // Look for a move out of a register that was written just to be moved
+        // and write the destination directly instead. Only straight-line code
+        // between the two is considered.
+        for (int move = 0; move < mCode.Count(); move++)
+        {
+            Op & op = mCode[move];
+            if (op.op != OP_MOVE) continue;
+
+            int source = op.a;
+            int dest = op.b;
+            if ((source == dest) || mCaptured[source] || mCaptured[dest]) continue;
+            if (IsReadAfter(source, move)) continue;
+
+            for (int i = move - 1; i >= 0; i--)
+            {
+                if (mIsTarget[i + 1]) break;
+
+                Op & def = mCode[i];
+                if (def.op == OP_REMOVED) continue;
+                if (Block::IsJump(def.op)) break;
+
+                if (WrittenRegister(def) == source)
+                {
+                    int * operand = RetargetableOperand(def);
+                    if (operand != NULL)
+                    {
+                        *operand = dest;
+                        op.op = OP_REMOVED;
+                        changed = true;
+                    }
+                    break;
+                }
+
+                // The source must not be used anywhere else and the dest must
+                // keep its value from the definition to the move.
+                if (Reads(def, source) || Reads(def, dest) ||
+                    (WrittenRegister(def) == dest) ||
+                    (IsMessage(def.op) && (dest > def.b)))
+                {
+                    break;
+                }
+            }
+        }
+
+        RemoveOps();
+        return changed;
+    }
+
+    bool Optimizer::RemoveDeadStores()
+    {
+        // Captured registers are always treated as live. Sends don't count as
+        // writing the registers above their receiver since whether they do
+        // depends on what gets called.
+        FindLiveRegisters();
+        bool changed = false;
+
+        for (int i = 0; i < mCode.Count(); i++)
+        {
+            Op & op = mCode[i];
+
+            int written = WrittenRegister(op);
+            if ((IsPure(op.op) && !IsLiveAfter(i, written)) ||
+                ((op.op == OP_MOVE) && (op.a == op.b)))
+            {
+                // Take the captures with the block.
+                op.op = OP_REMOVED;
+                for (int j = i + 1; j < mCode.Count(); j++)
+                {
+                    if ((mCode[j].op != OP_CAPTURE_LOCAL) &&
+                        (mCode[j].op != OP_CAPTURE_UPVALUE)) break;
+
+                    mCode[j].op = OP_REMOVED;
+                }
+
+                changed = true;
+            }
+        }
+
+        RemoveOps();
+        return changed;
+    }
+
+    bool Optimizer::ThreadJumps()
+    {
+        bool changed = false;
+
+        for (int i = 0; i < mCode.Count(); i++)
+        {
+            Op & op = mCode[i];
+            if (!Block::IsJump(op.op) || (op.op == OP_LOOP)) continue;
+
+            // Jump straight to where a jump to a jump ends up. The count
+            // stops an infinite loop of jumps from hanging the compiler.
+            for (int hops = 0; hops < mCode.Count(); hops++)
+            {
+                const Op & target = mCode[op.a];
+                if ((target.op != OP_JUMP) || (target.a == op.a)) break;
+
+                op.a = target.a;
+                changed = true;
+            }
+
+            if (op.op != OP_JUMP) continue;
+
+            if (mCode[op.a].op == OP_END)
+            {
+                // Return right away instead of jumping to do it. This can
+                // put a send right before an OP_END so it becomes a tail call.
+                op = mCode[op.a];
+                changed = true;
+            }
+            else if (op.a == i + 1)
+            {
+                op.op = OP_REMOVED;
+                changed = true;
+            }
+        }
+
+        RemoveOps();
+        return changed;
+    }
+
+    void Optimizer::CompactRegisters()
+    {
+        // Parameters are always used since the caller puts them there.
+        Array<bool> used(mNumRegisters, false);
+        for (int reg = 0; reg < mBlock.Params().Count(); reg++) used[reg] = true;
+
+        for (int i = 0; i < mCode.Count(); i++)
+        {
+            const Op & op = mCode[i];
+
+            int written = WrittenRegister(op);
+            if (written != -1) used[written] = true;
+
+            for (int reg = 0; reg < mNumRegisters; reg++)
+            {
+                if (Reads(op, reg)) used[reg] = true;
+            }
+        }
+
+        // Give each used register a new number, keeping them in order. That
+        // keeps each send's arguments right after its receiver and keeps
+        // every register that was above a receiver above it.
+        Array<int> renumber(mNumRegisters, -1);
+        int numUsed = 0;
+        for (int reg = 0; reg < mNumRegisters; reg++)
+        {
+            if (used[reg]) renumber[reg] = numUsed++;
+        }
+
+        for (int i = 0; i < mCode.Count(); i++)
+        {
+            Op & op = mCode[i];
+            switch (op.op)
+            {
+                case OP_CONSTANT:
+                case OP_BLOCK:
+                case OP_ARRAY:
+                case OP_GET_UPVALUE:
+                case OP_SET_UPVALUE:
+                case OP_GET_FIELD:
+                case OP_SET_FIELD:
+                case OP_GET_GLOBAL:
+                case OP_SET_GLOBAL:
+                case OP_RETURN:
+                    op.b = renumber[op.b];
+                    break;
+
+                case OP_JUMP_IF_FALSE:
+                case OP_GUARD_LOGIC:
+                case OP_GUARD_IF:
+                    op.b = renumber[op.b];
+                    break;
+
+                case OP_OBJECT:
+                case OP_SELF:
+                case OP_END:
+                case OP_CAPTURE_LOCAL:
+                case OP_CLOSE_UPVALUES:
+                    op.a = renumber[op.a];
+                    break;
+
+                case OP_ARRAY_ELEMENT:
+                case OP_MOVE:
+                    op.a = renumber[op.a];
+                    op.b = renumber[op.b];
+                    break;
+
+                case OP_DEF_METHOD:
+                case OP_DEF_FIELD:
+                    op.b = renumber[op.b];
+                    op.c = renumber[op.c];
+                    break;
+
+                default:
+                    if (IsMessage(op.op))
+                    {
+                        op.b = renumber[op.b];
+                        op.c = renumber[op.c];
+                    }
+                    break;
+            }
+        }
+
+        mNumRegisters = numUsed;
+    }
+
+    void Optimizer::FindBorrowedParams()
+    {
+        int numParams = mBlock.Params().Count();
+        if (numParams > Block::MAX_BORROWED_PARAMS)
+        {
+            numParams = Block::MAX_BORROWED_PARAMS;
+        }
+
+        // Walk forwards tracking which parameters each register may hold a
+        // copy of, as a mask. A parameter escapes if a copy of it is read by
+        // anything other than a move or a send, or is moved into a register
+        // that a nested block captured. Capturing a register that already
+        // holds one is fine since OP_BLOCK moves it to the heap then. Loops
+        // can carry copies back to their start, so go around until nothing
+        // changes.
+        int numRegisters = mNumRegisters;
+        Array<int> holdsIn(mCode.Count() * numRegisters, 0);
+        for (int reg = 0; reg < numParams; reg++) holdsIn[reg] = 1 << reg;
+
+        Array<int> holdsOut(numRegisters, 0);
+        int escaped = 0;
+
+        bool changed = numParams > 0;
+        while (changed)
+        {
+            changed = false;
+            for (int i = 0; i < mCode.Count(); i++)
+            {
+                const Op & op = mCode[i];
+                const int * holds = &holdsIn[i * numRegisters];
+
+                for (int reg = 0; reg < numRegisters; reg++)
+                {
+                    holdsOut[reg] = holds[reg];
+                    if (holds[reg] == 0) continue;
+
+                    if (Reads(op, reg) && (op.op != OP_MOVE) &&
+                        (op.op != OP_CAPTURE_LOCAL) &&
+                        (op.op != OP_CLOSE_UPVALUES) && !IsPlainSend(op.op))
+                    {
+                        escaped |= holds[reg];
+                    }
+                }
+                
+                if ((op.op == OP_MOVE) && mCaptured[op.b])
+                {
+                    escaped |= holds[op.a];
+                }
+
+                // Forget what the instruction overwrites.
+                int written = WrittenRegister(op);
+                int clobbered = IsMessage(op.op) ? op.b : numRegisters;
+                for (int reg = 0; reg < numRegisters; reg++)
+                {
+                    if ((reg == written) || (reg > clobbered)) holdsOut[reg] = 0;
+                }
+
+                if (op.op == OP_MOVE) holdsOut[op.b] = holds[op.a];
+
+                int successors[2];
+                int numSuccessors = Successors(i, successors);
+                for (int j = 0; j < numSuccessors; j++)
+                {
+                    int * successorHolds = &holdsIn[successors[j] * numRegisters];
+                    for (int reg = 0; reg < numRegisters; reg++)
+                    {
+                        int merged = successorHolds[reg] | holdsOut[reg];
+                        if (merged != successorHolds[reg])
+                        {
+                            successorHolds[reg] = merged;
+                            changed = true;
+                        }
+                    }
+                }
+            }
+        }
+
+        int borrowed = ((1 << numParams) - 1) & ~escaped;
+        mBlock.SetBorrowedParams(borrowed);
+
+        // Sends that pass on a borrowed parameter need to check whether what
+        // they call will keep it. The compiler has already put an OP_BORROW
+        // before the sends that pass literal blocks.
+        Array<Op> code;
+        Array<int> newIndex(mCode.Count(), 0);
+        for (int i = 0; i < mCode.Count(); i++)
+        {
+            const Op & op = mCode[i];
+            newIndex[i] = code.Count();
+
+            bool borrows = false;
+            if (IsPlainSend(op.op) &&
+                ((i == 0) || (mCode[i - 1].op != OP_BORROW)))
+            {
+                for (int reg = op.b; reg <= op.b + NumArgs(op.op); reg++)
+                {
+                    if ((holdsIn[i * numRegisters + reg] & borrowed) != 0)
+                    {
+                        borrows = true;
+                    }
+                }
+            }
+
+            if (borrows)
+            {
+                Op borrow = { OP_BORROW, 0, 0, 0xff };
+                code.Add(borrow);
+            }
+
+            code.Add(op);
+        }
+
+        for (int i = 0; i < code.Count(); i++)
+        {
+            // A jump to a send now goes to its OP_BORROW.
+            if (Block::IsJump(code[i].op)) code[i].a = newIndex[code[i].a];
+
+            // The other passes leave OP_BORROW alone, so this is where it
+            // learns which registers the send uses.
+            if (code[i].op == OP_BORROW)
+            {
+                code[i].a = code[i + 1].b;
+                code[i].b = NumArgs(code[i + 1].op);
+            }
+        }
+
+        mCode = code;
+    }
+
+    void Optimizer::FindLiveRegisters()
+    {
+        // Walk backwards tracking which registers will be read later. A loop
+        // can make a register live at its start, so go around again until
+        // nothing changes. Without one, a single walk is enough.
+        int numRegisters = mNumRegisters;
+        Array<bool> liveIn(mCode.Count() * numRegisters, false);
+        mLiveOut = Array<bool>(mCode.Count() * numRegisters, false);
+
+        bool hasLoop = false;
+        for (int i = 0; i < mCode.Count(); i++)
+        {
+            if (mCode[i].op == OP_LOOP) hasLoop = true;
+        }
+
+        bool changed = true;
+        while (changed)
+        {
+            changed = false;
+            for (int i = mCode.Count() - 1; i >= 0; i--)
+            {
+                const Op & op = mCode[i];
+
+                int successors[2];
+                int numSuccessors = Successors(i, successors);
+
+                int written = WrittenRegister(op);
+                for (int reg = 0; reg < numRegisters; reg++)
+                {
+                    bool live = mCaptured[reg];
+                    for (int j = 0; j < numSuccessors; j++)
+                    {
+                        live = live || liveIn[successors[j] * numRegisters + reg];
+                    }
+
+                    mLiveOut[i * numRegisters + reg] = live;
+
+                    if (reg == written) live = mCaptured[reg];
+                    if (Reads(op, reg)) live = true;
+
+                    if (live != liveIn[i * numRegisters + reg])
+                    {
+                        liveIn[i * numRegisters + reg] = live;
+                        changed = hasLoop;
+                    }
+                }
+            }
+        }
+
+        mMaxLiveAfter.Clear();
+        for (int i = 0; i < mCode.Count(); i++)
+        {
+            int written = WrittenRegister(mCode[i]);
+            int maxLive = -1;
+            for (int reg = numRegisters - 1; reg >= 0; reg--)
+            {
+                if (IsLiveAfter(i, reg) && (reg != written))
+                {
+                    maxLive = reg;
+                    break;
+                }
+            }
+
+            mMaxLiveAfter.Add(maxLive);
+        }
+    }
+
+    void Optimizer::FindJumpTargets()
+    {
+        mIsTarget = Array<bool>(mCode.Count() + 1, false);
+        for (int i = 0; i < mCode.Count(); i++)
+        {
+            if (Block::IsJump(mCode[i].op)) mIsTarget[mCode[i].a] = true;
+        }
+    }
+
+    int Optimizer::Successors(int index, int * successors) const
+    {
+        const Op & op = mCode[index];
+        switch (op.op)
+        {
+            case OP_END:
+            case OP_RETURN:
+                return 0;
+
+            case OP_JUMP:
+            case OP_LOOP:
+                successors[0] = op.a;
+                return 1;
+
+            case OP_JUMP_IF_FALSE:
+            case OP_GUARD_ETHER:
+            case OP_GUARD_LOGIC:
+            case OP_GUARD_IF:
+                successors[0] = index + 1;
+                successors[1] = op.a;
+                return 2;
+
+            default:
+                if (index + 1 == mCode.Count()) return 0;
+
+                successors[0] = index + 1;
+                return 1;
+        }
+    }
+
+    bool Optimizer::IsReadAfter(int reg, int index) const
+    {
+        // Search every path from the instruction until the register is read
+        // or written.
+        Array<bool> visited(mCode.Count(), false);
+        Array<int> stack;
+
+        int successors[2];
+        int numSuccessors = Successors(index, successors);
+        for (int j = 0; j < numSuccessors; j++) stack.Add(successors[j]);
+
+        while (stack.Count() > 0)
+        {
+            int i = stack[stack.Count() - 1];
+            stack.Truncate(stack.Count() - 1);
+
+            if (visited[i]) continue;
+            visited[i] = true;
+
+            const Op & op = mCode[i];
+            if (Reads(op, reg)) return true;
+            if (WrittenRegister(op) == reg) continue;
+
+            numSuccessors = Successors(i, successors);
+            for (int j = 0; j < numSuccessors; j++) stack.Add(successors[j]);
+        }
+
+        return false;
+    }
+
+    void Optimizer::RemoveOps()
+    {
+        // A jump to a removed instruction goes to the next one that's left.
+        Array<int> newIndex(mCode.Count(), 0);
+        int count = 0;
+        for (int i = 0; i < mCode.Count(); i++)
+        {
+            newIndex[i] = count;
+            if (mCode[i].op != OP_REMOVED) mCode[count++] = mCode[i];
+        }
+
+        mCode.Truncate(count);
+
+        for (int i = 0; i < mCode.Count(); i++)
+        {
+            if (Block::IsJump(mCode[i].op)) mCode[i].a = newIndex[mCode[i].a];
+        }
+    }
+
+    bool Optimizer::IsMessage(OpCode op)
+    {
+        return (op >= OP_MESSAGE_0) && (op <= OP_TAIL_MESSAGE_10);
+    }
+
+    bool Optimizer::IsPlainSend(OpCode op)
+    {
+        return ((op >= OP_MESSAGE_0) && (op <= OP_MESSAGE_10)) ||
+               ((op >= OP_TAIL_MESSAGE_0) && (op <= OP_TAIL_MESSAGE_10));
+    }
+
+    bool Optimizer::IsPure(OpCode op)
+    {
+        // Getting a global isn't pure since it reports an error if the global
+        // is undefined.
+        switch (op)
+        {
+            case OP_CONSTANT:
+            case OP_BLOCK:
+            case OP_OBJECT:
+            case OP_ARRAY:
+            case OP_MOVE:
+            case OP_SELF:
+            case OP_GET_UPVALUE:
+            case OP_GET_FIELD:
+                return true;
+
+            default:
+                return false;
+        }
+    }
+
+    int Optimizer::NumArgs(OpCode op)
+    {
+        if ((op >= OP_MESSAGE_0) && (op <= OP_MESSAGE_10))
+        {
+            return op - OP_MESSAGE_0;
+        }
+
+        if ((op >= OP_TAIL_MESSAGE_0) && (op <= OP_TAIL_MESSAGE_10))
+        {
+            return op - OP_TAIL_MESSAGE_0;
+        }
+
+        if (op == OP_AT_PUT) return 2;
+        if ((op >= OP_ADD) && (op <= OP_AT)) return 1;
+
+        return -1;
+    }
+
+    int Optimizer::WrittenRegister(const Op & op)
+    {
+        switch (op.op)
+        {
+            case OP_CONSTANT:
+            case OP_BLOCK:
+            case OP_ARRAY:
+            case OP_MOVE:
+            case OP_GET_UPVALUE:
+            case OP_GET_FIELD:
+            case OP_GET_GLOBAL:
+                return op.b;
+
+            case OP_OBJECT:
+            case OP_SELF:
+                return op.a;
+
+            default:
+                return IsMessage(op.op) ? op.c : -1;
+        }
+    }
+
+    int * Optimizer::RetargetableOperand(Op & op)
+    {
+        // A tail call's result never goes into its register, so there's no
+        // point moving it.
+        switch (op.op)
+        {
+            case OP_CONSTANT:
+            case OP_BLOCK:
+            case OP_GET_UPVALUE:
+            case OP_GET_FIELD:
+            case OP_GET_GLOBAL:
+                return &op.b;
+
+            case OP_SELF:
+                return &op.a;
+
+            default:
+                if ((op.op >= OP_MESSAGE_0) && (op.op < OP_TAIL_MESSAGE_0))
+                {
+                    return &op.c;
+                }
+                return NULL;
+        }
+    }
+
+    bool Optimizer::Reads(const Op & op, int reg)
+    {
+        switch (op.op)
+        {
+            case OP_OBJECT:
+            case OP_END:
+            case OP_CAPTURE_LOCAL:
+                return op.a == reg;
+
+            case OP_SET_UPVALUE:
+            case OP_SET_FIELD:
+            case OP_SET_GLOBAL:
+            case OP_RETURN:
+                return op.b == reg;
+
+            case OP_ARRAY_ELEMENT:
+                return (op.a == reg) || (op.b == reg);
+
+            case OP_MOVE:
+            case OP_CLOSE_UPVALUES:
+                return op.a == reg;
+
+            case OP_JUMP_IF_FALSE:
+            case OP_GUARD_LOGIC:
+            case OP_GUARD_IF:
+                return op.b == reg;
+
+            case OP_DEF_METHOD:
+            case OP_DEF_FIELD:
+                return (op.b == reg) || (op.c == reg);
+
+            default:
+                if (IsMessage(op.op))
+                {
+                    return (reg >= op.b) && (reg <= op.b + NumArgs(op.op));
+                }
+                return false;
+        }
+    }
+
+    int Optimizer::ReplaceableReads(Op & op, int ** operands)
+    {
+        // OP_OBJECT reads and writes the same register, and the registers a
+        // send reads are fixed by where its receiver is.
+        switch (op.op)
+        {
+            case OP_END:
+            case OP_MOVE:
+                operands[0] = &op.a;
+                return 1;
+
+            case OP_SET_UPVALUE:
+            case OP_SET_FIELD:
+            case OP_SET_GLOBAL:
+            case OP_RETURN:
+            case OP_JUMP_IF_FALSE:
+            case OP_GUARD_LOGIC:
+            case OP_GUARD_IF:
+                operands[0] = &op.b;
+                return 1;
+
+            case OP_ARRAY_ELEMENT:
+                operands[0] = &op.a;
+                operands[1] = &op.b;
+                return 2;
+
+            case OP_DEF_METHOD:
+            case OP_DEF_FIELD:
+                operands[0] = &op.b;
+                operands[1] = &op.c;
+                return 2;
+
+            default:
+                return 0;
+        }
+    }
+}
+
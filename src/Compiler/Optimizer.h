@@ -0,0 +1,136 @@
+#pragma once
+
+#include "Array.h"
+#include "Block.h"
+#include "Macros.h"
+
+namespace Finch
+{
+    // Instruction and register counts summed over every block optimized since
+    // the last call to Optimizer::ResetStats().
+    struct OptimizerStats
+    {
+        int instructionsBefore;
+        int instructionsAfter;
+        int registersBefore;
+        int registersAfter;
+    };
+
+    // Cleans up the bytecode for a block after the compiler has finished it.
+    // The compiler is simple and emits plenty of redundant moves and stores,
+    // so this removes them and then packs the registers that are left so that
+    // call frames are smaller.
+    //
+    // Most blocks are straight-line code. Inlined control flow adds jumps, so
+    // liveness follows them to a fixpoint, and the passes that track values
+    // along the code forget what they know wherever a jump lands. Two other
+    // things make it trickier than that sounds:
+    //
+    // - A message send's receiver and arguments must be in consecutive
+    //   registers, and the callee's frame starts right after the receiver, so
+    //   any register above the receiver may be overwritten by the send.
+    // - A register captured by a nested block can be read or written by that
+    //   block during any send, so captured registers are left alone.
+    class Optimizer
+    {
+    public:
+        // Optimizes the block's code and register count in place. The code must
+        // be complete, ending with OP_END.
+        static void Optimize(Block & block);
+
+        static const OptimizerStats & GetStats() { return sStats; }
+        static void ResetStats();
+
+    private:
+        // A decoded instruction with any OP_WIDE prefixes folded in. Jumps
+        // hold the index of their target.
+        typedef DecodedInstruction Op;
+
+        // Decoded instructions that have been removed are marked with this
+        // until the code is compacted. Prefixes never appear once decoded.
+        static const OpCode OP_REMOVED = OP_WIDE;
+
+        Optimizer(Block & block);
+
+        void Decode();
+        void Encode();
+
+        bool PropagateCopies();
+        bool CoalesceMoves();
+        bool RemoveDeadStores();
+        bool ThreadJumps();
+        void CompactRegisters();
+        
+        // Works out which parameters a block on the caller's stack can be
+        // passed for, and puts an OP_BORROW before each send that passes one
+        // of them on.
+        void FindBorrowedParams();
+
+        // Fills in mLiveOut and mMaxLiveAfter.
+        void FindLiveRegisters();
+
+        // Gets whether the register may be read after the given instruction.
+        bool IsLiveAfter(int index, int reg) const
+        {
+            return mLiveOut[index * mNumRegisters + reg];
+        }
+
+        // Fills in mIsTarget.
+        void FindJumpTargets();
+
+        // Fills in the indexes of the instructions that can run right after
+        // the given one. Returns how many there are.
+        int  Successors(int index, int * successors) const;
+
+        // Gets whether the register is read after the given instruction before
+        // being written again.
+        bool IsReadAfter(int reg, int index) const;
+
+        void RemoveOps();
+
+        static bool IsMessage(OpCode op);
+        
+        // Gets whether the instruction is a send that isn't one of the
+        // superinstructions.
+        static bool IsPlainSend(OpCode op);
+        static bool IsPure(OpCode op);
+        static int  NumArgs(OpCode op);
+
+        // Gets the register the instruction writes, or -1 if it doesn't.
+        static int  WrittenRegister(const Op & op);
+
+        // Gets the operand holding the register the instruction writes, if
+        // another register could be written instead. Otherwise NULL.
+        static int * RetargetableOperand(Op & op);
+
+        // Gets whether the instruction reads the given register.
+        static bool Reads(const Op & op, int reg);
+
+        // Fills in pointers to the operands holding registers the instruction
+        // reads that could be replaced with other registers. Returns how many.
+        static int  ReplaceableReads(Op & op, int ** operands);
+
+        static OptimizerStats sStats;
+
+        Block &     mBlock;
+        Array<Op>   mCode;
+        int         mNumRegisters;
+
+        // Registers that nested blocks have captured.
+        Array<bool> mCaptured;
+
+        // For each instruction and register, whether the register may be
+        // read after the instruction before being written again.
+        Array<bool> mLiveOut;
+
+        // For each instruction, the highest register other than the one it
+        // writes that is read later, or -1 if there aren't any.
+        Array<int>  mMaxLiveAfter;
+
+        // Whether a jump lands on each instruction.
+        Array<bool> mIsTarget;
+
+        NO_COPY(Optimizer);
+    };
+}
+
@@ -4,7 +4,10 @@
 #include "ArrayPrimitives.h"
 #include "BlockObject.h"
 #include "BlockPrimitives.h"
+#include "BytecodeImage.h"
 #include "Compiler.h"
+#include "DictionaryObject.h"
+#include "DictionaryPrimitives.h"
 #include "DynamicObject.h"
 #include "Expr.h"
 #include "Fiber.h"
@@ -18,10 +21,10 @@
 #include "IoPrimitives.h"
 #include "Lexer.h"
 #include "LineNormalizer.h"
-#include "NumberObject.h"
 #include "NumberPrimitives.h"
 #include "ObjectPrimitives.h"
 #include "Primitives.h"
+#include "Snapshot.h"
 #include "StringObject.h"
 #include "StringPrimitives.h"
 
@@ -45,8 +48,78 @@ namespace Finch
         Interpreter & mInterpreter;
     };
     
+    // What each superinstruction does when it's done inline, in terms of the
+    // primitives it stands in for. The arithmetic operators and "=" double
+    // dispatch, so they also depend on how the number on the right responds
+    // to the second message.
+    struct BuiltInOp
+    {
+        const char *    message;
+        PrimitiveMethod primitive;
+        const char *    dispatchMessage;
+        PrimitiveMethod dispatchPrimitive;
+    };
+    
+    // Indexed from OP_ADD.
+    static const BuiltInOp sBuiltInOps[] = {
+        { "+",       NumberDispatchAdd,      "+number:", NumberAdd },
+        { "-",       NumberDispatchSubtract, "-number:", NumberSubtract },
+        { "*",       NumberDispatchMultiply, "*number:", NumberMultiply },
+        { "/",       NumberDispatchDivide,   "/number:", NumberDivide },
+        { "=",       NumberDispatchEquals,   "=number:", NumberEquals },
+        { "!=",      NumberNotEquals,          NULL, NULL },
+        { "<",       NumberLessThan,           NULL, NULL },
+        { ">",       NumberGreaterThan,        NULL, NULL },
+        { "<=",      NumberLessThanOrEqual,    NULL, NULL },
+        { ">=",      NumberGreaterThanOrEqual, NULL, NULL },
+        { "at:",     ArrayAt,                  NULL, NULL },
+        { "at:put:", ArrayAtPut,               NULL, NULL }
+    };
+    
+    // The methods that the code the compiler inlines for the control flow
+    // messages stands in for. The receivers are named by their globals. The
+    // first two are the ones an inlined and: or or: also checks on its
+    // receiver, and the third is the one an inlined if:then: or while:do:
+    // checks on a condition that isn't true, false or nil.
+    struct ControlFlowMethod
+    {
+        const char * receiver;
+        const char * message;
+    };
+    
+    static const ControlFlowMethod sControlFlowMethods[] = {
+        { "Object", "and:" },
+        { "Object", "or:" },
+        { "Object", "if-true:else:" },
+        { "true",   "if-true:else:" },
+        { "false",  "if-true:else:" },
+        { "nil",    "if-true:else:" },
+        { "Ether",  "if:then:" },
+        { "Ether",  "if:then:else:" },
+        { "Ether",  "while:do:" },
+        { "Ether",  "from:to:do:" },
+        { "Ether",  "from:to:step:do:" },
+        { "Blocks", "call" },
+        { "Blocks", "call:" },
+        { "Blocks", "true?" }
+    };
+    
+    static const int NUM_CONTROL_FLOW_METHODS =
+        sizeof(sControlFlowMethods) / sizeof(sControlFlowMethods[0]);
+    
     Interpreter::Interpreter(IInterpreterHost & host)
-    :   mHost(host)
+    :   mHost(host),
+        mAllocator(host),
+        mEmptyShape(mAllocator),
+        mHeap(),
+        mBuiltIns(0),
+        mBuiltInEpoch(-1),
+        mEtherGlobal(-1),
+        mHasCore(false),
+        mControlFlowBuiltIn(false),
+        mControlFlowEpoch(-1),
+        mMaxStackSize(DEFAULT_MAX_STACK_SIZE),
+        mNextFrameId(1)
     {
         // Build the global scope.
         
@@ -64,6 +137,15 @@ namespace Finch
         AddPrimitive(mArrayPrototype, "at:put:",     ArrayAtPut);
         AddPrimitive(mArrayPrototype, "remove-at:",  ArrayRemoveAt);
         
+        // Dictionaries.
+        mDictionaryPrototype = MakeGlobal("Dictionaries");
+        AddPrimitive(mDictionaryPrototype, "count",     DictionaryCount);
+        AddPrimitive(mDictionaryPrototype, "at:",       DictionaryAt);
+        AddPrimitive(mDictionaryPrototype, "at:put:",   DictionaryAtPut);
+        AddPrimitive(mDictionaryPrototype, "contains:", DictionaryContains);
+        AddPrimitive(mDictionaryPrototype, "remove:",   DictionaryRemove);
+        AddPrimitive(mDictionaryPrototype, "keys",      DictionaryKeys);
+        
         // Blocks.
         mBlockPrototype = MakeGlobal("Blocks");
         AddPrimitive(mBlockPrototype, "call", BlockCall);
@@ -82,6 +164,7 @@ namespace Finch
         mFiberPrototype = MakeGlobal("Fibers");
         AddPrimitive(mFiberPrototype, "running?", FiberRunning);
         AddPrimitive(mFiberPrototype, "done?", FiberDone);
+        AddPrimitive(mFiberPrototype, "run-by", FiberRunBy);
         
         // Numbers.
         mNumberPrototype = MakeGlobal("Numbers");
@@ -98,6 +181,11 @@ namespace Finch
         AddPrimitive(mNumberPrototype, "acos",  NumberAcos);
         AddPrimitive(mNumberPrototype, "atan",  NumberAtan);
         AddPrimitive(mNumberPrototype, "atan:", NumberAtan2);
+        AddPrimitive(mNumberPrototype, "+", NumberDispatchAdd);
+        AddPrimitive(mNumberPrototype, "-", NumberDispatchSubtract);
+        AddPrimitive(mNumberPrototype, "*", NumberDispatchMultiply);
+        AddPrimitive(mNumberPrototype, "/", NumberDispatchDivide);
+        AddPrimitive(mNumberPrototype, "=", NumberDispatchEquals);
         AddPrimitive(mNumberPrototype, "+number:", NumberAdd);
         AddPrimitive(mNumberPrototype, "-number:", NumberSubtract);
         AddPrimitive(mNumberPrototype, "*number:", NumberMultiply);
@@ -118,7 +206,8 @@ namespace Finch
         AddPrimitive(mStringPrototype, "index-of:",   StringIndexOf);
         
         // Ether.
-        MakeGlobal("Ether");
+        mEther = MakeGlobal("Ether");
+        mEtherGlobal = FindGlobal("Ether");
         
         // Io.
         Value io = MakeGlobal("Io");
@@ -128,18 +217,34 @@ namespace Finch
         Value primitives = MakeGlobal("*primitive*");
         AddPrimitive(primitives, "string-concat:and:",       PrimitiveStringConcat);
         AddPrimitive(primitives, "string-compare:to:",       PrimitiveStringCompare);
+        AddPrimitive(primitives, "string-equals:to:",        PrimitiveStringEquals);
         AddPrimitive(primitives, "write:",                   PrimitiveWrite);
-        /*
-         AddPrimitive(primitives, "new-fiber:",               PrimitiveNewFiber);
-         AddPrimitive(primitives, "current-fiber",            PrimitiveGetCurrentFiber);
-         AddPrimitive(primitives, "switch-to-fiber:passing:", PrimitiveSwitchToFiber);
-         */
+        AddPrimitive(primitives, "new-dictionary",           PrimitiveNewDictionary);
+        AddPrimitive(primitives, "new-fiber:",               PrimitiveNewFiber);
+        AddPrimitive(primitives, "current-fiber",            PrimitiveGetCurrentFiber);
+        AddPrimitive(primitives, "switch-to-fiber:passing:", PrimitiveSwitchToFiber);
+        AddPrimitive(primitives, "run-fiber:passing:",       PrimitiveRunFiber);
         AddPrimitive(primitives, "callstack-depth",          PrimitiveGetCallstackDepth);
+        AddPrimitive(primitives, "collect-garbage",          PrimitiveCollectGarbage);
+        AddPrimitive(primitives, "heap-object-count",        PrimitiveGetHeapObjectCount);
         
         // The special singleton values.
         mNil = MakeGlobal("nil");
         mTrue = MakeGlobal("true");
         mFalse = MakeGlobal("false");
+        
+        for (int i = 0; i <= OP_AT_PUT - OP_ADD; i++)
+        {
+            const BuiltInOp & builtIn = sBuiltInOps[i];
+            mBuiltInMessages[i] = mStrings.Add(builtIn.message);
+            mDispatchMessages[i] = (builtIn.dispatchMessage == NULL) ? -1 :
+                mStrings.Add(builtIn.dispatchMessage);
+        }
+        
+        for (int i = 0; i < NUM_CONTROL_FLOW_METHODS; i++)
+        {
+            mControlFlowMessages.Add(mStrings.Add(sControlFlowMethods[i].message));
+        }
     }
     
     void Interpreter::Interpret(ILineReader & reader, bool showResult)
@@ -149,13 +254,71 @@ namespace Finch
         // Bail if we failed to parse.
         if (expr.IsNull()) return;
         
-        // Create a starting fiber for the expression.
-        Ref<Block> block = Compiler::CompileTopLevel(*this, *expr);
+        Handle<Block> block = Compiler::CompileTopLevel(*this, *expr);
+        Execute(block, showResult);
+    }
+    
+    bool Interpreter::CompileImage(ILineReader & reader, std::ostream & stream)
+    {
+        Ref<Expr> expr = Parse(reader);
+        if (expr.IsNull()) return false;
+        
+        Handle<Block> block = Compiler::CompileTopLevel(*this, *expr);
+        BytecodeImage::Write(*this, *block, stream);
+        return true;
+    }
+    
+    bool Interpreter::InterpretImage(std::istream & stream, bool showResult)
+    {
+        Handle<Block> block = BytecodeImage::Read(*this, stream);
+        
+        // Bail if the image was invalid.
+        if (block.IsNull()) return false;
+        
+        Execute(block, showResult);
+        return true;
+    }
+    
+    void Interpreter::WriteSnapshot(std::ostream & stream)
+    {
+        ASSERT(mCurrentFiber.IsNull(),
+               "Cannot write a snapshot while a fiber is running.");
+        
+        Snapshot::Write(*this, stream);
+    }
+    
+    bool Interpreter::LoadSnapshot(std::istream & stream)
+    {
+        if (!Snapshot::Read(*this, stream)) return false;
+        
+        mHasCore = true;
+        RecordControlFlow();
+        return true;
+    }
+    
+    void Interpreter::Execute(Handle<Block> block, bool showResult)
+    {
+        // Create a starting fiber for the block.
         Value blockObj = NewBlock(block, mNil);
         Value fiber = NewFiber(blockObj);
         
+        // If a script is loading this, its fiber waits until this is done.
+        Value waiting = mCurrentFiber;
+        mRunningFibers.Add(waiting);
+        mRunningFibers.Add(fiber);
+        
         // Run the interpreter.
-        Value result = fiber.AsFiber()->GetFiber().Execute();
+        Value result = RunFibers(fiber);
+        
+        mRunningFibers.RemoveAt(-1);
+        mRunningFibers.RemoveAt(-1);
+        mCurrentFiber = waiting;
+        
+        if (!mHasCore && (mRunningFibers.Count() == 0))
+        {
+            mHasCore = true;
+            RecordControlFlow();
+        }
         
         if (showResult)
         {
@@ -165,6 +328,124 @@ namespace Finch
         }
     }
     
+    void Interpreter::SwitchToFiber(const Value & fiber, const Value & value)
+    {
+        mNextFiber = fiber;
+        mPassedValue = value;
+        mCurrentFiber.AsFiber()->GetFiber().Pause();
+    }
+    
+    void Interpreter::FindBuiltIns()
+    {
+        mBuiltIns = 0;
+        mBuiltInEpoch = MethodEpoch();
+        
+        // Any number will do since they all share a prototype.
+        Value number(0.0);
+        
+        for (int i = 0; i <= OP_AT_PUT - OP_ADD; i++)
+        {
+            const BuiltInOp & builtIn = sBuiltInOps[i];
+            OpCode op = static_cast<OpCode>(OP_ADD + i);
+            const Value & receiver = ((op == OP_AT) || (op == OP_AT_PUT)) ?
+                mArrayPrototype : number;
+            
+            Value method;
+            PrimitiveMethod primitive = NULL;
+            if (!receiver.FindMethod(*this, mBuiltInMessages[i],
+                                     &method, &primitive)) continue;
+            if (primitive != builtIn.primitive) continue;
+            
+            if (mDispatchMessages[i] != -1)
+            {
+                primitive = NULL;
+                if (!number.FindMethod(*this, mDispatchMessages[i],
+                                       &method, &primitive)) continue;
+                if (primitive != builtIn.dispatchPrimitive) continue;
+            }
+            
+            mBuiltIns |= 1 << i;
+        }
+    }
+    
+    bool Interpreter::IsLogicBuiltIn(const Value & receiver)
+    {
+        if (!IsControlFlowBuiltIn()) return false;
+        
+        // and: and or: come first in sControlFlowMethods.
+        for (int i = 0; i < 2; i++)
+        {
+            Value method;
+            PrimitiveMethod primitive = NULL;
+            if (!receiver.FindMethod(*this, mControlFlowMessages[i],
+                                     &method, &primitive)) return false;
+            if ((method != mControlFlowMethods[i]) ||
+                (primitive != mControlFlowPrimitives[i])) return false;
+        }
+        
+        return true;
+    }
+    
+    bool Interpreter::IsIfBuiltIn(const Value & condition)
+    {
+        if (!IsControlFlowBuiltIn()) return false;
+        
+        Value method;
+        PrimitiveMethod primitive = NULL;
+        if (!condition.FindMethod(*this, mControlFlowMessages[2],
+                                  &method, &primitive)) return false;
+        
+        return (method == mControlFlowMethods[2]) &&
+               (primitive == mControlFlowPrimitives[2]);
+    }
+    
+    void Interpreter::RecordControlFlow()
+    {
+        mEther = GetGlobal(mEtherGlobal);
+        mControlFlowEpoch = -1;
+        
+        for (int i = 0; i < NUM_CONTROL_FLOW_METHODS; i++)
+        {
+            const ControlFlowMethod & controlFlow = sControlFlowMethods[i];
+            int global = FindGlobal(controlFlow.receiver);
+            Value receiver = (global == -1) ? Value() : GetGlobal(global);
+            
+            Value method;
+            PrimitiveMethod primitive = NULL;
+            if (receiver.IsNull() ||
+                !receiver.FindMethod(*this, mControlFlowMessages[i],
+                                     &method, &primitive))
+            {
+                // Without the whole core library, nothing is inlined.
+                mControlFlowReceivers.Clear();
+                mControlFlowMethods.Clear();
+                mControlFlowPrimitives.Clear();
+                return;
+            }
+            
+            mControlFlowReceivers.Add(receiver);
+            mControlFlowMethods.Add(method);
+            mControlFlowPrimitives.Add(primitive);
+        }
+    }
+    
+    void Interpreter::FindControlFlow()
+    {
+        mControlFlowEpoch = MethodEpoch();
+        mControlFlowBuiltIn = mControlFlowMethods.Count() > 0;
+        
+        for (int i = 0; mControlFlowBuiltIn && (i < mControlFlowMethods.Count()); i++)
+        {
+            Value method;
+            PrimitiveMethod primitive = NULL;
+            mControlFlowBuiltIn =
+                mControlFlowReceivers[i].FindMethod(*this, mControlFlowMessages[i],
+                                                    &method, &primitive) &&
+                (method == mControlFlowMethods[i]) &&
+                (primitive == mControlFlowPrimitives[i]);
+        }
+    }
+    
     void Interpreter::BindMethod(String objectName, String message,
                                  PrimitiveMethod method)
     {
@@ -247,9 +528,55 @@ namespace Finch
     }
     
     
+    void Interpreter::CollectGarbage()
+    {
+        for (int i = 0; i < mGlobals.Count(); i++)
+        {
+            mHeap.Mark(mGlobals[i]);
+        }
+        
+        // The built-in objects are globals too, but they can be reassigned
+        // while the interpreter still needs the originals.
+        mHeap.Mark(mObject);
+        mHeap.Mark(mArrayPrototype);
+        mHeap.Mark(mBlockPrototype);
+        mHeap.Mark(mDictionaryPrototype);
+        mHeap.Mark(mFiberPrototype);
+        mHeap.Mark(mNumberPrototype);
+        mHeap.Mark(mStringPrototype);
+        mHeap.Mark(mNil);
+        mHeap.Mark(mTrue);
+        mHeap.Mark(mFalse);
+        mHeap.Mark(mEther);
+        
+        for (int i = 0; i < mControlFlowMethods.Count(); i++)
+        {
+            mHeap.Mark(mControlFlowReceivers[i]);
+            mHeap.Mark(mControlFlowMethods[i]);
+        }
+        
+        for (int i = 0; i < mStringLiterals.NumSlots(); i++)
+        {
+            Value literal;
+            if (mStringLiterals.GetSlot(i, &literal)) mHeap.Mark(literal);
+        }
+        
+        for (int i = 0; i < mRunningFibers.Count(); i++)
+        {
+            mHeap.Mark(mRunningFibers[i]);
+        }
+        
+        mHeap.Mark(mCurrentFiber);
+        mHeap.Mark(mNextFiber);
+        mHeap.Mark(mPassedValue);
+        
+        mHeap.Collect();
+    }
+    
     Value Interpreter::NewObject(const Value & parent, String name)
     {
-        return Value(new DynamicObject(parent, name));
+        return mHeap.Add(new (mAllocator) DynamicObject(parent, name,
+                                                        &mEmptyShape));
     }
     
     Value Interpreter::NewObject(const Value & parent)
@@ -259,27 +586,106 @@ namespace Finch
     
     Value Interpreter::NewNumber(double value)
     {
-        return Value(new NumberObject(mNumberPrototype, value));
+        return Value(value);
     }
     
     Value Interpreter::NewString(String value)
     {
-        return Value(new StringObject(mStringPrototype, value));
+        return mHeap.Add(new (mAllocator) StringObject(mStringPrototype, value));
+    }
+    
+    Value Interpreter::StringLiteral(const String & value)
+    {
+        StringId id = mStrings.Add(value);
+        
+        Value literal;
+        if (!mStringLiterals.Find(id, &literal))
+        {
+            literal = mHeap.Add(new (mAllocator) StringObject(
+                mStringPrototype, value, id));
+            mStringLiterals.Insert(id, literal);
+        }
+        
+        return literal;
     }
     
     Value Interpreter::NewArray(int capacity)
     {
-        return Value(new ArrayObject(mArrayPrototype, capacity));
+        return mHeap.Add(new (mAllocator) ArrayObject(mArrayPrototype,
+                                                      mAllocator, capacity));
     }
     
-    Value Interpreter::NewBlock(Ref<Block> block, const Value & self)
+    Value Interpreter::NewDictionary()
     {
-        return Value(new BlockObject(mBlockPrototype, block, self));
+        return mHeap.Add(new (mAllocator) DictionaryObject(mDictionaryPrototype));
+    }
+    
+    Value Interpreter::NewBlock(const Handle<Block> & block, const Value & self)
+    {
+        return mHeap.Add(new (mAllocator) BlockObject(mBlockPrototype,
+                                                      block, self));
+    }
+    
+    BlockObject * Interpreter::NewStackBlock(const Handle<Block> & block, const Value & self)
+    {
+        return new (mAllocator) BlockObject(mBlockPrototype, block, self);
+    }
+    
+    Value Interpreter::PromoteBlock(BlockObject * block)
+    {
+        return mHeap.Add(block);
     }
     
     Value Interpreter::NewFiber(const Value & block)
     {
-        return Value(new FiberObject(mFiberPrototype, *this, block));
+        return mHeap.Add(new (mAllocator) FiberObject(mFiberPrototype,
+                                                      *this, block));
+    }
+    
+    Value Interpreter::RunFibers(const Value & root)
+    {
+        Value current = root;
+        Value result;
+        
+        while (true)
+        {
+            mCurrentFiber = current;
+            Fiber & fiber = current.AsFiber()->GetFiber();
+            
+            // The fiber may have finished when it was resumed.
+            if (!fiber.IsDone()) result = fiber.Execute();
+            
+            if (!mNextFiber.IsNull())
+            {
+                // The fiber paused to switch to another one. The fibers each
+                // have their own stack, so this just changes which one runs.
+                current = mNextFiber;
+                result = mPassedValue;
+                mNextFiber = Value();
+                mPassedValue = Value();
+                
+                current.AsFiber()->GetFiber().Resume(result);
+                continue;
+            }
+            
+            // The fiber completed. One that overflowed its stack was unwound
+            // without a result.
+            if (result.IsNull()) result = mNil;
+            if (current == root) break;
+            
+            // Hand its result back to the fiber that ran it. If nothing did,
+            // or that has finished too, go back to the top-level one.
+            current = fiber.GetRunBy();
+            if (current.IsNull() || current.AsFiber()->GetFiber().IsDone())
+            {
+                current = root;
+            }
+            
+            current.AsFiber()->GetFiber().Resume(result);
+        }
+        
+        mCurrentFiber = Value();
+        return result;
     }
     
     Ref<Expr> Interpreter::Parse(ILineReader & reader)
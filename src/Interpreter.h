@@ -1,6 +1,12 @@
 #pragma once
 
+#include <iostream>
+
+#include "Allocator.h"
+#include "Block.h"
 #include "Dictionary.h"
+#include "DynamicObject.h"
+#include "Heap.h"
 #include "Macros.h"
 #include "Object.h"
 #include "StringTable.h"
@@ -10,6 +16,7 @@ namespace Finch
     class IInterpreterHost;
     class ILineReader;
     //### bob: ideally, this stuff wouldn't be in the public api for Interpreter.
+    class BlockObject;
     class Object;
     class Fiber;
     
@@ -25,6 +32,27 @@ namespace Finch
         // in this interpreter.
         void Interpret(ILineReader & reader, bool showResult);
         
+        // Compiles the source from the given reader and writes it to the
+        // stream as a bytecode image that InterpretImage() can run later. The
+        // source is not executed. Returns false if it couldn't be parsed.
+        bool CompileImage(ILineReader & reader, std::ostream & stream);
+        
+        // Reads a bytecode image written by CompileImage() and executes it in
+        // a new fiber in this interpreter. Returns false without running
+        // anything if the image is invalid or from a different version.
+        bool InterpretImage(std::istream & stream, bool showResult);
+        
+        // Writes a heap snapshot of everything reachable from the globals,
+        // which LoadSnapshot() can use to restore this state. Must not be
+        // called while a fiber is running.
+        void WriteSnapshot(std::ostream & stream);
+        
+        // Reads a heap snapshot written by WriteSnapshot() into this
+        // interpreter. Should be called on a newly created interpreter,
+        // before it has run anything. Returns false if the snapshot is
+        // invalid.
+        bool LoadSnapshot(std::istream & stream);
+        
         //### bob: exposing the entire host here is a bit dirty.
         IInterpreterHost & GetHost() { return mHost; }
 
@@ -52,28 +80,153 @@ namespace Finch
         
         String FindGlobalName(int index);
         
+        // Gets the number of global slots that have been defined.
+        int NumGlobals() const { return mGlobals.Count(); }
+        
         // Object constructors.
         Value NewObject(const Value & parent, String name);
         Value NewObject(const Value & parent);
         Value NewNumber(double value);
         Value NewString(String value);
         Value NewArray(int capacity);
-        Value NewBlock(Ref<Block> block, const Value & self);
+        Value NewDictionary();
+        Value NewBlock(const Handle<Block> & block, const Value & self);
+        
+        // Creates a block that a fiber keeps on its own stack instead of in
+        // the heap. The fiber owns it until it's passed to PromoteBlock().
+        BlockObject * NewStackBlock(const Handle<Block> & block, const Value & self);
+        
+        // Moves a block created by NewStackBlock() into the heap.
+        Value PromoteBlock(BlockObject * block);
+        
+        // Gets the string object for a string literal. Every literal with the
+        // same contents shares one object, which is a symbol for the string.
+        Value StringLiteral(const String & value);
         Value NewFiber(const Value & block);
         
+        // Gets the fiber that is currently executing.
+        const Value & GetCurrentFiber() const { return mCurrentFiber; }
+        
+        // Pauses the current fiber and switches to the given one, passing it
+        // the given value. The switch happens once the primitive that calls
+        // this has returned.
+        void SwitchToFiber(const Value & fiber, const Value & value);
+        
         // Get built-in objects.
         const Value & Nil()   const { return mNil; }
         const Value & True()  const { return mTrue; }
         const Value & False() const { return mFalse; }
         
+        // Gets the prototype shared by all numbers. Since numbers are stored
+        // unboxed in Values, they don't have an object to hold this.
+        const Value & NumberPrototype() const { return mNumberPrototype; }
+        
+        // Gets the second message a double-dispatched operator's
+        // superinstruction sends, like "+number:" for OP_ADD.
+        StringId DispatchMessage(OpCode op) const
+        {
+            return mDispatchMessages[op - OP_ADD];
+        }
+        
+        // Gets a counter that is incremented every time a method or
+        // primitive is added to one of this interpreter's objects. Inline
+        // caches use it to tell if they're stale.
+        int MethodEpoch() const { return mEmptyShape.MethodEpoch(); }
+        
+        // Gets whether the given superinstruction can do its operation inline
+        // because the methods it would end up calling on numbers (or arrays)
+        // are still the built-in primitives.
+        bool IsBuiltIn(OpCode op)
+        {
+            if (mBuiltInEpoch != MethodEpoch()) FindBuiltIns();
+            return (mBuiltIns & (1 << (op - OP_ADD))) != 0;
+        }
+        
+        // Gets whether code the compiler inlined from the control flow
+        // messages (if:then:, while:do: and the like) can run inline: Ether
+        // is still the Ether the core library set up, and none of the
+        // methods the inlined code stands in for have been replaced. The
+        // first code an interpreter runs, or the snapshot it loads, is taken
+        // to be the core library.
+        bool IsControlFlowBuiltIn()
+        {
+            if (mControlFlowEpoch != MethodEpoch()) FindControlFlow();
+            return mControlFlowBuiltIn && (mGlobals[mEtherGlobal] == mEther);
+        }
+        
+        // Gets whether an inlined and: or or: can run inline for the given
+        // receiver.
+        bool IsLogicBuiltIn(const Value & receiver);
+        
+        // Gets whether an inlined if:then: or while:do: can treat the given
+        // condition as false without sending it if-true:else:.
+        bool IsIfBuiltIn(const Value & condition);
+        
+        // Gets whether enough objects have been allocated that the running
+        // fiber should call CollectGarbage() at its next safe point.
+        bool ShouldCollectGarbage() const { return mHeap.ShouldCollect(); }
+        
+        // Frees every object that isn't reachable from the globals or the
+        // running fibers. Must only be called when every live value is stored
+        // somewhere the collector can see it.
+        void CollectGarbage();
+        
+        // Gets statistics about the objects the interpreter has allocated.
+        const HeapStats & GetHeapStats() const { return mHeap.GetStats(); }
+        
+        // Gets the allocator that objects, blocks and their storage come
+        // from. Hosts can use this to monitor memory use by size class.
+        Allocator & GetAllocator() { return mAllocator; }
+        
+        // Gets or sets the largest number of registers a fiber's stack can
+        // grow to. A fiber that needs more reports a stack overflow and is
+        // unwound. Only affects fibers created after it's set.
+        int  GetMaxStackSize() const { return mMaxStackSize; }
+        void SetMaxStackSize(int size) { mMaxStackSize = size; }
+        
+        // Gets a new id for a call frame. Ids are unique across all of this
+        // interpreter's fibers and start at 1 so that 0 can mean no frame.
+        uint64_t NextFrameId() { return mNextFrameId++; }
+        
     private:
         Ref<Expr>   Parse(ILineReader & reader);
         
+        // Executes the given top-level block in a new fiber.
+        void Execute(Handle<Block> block, bool showResult);
+        
+        // Runs the given top-level fiber and any fibers it switches to until
+        // it completes. Returns its result.
+        Value RunFibers(const Value & root);
+        
         Value MakeGlobal(const char * name);
         void AddPrimitive(const Value & object, String message,
                           PrimitiveMethod primitive);
         
+        // Works out which superinstructions are still built in.
+        void FindBuiltIns();
+        
+        // Remembers the core library's methods for the messages the compiler
+        // inlines, so that FindControlFlow() can tell if they change.
+        void RecordControlFlow();
+        
+        // Works out whether the control flow methods are still the ones
+        // RecordControlFlow() found.
+        void FindControlFlow();
+        
         IInterpreterHost & mHost;
+        
+        // Declared before the heap so that it outlives everything allocated
+        // from it.
+        Allocator mAllocator;
+        
+        // The root of the tree of shapes for this interpreter's objects.
+        // Blocks cache pointers to shapes, so it's declared before anything
+        // that holds them. The tree is allocated from mAllocator.
+        Shape mEmptyShape;
+        
+        // Declared before anything that holds Values so that it's destroyed
+        // after them.
+        Heap mHeap;
 
         StringTable mStrings;
         
@@ -82,9 +235,15 @@ namespace Finch
         // Maps global variable names to their indices. Used by the compiler.
         IdTable<int> mGlobalNames;
         
+        // The shared string objects for string literals, keyed by the ID of
+        // their contents in mStrings. Compiled code can hold on to these, so
+        // they are never collected.
+        IdTable<Value> mStringLiterals;
+        
         Value mObject;
         Value mArrayPrototype;
         Value mBlockPrototype;
+        Value mDictionaryPrototype;
         Value mFiberPrototype;
         Value mNumberPrototype;
         Value mStringPrototype;
@@ -92,6 +251,62 @@ namespace Finch
         Value mTrue;
         Value mFalse;
         
+        // The messages the superinstructions send, indexed from OP_ADD, and
+        // for the double-dispatched operators the message the number then
+        // sends to its argument. -1 if there isn't one.
+        StringId mBuiltInMessages[OP_AT_PUT - OP_ADD + 1];
+        StringId mDispatchMessages[OP_AT_PUT - OP_ADD + 1];
+        
+        // One bit for each superinstruction that is still built in, as of
+        // the method epoch in mBuiltInEpoch.
+        int mBuiltIns;
+        int mBuiltInEpoch;
+        
+        // The original Ether and the global it's stored in.
+        Value mEther;
+        int   mEtherGlobal;
+        
+        // Whether the core library has been run or loaded yet.
+        bool  mHasCore;
+        
+        // The messages in sControlFlowMethods.
+        Array<StringId>        mControlFlowMessages;
+        
+        // The receivers, methods and primitives RecordControlFlow() found,
+        // in the order of sControlFlowMethods. Empty if any were missing.
+        Array<Value>           mControlFlowReceivers;
+        Array<Value>           mControlFlowMethods;
+        Array<PrimitiveMethod> mControlFlowPrimitives;
+        
+        // Whether the control flow methods are still the recorded ones, as
+        // of the method epoch in mControlFlowEpoch.
+        bool mControlFlowBuiltIn;
+        int  mControlFlowEpoch;
+        
+        // The most registers a new fiber's stack may use.
+        int mMaxStackSize;
+        
+        // The id NextFrameId() will return next.
+        uint64_t mNextFrameId;
+        
+        // The fiber that is currently executing.
+        Value mCurrentFiber;
+        
+        // The fiber to switch to once the current one pauses, and the value
+        // to pass to it.
+        Value mNextFiber;
+        Value mPassedValue;
+        
+        // The top-level fiber for each call to Interpret() in progress. Usually
+        // just one, but loading a file from within a script runs it in a new
+        // fiber while the loading one waits. The waiting fibers are kept here
+        // too.
+        Array<Value> mRunningFibers;
+        
+        // About eight megabytes of registers, which is hundreds of thousands
+        // of nested calls.
+        static const int DEFAULT_MAX_STACK_SIZE = 1024 * 1024;
+        
         NO_COPY(Interpreter);
     };
 }
@@ -1,19 +1,21 @@
 #pragma once
 
-#include "Array.h"
 #include "Macros.h"
-#include "Ref.h"
+#include "RegisterStack.h"
 
 namespace Finch
 {
     class Object;
     class Value;
 
+    // The arguments to a message send. They're read straight out of the
+    // sending fiber's registers, so an ArgReader is only valid until that
+    // fiber's stack grows.
     class ArgReader
     {
     public:
-        ArgReader(Array<Value> & stack, int firstArg, int numArgs)
-        :   mStack(stack),
+        ArgReader(RegisterStack & stack, int firstArg, int numArgs)
+        :   mArgs(stack.At(firstArg)),
             mFirstArg(firstArg),
             mNumArgs(numArgs)
         {}
@@ -24,11 +26,11 @@ namespace Finch
         const Value & operator[] (int index) const
         {
             ASSERT_RANGE(index, mNumArgs);
-            return mStack[mFirstArg + index];
+            return mArgs[index];
         }
 
     private:
-        Array<Value> & mStack;
+        const Value * mArgs;
         int mFirstArg;
         int mNumArgs;
     };
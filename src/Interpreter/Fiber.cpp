@@ -2,9 +2,11 @@
 
 #include "ArrayObject.h"
 #include "BlockObject.h"
+#include "BlockPrimitives.h"
 #include "Block.h"
 #include "DynamicObject.h"
 #include "FiberObject.h"
+#include "Heap.h"
 #include "IInterpreterHost.h"
 #include "Interpreter.h"
 #include "Fiber.h"
@@ -21,6 +23,12 @@
 #define TRACE_STACK() ;
 #endif
 
+// Use threaded dispatch when the compiler supports taking the address of a
+// label. Define FINCH_NO_COMPUTED_GOTO to force the portable switch instead.
+#if defined(__GNUC__) && !defined(FINCH_NO_COMPUTED_GOTO)
+#define FINCH_COMPUTED_GOTO
+#endif
+
 namespace Finch
 {
     using std::cout;
@@ -29,8 +37,12 @@ namespace Finch
     Fiber::Fiber(Interpreter & interpreter, const Value & block)
     :   mIsRunning(false),
         mInterpreter(interpreter),
-        mStack(),
-        mCallFrames()
+        mStack(interpreter.GetAllocator(), interpreter.GetMaxStackSize()),
+        mCallFrames(),
+        mStackBlocks(),
+        mNumStackBlocks(0),
+        mLentStackBlock(-1),
+        mRunBy()
     {
         ArgReader args(mStack, 0, 0);
 
@@ -38,6 +50,24 @@ namespace Finch
         CallBlock(interpreter.Nil(), block, args);
     }
 
+    Fiber::~Fiber()
+    {
+        // Blocks created in this fiber may outlive it, so give them their own
+        // copies of anything they captured.
+        while (!mOpenUpvalues.IsNull())
+        {
+            mOpenUpvalues->Close();
+            mOpenUpvalues = mOpenUpvalues->Next();
+        }
+        
+        // Any blocks still on the stack of blocks can't be reached from
+        // anywhere else.
+        for (int i = 0; i < mStackBlocks.Count(); i++)
+        {
+            delete mStackBlocks[i];
+        }
+    }
+
     bool Fiber::IsDone() const
     {
         return mCallFrames.Count() == 0;
@@ -47,302 +77,819 @@ namespace Finch
     {
         mIsRunning = true;
 
-        // Continue processing bytecode until the entire callstack has returned
-        // or we pause and switch to another fiber.
-        while (mIsRunning)
-        {
-            CallFrame & frame = mCallFrames.Peek();
+        // The current callframe's state is cached in locals so that the
+        // common instructions don't have to go through mCallFrames and the
+        // block object to get at them. They're reloaded whenever a callframe
+        // is pushed or popped. The stack only grows when a callframe is
+        // pushed, so the register pointer stays valid until then.
+        CallFrame *         frame;
+        const BlockObject * block;
+        const Instruction * code;
+        Value *             registers;
+        int                 ip;
+
+        // The decoded current instruction.
+        Instruction instruction;
+        OpCode      op;
+        int         a;
+        int         b;
+        int         c;
+        
+        // The number of arguments for a message send. Superinstructions set
+        // this before falling back to a normal send.
+        int         numArgs;
+
+        #define LOAD_FRAME()                                                \
+            do                                                              \
+            {                                                               \
+                frame = &mCallFrames.Peek();                                \
+                block = &frame->Block();                                    \
+                code = &block->Code()[0];                                   \
+                registers = frame->registers;                               \
+                ip = frame->ip;                                             \
+            }                                                               \
+            while (false)
+
+        // Writes the cached instruction pointer back to the callframe. Must be
+        // done before anything that may push a callframe or look at the ip.
+        #define STORE_FRAME() frame->ip = ip
+
+        #define READ_INSTRUCTION()                                          \
+            do                                                              \
+            {                                                               \
+                instruction = code[ip++];                                   \
+                op = DECODE_OP(instruction);                                \
+                a = DECODE_A(instruction);                                  \
+                b = DECODE_B(instruction);                                  \
+                c = DECODE_C(instruction);                                  \
+                TRACE_INSTRUCTION(instruction);                             \
+            }                                                               \
+            while (false)
+
+        // Once an instruction may have allocated, every live value is in a
+        // register, so this is a safe time to collect.
+        #define COLLECT_IF_NEEDED()                                         \
+            if (mInterpreter.ShouldCollectGarbage())                        \
+            {                                                               \
+                mInterpreter.CollectGarbage();                              \
+            }
 
-            // Read and decode the next instruction.
-            Instruction instruction = frame.Block().Code()[frame.ip++];
-            OpCode op = DECODE_OP(instruction);
-            int a = DECODE_A(instruction);
-            int b = DECODE_B(instruction);
-            int c = DECODE_C(instruction);
+#ifdef FINCH_COMPUTED_GOTO
+        // Jump straight to the code for each instruction instead of going
+        // back through a switch. Each instruction ends with its own indirect
+        // jump, which is easier for the CPU to predict than a single shared
+        // one. The order of this table must match the OpCode enum.
+        static void * dispatchTable[] = {
+            &&code_CONSTANT,
+            &&code_BLOCK,
+            &&code_OBJECT,
+            &&code_ARRAY,
+            &&code_ARRAY_ELEMENT,
+            &&code_MOVE,
+            &&code_SELF,
+            &&code_MESSAGE, &&code_MESSAGE, &&code_MESSAGE, &&code_MESSAGE,
+            &&code_MESSAGE, &&code_MESSAGE, &&code_MESSAGE, &&code_MESSAGE,
+            &&code_MESSAGE, &&code_MESSAGE, &&code_MESSAGE,
+            &&code_ADD,
+            &&code_SUBTRACT,
+            &&code_MULTIPLY,
+            &&code_DIVIDE,
+            &&code_EQUAL,
+            &&code_NOT_EQUAL,
+            &&code_LESS,
+            &&code_GREATER,
+            &&code_LESS_EQUAL,
+            &&code_GREATER_EQUAL,
+            &&code_AT,
+            &&code_AT_PUT,
+            &&code_SEND_PRIMITIVE,
+            &&code_SEND_METHOD,
+            &&code_GET_ACCESSOR,
+            &&code_SET_ACCESSOR,
+            &&code_TAIL_MESSAGE, &&code_TAIL_MESSAGE, &&code_TAIL_MESSAGE,
+            &&code_TAIL_MESSAGE, &&code_TAIL_MESSAGE, &&code_TAIL_MESSAGE,
+            &&code_TAIL_MESSAGE, &&code_TAIL_MESSAGE, &&code_TAIL_MESSAGE,
+            &&code_TAIL_MESSAGE, &&code_TAIL_MESSAGE,
+            &&code_GET_UPVALUE,
+            &&code_SET_UPVALUE,
+            &&code_GET_FIELD,
+            &&code_SET_FIELD,
+            &&code_GET_GLOBAL,
+            &&code_SET_GLOBAL,
+            &&code_DEF_METHOD,
+            &&code_DEF_FIELD,
+            &&code_END,
+            &&code_RETURN,
+            &&code_JUMP,
+            &&code_LOOP,
+            &&code_JUMP_IF_FALSE,
+            &&code_GUARD_ETHER,
+            &&code_GUARD_LOGIC,
+            &&code_GUARD_IF,
+            &&code_CLOSE_UPVALUES,
+            &&code_BORROW,
+            &&code_CAPTURE_LOCAL,
+            &&code_CAPTURE_UPVALUE,
+            &&code_WIDE
+        };
+
+        // DISPATCH() jumps straight to the next instruction's label without
+        // leaving the current case's scope normally, so destructors of its
+        // locals never run. A case must not hold anything with a non-trivial
+        // destructor, like a Handle or String, when it dispatches.
+        #define INTERPRET_LOOP          DISPATCH();
+        #define CASE_CODE(name)         code_##name
+        #define CASE_MESSAGE_CODES      code_MESSAGE
+        #define CASE_TAIL_MESSAGE_CODES code_TAIL_MESSAGE
+        #define DISPATCH_DECODED()      goto *dispatchTable[op]
+        #define DISPATCH()                                                  \
+            do                                                              \
+            {                                                               \
+                TRACE_STACK();                                              \
+                READ_INSTRUCTION();                                         \
+                DISPATCH_DECODED();                                         \
+            }                                                               \
+            while (false)
+#else
+        #define INTERPRET_LOOP                                              \
+            loop:                                                           \
+                READ_INSTRUCTION();                                         \
+            dispatch:                                                       \
+                switch (op)
+
+        #define CASE_CODE(name)         case OP_##name
+        #define CASE_MESSAGE_CODES                                          \
+            case OP_MESSAGE_0: case OP_MESSAGE_1: case OP_MESSAGE_2:        \
+            case OP_MESSAGE_3: case OP_MESSAGE_4: case OP_MESSAGE_5:        \
+            case OP_MESSAGE_6: case OP_MESSAGE_7: case OP_MESSAGE_8:        \
+            case OP_MESSAGE_9: case OP_MESSAGE_10
+
+        #define CASE_TAIL_MESSAGE_CODES                                     \
+            case OP_TAIL_MESSAGE_0: case OP_TAIL_MESSAGE_1:                 \
+            case OP_TAIL_MESSAGE_2: case OP_TAIL_MESSAGE_3:                 \
+            case OP_TAIL_MESSAGE_4: case OP_TAIL_MESSAGE_5:                 \
+            case OP_TAIL_MESSAGE_6: case OP_TAIL_MESSAGE_7:                 \
+            case OP_TAIL_MESSAGE_8: case OP_TAIL_MESSAGE_9:                 \
+            case OP_TAIL_MESSAGE_10
+        #define DISPATCH_DECODED()      goto dispatch
+        #define DISPATCH()                                                  \
+            do                                                              \
+            {                                                               \
+                TRACE_STACK();                                              \
+                goto loop;                                                  \
+            }                                                               \
+            while (false)
+#endif
 
-            TRACE_INSTRUCTION(instruction);
+        COLLECT_IF_NEEDED();
+        LOAD_FRAME();
 
-            switch (op)
+        INTERPRET_LOOP
+        {
+            CASE_CODE(WIDE):
             {
-                case OP_CONSTANT:
-                    Store(frame, b, frame.Block().GetConstant(a));
-                    break;
+                // Shift in the low bits from the next instruction. Doing this
+                // as its own instruction instead of checking for prefixes up
+                // front keeps the common narrow case free of any extra work.
+                instruction = code[ip++];
+                op = DECODE_OP(instruction);
+                a = (a << 8) | DECODE_A(instruction);
+                b = (b << 8) | DECODE_B(instruction);
+                c = (c << 8) | DECODE_C(instruction);
+                DISPATCH_DECODED();
+            }
 
-                case OP_OBJECT:
+            CASE_CODE(CONSTANT):
+                registers[b] = block->GetConstant(a);
+                DISPATCH();
+
+            CASE_CODE(OBJECT):
+            {
+                // The parent is already in the register that the child will
+                // be placed into.
+                registers[a] = mInterpreter.NewObject(registers[a]);
+                COLLECT_IF_NEEDED();
+                DISPATCH();
+            }
+
+            CASE_CODE(BLOCK):
+            {
+                // Create a new block object from the block. If the compiler
+                // found that it's only passed to a send, it can go on the
+                // stack of blocks until OP_BORROW knows more.
+                const Handle<Block> & child = block->GetBlock(a);
+                Value blockObj = (c == 1) ?
+                    PushStackBlock(child, frame->receiver) :
+                    mInterpreter.NewBlock(child, frame->receiver);
+                BlockObject * blockPtr = blockObj.AsBlock();
+
+                // A return in the new block returns from this frame if it's a
+                // method, or else from the one this block would return from.
+                if (block->MethodId() != Block::BLOCK_METHOD_ID)
                 {
-                    // The parent is already in the register that the child
-                    // will be placed into.
-                    const Value & parent = Load(frame, a);
-                    Value object = mInterpreter.NewObject(parent);
-                    Store(frame, a, object);
-                    break;
+                    blockPtr->SetHome(mCallFrames.Count() - 1, frame->id);
+                }
+                else
+                {
+                    blockPtr->SetHome(block->HomeDepth(), block->HomeFrameId());
                 }
 
-                case OP_BLOCK:
+                // Capture upvalues.
+                for (int i = 0; i < child->NumUpvalues(); i++)
                 {
-                    // Create a new block object from the block.
-                    Ref<Block> block = frame.Block().GetBlock(a);
-                    Value blockObj = mInterpreter.NewBlock(block, Self());
-                    BlockObject * blockPtr = blockObj.AsBlock();
+                    Instruction capture = code[ip++];
+                    int captureIndex = DECODE_A(capture);
 
-                    // Capture upvalues.
-                    for (int i = 0; i < block->NumUpvalues(); i++)
+                    while (DECODE_OP(capture) == OP_WIDE)
                     {
-                        Instruction capture = frame.Block().Code()[frame.ip++];
-                        OpCode captureOp = DECODE_OP(capture);
-                        int captureIndex = DECODE_A(capture);
+                        capture = code[ip++];
+                        captureIndex = (captureIndex << 8) | DECODE_A(capture);
+                    }
 
-                        switch (captureOp)
+                    switch (DECODE_OP(capture))
+                    {
+                        case OP_CAPTURE_LOCAL:
                         {
-                            case OP_CAPTURE_LOCAL:
-                                blockPtr->AddUpvalue(CaptureUpvalue(
-                                    frame.stackStart + captureIndex));
-                                break;
+                            // The new block can do anything with what it
+                            // captures, so it can't be borrowed.
+                            BlockObject * captured =
+                                registers[captureIndex].AsBlock();
+                            if ((captured != NULL) &&
+                                (captured->StackIndex() != -1))
+                            {
+                                PromoteStackBlock(captured);
+                            }
+                            
+                            blockPtr->AddUpvalue(CaptureUpvalue(
+                                frame->stackStart + captureIndex));
+                            break;
+                        }
 
-                            case OP_CAPTURE_UPVALUE:
-                                blockPtr->AddUpvalue(frame.Block().GetUpvalue(captureIndex));
-                                break;
+                        case OP_CAPTURE_UPVALUE:
+                            blockPtr->AddUpvalue(block->GetUpvalue(captureIndex));
+                            break;
 
-                            default:
-                                ASSERT(false, "Unexpected capture pseudo-op.");
-                        }
+                        default:
+                            ASSERT(false, "Unexpected capture pseudo-op.");
                     }
-
-                    Store(frame, b, blockObj);
-                    break;
                 }
 
-                case OP_ARRAY:
+                registers[b] = blockObj;
+                COLLECT_IF_NEEDED();
+                DISPATCH();
+            }
+
+            CASE_CODE(ARRAY):
+                // Create the empty array with enough capacity. Subsequent
+                // OP_ARRAY_ELEMENT instructions will fill it.
+                registers[b] = mInterpreter.NewArray(a);
+                COLLECT_IF_NEEDED();
+                DISPATCH();
+
+            CASE_CODE(ARRAY_ELEMENT):
+                // Add the item to the array.
+                registers[b].AsArray()->Elements().Add(registers[a]);
+                DISPATCH();
+
+            CASE_CODE(MOVE):
+                registers[b] = registers[a];
+                DISPATCH();
+
+            CASE_CODE(SELF):
+                registers[a] = frame->receiver;
+                DISPATCH();
+
+            CASE_MESSAGE_CODES:
+            {
+                numArgs = op - OP_MESSAGE_0;
+
+            sendMessage:
+                STORE_FRAME();
+                Value result = SendMessage(a, b, numArgs);
+
+                // The message may have paused this fiber. If so, Resume() will
+                // store the result when it's switched back to.
+                if (!mIsRunning) return Value();
+
+                // A non-null result means the message was handled by a
+                // primitive that immediately calculated the result. Otherwise
+                // it's a normal method which has pushed a new callframe. When
+                // that method returns, it will handle setting the result on
+                // the caller.
+                if (!result.IsNull())
                 {
-                    // Create the empty array with enough capacity. Subsequent
-                    // OP_ARRAY_ELEMENT instructions will fill it.
-                    Value array = mInterpreter.NewArray(a);
-                    Store(frame, b, array);
-                    break;
+                    registers[c] = result;
                 }
-
-                case OP_ARRAY_ELEMENT:
+                else
                 {
-                    // Add the item to the array.
-                    const Value & element = Load(frame, a);
-                    Value array = Load(frame, b);
-                    array.AsArray()->Elements().Add(element);
-                    break;
+                    // Switch to the callee.
+                    LOAD_FRAME();
                 }
 
-                case OP_MOVE:
-                    //cout << "MOVE     " << a << " -> " << b << endl;
-                    Store(frame, b, Load(frame, a));
-                    break;
+                COLLECT_IF_NEEDED();
+                DISPATCH();
+            }
 
-                case OP_SELF:
-                    Store(frame, a, Self());
-                    break;
+            // Each superinstruction does its operation inline if its operands
+            // are the right type and the methods it stands in for haven't been
+            // overridden. Otherwise it's sent like any other message.
+            #define NUMBER_OP(name, result)                                 \
+                CASE_CODE(name):                                            \
+                {                                                           \
+                    const Value & left = registers[b];                      \
+                    const Value & right = registers[b + 1];                 \
+                    if (left.IsNumber() && right.IsNumber() &&              \
+                        mInterpreter.IsBuiltIn(OP_##name))                  \
+                    {                                                       \
+                        double x = left.AsNumber();                         \
+                        double y = right.AsNumber();                        \
+                        registers[c] = result;                              \
+                        DISPATCH();                                         \
+                    }                                                       \
+                                                                            \
+                    numArgs = 1;                                            \
+                    goto sendMessage;                                       \
+                }
+
+            NUMBER_OP(ADD,           Value(x + y))
+            NUMBER_OP(SUBTRACT,      Value(x - y))
+            NUMBER_OP(MULTIPLY,      Value(x * y))
+            NUMBER_OP(DIVIDE,        (y == 0) ? Nil() : Value(x / y))
+            NUMBER_OP(EQUAL,         CreateBool(x == y))
+            NUMBER_OP(NOT_EQUAL,     CreateBool(x != y))
+            NUMBER_OP(LESS,          CreateBool(x < y))
+            NUMBER_OP(GREATER,       CreateBool(x > y))
+            NUMBER_OP(LESS_EQUAL,    CreateBool(x <= y))
+            NUMBER_OP(GREATER_EQUAL, CreateBool(x >= y))
+
+            #undef NUMBER_OP
+
+            CASE_CODE(AT):
+            {
+                ArrayObject * array = registers[b].AsArray();
+                const Value & index = registers[b + 1];
+                if ((array != NULL) && index.IsNumber() &&
+                    mInterpreter.IsBuiltIn(OP_AT))
+                {
+                    // Negative indexes count back from the end, and anything
+                    // out of bounds is nil.
+                    Array<Value> & elements = array->Elements();
+                    int i = static_cast<int>(index.AsNumber());
+                    registers[c] = ((i >= -elements.Count()) &&
+                                    (i < elements.Count())) ?
+                                   elements[i] : Nil();
+                    DISPATCH();
+                }
+
+                numArgs = 1;
+                goto sendMessage;
+            }
 
-                case OP_MESSAGE_0:
-                case OP_MESSAGE_1:
-                case OP_MESSAGE_2:
-                case OP_MESSAGE_3:
-                case OP_MESSAGE_4:
-                case OP_MESSAGE_5:
-                case OP_MESSAGE_6:
-                case OP_MESSAGE_7:
-                case OP_MESSAGE_8:
-                case OP_MESSAGE_9:
-                case OP_MESSAGE_10:
+            CASE_CODE(AT_PUT):
+            {
+                ArrayObject * array = registers[b].AsArray();
+                const Value & index = registers[b + 1];
+                if ((array != NULL) && index.IsNumber() &&
+                    mInterpreter.IsBuiltIn(OP_AT_PUT))
                 {
-                    //String name = GetEnvironment().Strings().Find(a);
-                    //cout << "MESSAGE  " << name << " " << b << " -> " << c << endl;
-                    int numArgs = op - OP_MESSAGE_0;
-
-                    Value result = SendMessage(a, b, numArgs);
-
-                    // A non-null result means the message was handled by a
-                    // primitive that immediately calculated the result.
-                    // Otherwise it's a normal method which will push a new
-                    // callframe. When that method returns, it will handle
-                    // setting the result on the caller.
-                    if (!result.IsNull())
+                    Array<Value> & elements = array->Elements();
+                    int i = static_cast<int>(index.AsNumber());
+                    if ((i >= -elements.Count()) && (i < elements.Count()))
                     {
-                        Store(frame, c, result);
+                        elements[i] = registers[b + 2];
                     }
-                    break;
+
+                    registers[c] = registers[b];
+                    DISPATCH();
                 }
 
-                case OP_GET_UPVALUE:
-                {
-                    Ref<Upvalue> upvalue = frame.Block().GetUpvalue(a);
-                    Store(frame, b, upvalue->Get(mStack));
-                    break;
+                numArgs = 2;
+                goto sendMessage;
+            }
+
+            // Makes sure the inline cache for a quickened send still applies
+            // to its receiver. If not, changes the instruction back to a
+            // normal send and does that instead.
+            #define CHECK_QUICKENED_CACHE()                                 \
+                MessageCache & cache = block->GetMessageCache(ip - 1);      \
+                Value receiver = registers[b];                              \
+                if ((cache.key != receiver.DispatchKey(mInterpreter)) ||    \
+                    (cache.epoch != mInterpreter.MethodEpoch()))            \
+                {                                                           \
+                    block->Quicken(ip - 1, block->OriginalOp(ip - 1));      \
+                    numArgs = cache.numArgs;                                \
+                    goto sendMessage;                                       \
                 }
 
-                case OP_SET_UPVALUE:
+            CASE_CODE(SEND_PRIMITIVE):
+            {
+                CHECK_QUICKENED_CACHE();
+
+                STORE_FRAME();
+                ArgReader args(mStack, frame->stackStart + b + 1, cache.numArgs);
+                Value result = cache.primitive(*this, receiver, args);
+
+                // Same as a normal send from here on.
+                if (!mIsRunning) return Value();
+
+                if (!result.IsNull())
                 {
-                    Ref<Upvalue> upvalue = frame.Block().GetUpvalue(a);
-                    upvalue->Set(mStack, Load(frame, b));
-                    break;
+                    registers[c] = result;
+                }
+                else
+                {
+                    LOAD_FRAME();
                 }
 
-                case OP_GET_FIELD:
+                COLLECT_IF_NEEDED();
+                DISPATCH();
+            }
+
+            CASE_CODE(SEND_METHOD):
+            {
+                CHECK_QUICKENED_CACHE();
+
+                STORE_FRAME();
+                ArgReader args(mStack, frame->stackStart + b + 1, cache.numArgs);
+                CallBlock(receiver, cache.method, args);
+
+                // Overflowing the stack stops the fiber.
+                if (!mIsRunning) return Value();
+
+                LOAD_FRAME();
+                DISPATCH();
+            }
+
+            CASE_CODE(GET_ACCESSOR):
+            {
+                CHECK_QUICKENED_CACHE();
+
+                // Do what the method's GET_FIELD would do, using its cache.
+                const BlockObject & method = *cache.method.AsBlock();
+                registers[c] = GetField(receiver, DECODE_A(method.Code()[0]),
+                                        method.GetFieldCache(0));
+                DISPATCH();
+            }
+
+            CASE_CODE(SET_ACCESSOR):
+            {
+                CHECK_QUICKENED_CACHE();
+
+                // Do what the method's SET_FIELD would do, using its cache.
+                // The method returns the value it set.
+                const BlockObject & method = *cache.method.AsBlock();
+                Value value = registers[b + 1];
+                SetField(receiver, DECODE_A(method.Code()[0]), value,
+                         method.GetFieldCache(0));
+                registers[c] = value;
+                DISPATCH();
+            }
+
+            #undef CHECK_QUICKENED_CACHE
+
+            CASE_TAIL_MESSAGE_CODES:
+            {
+                numArgs = op - OP_TAIL_MESSAGE_0;
+                int numFrames = mCallFrames.Count();
+
+                STORE_FRAME();
+                Value result = SendMessage(a, b, numArgs);
+
+                // If the message paused this fiber, leave this frame in place.
+                // Resume() will finish it when the fiber is switched back to.
+                if (!mIsRunning) return Value();
+
+                if (!result.IsNull())
                 {
-                    Value field = Self().GetField(a);
-                    // TODO(bob): Just make a null Value equivalent to nil.
-                    if (!field.IsNull())
-                    {
-                        Store(frame, b, field);
-                    }
-                    else
+                    // A primitive calculated the result, so there's nothing
+                    // left to do in this frame. Return it.
+                    PopCallFrames(1);
+
+                    if (mCallFrames.Count() == 0)
                     {
-                        // TODO(bob): Should this be an error instead?
-                        Store(frame, b, Nil());
+                        TRACE_STACK();
+                        return result;
                     }
-                    break;
+
+                    StoreMessageResult(result);
+                }
+                else if (mCallFrames.Count() > numFrames)
+                {
+                    // A method or block was called, so have it take over this
+                    // frame instead of stacking on top of it.
+                    ReuseCallFrame();
                 }
 
-                case OP_SET_FIELD:
+                LOAD_FRAME();
+                COLLECT_IF_NEEDED();
+                DISPATCH();
+            }
+
+            CASE_CODE(GET_UPVALUE):
+            {
+                registers[b] = block->GetUpvalue(a)->Get();
+                DISPATCH();
+            }
+
+            CASE_CODE(SET_UPVALUE):
+            {
+                block->GetUpvalue(a)->Set(registers[b]);
+                DISPATCH();
+            }
+
+            CASE_CODE(GET_FIELD):
+                registers[b] = GetField(frame->receiver, a,
+                                        block->GetFieldCache(ip - 1));
+                DISPATCH();
+
+            CASE_CODE(SET_FIELD):
+                SetField(frame->receiver, a, registers[b],
+                         block->GetFieldCache(ip - 1));
+                DISPATCH();
+
+            CASE_CODE(GET_GLOBAL):
+            {
+                const Value & value = mInterpreter.GetGlobal(a);
+
+                if (!value.IsNull())
                 {
-                    Self().SetField(a, Load(frame, b));
-                    break;
+                    registers[b] = value;
+                }
+                else
+                {
+                    UndefinedGlobal(a);
+                    registers[b] = mInterpreter.Nil();
                 }
+                DISPATCH();
+            }
+
+            CASE_CODE(SET_GLOBAL):
+                mInterpreter.SetGlobal(a, registers[b]);
+                DISPATCH();
 
-                case OP_GET_GLOBAL:
+            CASE_CODE(DEF_METHOD):
+            {
+                // Get the object we're attaching the method to.
+                DynamicObject * object = registers[c].AsDynamic();
+                // TODO(bob): What should this do if you try to bind a method
+                // to something non-dynamic?
+                ASSERT_NOT_NULL(object);
+
+                object->AddMethod(a, registers[b]);
+                DISPATCH();
+            }
+
+            CASE_CODE(DEF_FIELD):
+            {
+                // Get the object we're attaching the field to.
+                DynamicObject * object = registers[c].AsDynamic();
+                // TODO(bob): What should this do if you try to bind a field
+                // to something non-dynamic?
+                ASSERT_NOT_NULL(object);
+
+                object->SetField(a, registers[b]);
+                DISPATCH();
+            }
+
+            CASE_CODE(END):
+            {
+                Value result = registers[a];
+                PopCallFrames(1);
+
+                if (mCallFrames.Count() == 0)
                 {
-                    const Value & value = mInterpreter.GetGlobal(a);
+                    // The fiber has completely unwound, so return the final
+                    // result value.
+                    TRACE_STACK();
+                    return result;
+                }
 
-                    if (!value.IsNull())
-                    {
-                        Store(frame, b, value);
-                    }
-                    else
+                StoreMessageResult(result);
+                LOAD_FRAME();
+                DISPATCH();
+            }
+
+            CASE_CODE(RETURN):
+            {
+                Value result = registers[b];
+
+                // A return in the method's own code just returns from this
+                // frame. One in a block goes straight to the call of the
+                // method that the block was created in.
+                int numFrames = 1;
+                if (block->MethodId() != a)
+                {
+                    numFrames = FramesToHome(*block);
+                    if (numFrames == -1)
                     {
-                        String name = mInterpreter.FindGlobalName(a);
-                        Error(String::Format(
-                                             "Trying to access undefined global '%s'.",
-                                             name.CString()));
-                        Store(frame, b, mInterpreter.Nil());
+                        Error("Cannot return from a block whose enclosing method has already returned.");
+                        // Unwind the whole stack.
+                        numFrames = mCallFrames.Count();
                     }
-                    break;
                 }
 
-                case OP_SET_GLOBAL:
+                PopCallFrames(numFrames);
+
+                if (mCallFrames.Count() == 0)
                 {
-                    mInterpreter.SetGlobal(a, Load(frame, b));
-                    break;
+                    // If we unwound everything, end the fiber.
+                    TRACE_STACK();
+                    return result;
                 }
 
-                case OP_DEF_METHOD:
-                {
-                    // Get the object we're attaching the method to.
-                    DynamicObject * object = Load(frame, c).AsDynamic();
-                    // TODO(bob): What should this do if you try to bind a
-                    // method to something non-dynamic?
-                    ASSERT_NOT_NULL(object);
+                StoreMessageResult(result);
+                LOAD_FRAME();
+                DISPATCH();
+            }
 
-                    object->AddMethod(a, Load(frame, b));
-                    break;
-                }
+            CASE_CODE(JUMP):
+                ip += a;
+                DISPATCH();
 
-                case OP_DEF_FIELD:
-                {
-                    // Get the object we're attaching the field to.
-                    DynamicObject * object = Load(frame, c).AsDynamic();
-                    // TODO(bob): What should this do if you try to bind a
-                    // field to something non-dynamic?
-                    ASSERT_NOT_NULL(object);
+            CASE_CODE(LOOP):
+                ip -= a;
+                DISPATCH();
 
-                    object->SetField(a, Load(frame, b));
-                    break;
+            CASE_CODE(JUMP_IF_FALSE):
+                // Like if-true:else:, only true itself counts as true.
+                if (registers[b] != mInterpreter.True()) ip += a;
+                DISPATCH();
+
+            CASE_CODE(GUARD_ETHER):
+                if (!mInterpreter.IsControlFlowBuiltIn()) ip += a;
+                DISPATCH();
+
+            CASE_CODE(GUARD_LOGIC):
+            {
+                // The cache remembers the last kind of receiver that was
+                // checked, so that the common case doesn't look up and: and
+                // or: every time.
+                MessageCache & cache = block->GetMessageCache(ip - 1);
+                const Value & key = registers[b].DispatchKey(mInterpreter);
+                if ((cache.key == key) &&
+                    (cache.epoch == mInterpreter.MethodEpoch()) &&
+                    mInterpreter.IsControlFlowBuiltIn())
+                {
+                    DISPATCH();
                 }
 
-                case OP_END:
+                if (mInterpreter.IsLogicBuiltIn(registers[b]))
+                {
+                    cache.key = key;
+                    cache.epoch = mInterpreter.MethodEpoch();
+                }
+                else
                 {
-                    const Value & result = Load(frame, a);
-                    PopCallFrame();
+                    ip += a;
+                }
+                DISPATCH();
+            }
 
-                    if (mCallFrames.Count() > 0)
-                    {
-                        StoreMessageResult(result);
-                    }
-                    else
-                    {
-                        // The fiber has completely unwound, so return the
-                        // final result value.
-                        TRACE_STACK();
-                        return result;
-                    }
-                    break;
+            CASE_CODE(GUARD_IF):
+            {
+                // Any other object that inherits if-true:else: from Object
+                // is false too. The cache works like OP_GUARD_LOGIC's.
+                const Value & condition = registers[b];
+                if ((condition == mInterpreter.False()) ||
+                    (condition == mInterpreter.Nil()))
+                {
+                    DISPATCH();
                 }
 
-                case OP_RETURN:
+                MessageCache & cache = block->GetMessageCache(ip - 1);
+                const Value & key = condition.DispatchKey(mInterpreter);
+                if ((cache.key == key) &&
+                    (cache.epoch == mInterpreter.MethodEpoch()) &&
+                    mInterpreter.IsControlFlowBuiltIn())
                 {
-                    int methodId = a;
+                    DISPATCH();
+                }
 
-                    const Value & result = Load(frame, b);
+                if (mInterpreter.IsIfBuiltIn(condition))
+                {
+                    cache.key = key;
+                    cache.epoch = mInterpreter.MethodEpoch();
+                }
+                else
+                {
+                    ip += a;
+                }
+                DISPATCH();
+            }
 
-                    // Find the enclosing method on the callstack.
-                    int methodFrame;
-                    for (methodFrame = 0; methodFrame < mCallFrames.Count(); methodFrame++)
-                    {
-                        if (mCallFrames[methodFrame].Block().MethodId() == methodId)
-                        {
-                            // Found it.
-                            break;
-                        }
-                    }
+            CASE_CODE(CLOSE_UPVALUES):
+                CloseUpvalues(frame->stackStart + a);
+                DISPATCH();
 
-                    if (methodFrame == mCallFrames.Count())
+            CASE_CODE(BORROW):
+            {
+                // Usually none of them are on the stack, for example when a
+                // parameter being passed on was given a block from the heap.
+                // The other common case is calling a block this frame was
+                // lent, which needs nothing done either.
+                for (int i = a; i <= a + b; i++)
+                {
+                    BlockObject * blockObj = registers[i].AsBlock();
+                    if ((blockObj == NULL) || (blockObj->StackIndex() == -1))
                     {
-                        Error("Cannot return from a block whose enclosing method has already returned.");
-                        // Unwind the whole stack.
-                        methodFrame = mCallFrames.Count() - 1;
+                        continue;
                     }
 
-                    // Unwind until we reach the method.
-                    while (methodFrame >= 0)
+                    if ((i == a) &&
+                        (blockObj->StackIndex() < frame->firstStackBlock) &&
+                        (DECODE_OP(code[ip]) == OP_SEND_PRIMITIVE))
                     {
-                        PopCallFrame();
-                        methodFrame--;
+                        const MessageCache & cache = block->GetMessageCache(ip);
+                        if ((cache.primitive == BlockCall) &&
+                            (cache.key == blockObj->Parent()) &&
+                            (cache.epoch == mInterpreter.MethodEpoch()))
+                        {
+                            continue;
+                        }
                     }
 
-                    if (mCallFrames.Count() > 0)
-                    {
-                        StoreMessageResult(result);
-                    }
-                    else
-                    {
-                        // If we unwound everything, end the fiber.
-                        TRACE_STACK();
-                        return result;
-                    }
+                    LendStackBlocks(ip);
                     break;
                 }
-
-                default:
-                    std::cout << op << std::endl;
-                    ASSERT(false, "Unknown opcode.");
+                DISPATCH();
             }
 
-            TRACE_STACK();
+            CASE_CODE(CAPTURE_LOCAL):
+            CASE_CODE(CAPTURE_UPVALUE):
+                // These are only ever read by OP_BLOCK.
+                ASSERT(false, "Unexpected capture pseudo-op.");
+                DISPATCH();
         }
 
+        // We only get here if an unknown opcode fell out of the switch.
+        ASSERT(false, "Unknown opcode.");
         return Value();
+
+        #undef LOAD_FRAME
+        #undef STORE_FRAME
+        #undef READ_INSTRUCTION
+        #undef COLLECT_IF_NEEDED
+        #undef INTERPRET_LOOP
+        #undef CASE_CODE
+        #undef CASE_MESSAGE_CODES
+        #undef CASE_TAIL_MESSAGE_CODES
+        #undef DISPATCH_DECODED
+        #undef DISPATCH
+    }
+
+    void Fiber::Resume(const Value & value)
+    {
+        CallFrame & frame = mCallFrames.Peek();
+
+        // A fiber that hasn't started isn't waiting on a message.
+        if (frame.ip == 0) return;
+
+        OpCode op = DECODE_OP(frame.Block().Code()[frame.ip - 1]);
+        if ((op >= OP_TAIL_MESSAGE_0) && (op <= OP_TAIL_MESSAGE_10))
+        {
+            // The send was the last thing this frame had to do, so return the
+            // value from it.
+            PopCallFrames(1);
+            if (mCallFrames.Count() == 0) return;
+        }
+
+        StoreMessageResult(value);
     }
 
     Value Fiber::Load(const CallFrame & frame, int reg)
     {
-        return mStack[frame.stackStart + reg];
+        return frame.registers[reg];
     }
 
     void Fiber::Store(const CallFrame & frame, int reg, const Value & value)
     {
-        mStack[frame.stackStart + reg] = value;
+        frame.registers[reg] = value;
     }
 
-    void Fiber::PopCallFrame()
+    void Fiber::PopCallFrames(int count)
     {
-        CallFrame & frame = mCallFrames.Peek();
-        int oldStackSize = frame.stackStart + frame.Block().NumRegisters();
-        mCallFrames.Pop();
+        // A frame's registers and blocks never start below its caller's, so
+        // everything the popped frames used can be discarded at once using
+        // the lowest start of any of them.
+        int stackStart = mStack.Count();
+        int oldStackSize = 0;
+        int lentStackBlock = mNumStackBlocks;
+        for (int i = 0; i < count; i++)
+        {
+            CallFrame & frame = mCallFrames.Peek();
+            int frameEnd = frame.stackStart + frame.Block().NumRegisters();
+            
+            if (frame.stackStart < stackStart) stackStart = frame.stackStart;
+            if (frameEnd > oldStackSize) oldStackSize = frameEnd;
+            if (frame.lentStackBlock < lentStackBlock)
+            {
+                lentStackBlock = frame.lentStackBlock;
+            }
+            
+            mCallFrames.Pop();
+        }
+        
+        if (mNumStackBlocks > lentStackBlock) PopStackBlocks(lentStackBlock);
 
         // Discard the callee frame's registers.
         int newStackSize = 0;
@@ -352,15 +899,10 @@ namespace Finch
             newStackSize = caller.stackStart + caller.Block().NumRegisters();
         }
 
-        // Close any open upvalues that are being popped off
-        // the stack.
-        while (!mOpenUpvalues.IsNull())
-        {
-            if (mOpenUpvalues->Index() < newStackSize) break;
-
-            mOpenUpvalues->Close(mStack);
-            mOpenUpvalues = mOpenUpvalues->Next();
-        }
+        // Close any open upvalues for the popped frames' variables. Their
+        // parameters are in registers that overlap the caller's, so this
+        // can't just close the ones past the caller's window.
+        CloseUpvalues(stackStart);
 
         // Clear any discarded registers on the stack. Note that we don't
         // actually truncate the stack here. This is important because we may
@@ -381,9 +923,68 @@ namespace Finch
         // Instead, we'll just *clear* the popped registers (because we know
         // they aren't in use after the call even though they may get used
         // again) but keep them around in case later callers need them.
-        for (int i = newStackSize; i < oldStackSize; i++)
+        mStack.Clear(newStackSize, oldStackSize);
+    }
+
+    int Fiber::FramesToHome(const BlockObject & block) const
+    {
+        int depth = block.HomeDepth();
+        if ((depth == -1) || (depth >= mCallFrames.Count())) return -1;
+
+        // The frame at that depth may belong to a later call, or to another
+        // fiber if the block was passed to this one.
+        int numFrames = mCallFrames.Count() - depth;
+        if (mCallFrames[numFrames - 1].id != block.HomeFrameId()) return -1;
+
+        return numFrames;
+    }
+
+    void Fiber::ReuseCallFrame()
+    {
+        CallFrame callee = mCallFrames.Pop();
+        CallFrame & frame = mCallFrames.Peek();
+
+        int oldStackSize = frame.stackStart + frame.Block().NumRegisters();
+        int calleeStackSize = callee.stackStart + callee.Block().NumRegisters();
+        if (calleeStackSize > oldStackSize) oldStackSize = calleeStackSize;
+
+        // The frame's registers are about to be overwritten, so close any
+        // upvalues that still point into them. Its blocks are gone too, but
+        // the ones its caller lent it are the callee's now.
+        CloseUpvalues(frame.stackStart);
+        PopStackBlocks(frame.firstStackBlock);
+
+        // Slide the arguments down to the start of the frame. The callee's
+        // window is always above the frame's start, so copying forward is
+        // safe.
+        int numParams = callee.Block().NumParams();
+        for (int i = 0; i < numParams; i++)
+        {
+            frame.registers[i] = callee.registers[i];
+        }
+
+        // Clear everything else so that the callee starts with fresh
+        // registers. See PopCallFrames() for why the stack isn't truncated.
+        mStack.Clear(frame.stackStart + numParams, oldStackSize);
+
+        // It's a different call now, so blocks made by the old one can't
+        // return from it.
+        frame.ip = 0;
+        frame.id = callee.id;
+        frame.receiver = callee.receiver;
+        frame.block = callee.block;
+    }
+
+    void Fiber::CloseUpvalues(int stackIndex)
+    {
+        // The list is ordered from the top of the stack down, so the ones to
+        // close are all at the front.
+        while (!mOpenUpvalues.IsNull())
         {
-            mStack[i] = Value();
+            if (mOpenUpvalues->Index() < stackIndex) break;
+
+            mOpenUpvalues->Close();
+            mOpenUpvalues = mOpenUpvalues->Next();
         }
     }
 
@@ -391,22 +992,133 @@ namespace Finch
     {
         // Store the result back in the caller's dest register.
         CallFrame & caller = mCallFrames.Peek();
-        Instruction instruction = caller.Block().Code()[caller.ip - 1];
+        const Array<Instruction> & code = caller.Block().Code();
+        Instruction instruction = code[caller.ip - 1];
 
         ASSERT((DECODE_OP(instruction) >= OP_MESSAGE_0) &&
-               (DECODE_OP(instruction) <= OP_MESSAGE_10),
+               (DECODE_OP(instruction) < OP_TAIL_MESSAGE_0),
                "Should be returning to a message instruction.");
 
-        int dest = instruction & 0x000000ff; // c
+        int dest = DECODE_C(instruction);
+
+        // If the message had wide operands, the high bits of the dest
+        // register are in the prefixes right before it.
+        int shift = 8;
+        for (int i = caller.ip - 2;
+             (i >= 0) && (DECODE_OP(code[i]) == OP_WIDE);
+             i--, shift += 8)
+        {
+            dest |= DECODE_C(code[i]) << shift;
+        }
+
         Store(caller, dest, result);
     }
 
+    OpCode Fiber::QuickenedOp(const MessageCache & cache)
+    {
+        if (cache.method.IsNull()) return OP_SEND_PRIMITIVE;
+        
+        const BlockObject & method = *cache.method.AsBlock();
+        if (method.IsGetter()) return OP_GET_ACCESSOR;
+        if (method.IsSetter()) return OP_SET_ACCESSOR;
+        
+        return OP_SEND_METHOD;
+    }
+    
+    Value Fiber::GetField(const Value & receiver, StringId name, FieldCache & cache)
+    {
+        DynamicObject * object = receiver.AsDynamic();
+
+        // If the object has the same shape as last time, the field is in the
+        // same slot.
+        if ((object != NULL) && (object->GetShape() == cache.shape))
+        {
+            return object->GetSlot(cache.slot);
+        }
+
+        // Only the object's own fields can be cached. Inherited ones depend
+        // on the parent's shape too.
+        if (object != NULL)
+        {
+            int slot = object->GetShape()->FindSlot(name);
+            if (slot != -1)
+            {
+                cache.shape = object->GetShape();
+                cache.slot = slot;
+            }
+        }
+
+        Value field = receiver.GetField(name);
+        // TODO(bob): Just make a null Value equivalent to nil.
+        // TODO(bob): Should this be an error instead?
+        if (field.IsNull()) return Nil();
+
+        return field;
+    }
+
+    void Fiber::SetField(const Value & receiver, StringId name, const Value & value,
+                         FieldCache & cache)
+    {
+        DynamicObject * object = receiver.AsDynamic();
+        if (object == NULL) return;
+
+        if (object->GetShape() == cache.shape)
+        {
+            object->SetSlot(cache.slot, value);
+            return;
+        }
+
+        object->SetField(name, value);
+
+        // Now the field is definitely the object's own.
+        cache.shape = object->GetShape();
+        cache.slot = object->GetShape()->FindSlot(name);
+    }
+
     Value Fiber::SendMessage(StringId messageId, int receiverReg, int numArgs)
     {
-        const Value & self = Load(mCallFrames.Peek(), receiverReg);
-        ArgReader args(mStack, mCallFrames.Peek().stackStart + receiverReg + 1,
-                       numArgs);
-        return self.SendMessage(*this, messageId, args);
+        const CallFrame & frame = mCallFrames.Peek();
+        const Value & self = Load(frame, receiverReg);
+        ArgReader args(mStack, frame.stackStart + receiverReg + 1, numArgs);
+
+        // See if the inline cache for this instruction already knows which
+        // method to use.
+        MessageCache & cache = frame.Block().GetMessageCache(frame.ip - 1);
+        const Value & key = self.DispatchKey(mInterpreter);
+
+        if ((cache.key != key) ||
+            (cache.epoch != mInterpreter.MethodEpoch()))
+        {
+            cache.primitive = NULL;
+            if (!self.FindMethod(mInterpreter, messageId,
+                                 &cache.method, &cache.primitive))
+            {
+                // Not handled, so don't cache anything and let the normal
+                // path report the error.
+                cache = MessageCache();
+                return self.SendMessage(*this, messageId, args);
+            }
+
+            cache.key = key;
+            cache.epoch = mInterpreter.MethodEpoch();
+            cache.numArgs = numArgs;
+            
+            // Now that the send knows where it's going, rewrite a plain
+            // message instruction so it goes there directly next time.
+            OpCode op = DECODE_OP(frame.Block().Code()[frame.ip - 1]);
+            if ((op >= OP_MESSAGE_0) && (op <= OP_MESSAGE_10))
+            {
+                frame.Block().Quicken(frame.ip - 1, QuickenedOp(cache));
+            }
+        }
+
+        if (!cache.method.IsNull())
+        {
+            CallBlock(self, cache.method, args);
+            return Value();
+        }
+
+        return cache.primitive(*this, self, args);
     }
 
     const Value & Fiber::Self()
@@ -426,7 +1138,7 @@ namespace Finch
 
     Value Fiber::CreateNumber(double value)
     {
-        return mInterpreter.NewNumber(value);
+        return Value(value);
     }
 
     Value Fiber::CreateString(const String & value)
@@ -438,22 +1150,77 @@ namespace Finch
     {
         BlockObject & block = *(blockObj.AsBlock());
 
-        // Allocate this frame's registers.
-        // TODO(bob): Make this a single operation on Array.
-        while (mStack.Count() < args.StackStart() + block.NumRegisters())
+        // Make sure the stack has room for this frame's registers.
+        int stackEnd = args.StackStart() + block.NumRegisters();
+        if (stackEnd > mStack.Count())
         {
-            mStack.Add(Value());
+            const Value * oldRegisters = mStack.At(0);
+            if (!mStack.Reserve(stackEnd))
+            {
+                StackOverflow();
+                return;
+            }
+
+            // If the registers moved, the frames below need to follow them.
+            if (mStack.At(0) != oldRegisters)
+            {
+                for (int i = 0; i < mCallFrames.Count(); i++)
+                {
+                    CallFrame & frame = mCallFrames[i];
+                    frame.registers = mStack.At(frame.stackStart);
+                }
+            }
         }
 
         // If there aren't enough arguments, nil out the remaining parameters.
+        Value * registers = mStack.At(args.StackStart());
         for (int i = args.NumArgs(); i < block.NumParams(); i++)
         {
-            mStack[args.StackStart() + i] = Nil();
+            registers[i] = Nil();
         }
 
-        mCallFrames.Push(CallFrame(args.StackStart(), receiver, blockObj));
+        // If the caller lent any of its blocks to this call, they're done
+        // with once it returns.
+        int lentStackBlock = (mLentStackBlock != -1) ?
+                             mLentStackBlock : mNumStackBlocks;
+        mLentStackBlock = -1;
+
+        mCallFrames.Push(CallFrame(mInterpreter.NextFrameId(),
+                                   args.StackStart(), registers,
+                                   receiver, blockObj, mNumStackBlocks,
+                                   lentStackBlock));
+    }
+
+    void Fiber::UndefinedGlobal(int name)
+    {
+        Error(String::Format("Trying to access undefined global '%s'.",
+                             mInterpreter.FindGlobalName(name).CString()));
+    }
+
+    void Fiber::StackOverflow()
+    {
+        Error("Stack overflow.");
+
+        // There's no way to recover from within the fiber, so unwind the
+        // whole stack and stop it.
+        PopCallFrames(mCallFrames.Count());
+
+        mLentStackBlock = -1;
+        Pause();
     }
 
+    Value Fiber::SendToArgument(StringId messageId, const Value & self, const ArgReader & args)
+    {
+        Value receiver = args[0];
+        
+        // The argument's register is the first one the callee would get, and
+        // the caller doesn't expect it to survive the send, so the receiver
+        // can be passed in its place.
+        mStack[args.StackStart()] = self;
+        ArgReader swapped(mStack, args.StackStart(), 1);
+        return receiver.SendMessage(*this, messageId, swapped);
+    }
+    
     void Fiber::Error(const String & message)
     {
         mInterpreter.GetHost().Error(message);
@@ -464,17 +1231,46 @@ namespace Finch
         return mCallFrames.Count();
     }
 
-    Ref<Upvalue> Fiber::CaptureUpvalue(int stackIndex)
+    void Fiber::Mark(Heap & heap)
+    {
+        // The heap doesn't clear the marks on blocks that aren't in it, so
+        // do that before anything can mark them again.
+        for (int i = 0; i < mStackBlocks.Count(); i++)
+        {
+            if (mStackBlocks[i] != NULL) heap.Unmark(mStackBlocks[i]);
+        }
+        
+        for (int i = 0; i < mNumStackBlocks; i++)
+        {
+            if (mStackBlocks[i] != NULL) heap.Mark(Value(mStackBlocks[i]));
+        }
+        
+        for (int i = 0; i < mStack.Count(); i++)
+        {
+            heap.Mark(mStack[i]);
+        }
+
+        for (int i = 0; i < mCallFrames.Count(); i++)
+        {
+            heap.Mark(mCallFrames[i].receiver);
+            heap.Mark(mCallFrames[i].block);
+        }
+
+        heap.Mark(mRunBy);
+    }
+
+    Handle<Upvalue> Fiber::CaptureUpvalue(int stackIndex)
     {
         // If there are no open upvalues at all, we must need a new one.
         if (mOpenUpvalues.IsNull())
         {
-            mOpenUpvalues = Ref<Upvalue>(new Upvalue(stackIndex));
+            mOpenUpvalues = Handle<Upvalue>(
+                new (mInterpreter.GetAllocator()) Upvalue(mStack, stackIndex));
             return mOpenUpvalues;
         }
 
-        Ref<Upvalue> prevUpvalue;
-        Ref<Upvalue> upvalue = mOpenUpvalues;
+        Handle<Upvalue> prevUpvalue;
+        Handle<Upvalue> upvalue = mOpenUpvalues;
         while (true)
         {
             if (upvalue.IsNull() || (upvalue->Index() < stackIndex))
@@ -482,7 +1278,8 @@ namespace Finch
                 // We've gone past this item on the stack, so there must not be
                 // an open upvalue for it. Make a new one and link it in in the
                 // right place to keep the list sorted.
-                Ref<Upvalue> newUpvalue = Ref<Upvalue>(new Upvalue(stackIndex));
+                Handle<Upvalue> newUpvalue = Handle<Upvalue>(
+                    new (mInterpreter.GetAllocator()) Upvalue(mStack, stackIndex));
 
                 if (prevUpvalue.IsNull())
                 {
@@ -509,6 +1306,128 @@ namespace Finch
         }
     }
 
+    Value Fiber::PushStackBlock(const Handle<Block> & block, const Value & self)
+    {
+        int index = mNumStackBlocks++;
+        if (index == mStackBlocks.Count()) mStackBlocks.Add(NULL);
+
+        BlockObject * blockObj = mStackBlocks[index];
+        if (blockObj == NULL)
+        {
+            blockObj = mInterpreter.NewStackBlock(block, self);
+            mStackBlocks[index] = blockObj;
+        }
+        else
+        {
+            blockObj->Reset(block, self);
+        }
+
+        blockObj->SetStackIndex(index);
+        return Value(blockObj);
+    }
+
+    void Fiber::PopStackBlocks(int index)
+    {
+        // Drop what the blocks refer to so they don't keep it alive, but keep
+        // the objects to use again.
+        while (mNumStackBlocks > index)
+        {
+            mNumStackBlocks--;
+
+            BlockObject * blockObj = mStackBlocks[mNumStackBlocks];
+            if (blockObj != NULL) blockObj->Reset(Handle<Block>(), Value());
+        }
+    }
+
+    void Fiber::LendStackBlocks(int ip)
+    {
+        const CallFrame & frame = mCallFrames.Peek();
+        const BlockObject & block = frame.Block();
+        mLentStackBlock = -1;
+
+        // Decode the send that follows.
+        int a = 0;
+        int b = 0;
+        while (DECODE_OP(block.Code()[ip]) == OP_WIDE)
+        {
+            a = (a << 8) | DECODE_A(block.Code()[ip]);
+            b = (b << 8) | DECODE_B(block.Code()[ip]);
+            ip++;
+        }
+
+        a = (a << 8) | DECODE_A(block.Code()[ip]);
+        b = (b << 8) | DECODE_B(block.Code()[ip]);
+
+        OpCode op = block.OriginalOp(ip);
+        bool isTail = (op >= OP_TAIL_MESSAGE_0);
+        int numArgs = isTail ? op - OP_TAIL_MESSAGE_0 : op - OP_MESSAGE_0;
+
+        // Find out what the send will call, without changing its cache.
+        const Value & receiver = frame.registers[b];
+        Value method;
+        PrimitiveMethod primitive = NULL;
+        bool found = true;
+
+        MessageCache & cache = block.GetMessageCache(ip);
+        if ((cache.key == receiver.DispatchKey(mInterpreter)) &&
+            (cache.epoch == mInterpreter.MethodEpoch()))
+        {
+            method = cache.method;
+            primitive = cache.primitive;
+        }
+        else
+        {
+            found = receiver.FindMethod(mInterpreter, a, &method, &primitive);
+        }
+
+        for (int i = 0; i <= numArgs; i++)
+        {
+            BlockObject * blockObj = frame.registers[b + i].AsBlock();
+            if ((blockObj == NULL) || (blockObj->StackIndex() == -1)) continue;
+
+            // A called block can borrow its receiver since it only runs its
+            // code. Otherwise, the method being called has to have promised
+            // not to keep the argument. A block this frame created can't be
+            // lent to a tail call since the frame is going away.
+            bool lend = false;
+            if (!found)
+            {
+                // The send will fail, so there's nothing to lend it to.
+            }
+            else if ((primitive == BlockCall) && (receiver.AsBlock() != NULL))
+            {
+                lend = (i == 0) || receiver.AsBlock()->BorrowsParam(i - 1);
+            }
+            else if (!method.IsNull())
+            {
+                lend = (i > 0) && method.AsBlock()->BorrowsParam(i - 1);
+            }
+
+            bool isOwned = blockObj->StackIndex() >= frame.firstStackBlock;
+            if (isOwned && isTail) lend = false;
+
+            if (!lend)
+            {
+                PromoteStackBlock(blockObj);
+            }
+            else if (isOwned)
+            {
+                if ((mLentStackBlock == -1) ||
+                    (blockObj->StackIndex() < mLentStackBlock))
+                {
+                    mLentStackBlock = blockObj->StackIndex();
+                }
+            }
+        }
+    }
+
+    void Fiber::PromoteStackBlock(BlockObject * block)
+    {
+        mStackBlocks[block->StackIndex()] = NULL;
+        block->SetStackIndex(-1);
+        mInterpreter.PromoteBlock(block);
+    }
+
 #ifdef TRACE_INSTRUCTIONS
     void Fiber::TraceInstruction(Instruction instruction)
     {
@@ -535,7 +1454,8 @@ namespace Finch
 
             case OP_BLOCK:
                 opName = "BLOCK";
-                action = String::Format("b%d -> %d", a, b);
+                action = String::Format("b%d -> %d%s", a, b,
+                                        (c == 1) ? " (stack)" : "");
                 break;
 
             case OP_ARRAY:
@@ -571,11 +1491,59 @@ namespace Finch
             case OP_MESSAGE_10:
             {
                 opName = String::Format("MESSAGE_%d", op - OP_MESSAGE_0);
-                String name = GetEnvironment().Strings().Find(a);
+                String name = mInterpreter.FindString(a);
+                action = String::Format("'%s' %d -> %d", name.CString(), b, c);
+                break;
+            }
+
+            case OP_ADD:
+            case OP_SUBTRACT:
+            case OP_MULTIPLY:
+            case OP_DIVIDE:
+            case OP_EQUAL:
+            case OP_NOT_EQUAL:
+            case OP_LESS:
+            case OP_GREATER:
+            case OP_LESS_EQUAL:
+            case OP_GREATER_EQUAL:
+            case OP_AT:
+            case OP_AT_PUT:
+            {
+                opName = "FAST_MESSAGE";
+                String name = mInterpreter.FindString(a);
+                action = String::Format("'%s' %d -> %d", name.CString(), b, c);
+                break;
+            }
+
+            case OP_SEND_PRIMITIVE:
+            case OP_SEND_METHOD:
+            case OP_GET_ACCESSOR:
+            case OP_SET_ACCESSOR:
+            {
+                opName = "QUICK_MESSAGE";
+                String name = mInterpreter.FindString(a);
                 action = String::Format("'%s' %d -> %d", name.CString(), b, c);
                 break;
             }
 
+            case OP_TAIL_MESSAGE_0:
+            case OP_TAIL_MESSAGE_1:
+            case OP_TAIL_MESSAGE_2:
+            case OP_TAIL_MESSAGE_3:
+            case OP_TAIL_MESSAGE_4:
+            case OP_TAIL_MESSAGE_5:
+            case OP_TAIL_MESSAGE_6:
+            case OP_TAIL_MESSAGE_7:
+            case OP_TAIL_MESSAGE_8:
+            case OP_TAIL_MESSAGE_9:
+            case OP_TAIL_MESSAGE_10:
+            {
+                opName = String::Format("TAIL_MESSAGE_%d", op - OP_TAIL_MESSAGE_0);
+                String name = mInterpreter.FindString(a);
+                action = String::Format("'%s' %d", name.CString(), b);
+                break;
+            }
+
             case OP_GET_UPVALUE:
                 opName = "GET_UPVALUE";
                 action = String::Format("u%d -> %d", a, b);
@@ -589,7 +1557,7 @@ namespace Finch
             case OP_GET_FIELD:
             {
                 opName = "GET_FIELD";
-                String name = GetEnvironment().Strings().Find(a);
+                String name = mInterpreter.FindString(a);
                 action = String::Format("'%s' -> %d", name.CString(), b);
                 break;
             }
@@ -597,7 +1565,7 @@ namespace Finch
             case OP_SET_FIELD:
             {
                 opName = "SET_FIELD";
-                String name = GetEnvironment().Strings().Find(a);
+                String name = mInterpreter.FindString(a);
                 action = String::Format("'%s' <- %d", name.CString(), b);
                 break;
             }
@@ -605,7 +1573,7 @@ namespace Finch
             case OP_GET_GLOBAL:
             {
                 opName = "GET_GLOBAL";
-                String name = GetEnvironment().FindGlobalName(a);
+                String name = mInterpreter.FindGlobalName(a);
                 action = String::Format("%d '%s' -> %d", a, name.CString(), b);
                 break;
             }
@@ -613,7 +1581,7 @@ namespace Finch
             case OP_SET_GLOBAL:
             {
                 opName = "SET_GLOBAL";
-                String name = GetEnvironment().FindGlobalName(a);
+                String name = mInterpreter.FindGlobalName(a);
                 action = String::Format("%d '%s' <- %d", a, name.CString(), b);
                 break;
             }
@@ -621,7 +1589,7 @@ namespace Finch
             case OP_DEF_METHOD:
             {
                 opName = "DEF_METHOD";
-                String name = GetEnvironment().Strings().Find(a);
+                String name = mInterpreter.FindString(a);
                 action = String::Format("'%s' %d -> %d", name.CString(), b, c);
                 break;
             }
@@ -629,7 +1597,7 @@ namespace Finch
             case OP_DEF_FIELD: // a name, b value, c obj
             {
                 opName = "DEF_FIELD";
-                String name = GetEnvironment().Strings().Find(a);
+                String name = mInterpreter.FindString(a);
                 action = String::Format("'%s' %d -> %d", name.CString(), b, c);
                 break;
             }
@@ -644,6 +1612,51 @@ namespace Finch
                 action = String::Format("m%d ^ %d", a, b);
                 break;
 
+            case OP_JUMP:
+                opName = "JUMP";
+                action = String::Format("+%d", a);
+                break;
+
+            case OP_LOOP:
+                opName = "LOOP";
+                action = String::Format("-%d", a);
+                break;
+
+            case OP_JUMP_IF_FALSE:
+                opName = "JUMP_IF_FALSE";
+                action = String::Format("%d +%d", b, a);
+                break;
+
+            case OP_GUARD_ETHER:
+                opName = "GUARD_ETHER";
+                action = String::Format("+%d", a);
+                break;
+
+            case OP_GUARD_LOGIC:
+                opName = "GUARD_LOGIC";
+                action = String::Format("%d +%d", b, a);
+                break;
+
+            case OP_GUARD_IF:
+                opName = "GUARD_IF";
+                action = String::Format("%d +%d", b, a);
+                break;
+
+            case OP_CLOSE_UPVALUES:
+                opName = "CLOSE_UPVALUES";
+                action = String::Format("%d", a);
+                break;
+
+            case OP_BORROW:
+                opName = "BORROW";
+                action = String::Format("%d %d", a, b);
+                break;
+
+            case OP_WIDE:
+                opName = "WIDE";
+                action = String::Format("%d %d %d", a, b, c);
+                break;
+
             default:
                 opName = String::Format("UNKNOWN OP(%d)", op);
                 action = "";
@@ -1,9 +1,13 @@
 #pragma once
 
+#include <stdint.h>
+
+#include "ArgReader.h"
 #include "Block.h"
 #include "Macros.h"
 #include "Object.h"
-#include "Ref.h"
+#include "Handle.h"
+#include "RegisterStack.h"
 #include "Stack.h"
 #include "Upvalue.h"
 
@@ -11,8 +15,9 @@
 
 namespace Finch
 {
-    class Environment;
+    class BlockObject;
     class Expr;
+    class Heap;
     class Interpreter;
     
     // A single bytecode execution thread in the interpreter. A Fiber has a
@@ -22,6 +27,7 @@ namespace Finch
     {
     public:
         Fiber(Interpreter & interpreter, const Value & block);
+        ~Fiber();
 
         bool IsRunning() const { return mIsRunning && !IsDone(); }
         
@@ -31,8 +37,21 @@ namespace Finch
         
         Interpreter & GetInterpreter() { return mInterpreter; }
 
+        // Stops Execute() after the current message send so that the
+        // interpreter can switch to another fiber.
         void Pause() { mIsRunning = false; }
 
+        // Prepares a paused fiber to continue by making the given value the
+        // result of the message send that paused it. Does nothing if the
+        // fiber hasn't started yet. If the send was the last thing the fiber
+        // had left to do, it will be done after this.
+        void Resume(const Value & value);
+
+        // Gets the fiber that last ran this one. When this fiber yields or
+        // completes, control goes back to it.
+        const Value & GetRunBy() const { return mRunBy; }
+        void SetRunBy(const Value & fiber) { mRunBy = fiber; }
+
         const Value & Nil();
         const Value & CreateBool(bool value);
         Value CreateNumber(double value);
@@ -41,12 +60,21 @@ namespace Finch
         // Pushes the given block onto the call stack.
         void CallBlock(const Value & receiver, const Value & blockObj, const ArgReader & args);
 
+        // Sends a message to a primitive's single argument, passing the
+        // primitive's receiver as its argument instead. Lets binary operators
+        // dispatch on their right operand. Like a primitive, returns null if
+        // a method was called.
+        Value SendToArgument(StringId messageId, const Value & self, const ArgReader & args);
+
         // Displays a runtime error to the user.
         void Error(const String & message);
         
         // Gets the current number of stack frames on the callstack. Used as a
         // diagnostic to ensure that tail call optimization is working.
         int GetCallstackDepth() const;
+        
+        // Marks every value on the stack and in the callframes.
+        void Mark(Heap & heap);
     private:
         // A single stack frame on the virtual callstack.
         struct CallFrame
@@ -55,8 +83,16 @@ namespace Finch
             // instruction in the bytecode for this frame.
             int ip;
             
+            // Uniquely identifies this call, so that blocks created in it can
+            // tell if it has returned. 64 bits so that it never wraps around.
+            uint64_t id;
+            
             // The index on the stack of the first register for this frame.
             int stackStart;
+            
+            // Points to the first register for this frame. Updated whenever
+            // the stack grows.
+            Value * registers;
 
             // The current receiver.
             Value receiver;
@@ -64,18 +100,37 @@ namespace Finch
             // The block of code being executed by this frame.
             Value block;
             
+            // The index of the first block on the fiber's stack of blocks
+            // that this frame created.
+            int firstStackBlock;
+            
+            // The index of the first block on the fiber's stack of blocks
+            // that goes away when this frame returns. That includes the ones
+            // the caller created only to pass to it.
+            int lentStackBlock;
+            
             CallFrame()
             :   ip(0),
+                id(0),
                 stackStart(0),
+                registers(NULL),
                 receiver(),
-                block()
+                block(),
+                firstStackBlock(0),
+                lentStackBlock(0)
             {}
             
-            CallFrame(int stackStart, const Value & receiver, const Value & block)
+            CallFrame(uint64_t id, int stackStart, Value * registers,
+                      const Value & receiver, const Value & block,
+                      int firstStackBlock, int lentStackBlock)
             :   ip(0),
+                id(id),
                 stackStart(stackStart),
+                registers(registers),
                 receiver(receiver),
-                block(block)
+                block(block),
+                firstStackBlock(firstStackBlock),
+                lentStackBlock(lentStackBlock)
             {}
 
             // Gets the code object for this frame.
@@ -88,14 +143,60 @@ namespace Finch
         // Stores a register for the given callframe.
         void Store(const CallFrame & frame, int reg, const Value & value);
 
-        void PopCallFrame();
+        // Discards the given number of callframes from the top of the
+        // callstack, along with their registers, blocks and upvalues.
+        void PopCallFrames(int count);
+        
+        // Gets the number of callframes to pop to return from the call to the
+        // method the given block was created in, including that call's own
+        // frame. Returns -1 if that call isn't on the callstack anymore.
+        int FramesToHome(const BlockObject & block) const;
+        
+        // Reports an access to a global that hasn't been defined. Kept out
+        // of Execute() so that no String is live when the case dispatches.
+        void UndefinedGlobal(int name);
+
+        // Reports that a call needed more registers than the stack can hold
+        // and unwinds the fiber.
+        void StackOverflow();
+
+        // Replaces the current callframe with the one just pushed above it.
+        // Used to implement tail calls.
+        void ReuseCallFrame();
+
+        // Closes the open upvalues for every stack slot from the given one
+        // up.
+        void CloseUpvalues(int stackIndex);
+
         void StoreMessageResult(const Value & result);
 
         Value SendMessage(StringId messageId, int receiverReg, int numArgs);
         
+        // Picks the quickened form of a send for the method its inline cache
+        // has found.
+        static OpCode QuickenedOp(const MessageCache & cache);
+        
+        // Reads and writes the receiver's fields, using and updating the
+        // given inline cache.
+        Value GetField(const Value & receiver, StringId name, FieldCache & cache);
+        void  SetField(const Value & receiver, StringId name, const Value & value,
+                       FieldCache & cache);
+        
         const Value & Self();
         
-        Ref<Upvalue> CaptureUpvalue(int stackIndex);
+        Handle<Upvalue> CaptureUpvalue(int stackIndex);
+        
+        // Creates a block on this fiber's stack of blocks.
+        Value PushStackBlock(const Handle<Block> & block, const Value & self);
+        
+        // Discards the blocks on the stack of blocks from the given index up.
+        void PopStackBlocks(int index);
+        
+        // Handles OP_BORROW for the send at the given instruction.
+        void LendStackBlocks(int ip);
+        
+        // Moves a block from the stack of blocks to the heap.
+        void PromoteStackBlock(BlockObject * block);
         
 #ifdef TRACE_INSTRUCTIONS
         void TraceInstruction(Instruction instruction);
@@ -104,12 +205,24 @@ namespace Finch
         
         bool mIsRunning;
         Interpreter & mInterpreter;
-        Array<Value>  mStack;
+        RegisterStack mStack;
         Stack<CallFrame>     mCallFrames;
         
         // Reference to first upvalue in list of open upvalues. List is ordered
         // from top of stack down.
-        Ref<Upvalue> mOpenUpvalues;
+        Handle<Upvalue> mOpenUpvalues;
+        
+        // Blocks that only live as long as the call frame that created them
+        // or the send they were passed to. The objects are allocated once
+        // and reused. A slot is NULL if its block moved to the heap.
+        Array<BlockObject *> mStackBlocks;
+        int                  mNumStackBlocks;
+        
+        // Set by OP_BORROW to the first block the next call frame pushed
+        // will take from its caller, or -1 if it doesn't take any.
+        int                  mLentStackBlock;
+        
+        Value mRunBy;
         
         NO_COPY(Fiber);
     };
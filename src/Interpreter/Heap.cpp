@@ -0,0 +1,86 @@
+#include "Heap.h"
+
+namespace Finch
+{
+    Heap::Heap()
+    :   mFirst(NULL),
+        mNextCollection(MIN_COLLECTION),
+        mGray()
+    {
+        mStats.numObjects = 0;
+        mStats.numCollections = 0;
+        mStats.numFreed = 0;
+    }
+    
+    Heap::~Heap()
+    {
+        // Nothing can refer to anything once the heap is gone.
+        while (mFirst != NULL)
+        {
+            Object * object = mFirst;
+            mFirst = object->mNext;
+            delete object;
+        }
+    }
+    
+    Value Heap::Add(Object * object)
+    {
+        object->mNext = mFirst;
+        object->mIsMarked = false;
+        mFirst = object;
+        mStats.numObjects++;
+        
+        return Value(object);
+    }
+    
+    void Heap::Mark(const Value & value)
+    {
+        if (!value.IsObject()) return;
+        
+        Object * object = value.AsObject();
+        if (object->mIsMarked) return;
+        
+        // Don't trace its children right away. Using an explicit stack instead
+        // of recursing keeps long chains of objects from overflowing the C++
+        // stack.
+        object->mIsMarked = true;
+        mGray.Push(object);
+    }
+    
+    void Heap::Collect()
+    {
+        mStats.numCollections++;
+        
+        // Trace everything reachable from the roots.
+        while (mGray.Count() > 0)
+        {
+            mGray.Pop()->MarkChildren(*this);
+        }
+        
+        // Free everything that wasn't reached and clear the marks on the rest
+        // for next time.
+        Object ** link = &mFirst;
+        while (*link != NULL)
+        {
+            Object * object = *link;
+            if (object->mIsMarked)
+            {
+                object->mIsMarked = false;
+                link = &object->mNext;
+            }
+            else
+            {
+                *link = object->mNext;
+                delete object;
+                mStats.numObjects--;
+                mStats.numFreed++;
+            }
+        }
+        
+        // Let the heap grow in proportion to how much is live so that
+        // programs with a lot of live data don't collect constantly.
+        mNextCollection = mStats.numObjects * 2;
+        if (mNextCollection < MIN_COLLECTION) mNextCollection = MIN_COLLECTION;
+    }
+}
+
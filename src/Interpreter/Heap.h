@@ -0,0 +1,82 @@
+#pragma once
+
+#include "Macros.h"
+#include "Object.h"
+#include "Stack.h"
+
+namespace Finch
+{
+    // Statistics about the garbage-collected heap. Lets the host see how much
+    // memory a script is using and how hard the collector is working.
+    struct HeapStats
+    {
+        // The number of objects currently allocated, live or not.
+        int numObjects;
+        
+        // The number of times the collector has run.
+        int numCollections;
+        
+        // The total number of objects the collector has freed.
+        int numFreed;
+    };
+    
+    // Owns every Object the interpreter allocates and frees the ones that
+    // can no longer be reached, using a simple mark-sweep collector.
+    //
+    // The Heap doesn't know what the roots are. To collect, the interpreter
+    // marks them all and then calls Collect(). It only does that at points
+    // where every live value is reachable from those roots, so the C++ code
+    // can pass Values around freely without registering them anywhere.
+    class Heap
+    {
+    public:
+        Heap();
+        ~Heap();
+        
+        // Takes ownership of a newly allocated object and returns a Value
+        // referring to it. The object may have been used outside of the heap
+        // before this (see Fiber), so any mark it has is cleared.
+        Value Add(Object * object);
+        
+        // Gets whether enough has been allocated since the last collection that
+        // it's time for another one.
+        bool ShouldCollect() const { return mStats.numObjects >= mNextCollection; }
+        
+        // Marks the given value as reachable. Called on each root by the
+        // interpreter, and on their children by the objects themselves.
+        void Mark(const Value & value);
+        
+        // Clears the mark on an object that isn't in the heap. Collect() only
+        // clears the marks on its own objects.
+        void Unmark(Object * object) { object->mIsMarked = false; }
+        
+        // Traces everything reachable from the marked roots and frees the
+        // rest.
+        void Collect();
+        
+        // Gets the number of collections that have started so far. Things
+        // that are shared by many objects can use this to tell if they've
+        // already been marked during the current one.
+        int CollectionNumber() const { return mStats.numCollections; }
+        
+        const HeapStats & GetStats() const { return mStats; }
+        
+    private:
+        // Collection won't happen until at least this many objects exist.
+        static const int MIN_COLLECTION = 1000;
+        
+        // List of every object, threaded through Object::mNext.
+        Object *        mFirst;
+        
+        // The number of objects that will trigger the next collection.
+        int             mNextCollection;
+        
+        // Objects that have been marked but whose children haven't yet.
+        Stack<Object *> mGray;
+        
+        HeapStats       mStats;
+        
+        NO_COPY(Heap);
+    };
+}
+
@@ -2,6 +2,7 @@
 
 #include <iostream>
 
+#include "Heap.h"
 #include "Macros.h"
 #include "Object.h"
 #include "Ref.h"
@@ -15,9 +16,9 @@ namespace Finch
     class ArrayObject : public Object
     {
     public:
-        ArrayObject(const Value & parent, int length)
+        ArrayObject(const Value & parent, Allocator & allocator, int length)
         :   Object(parent),
-            mElements(length)
+            mElements(allocator, length)
         {
         }
         
@@ -30,6 +31,16 @@ namespace Finch
         
         virtual ArrayObject * AsArray() { return this; }
         
+        virtual void MarkChildren(Heap & heap)
+        {
+            Object::MarkChildren(heap);
+            
+            for (int i = 0; i < mElements.Count(); i++)
+            {
+                heap.Mark(mElements[i]);
+            }
+        }
+        
         virtual String AsString() const
         {
             String text = "#[";
@@ -1,14 +1,23 @@
 #include "BlockObject.h"
+#include "Heap.h"
 
 namespace Finch
 {
+    void BlockObject::Reset(const Handle<Block> & block, const Value & self)
+    {
+        mBlock = block;
+        mSelf = self;
+        mUpvalues.Truncate(0);
+        mHomeDepth = -1;
+        mHomeFrameId = 0;
+    }
     
     const Value & BlockObject::GetConstant(int index) const
     {
         return mBlock->GetConstant(index);
     }
     
-    const Ref<Block> BlockObject::GetBlock(int index) const
+    const Handle<Block> & BlockObject::GetBlock(int index) const
     {
         return mBlock->GetBlock(index);
     }
@@ -19,13 +28,28 @@ namespace Finch
         return mBlock->Code();
     }
     
-    void BlockObject::AddUpvalue(Ref<Upvalue> upvalue)
+    void BlockObject::AddUpvalue(const Handle<Upvalue> & upvalue)
     {
         mUpvalues.Add(upvalue);
     }
     
-    Ref<Upvalue> BlockObject::GetUpvalue(int index) const
+    const Handle<Upvalue> & BlockObject::GetUpvalue(int index) const
     {
         return mUpvalues[index];
     }
+    
+    void BlockObject::MarkChildren(Heap & heap)
+    {
+        Object::MarkChildren(heap);
+        
+        heap.Mark(mSelf);
+        
+        // A block on a fiber's stack that isn't in use has no code.
+        if (!mBlock.IsNull()) mBlock->Mark(heap);
+        
+        for (int i = 0; i < mUpvalues.Count(); i++)
+        {
+            mUpvalues[i]->Mark(heap);
+        }
+    }
 }
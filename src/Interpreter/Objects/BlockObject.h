@@ -1,12 +1,13 @@
 #pragma once
 
 #include <iostream>
+#include <stdint.h>
 
 #include "Block.h"
 #include "Expr.h"
 #include "Macros.h"
 #include "Object.h"
-#include "Ref.h"
+#include "Handle.h"
 #include "FinchString.h"
 #include "Upvalue.h"
 
@@ -20,14 +21,24 @@ namespace Finch
     // encloses it.
     class BlockObject : public Object
     {
+        friend class Snapshot;
+        
     public:
-        BlockObject(const Value & parent, Ref<Block> block, const Value & self)
+        BlockObject(const Value & parent, const Handle<Block> & block,
+                    const Value & self)
         :   Object(parent),
             mBlock(block),
             mSelf(self),
-            mUpvalues(block->NumUpvalues())
+            mUpvalues(block->NumUpvalues()),
+            mStackIndex(-1),
+            mHomeDepth(-1),
+            mHomeFrameId(0)
         {}
         
+        // Reinitializes a block on a fiber's stack so that it can be used for
+        // another block literal. Keeps the upvalue array's storage.
+        void Reset(const Handle<Block> & block, const Value & self);
+        
         bool IsMethod() const { return !mSelf.IsNull(); }
         
         // Gets the object owning the method enclosing the definition of this
@@ -38,26 +49,77 @@ namespace Finch
         int NumParams() const { return mBlock->Params().Count(); }
         int MethodId() const { return mBlock->MethodId(); }
         
+        // Gets whether a block on the caller's stack can be passed to this
+        // one for the given parameter. See Block::BorrowsParam().
+        bool BorrowsParam(int param) const { return mBlock->BorrowsParam(param); }
+        
+        // The index of this block in its fiber's stack of blocks, or -1 if
+        // it's on the heap.
+        int  StackIndex() const { return mStackIndex; }
+        void SetStackIndex(int index) { mStackIndex = index; }
+        
+        // Identifies the call to the method that a return in this block
+        // returns from: the depth of its frame on the fiber's callstack and
+        // the id that frame was given. The depth is -1 and the id 0 if the
+        // block isn't in a method.
+        int      HomeDepth() const { return mHomeDepth; }
+        uint64_t HomeFrameId() const { return mHomeFrameId; }
+        void     SetHome(int depth, uint64_t frameId)
+        {
+            mHomeDepth = depth;
+            mHomeFrameId = frameId;
+        }
+        
         const Value & GetConstant(int index) const;
-        const Ref<Block> GetBlock(int index) const;
+        const Handle<Block> & GetBlock(int index) const;
         
         // Gets the compiled bytecode for the block.
         const Array<Instruction> & Code() const;
         
-        void AddUpvalue(Ref<Upvalue> upvalue);
-        Ref<Upvalue> GetUpvalue(int index) const;
+        // Rewrites the opcode of the message send at the given index. See
+        // Block::Quicken().
+        void Quicken(int ip, OpCode op) const { mBlock->Quicken(ip, op); }
+        
+        // Gets the opcode the compiler wrote for the instruction at the given
+        // index, undoing any quickening.
+        OpCode OriginalOp(int ip) const { return mBlock->OriginalOp(ip); }
+        
+        bool IsGetter() const { return mBlock->IsGetter(); }
+        bool IsSetter() const { return mBlock->IsSetter(); }
+        
+        // Gets the inline cache for the message instruction at the given
+        // index in the bytecode.
+        MessageCache & GetMessageCache(int ip) const
+        {
+            return mBlock->GetMessageCache(ip);
+        }
+        
+        // Gets the inline cache for the field instruction at the given index
+        // in the bytecode.
+        FieldCache & GetFieldCache(int ip) const
+        {
+            return mBlock->GetFieldCache(ip);
+        }
+        
+        void AddUpvalue(const Handle<Upvalue> & upvalue);
+        const Handle<Upvalue> & GetUpvalue(int index) const;
         
         virtual BlockObject * AsBlock() { return this; }
         
+        virtual void MarkChildren(Heap & heap);
+        
         virtual void Trace(ostream & stream) const
         {
             stream << "block";
         }
         
     private:
-        Ref<Block>              mBlock;
+        Handle<Block>           mBlock;
         Value                   mSelf;
-        Array<Ref<Upvalue> >    mUpvalues;
+        Array<Handle<Upvalue> > mUpvalues;
+        int                     mStackIndex;
+        int                     mHomeDepth;
+        uint64_t                mHomeFrameId;
     };
 }
 
@@ -0,0 +1,74 @@
+#include "DictionaryObject.h"
+#include "StringObject.h"
+
+namespace Finch
+{
+    unsigned int DictionaryKey::HashCode() const
+    {
+        StringObject * string = mValue.AsStringObject();
+        if (string != NULL) return string->AsString().HashCode();
+        
+        // 0 and -0 are equal, so they must hash the same
+        if (mValue.IsNumber() && (mValue.AsNumber() == 0))
+        {
+            return Value(0.0).IdentityHash();
+        }
+        
+        return mValue.IdentityHash();
+    }
+    
+    bool DictionaryKey::operator ==(const DictionaryKey & other) const
+    {
+        if (mValue == other.mValue) return true;
+        
+        if (mValue.IsNumber() && other.mValue.IsNumber())
+        {
+            return mValue.AsNumber() == other.mValue.AsNumber();
+        }
+        
+        StringObject * string = mValue.AsStringObject();
+        StringObject * otherString = other.mValue.AsStringObject();
+        if ((string != NULL) && (otherString != NULL))
+        {
+            return string->Equals(*otherString);
+        }
+        
+        return false;
+    }
+    
+    void DictionaryObject::MarkChildren(Heap & heap)
+    {
+        Object::MarkChildren(heap);
+        
+        for (int i = 0; i < mEntries.NumSlots(); i++)
+        {
+            DictionaryKey key;
+            Value value;
+            if (!mEntries.GetSlot(i, &key, &value)) continue;
+            
+            heap.Mark(key.GetValue());
+            heap.Mark(value);
+        }
+    }
+    
+    String DictionaryObject::AsString() const
+    {
+        String text = "#{";
+        
+        bool first = true;
+        for (int i = 0; i < mEntries.NumSlots(); i++)
+        {
+            DictionaryKey key;
+            Value value;
+            if (!mEntries.GetSlot(i, &key, &value)) continue;
+            
+            if (!first) text += ", ";
+            first = false;
+            
+            text += key.GetValue().AsString() + ": " + value.AsString();
+        }
+        text += "}";
+        
+        return text;
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <iostream>
+
+#include "Dictionary.h"
+#include "Heap.h"
+#include "Macros.h"
+#include "Object.h"
+#include "FinchString.h"
+
+namespace Finch
+{
+    using std::ostream;
+    
+    // A value used as a key in a DictionaryObject. Strings are the same key
+    // if they have the same characters, and numbers if they are equal.
+    // Anything else is only the same key as itself.
+    class DictionaryKey
+    {
+    public:
+        // Default constructor so we can use it in Dictionary<TKey, TValue>.
+        DictionaryKey() {}
+        
+        DictionaryKey(const Value & value)
+        :   mValue(value)
+        {}
+        
+        const Value & GetValue() const { return mValue; }
+        
+        unsigned int HashCode() const;
+        
+        bool operator ==(const DictionaryKey & other) const;
+        bool operator !=(const DictionaryKey & other) const
+        {
+            return !(*this == other);
+        }
+        
+    private:
+        Value mValue;
+    };
+    
+    // Object class for a hash table mapping keys to values.
+    class DictionaryObject : public Object
+    {
+    public:
+        DictionaryObject(const Value & parent)
+        :   Object(parent)
+        {}
+        
+        Dictionary<DictionaryKey, Value> & Entries() { return mEntries; }
+        
+        virtual void Trace(ostream & stream) const
+        {
+            stream << AsString();
+        }
+        
+        virtual DictionaryObject * AsDictionary() { return this; }
+        
+        virtual void MarkChildren(Heap & heap);
+        
+        virtual String AsString() const;
+        
+    private:
+        Dictionary<DictionaryKey, Value> mEntries;
+    };
+}
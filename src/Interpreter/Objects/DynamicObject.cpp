@@ -1,16 +1,38 @@
 #include "DynamicObject.h"
 #include "BlockObject.h"
 #include "Fiber.h"
+#include "Heap.h"
 
 namespace Finch
 {
     using std::ostream;
     
+    DynamicObject::~DynamicObject()
+    {
+        Allocator::Free(mOverflowFields);
+    }
+    
     void DynamicObject::Trace(ostream & stream) const
     {
         stream << mName;
     }
     
+    void DynamicObject::MarkChildren(Heap & heap)
+    {
+        Object::MarkChildren(heap);
+        
+        for (int i = 0; i < mShape->NumFields(); i++)
+        {
+            heap.Mark(GetSlot(i));
+        }
+        
+        for (int i = 0; i < mMethods.NumSlots(); i++)
+        {
+            Value method;
+            if (mMethods.GetSlot(i, &method)) heap.Mark(method);
+        }
+    }
+    
     Value DynamicObject::FindMethod(StringId messageId)
     {
         Value method;
@@ -39,11 +61,11 @@ namespace Finch
         DynamicObject * object = this;
         while (true)
         {
-            Value field;
-            if (object->mFields.Find(name, &field))
+            int slot = object->mShape->FindSlot(name);
+            if (slot != -1)
             {
                 // Found it.
-                return field;
+                return object->GetSlot(slot);
             }
             
             // If we're at the root of the inheritance chain, then stop.
@@ -60,16 +82,58 @@ namespace Finch
     
     void DynamicObject::SetField(StringId name, const Value & value)
     {
-        mFields.Insert(name, value);
+        int slot = mShape->FindSlot(name);
+        if (slot == -1)
+        {
+            // It's a new field, so move to the shape that has it.
+            mShape = mShape->AddField(name);
+            slot = mShape->NumFields() - 1;
+            
+            // Make room for it if it doesn't fit inline or in the overflow
+            // array.
+            int numOverflow = slot - INLINE_FIELDS + 1;
+            if ((numOverflow > 0) &&
+                (numOverflow > OverflowCapacity(numOverflow - 1)))
+            {
+                int capacity = OverflowCapacity(numOverflow);
+                Value * overflow = static_cast<Value *>(
+                    mShape->GetAllocator().Allocate(sizeof(Value) * capacity));
+                for (int i = 0; i < capacity; i++)
+                {
+                    new (&overflow[i]) Value();
+                }
+                
+                for (int i = 0; i < numOverflow - 1; i++)
+                {
+                    overflow[i] = mOverflowFields[i];
+                }
+                
+                Allocator::Free(mOverflowFields);
+                mOverflowFields = overflow;
+            }
+        }
+        
+        SetSlot(slot, value);
     }
         
+    int DynamicObject::OverflowCapacity(int numOverflow)
+    {
+        if (numOverflow == 0) return 0;
+        
+        int capacity = MIN_OVERFLOW_CAPACITY;
+        while (capacity < numOverflow) capacity *= 2;
+        return capacity;
+    }
+    
     void DynamicObject::AddMethod(StringId messageId, const Value & method)
     {
         mMethods.Insert(messageId, method);
+        mShape->AddedMethod();
     }
 
     void DynamicObject::AddPrimitive(StringId messageId, PrimitiveMethod method)
     {
         mPrimitives.Insert(messageId, method);
+        mShape->AddedMethod();
     }
 }
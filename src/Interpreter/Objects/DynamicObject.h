@@ -7,6 +7,7 @@
 #include "Macros.h"
 #include "Object.h"
 #include "Ref.h"
+#include "Shape.h"
 #include "FinchString.h"
 
 namespace Finch
@@ -19,37 +20,94 @@ namespace Finch
     // fields and methods as well as primitive methods.
     class DynamicObject : public Object
     {
+        friend class Snapshot;
+        
     public:
-        DynamicObject(const Value & parent, String name)
+        // Creates an object with no fields. The shape is the root of the
+        // interpreter's tree of shapes.
+        DynamicObject(const Value & parent, String name, Shape * emptyShape)
         :   Object(parent),
-            mName(name)
+            mName(name),
+            mShape(emptyShape),
+            mOverflowFields(NULL)
         {
         }
         
-        DynamicObject(const Value & parent)
+        DynamicObject(const Value & parent, Shape * emptyShape)
         :   Object(parent),
-            mName("object")
+            mName("object"),
+            mShape(emptyShape),
+            mOverflowFields(NULL)
         {
         }
         
+        virtual ~DynamicObject();
+        
         virtual void Trace(ostream & stream) const;
         
         virtual String AsString() const     { return mName; }
         virtual DynamicObject * AsDynamic() { return this; }
         
+        virtual void MarkChildren(Heap & heap);
+        
         Value FindMethod(StringId messageId);
         PrimitiveMethod FindPrimitive(StringId messageId);
+        
+        // Gets whether this object has any methods or primitives of its own.
+        bool HasMethods() const
+        {
+            return (mMethods.Count() > 0) || (mPrimitives.Count() > 0);
+        }
 
+        // Looks up the field with the given name on this object or its
+        // parents. Returns a null value if not found.
         Value GetField(StringId name);
+        
+        // Sets the given field on this object, adding it if needed.
         void SetField(StringId name, const Value & value);
+        
+        // Gets the layout of this object's own fields.
+        const Shape * GetShape() const { return mShape; }
+        
+        // Gets or sets the value of one of this object's own fields by its
+        // slot in the object's shape.
+        const Value & GetSlot(int slot) const
+        {
+            if (slot < INLINE_FIELDS) return mFields[slot];
+            return mOverflowFields[slot - INLINE_FIELDS];
+        }
+        
+        void SetSlot(int slot, const Value & value)
+        {
+            if (slot < INLINE_FIELDS)
+            {
+                mFields[slot] = value;
+            }
+            else
+            {
+                mOverflowFields[slot - INLINE_FIELDS] = value;
+            }
+        }
 
         void AddMethod(StringId messageId, const Value & method);
         void AddPrimitive(StringId messageId, PrimitiveMethod method);
         
     private:
+        // Most objects only have a few fields, so their values are stored
+        // right in the object. Any others go in a separate array from the
+        // shape's allocator, which doubles in size when it fills up.
+        static const int INLINE_FIELDS = 4;
+        static const int MIN_OVERFLOW_CAPACITY = 4;
+        
+        // Gets the capacity of the overflow array when it holds the given
+        // number of fields. Derived from the count so it doesn't need to be
+        // stored in every object.
+        static int OverflowCapacity(int numOverflow);
         
         String                      mName; //### bob: hack temp
-        IdTable<Value>              mFields;
+        Shape *                     mShape;
+        Value                       mFields[INLINE_FIELDS];
+        Value *                     mOverflowFields;
         IdTable<Value>              mMethods;
         IdTable<PrimitiveMethod>    mPrimitives;
     };    
@@ -29,6 +29,12 @@ namespace Finch
             stream << "fiber";
         }
         
+        virtual void MarkChildren(Heap & heap)
+        {
+            Object::MarkChildren(heap);
+            mFiber.Mark(heap);
+        }
+        
     private:
         Fiber mFiber;
     };
@@ -1,24 +1,27 @@
+#include <sstream>
+
 #include "Object.h"
 #include "ArrayObject.h"
 #include "BlockObject.h"
+#include "DictionaryObject.h"
 #include "DynamicObject.h"
 #include "FiberObject.h"
+#include "Heap.h"
 #include "Interpreter.h"
-#include "NumberObject.h"
 #include "Fiber.h"
 #include "StringObject.h"
 
 namespace Finch
 {
     using std::ostream;
+    using std::stringstream;
     
-    Value::Value(const Value & other)
-    :   mObj(other.mObj)
+    const Value & Value::Parent(Interpreter & interpreter) const
     {
-        if (mObj != NULL) mObj->mRefCount++;
+        if (IsNumber()) return interpreter.NumberPrototype();
+        
+        return AsObject()->Parent();
     }
-    
-    const Value & Value::Parent() const { return mObj->Parent(); }
 
     void Value::Trace(ostream & cout) const
     {
@@ -26,22 +29,14 @@ namespace Finch
         {
             cout << "(nil)";
         }
-        else
+        else if (IsNumber())
         {
-            mObj->Trace(cout);
+            cout << mNumber;
         }
-    }
-
-    Value & Value::operator =(const Value & other)
-    {
-        if (&other != this)
+        else
         {
-            Clear();
-            mObj = other.mObj;
-            if (mObj != NULL) mObj->mRefCount++;
+            AsObject()->Trace(cout);
         }
-        
-        return *this;
     }
     
     Value Value::GetField(int name) const
@@ -64,38 +59,23 @@ namespace Finch
 
     Value Value::SendMessage(Fiber & fiber, StringId messageId, const ArgReader & args) const
     {
-        const Value * receiver = this;
+        Interpreter & interpreter = fiber.GetInterpreter();
         
-        // Walk the parent chain looking for a method that matches the message.
-        while (true)
+        Value method;
+        PrimitiveMethod primitive = NULL;
+        if (FindMethod(interpreter, messageId, &method, &primitive))
         {
-            // Only dynamic objects have methods.
-            DynamicObject * dynamic = receiver->AsDynamic();
-            if (dynamic != NULL)
+            if (!method.IsNull())
             {
-                // See if the object has a method bound to that name.
-                Value method = dynamic->FindMethod(messageId);
-                if (!method.IsNull())
-                {
-                    fiber.CallBlock(*this, method, args);
-                    return Value();
-                }
-                
-                // See if the object has a primitive bound to that name.
-                PrimitiveMethod primitive = dynamic->FindPrimitive(messageId);
-                if (primitive != NULL)
-                {
-                    return primitive(fiber, *this, args);
-                }
+                fiber.CallBlock(*this, method, args);
+                return Value();
             }
             
-            // If we're at the root of the inheritance chain, then stop.
-            if (receiver->Parent().IsNull()) break;
-            receiver = &receiver->Parent();
+            return primitive(fiber, *this, args);
         }
         
         // If we got here, the object didn't handle the message.
-        String messageName = fiber.GetInterpreter().FindString(messageId);
+        String messageName = interpreter.FindString(messageId);
         String error = String::Format("Object '%s' did not handle message '%s'",
                                       AsString().CString(), messageName.CString());
         fiber.Error(error);
@@ -104,26 +84,90 @@ namespace Finch
         return fiber.Nil();
     }
 
-    void Value::Clear()
+    bool Value::FindMethod(Interpreter & interpreter, StringId messageId,
+                           Value * method, PrimitiveMethod * primitive) const
     {
-        if (mObj != NULL)
+        const Value * receiver = this;
+        
+        // Walk the parent chain looking for a method that matches the message.
+        while (true)
         {
-            mObj->mRefCount--;
-            if (mObj->mRefCount == 0)
+            // Only dynamic objects have methods.
+            DynamicObject * dynamic = receiver->AsDynamic();
+            if (dynamic != NULL)
             {
-                delete mObj;
+                // See if the object has a method bound to that name.
+                *method = dynamic->FindMethod(messageId);
+                if (!method->IsNull()) return true;
+                
+                // See if the object has a primitive bound to that name.
+                *primitive = dynamic->FindPrimitive(messageId);
+                if (*primitive != NULL) return true;
             }
             
-            mObj = NULL;
+            // If we're at the root of the inheritance chain, then stop.
+            const Value & parent = receiver->Parent(interpreter);
+            if (parent.IsNull()) return false;
+            receiver = &parent;
         }
     }
+    
+    const Value & Value::DispatchKey(Interpreter & interpreter) const
+    {
+        if (IsNumber()) return interpreter.NumberPrototype();
+        
+        DynamicObject * dynamic = AsObject()->AsDynamic();
+        if ((dynamic != NULL) && dynamic->HasMethods()) return *this;
         
-    double Value::AsNumber() const { return mObj->AsNumber(); }
-    String Value::AsString() const { return mObj->AsString(); }
-    ArrayObject * Value::AsArray() const { return mObj->AsArray(); }
-    BlockObject * Value::AsBlock() const { return mObj->AsBlock(); }
-    DynamicObject * Value::AsDynamic() const { return mObj->AsDynamic(); }
-    FiberObject * Value::AsFiber() const { return mObj->AsFiber(); }
+        return AsObject()->Parent();
+    }
+    
+    String Value::AsString() const
+    {
+        if (IsNumber())
+        {
+            stringstream result;
+            result << mNumber;
+            return String(result.str().c_str());
+        }
+        
+        return AsObject()->AsString();
+    }
+    
+    ArrayObject * Value::AsArray() const
+    {
+        if (IsNumber()) return NULL;
+        return AsObject()->AsArray();
+    }
+    
+    DictionaryObject * Value::AsDictionary() const
+    {
+        if (!IsObject()) return NULL;
+        return AsObject()->AsDictionary();
+    }
+    
+    DynamicObject * Value::AsDynamic() const
+    {
+        if (IsNumber()) return NULL;
+        return AsObject()->AsDynamic();
+    }
+    
+    FiberObject * Value::AsFiber() const
+    {
+        if (IsNumber()) return NULL;
+        return AsObject()->AsFiber();
+    }
+    
+    StringObject * Value::AsStringObject() const
+    {
+        if (!IsObject()) return NULL;
+        return AsObject()->AsStringObject();
+    }
+    
+    void Object::MarkChildren(Heap & heap)
+    {
+        heap.Mark(mParent);
+    }
     
     ostream & operator<<(ostream & cout, const Value & value)
     {
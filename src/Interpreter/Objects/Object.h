@@ -1,9 +1,9 @@
 #pragma once
 
 #include <iostream>
+#include <stdint.h>
 
 #include "Array.h"
-#include "ArgReader.h"
 #include "Macros.h"
 #include "Ref.h"
 #include "FinchString.h"
@@ -16,79 +16,163 @@ namespace Finch
     using std::ostream;
 
     class Expr;
+    class ArgReader;
     class ArrayObject;
     class Block;
     class BlockObject;
+    class DictionaryObject;
     class DynamicObject;
     class Environment;
     class Fiber;
     class FiberObject;
+    class Heap;
     class Interpreter;
+    class StringObject;
     class Object;
+    class Value;
 
     typedef Value (*PrimitiveMethod)(Fiber & fiber, const Value & self,
                                      const ArgReader & args);
 
+    // A reference to a Finch value. Numbers are stored directly inside the
+    // Value without any allocation. Everything else is a pointer to a
+    // garbage-collected Object on the Heap. Values are plain bits, so copying
+    // one is as cheap as copying a double.
+    //
+    // This uses "NaN-boxing": a Value is always 64 bits. If those bits are a
+    // regular double, then it's a number. IEEE 754 reserves a large range of
+    // quiet NaN bit patterns that the hardware never produces itself, so we
+    // use one of those (with the sign bit set) to tag an object pointer in
+    // the low bits, and another to represent the null value.
     class Value
     {
+        friend class Heap;
+        friend class Snapshot;
+        
     public:
         // Constructs a new null value.
         Value()
-        :   mObj(NULL)
+        :   mBits(NULL_BITS)
         {}
         
         explicit Value(Object * obj)
-        :   mObj(obj)
+        :   mBits(obj == NULL ? NULL_BITS :
+                  (OBJECT_BITS | reinterpret_cast<uintptr_t>(obj)))
+        {}
+        
+        // Constructs a new number value.
+        explicit Value(double number)
         {
-            // Don't increment refcount because Object's constructor initializes
-            // it to 1.
+            // Make sure any NaN produced by arithmetic has the canonical bit
+            // pattern so it can't be mistaken for a tagged value.
+            if (number != number)
+            {
+                mBits = CANONICAL_NAN;
+            }
+            else
+            {
+                mNumber = number;
+            }
         }
         
-        // Copies a value. If the copied value is a reference type, both values
-        // will point to the same object.
-        Value(const Value & other);
-        
-        ~Value() { Clear(); }
-        
         Value GetField(int name) const;
         void SetField(int name, const Value & value) const;
         
         Value SendMessage(Fiber & fiber, StringId messageId, const ArgReader & args) const;
+        
+        // Walks the parent chain looking for the method or primitive this
+        // value uses to respond to the given message. Returns false if it
+        // doesn't handle it.
+        bool FindMethod(Interpreter & interpreter, StringId messageId,
+                        Value * method, PrimitiveMethod * primitive) const;
+        
+        // Gets the value whose methods determine how this value responds to
+        // messages: the value itself if it has methods of its own, otherwise
+        // its parent. As long as no methods are added, two values with the
+        // same key will find the same methods.
+        const Value & DispatchKey(Interpreter & interpreter) const;
 
-        // Compares two values.
+        // Compares two values. Numbers are equal if they have the same bits,
+        // objects if they are the same object.
         bool operator ==(const Value & other) const
         {
-            return mObj == other.mObj;
+            return mBits == other.mBits;
         }
         
         // Compares two values.
         bool operator !=(const Value & other) const
         {
-            return mObj != other.mObj;
+            return mBits != other.mBits;
         }
         
-        Value & operator =(const Value & other);
-        
         // Gets whether or not this value is nil.
-        bool IsNull() const { return mObj == NULL; }
+        bool IsNull() const { return mBits == NULL_BITS; }
         
-        // Clears the reference. If this was the last reference to the referred
-        // object, it will be deallocated.
-        void Clear();
+        // Gets whether or not this value is an unboxed number.
+        bool IsNumber() const { return (mBits & QNAN) != QNAN; }
         
-        const Value & Parent() const;
+        // Gets whether or not this value refers to an Object on the heap.
+        bool IsObject() const
+        {
+            return (mBits & OBJECT_BITS) == OBJECT_BITS;
+        }
+        
+        // Clears the reference. The object it referred to will be freed by
+        // the next collection if nothing else refers to it.
+        void Clear() { mBits = NULL_BITS; }
+        
+        // Gets a hash code for the value's identity, so that values that are
+        // == hash the same.
+        unsigned int IdentityHash() const
+        {
+            // mix the high bits in, since the low bits of an object's address
+            // are always zero
+            uint64_t bits = mBits ^ (mBits >> 29);
+            bits *= 0xbf58476d1ce4e5b9ULL;
+            return static_cast<unsigned int>(bits ^ (bits >> 32));
+        }
+        
+        // Gets the parent of this value. Numbers don't have an object to store
+        // their parent in, so the interpreter is needed to find it.
+        const Value & Parent(Interpreter & interpreter) const;
         
         void Trace(ostream & cout) const;
         
-        double          AsNumber() const;
-        String          AsString() const;
-        ArrayObject *   AsArray() const;
-        BlockObject *   AsBlock() const;
-        DynamicObject * AsDynamic() const;
-        FiberObject *   AsFiber() const;
+        double             AsNumber() const;
+        String             AsString() const;
+        ArrayObject *      AsArray() const;
+        BlockObject *      AsBlock() const;
+        DictionaryObject * AsDictionary() const;
+        DynamicObject *    AsDynamic() const;
+        FiberObject *      AsFiber() const;
+        StringObject *     AsStringObject() const;
         
     private:
-        Object * mObj;
+        // The bits that are set for every quiet NaN we use as a tag. This
+        // includes one bit past the normal quiet NaN bit so that the NaNs the
+        // hardware generates are never mistaken for tagged values.
+        static const uint64_t QNAN          = 0x7ffc000000000000ULL;
+        
+        // The bit pattern for an object pointer, OR'd with the pointer.
+        static const uint64_t OBJECT_BITS   = 0xfffc000000000000ULL;
+        
+        // The bit pattern for the null value.
+        static const uint64_t NULL_BITS     = QNAN;
+        
+        // The single bit pattern used for every NaN number.
+        static const uint64_t CANONICAL_NAN = 0x7ff8000000000000ULL;
+        
+        Object * AsObject() const
+        {
+            return reinterpret_cast<Object *>(
+                static_cast<uintptr_t>(mBits & ~OBJECT_BITS));
+        }
+        
+        union
+        {
+            double   mNumber;
+            uint64_t mBits;
+        };
     };
     
     ostream & operator<<(ostream & cout, const Value & value);
@@ -96,28 +180,64 @@ namespace Finch
     // Base class for an object in Finch. All values in Finch inherit from this.
     class Object
     {
+        friend class Heap;
+        friend class Snapshot;
         friend class Value;
         
     public:
         virtual ~Object() {}
 
-        virtual double          AsNumber() const { return 0; }
-        virtual String          AsString() const { return ""; }
-        virtual ArrayObject *   AsArray()        { return NULL; }
-        virtual BlockObject *   AsBlock()        { return NULL; }
-        virtual DynamicObject * AsDynamic()      { return NULL; }
-        virtual FiberObject *   AsFiber()        { return NULL; }
+        virtual double             AsNumber() const { return 0; }
+        virtual String             AsString() const { return ""; }
+        virtual ArrayObject *      AsArray()        { return NULL; }
+        virtual BlockObject *      AsBlock()        { return NULL; }
+        virtual DictionaryObject * AsDictionary()   { return NULL; }
+        virtual DynamicObject *    AsDynamic()      { return NULL; }
+        virtual FiberObject *      AsFiber()        { return NULL; }
+        virtual StringObject *     AsStringObject() { return NULL; }
 
         const Value & Parent() const { return mParent; }
 
         virtual void Trace(ostream & stream) const = 0;
 
+        // Marks every value this object refers to so that the collector
+        // knows they are still in use. Objects that hold other values must
+        // override this and call the base implementation.
+        virtual void MarkChildren(Heap & heap);
+
+        // Objects are allocated from the interpreter's Allocator.
+        USE_ALLOCATOR
+
     protected:
-        Object(const Value & parent) : mParent(parent), mRefCount(1) {}
+        Object(const Value & parent)
+        :   mParent(parent),
+            mNext(NULL),
+            mIsMarked(false)
+        {}
 
     private:
-        Value mParent;
-        int   mRefCount;
+        Value    mParent;
+        
+        // The next object in the Heap's list of all allocated objects.
+        Object * mNext;
+        
+        // Whether the collector has reached this object yet.
+        bool     mIsMarked;
     };
-}
 
+    // Defined here instead of in the class so that it can see Object. The
+    // interpreter loop converts numbers often enough that this is worth
+    // inlining.
+    inline double Value::AsNumber() const
+    {
+        if (IsNumber()) return mNumber;
+        return AsObject()->AsNumber();
+    }
+    
+    // Likewise, OP_BORROW checks every value it's given for blocks.
+    inline BlockObject * Value::AsBlock() const
+    {
+        if (!IsObject()) return NULL;
+        return AsObject()->AsBlock();
+    }
+}
@@ -0,0 +1,71 @@
+#include "Shape.h"
+
+namespace Finch
+{
+    Shape::Shape(Allocator & allocator)
+    :   mAllocator(&allocator),
+        mRoot(this),
+        mMethodEpoch(0),
+        mParent(NULL),
+        mName(NO_STRING),
+        mNumFields(0),
+        mChildren(allocator, 0)
+    {
+    }
+    
+    Shape::Shape(Shape * parent, StringId name)
+    :   mAllocator(parent->mAllocator),
+        mRoot(parent->mRoot),
+        mMethodEpoch(0),
+        mParent(parent),
+        mName(name),
+        mNumFields(parent->mNumFields + 1),
+        mChildren(*parent->mAllocator, 0)
+    {
+    }
+    
+    Shape::~Shape()
+    {
+        for (int i = 0; i < mChildren.Count(); i++)
+        {
+            delete mChildren[i];
+        }
+    }
+    
+    StringId Shape::FieldName(int slot) const
+    {
+        ASSERT_RANGE(slot, mNumFields);
+        
+        const Shape * shape = this;
+        while (shape->mNumFields - 1 > slot) shape = shape->mParent;
+        
+        return shape->mName;
+    }
+    
+    int Shape::FindSlot(StringId name) const
+    {
+        // Objects rarely have more than a handful of fields, so a linear
+        // search up the tree is faster than hashing here.
+        for (const Shape * shape = this; shape->mParent != NULL;
+             shape = shape->mParent)
+        {
+            if (shape->mName == name) return shape->mNumFields - 1;
+        }
+        
+        return -1;
+    }
+    
+    Shape * Shape::AddField(StringId name)
+    {
+        // See if we've already made this transition.
+        for (int i = 0; i < mChildren.Count(); i++)
+        {
+            if (mChildren[i]->mName == name) return mChildren[i];
+        }
+        
+        Shape * child = new (*mAllocator) Shape(this, name);
+        mChildren.Add(child);
+        
+        return child;
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "Allocator.h"
+#include "Array.h"
+#include "Macros.h"
+
+namespace Finch
+{
+    // Describes the layout of a DynamicObject's fields: which fields it has
+    // and which slot each one's value is stored in. Objects that had the same
+    // fields added in the same order share a single Shape, so the field names
+    // only need to be stored once and each object can keep just a flat array
+    // of values.
+    //
+    // Shapes form a tree rooted at the empty shape, which each Interpreter
+    // owns. Adding a field to an object moves it to a child of its current
+    // shape that has the one extra field, so a shape only stores that field
+    // and finds the rest through its parent. Shapes live until the tree's
+    // root is destroyed, so it's safe to hang onto a pointer to one for
+    // caching.
+    class Shape
+    {
+    public:
+        // Creates an empty shape to be the root of a new tree. The rest of
+        // the tree is allocated from the given allocator.
+        Shape(Allocator & allocator);
+        
+        ~Shape();
+        
+        // Gets the number of fields in this shape.
+        int NumFields() const { return mNumFields; }
+        
+        // Gets the name of the field stored in the given slot.
+        StringId FieldName(int slot) const;
+        
+        // Gets the slot that the given field is stored in, or -1 if this
+        // shape doesn't have it.
+        int FindSlot(StringId name) const;
+        
+        // Gets the shape that has all of the fields of this one plus the
+        // given one, which will be stored in the last slot.
+        Shape * AddField(StringId name);
+        
+        // Gets the allocator this shape's tree comes from. Objects with a
+        // shape from the tree get the storage for their fields from it too.
+        Allocator & GetAllocator() const { return *mAllocator; }
+        
+        // Gets a counter that is incremented every time a method or
+        // primitive is added to an object with a shape from this tree.
+        // Inline caches use it to tell if they're stale. Since each
+        // Interpreter has its own tree, adding methods in one doesn't
+        // affect the caches of another.
+        int MethodEpoch() const { return mRoot->mMethodEpoch; }
+        
+        // Notes that a method or primitive was added to an object with this
+        // shape.
+        void AddedMethod() { mRoot->mMethodEpoch++; }
+        
+        USE_ALLOCATOR
+        
+    private:
+        Shape(Shape * parent, StringId name);
+        
+        Allocator *     mAllocator;
+        
+        // The empty shape at the root of the tree.
+        Shape *         mRoot;
+        
+        // Only used by the root. See MethodEpoch().
+        int             mMethodEpoch;
+        
+        // The shape this one adds a field to, or NULL for the root.
+        Shape *         mParent;
+        
+        // The name of the field this shape adds, stored in the last slot.
+        StringId        mName;
+        
+        int             mNumFields;
+        
+        // The shapes reached by adding one more field to this one.
+        Array<Shape *>  mChildren;
+        
+        NO_COPY(Shape);
+    };
+}
@@ -11,13 +11,18 @@ namespace Finch
 {
     using std::ostream;
     
-    // Object class for a string.
+    // Object class for a string. String literals are symbols: there is only
+    // one StringObject for each distinct literal, and it knows the literal's
+    // ID in the interpreter's StringTable, so two symbols can be compared
+    // without looking at their characters.
     class StringObject : public Object
     {
     public:
-        StringObject(const Value & parent, String value)
+        StringObject(const Value & parent, String value,
+                     StringId symbol = NO_STRING)
         :   Object(parent),
-            mValue(value)
+            mValue(value),
+            mSymbol(symbol)
         {}
         
         virtual void Trace(ostream & stream) const
@@ -26,9 +31,28 @@ namespace Finch
         }
             
         virtual String AsString() const { return mValue; }
+        virtual StringObject * AsStringObject() { return this; }
+        
+        // Gets the string's ID in the StringTable if it's a symbol, or
+        // NO_STRING if it isn't.
+        StringId Symbol() const { return mSymbol; }
+        
+        bool Equals(const StringObject & other) const
+        {
+            if (this == &other) return true;
+            
+            // interned strings are unique, so symbols are equal only if they
+            // are the same string
+            if ((mSymbol != NO_STRING) && (other.mSymbol != NO_STRING))
+            {
+                return mSymbol == other.mSymbol;
+            }
+            
+            return mValue == other.mValue;
+        }
         
     private:
-        String mValue;
+        String   mValue;
+        StringId mSymbol;
     };    
 }
-
@@ -10,6 +10,7 @@
 #include "Primitives.h"
 #include "Fiber.h"
 #include "Object.h"
+#include "StringObject.h"
 
 namespace Finch
 {
@@ -27,6 +28,15 @@ namespace Finch
         return fiber.CreateNumber(args[0].AsString().CompareTo(args[1].AsString()));
     }
     
+    PRIMITIVE(PrimitiveStringEquals)
+    {
+        StringObject * left = args[0].AsStringObject();
+        StringObject * right = args[1].AsStringObject();
+        if ((left == NULL) || (right == NULL)) return fiber.CreateBool(false);
+        
+        return fiber.CreateBool(left->Equals(*right));
+    }
+    
     PRIMITIVE(PrimitiveWrite)
     {
         String text = args[0].AsString();
@@ -34,19 +44,21 @@ namespace Finch
         return fiber.Nil();
     }
     
+    PRIMITIVE(PrimitiveNewDictionary)
+    {
+        return fiber.GetInterpreter().NewDictionary();
+    }
+    
     // Primitives for manipulating fibers.
-    /*
     PRIMITIVE(PrimitiveNewFiber)
     {
-        // get block arg
-        BlockObject * block = args[0].AsBlock();
-        if (block == NULL)
+        if (args[0].AsBlock() == NULL)
         {
             fiber.Error("Must pass in a block object to create a new fiber.");
             return fiber.Nil();
         }
         
-        return Object::NewFiber(fiber.GetInterpreter(), args[0]);
+        return fiber.GetInterpreter().NewFiber(args[0]);
     }
     
     PRIMITIVE(PrimitiveGetCurrentFiber)
@@ -54,36 +66,66 @@ namespace Finch
         return fiber.GetInterpreter().GetCurrentFiber();
     }
     
-    PRIMITIVE(PrimitiveSwitchToFiber)
+    // Switches from the current fiber to the given one, passing it a value.
+    // If runBy is true, the target will switch back to the current fiber when
+    // it yields or completes.
+    static Value SwitchToFiber(Fiber & fiber, const Value & target,
+                               const Value & value, bool runBy)
     {
-        // get the fiber we're about switch to
-        FiberObject * fiberObj = args[0].AsFiber();
-        
-        // if you try to run a completed fiber, it does nothing
-        if (fiberObj->GetFiber().IsDone())
+        FiberObject * fiberObj = target.AsFiber();
+        if (fiberObj == NULL)
         {
+            fiber.Error("Must pass in a fiber object to switch to.");
             return fiber.Nil();
         }
         
-        // pass the value to the new fiber
-        // TODO(bob): Figure out how to do this with registers.
-        fiberObj->GetFiber().Push(args[1]);
+        // If you try to run a completed fiber, it does nothing.
+        if (fiberObj->GetFiber().IsDone()) return fiber.Nil();
         
-        // run the new fiber
-        fiber.GetInterpreter().SwitchToFiber(args[0]);
+        // This includes the current fiber, and any that are waiting on a file
+        // being loaded.
+        if (fiberObj->GetFiber().IsRunning())
+        {
+            fiber.Error("Cannot switch to a fiber that is already running.");
+            return fiber.Nil();
+        }
         
-        // TODO(bob): What should we return here?
-        return Ref<Object>();
+        Interpreter & interpreter = fiber.GetInterpreter();
+        if (runBy) fiberObj->GetFiber().SetRunBy(interpreter.GetCurrentFiber());
+        interpreter.SwitchToFiber(target, value);
         
-        // note that unlike other primitives, we are *not* pushing a result
-        // onto the stack of the calling fiber here. when we switch back to
-        // this fiber, we'll push the passed value on to the stack then.
+        // This won't be used. When another fiber switches back to this one,
+        // the value it passes will be the result instead.
+        return fiber.Nil();
+    }
+    
+    PRIMITIVE(PrimitiveSwitchToFiber)
+    {
+        return SwitchToFiber(fiber, args[0], args[1], false);
+    }
+    
+    PRIMITIVE(PrimitiveRunFiber)
+    {
+        return SwitchToFiber(fiber, args[0], args[1], true);
     }
-    */
 
     PRIMITIVE(PrimitiveGetCallstackDepth)
     {
         return fiber.CreateNumber(fiber.GetCallstackDepth());
     }
+    
+    PRIMITIVE(PrimitiveCollectGarbage)
+    {
+        // This is safe here because the only values in flight are the
+        // receiver and arguments, and those are still in registers.
+        fiber.GetInterpreter().CollectGarbage();
+        return fiber.Nil();
+    }
+    
+    PRIMITIVE(PrimitiveGetHeapObjectCount)
+    {
+        return fiber.CreateNumber(
+            fiber.GetInterpreter().GetHeapStats().numObjects);
+    }
 }
 
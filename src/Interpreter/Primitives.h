@@ -9,14 +9,18 @@ namespace Finch
 {
     PRIMITIVE(PrimitiveStringConcat);
     PRIMITIVE(PrimitiveStringCompare);
+    PRIMITIVE(PrimitiveStringEquals);
 
     PRIMITIVE(PrimitiveWrite);
     
-    /*
+    PRIMITIVE(PrimitiveNewDictionary);
+    
     PRIMITIVE(PrimitiveNewFiber);
     PRIMITIVE(PrimitiveGetCurrentFiber);
     PRIMITIVE(PrimitiveSwitchToFiber);
-     */
+    PRIMITIVE(PrimitiveRunFiber);
     PRIMITIVE(PrimitiveGetCallstackDepth);
+    PRIMITIVE(PrimitiveCollectGarbage);
+    PRIMITIVE(PrimitiveGetHeapObjectCount);
 }
 
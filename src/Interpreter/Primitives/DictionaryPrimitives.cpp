@@ -0,0 +1,80 @@
+#include "ArrayObject.h"
+#include "DictionaryObject.h"
+#include "DictionaryPrimitives.h"
+#include "Fiber.h"
+#include "Interpreter.h"
+#include "Object.h"
+
+namespace Finch
+{
+    PRIMITIVE(DictionaryCount)
+    {
+        DictionaryObject * dictionary = self.AsDictionary();
+        ASSERT_NOT_NULL(dictionary);
+        
+        return fiber.CreateNumber(dictionary->Entries().Count());
+    }
+    
+    PRIMITIVE(DictionaryAt)
+    {
+        DictionaryObject * dictionary = self.AsDictionary();
+        ASSERT_NOT_NULL(dictionary);
+        
+        // missing keys are nil
+        Value value;
+        if (!dictionary->Entries().Find(args[0], &value)) return fiber.Nil();
+        
+        return value;
+    }
+    
+    PRIMITIVE(DictionaryAtPut)
+    {
+        DictionaryObject * dictionary = self.AsDictionary();
+        ASSERT_NOT_NULL(dictionary);
+        
+        dictionary->Entries().Insert(args[0], args[1]);
+        return self;
+    }
+    
+    PRIMITIVE(DictionaryContains)
+    {
+        DictionaryObject * dictionary = self.AsDictionary();
+        ASSERT_NOT_NULL(dictionary);
+        
+        Value value;
+        return fiber.CreateBool(dictionary->Entries().Find(args[0], &value));
+    }
+    
+    PRIMITIVE(DictionaryRemove)
+    {
+        DictionaryObject * dictionary = self.AsDictionary();
+        ASSERT_NOT_NULL(dictionary);
+        
+        // returns the removed value, or nil if it wasn't there
+        Value removed;
+        if (!dictionary->Entries().Find(args[0], &removed)) return fiber.Nil();
+        
+        dictionary->Entries().Remove(args[0]);
+        return removed;
+    }
+    
+    PRIMITIVE(DictionaryKeys)
+    {
+        DictionaryObject * dictionary = self.AsDictionary();
+        ASSERT_NOT_NULL(dictionary);
+        
+        Dictionary<DictionaryKey, Value> & entries = dictionary->Entries();
+        Value keys = fiber.GetInterpreter().NewArray(entries.Count());
+        for (int i = 0; i < entries.NumSlots(); i++)
+        {
+            DictionaryKey key;
+            Value value;
+            if (entries.GetSlot(i, &key, &value))
+            {
+                keys.AsArray()->Elements().Add(key.GetValue());
+            }
+        }
+        
+        return keys;
+    }
+}
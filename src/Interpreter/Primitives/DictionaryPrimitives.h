@@ -0,0 +1,15 @@
+#pragma once
+
+#include "Macros.h"
+#include "Object.h"
+
+namespace Finch
+{
+    // Primitive methods for dictionary objects.
+    PRIMITIVE(DictionaryCount);
+    PRIMITIVE(DictionaryAt);
+    PRIMITIVE(DictionaryAtPut);
+    PRIMITIVE(DictionaryContains);
+    PRIMITIVE(DictionaryRemove);
+    PRIMITIVE(DictionaryKeys);
+}
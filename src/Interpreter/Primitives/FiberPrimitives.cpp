@@ -19,5 +19,12 @@ namespace Finch
         FiberObject * fiberObj = self.AsFiber();
         return fiber.CreateBool(fiberObj->GetFiber().IsDone());
     }
+    
+    PRIMITIVE(FiberRunBy)
+    {
+        FiberObject * fiberObj = self.AsFiber();
+        const Value & runBy = fiberObj->GetFiber().GetRunBy();
+        return runBy.IsNull() ? fiber.Nil() : runBy;
+    }
 }
 
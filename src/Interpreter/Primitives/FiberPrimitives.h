@@ -10,6 +10,7 @@ namespace Finch
     // Primitive methods for fibers.
     PRIMITIVE(FiberRunning);
     PRIMITIVE(FiberDone);
+    PRIMITIVE(FiberRunBy);
 }
 
 
@@ -1,15 +1,51 @@
 #include <math.h>
 
 #include "NumberPrimitives.h"
-#include "NumberObject.h"
 #include "Fiber.h"
+#include "Interpreter.h"
 
 namespace Finch
 {
     // The binary operators here are the result of a double-dispatch on the two
     // operands. When you do "1 - 2", it sends a "-" message to 1 which in turn
-    // sends "-number:" to 2, passing in itself as the argument. The primitives
-    // here are those second messages. That means the operands are reversed:
+    // sends "-number:" to 2, passing in itself as the argument. These first
+    // primitives are the "-" half. The compiler turns these sends into
+    // superinstructions that skip both halves when both operands are numbers,
+    // so these are mostly reached when the right operand isn't one. The
+    // second messages are interned when the interpreter is created.
+    static Value DoubleDispatch(Fiber & fiber, OpCode op, const Value & self,
+                                const ArgReader & args)
+    {
+        StringId messageId = fiber.GetInterpreter().DispatchMessage(op);
+        return fiber.SendToArgument(messageId, self, args);
+    }
+    
+    PRIMITIVE(NumberDispatchAdd)
+    {
+        return DoubleDispatch(fiber, OP_ADD, self, args);
+    }
+    
+    PRIMITIVE(NumberDispatchSubtract)
+    {
+        return DoubleDispatch(fiber, OP_SUBTRACT, self, args);
+    }
+    
+    PRIMITIVE(NumberDispatchMultiply)
+    {
+        return DoubleDispatch(fiber, OP_MULTIPLY, self, args);
+    }
+    
+    PRIMITIVE(NumberDispatchDivide)
+    {
+        return DoubleDispatch(fiber, OP_DIVIDE, self, args);
+    }
+    
+    PRIMITIVE(NumberDispatchEquals)
+    {
+        return DoubleDispatch(fiber, OP_EQUAL, self, args);
+    }
+    
+    // These are the second messages. That means the operands are reversed:
     // self is the RHS and the arg is the LHS.
     PRIMITIVE(NumberAdd)
     {
@@ -9,6 +9,12 @@
 namespace Finch
 {
     // Primitive methods for numbers.
+    PRIMITIVE(NumberDispatchAdd);
+    PRIMITIVE(NumberDispatchSubtract);
+    PRIMITIVE(NumberDispatchMultiply);
+    PRIMITIVE(NumberDispatchDivide);
+    PRIMITIVE(NumberDispatchEquals);
+
     PRIMITIVE(NumberAdd);
     PRIMITIVE(NumberSubtract);
     PRIMITIVE(NumberMultiply);
@@ -4,6 +4,7 @@
 #include "ObjectPrimitives.h"
 #include "DynamicObject.h"
 #include "Fiber.h"
+#include "Interpreter.h"
 #include "Object.h"
 
 namespace Finch
@@ -21,7 +22,7 @@ namespace Finch
     
     PRIMITIVE(ObjectGetParent)
     {
-        Value parent = self.Parent();
+        Value parent = self.Parent(fiber.GetInterpreter());
         
         // If we don't have a parent, we're at Object, so just return Object
         // as its own parent.
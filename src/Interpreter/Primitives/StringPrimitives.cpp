@@ -3,6 +3,7 @@
 #include "StringPrimitives.h"
 #include "DynamicObject.h"
 #include "Fiber.h"
+#include "Interpreter.h"
 #include "Object.h"
 
 namespace Finch
@@ -19,8 +20,11 @@ namespace Finch
         
         if ((index >= 0) && (index < thisString.Length()))
         {
+            // There are only so many characters, so intern them. That saves
+            // allocating a string for each one and makes comparing them with
+            // literals cheap.
             String substring = String(thisString[index]);
-            return fiber.CreateString(substring);
+            return fiber.GetInterpreter().StringLiteral(substring);
         }
         else
         {
@@ -0,0 +1,34 @@
+#include <new>
+
+#include "RegisterStack.h"
+
+namespace Finch
+{
+    RegisterStack::~RegisterStack()
+    {
+        Allocator::Free(mValues);
+    }
+    
+    bool RegisterStack::Grow(int count)
+    {
+        if (count > mMaxSize) return false;
+        
+        // grow by a multiple of the current size so that deep recursion only
+        // moves the registers a few times
+        int capacity = (mCapacity < MIN_CAPACITY) ? MIN_CAPACITY : mCapacity;
+        while (capacity < count) capacity *= GROW_FACTOR;
+        if (capacity > mMaxSize) capacity = mMaxSize;
+        
+        Value * values = static_cast<Value *>(
+            mAllocator.Allocate(sizeof(Value) * capacity));
+        
+        for (int i = 0; i < mCount; i++) new (&values[i]) Value(mValues[i]);
+        for (int i = mCount; i < capacity; i++) new (&values[i]) Value();
+        
+        Allocator::Free(mValues);
+        mValues = values;
+        mCapacity = capacity;
+        return true;
+    }
+}
+
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "Allocator.h"
+#include "Macros.h"
+#include "Object.h"
+
+namespace Finch
+{
+    // The registers for every callframe on a fiber, in a single contiguous
+    // block of memory. Each callframe's registers are a window into it. It
+    // grows in chunks as deeper calls need more registers, up to a maximum
+    // size. Growing may move the registers, so a pointer into the stack is
+    // only valid until the next call to Reserve().
+    class RegisterStack
+    {
+    public:
+        RegisterStack(Allocator & allocator, int maxSize)
+        :   mValues(NULL),
+            mCount(0),
+            mCapacity(0),
+            mMaxSize(maxSize),
+            mAllocator(allocator)
+        {}
+        
+        ~RegisterStack();
+        
+        // Gets the number of registers that have been reserved. Ones past
+        // the current callframe's are null until they're used again.
+        int Count() const { return mCount; }
+        
+        // Gets the largest number of registers the stack can hold.
+        int MaxSize() const { return mMaxSize; }
+        
+        // Gets a pointer to the register at the given index.
+        Value * At(int index) { return mValues + index; }
+        
+        Value & operator[] (int index)
+        {
+            ASSERT_RANGE(index, mCount);
+            return mValues[index];
+        }
+        
+        const Value & operator[] (int index) const
+        {
+            ASSERT_RANGE(index, mCount);
+            return mValues[index];
+        }
+        
+        // Makes sure the registers below the given index exist. New ones are
+        // null. Returns false if that would make the stack larger than its
+        // maximum size, in which case it's left unchanged.
+        bool Reserve(int count)
+        {
+            if (count <= mCount) return true;
+            if ((count > mCapacity) && !Grow(count)) return false;
+            
+            mCount = count;
+            return true;
+        }
+        
+        // Sets the registers from start up to end back to null.
+        void Clear(int start, int end)
+        {
+            for (Value * value = mValues + start; value < mValues + end; value++)
+            {
+                *value = Value();
+            }
+        }
+        
+    private:
+        // Moves the registers to a larger block of memory that can hold at
+        // least the given number of them.
+        bool Grow(int count);
+        
+        // The number of registers in the first block allocated.
+        static const int MIN_CAPACITY = 256;
+        static const int GROW_FACTOR  = 2;
+        
+        Value *     mValues;
+        int         mCount;    // number of registers in use
+        int         mCapacity; // number of registers allocated
+        int         mMaxSize;
+        Allocator & mAllocator;
+        
+        NO_COPY(RegisterStack);
+    };
+}
+
@@ -0,0 +1,610 @@
+#include <cstring>
+
+#include "ArrayObject.h"
+#include "BlockObject.h"
+#include "DictionaryObject.h"
+#include "DynamicObject.h"
+#include "IInterpreterHost.h"
+#include "Interpreter.h"
+#include "Snapshot.h"
+
+namespace Finch
+{
+    // The first bytes of every snapshot.
+    static const char sMagic[] = { 'F', 'N', 'C', 'S' };
+
+    // The kinds of values in a snapshot.
+    enum ValueType
+    {
+        VALUE_NULL,
+        VALUE_NUMBER,
+        VALUE_OBJECT
+    };
+
+    // The kinds of objects in a snapshot.
+    enum ObjectType
+    {
+        OBJECT_DYNAMIC,
+        OBJECT_STRING,
+        OBJECT_ARRAY,
+        OBJECT_BLOCK,
+        OBJECT_DICTIONARY
+    };
+
+    void Snapshot::Write(Interpreter & interpreter, std::ostream & stream)
+    {
+        Snapshot snapshot(interpreter);
+
+        // Find the objects in the globals first so that they know which
+        // global they came from.
+        std::stringstream globals;
+        BytecodeImage::WriteInt(globals, interpreter.NumGlobals());
+        for (int i = 0; i < interpreter.NumGlobals(); i++)
+        {
+            String name = interpreter.FindGlobalName(i);
+            const Value & value = interpreter.GetGlobal(i);
+
+            if (value.IsObject() && (value.AsFiber() == NULL))
+            {
+                snapshot.AddObject(value.AsObject(), name);
+            }
+
+            BytecodeImage::WriteString(globals, name);
+            snapshot.WriteValue(globals, value);
+        }
+
+        // Writing an object's body finds the objects it refers to, so this
+        // keeps going until everything reachable has been written.
+        std::stringstream bodies;
+        for (int i = 0; i < snapshot.mObjects.Count(); i++)
+        {
+            snapshot.WriteObjectBody(bodies, snapshot.mObjects[i]);
+        }
+
+        // Now that everything has been found, the objects' headers can be
+        // written. They may add blocks, so do them before writing those.
+        std::stringstream headers;
+        BytecodeImage::WriteInt(headers, snapshot.mObjects.Count());
+        for (int i = 0; i < snapshot.mObjects.Count(); i++)
+        {
+            snapshot.WriteObjectHeader(headers, snapshot.mObjects[i],
+                                       snapshot.mObjectGlobals[i]);
+        }
+
+        stream.write(sMagic, sizeof(sMagic));
+        BytecodeImage::WriteInt(stream, VERSION);
+        snapshot.mImage.WriteTables(stream);
+
+        BytecodeImage::WriteInt(stream, snapshot.mNumBlocks);
+        stream << snapshot.mBlocks.str();
+        stream << headers.str();
+
+        BytecodeImage::WriteInt(stream, snapshot.mNumUpvalues);
+        stream << snapshot.mUpvalues.str();
+        stream << globals.str();
+        stream << bodies.str();
+    }
+
+    bool Snapshot::Read(Interpreter & interpreter, std::istream & stream)
+    {
+        Snapshot snapshot(interpreter);
+
+        if (!IsSnapshot(stream))
+        {
+            interpreter.GetHost().Error("Not a heap snapshot.");
+            return false;
+        }
+
+        stream.ignore(sizeof(sMagic));
+        if (BytecodeImage::ReadInt(stream) != VERSION)
+        {
+            interpreter.GetHost().Error(
+                "Heap snapshot was written by a different version of Finch.");
+            return false;
+        }
+
+        bool valid = snapshot.mImage.ReadTables(stream);
+
+        int numBlocks = BytecodeImage::ReadInt(stream);
+        for (int i = 0; valid && (i < numBlocks); i++)
+        {
+            Handle<Block> block = snapshot.mImage.ReadBlock(stream);
+            valid = !block.IsNull();
+            snapshot.mReadBlocks.Add(block);
+        }
+
+        // Create all of the objects before filling them in, since they can
+        // refer to each other in any order.
+        int numObjects = BytecodeImage::ReadInt(stream);
+        for (int i = 0; valid && (i < numObjects); i++)
+        {
+            Value object;
+            valid = snapshot.ReadObjectHeader(stream, &object);
+            snapshot.mReadObjects.Add(object);
+        }
+
+        int numUpvalues = BytecodeImage::ReadInt(stream);
+        for (int i = 0; valid && (i < numUpvalues); i++)
+        {
+            Value value;
+            valid = snapshot.ReadValue(stream, &value);
+
+            // Only closed upvalues are written, so there's no stack.
+            Handle<Upvalue> upvalue = Handle<Upvalue>(
+                new (interpreter.GetAllocator()) Upvalue());
+            upvalue->Set(value);
+            snapshot.mReadUpvalues.Add(upvalue);
+        }
+
+        // Hold on to the globals' values until the objects are complete.
+        Array<int> globalIndexes;
+        Array<Value> globalValues;
+        int numGlobals = BytecodeImage::ReadInt(stream);
+        for (int i = 0; valid && (i < numGlobals); i++)
+        {
+            String name = BytecodeImage::ReadString(stream);
+            Value value;
+            valid = snapshot.ReadValue(stream, &value) && (name.Length() > 0);
+
+            globalIndexes.Add(interpreter.DefineGlobal(name));
+            globalValues.Add(value);
+        }
+
+        for (int i = 0; valid && (i < snapshot.mReadObjects.Count()); i++)
+        {
+            valid = snapshot.ReadObjectBody(stream, snapshot.mReadObjects[i]);
+        }
+
+        if (!valid || stream.fail())
+        {
+            interpreter.GetHost().Error("Heap snapshot is corrupt.");
+            return false;
+        }
+
+        for (int i = 0; i < globalIndexes.Count(); i++)
+        {
+            interpreter.SetGlobal(globalIndexes[i], globalValues[i]);
+        }
+
+        return true;
+    }
+
+    bool Snapshot::IsSnapshot(std::istream & stream)
+    {
+        char magic[sizeof(sMagic)];
+        std::streampos start = stream.tellg();
+
+        stream.read(magic, sizeof(magic));
+        bool isSnapshot = stream &&
+                          (memcmp(magic, sMagic, sizeof(sMagic)) == 0);
+
+        stream.clear();
+        stream.seekg(start);
+        return isSnapshot;
+    }
+
+    Snapshot::IndexTable::IndexTable()
+    :   mEntries(NULL),
+        mCapacity(0),
+        mCount(0)
+    {}
+
+    Snapshot::IndexTable::~IndexTable()
+    {
+        delete [] mEntries;
+    }
+
+    int Snapshot::IndexTable::Find(const void * pointer) const
+    {
+        if (mCount == 0) return -1;
+
+        return mEntries[Slot(pointer)].index;
+    }
+
+    void Snapshot::IndexTable::Insert(const void * pointer, int index)
+    {
+        // Keep the table at most half full so probe sequences stay short.
+        if ((mCount + 1) * 2 > mCapacity)
+        {
+            Entry * oldEntries = mEntries;
+            int oldCapacity = mCapacity;
+
+            mCapacity = (mCapacity == 0) ? 64 : mCapacity * 2;
+            mEntries = new Entry[mCapacity];
+            for (int i = 0; i < mCapacity; i++)
+            {
+                mEntries[i].pointer = NULL;
+                mEntries[i].index = -1;
+            }
+
+            for (int i = 0; i < oldCapacity; i++)
+            {
+                if (oldEntries[i].pointer == NULL) continue;
+                mEntries[Slot(oldEntries[i].pointer)] = oldEntries[i];
+            }
+
+            delete [] oldEntries;
+        }
+
+        Entry & entry = mEntries[Slot(pointer)];
+        if (entry.pointer == NULL) mCount++;
+
+        entry.pointer = pointer;
+        entry.index = index;
+    }
+
+    int Snapshot::IndexTable::Slot(const void * pointer) const
+    {
+        // Everything in the table is at least 8-byte aligned, so drop the low
+        // bits before hashing.
+        uintptr_t hash = reinterpret_cast<uintptr_t>(pointer) >> 3;
+        hash ^= hash >> 16;
+
+        // The capacity is always a power of two.
+        int slot = static_cast<int>(hash & (mCapacity - 1));
+        while ((mEntries[slot].pointer != NULL) &&
+               (mEntries[slot].pointer != pointer))
+        {
+            slot = (slot + 1) & (mCapacity - 1);
+        }
+
+        return slot;
+    }
+
+    Snapshot::Snapshot(Interpreter & interpreter)
+    :   mInterpreter(interpreter),
+        mImage(interpreter),
+        mObjects(),
+        mObjectGlobals(),
+        mObjectIndexes(),
+        mBlockIndexes(),
+        mUpvalueIndexes(),
+        mNumBlocks(0),
+        mBlocks(),
+        mNumUpvalues(0),
+        mUpvalues(),
+        mReadObjects(),
+        mReadUpvalues(),
+        mReadBlocks()
+    {}
+
+    int Snapshot::AddObject(Object * object, const String & global)
+    {
+        int index = mObjectIndexes.Find(object);
+        if (index != -1) return index;
+
+        index = mObjects.Count();
+        mObjects.Add(object);
+        mObjectGlobals.Add(global);
+        mObjectIndexes.Insert(object, index);
+        return index;
+    }
+
+    int Snapshot::AddBlock(const Handle<Block> & block)
+    {
+        int index = mBlockIndexes.Find(&*block);
+        if (index != -1) return index;
+
+        index = mNumBlocks++;
+        mBlockIndexes.Insert(&*block, index);
+        mImage.WriteBlock(mBlocks, *block);
+        return index;
+    }
+
+    int Snapshot::AddUpvalue(const Handle<Upvalue> & upvalue)
+    {
+        int index = mUpvalueIndexes.Find(&*upvalue);
+        if (index != -1) return index;
+
+        index = mNumUpvalues++;
+        mUpvalueIndexes.Insert(&*upvalue, index);
+
+        // Upvalues are shared by the blocks that close over the same
+        // variable, so they're written separately from the blocks. Once
+        // loaded, they're all closed.
+        WriteValue(mUpvalues, upvalue->Get());
+        return index;
+    }
+
+    void Snapshot::WriteValue(std::ostream & stream, const Value & value)
+    {
+        if (value.IsNull())
+        {
+            BytecodeImage::WriteInt(stream, VALUE_NULL);
+        }
+        else if (value.IsNumber())
+        {
+            BytecodeImage::WriteInt(stream, VALUE_NUMBER);
+            BytecodeImage::WriteDouble(stream, value.AsNumber());
+        }
+        else
+        {
+            // A fiber's stack and call frames can't be written.
+            Object * object = value.AsObject();
+            if (object->AsFiber() != NULL)
+            {
+                object = mInterpreter.Nil().AsObject();
+            }
+
+            BytecodeImage::WriteInt(stream, VALUE_OBJECT);
+            BytecodeImage::WriteInt(stream, AddObject(object, ""));
+        }
+    }
+
+    void Snapshot::WriteObjectHeader(std::ostream & stream, Object * object,
+                                     const String & global)
+    {
+        if (object->AsDynamic() != NULL)
+        {
+            BytecodeImage::WriteInt(stream, OBJECT_DYNAMIC);
+            BytecodeImage::WriteString(stream, object->AsString());
+            BytecodeImage::WriteString(stream, global);
+        }
+        else if (object->AsArray() != NULL)
+        {
+            BytecodeImage::WriteInt(stream, OBJECT_ARRAY);
+        }
+        else if (object->AsDictionary() != NULL)
+        {
+            BytecodeImage::WriteInt(stream, OBJECT_DICTIONARY);
+        }
+        else if (object->AsBlock() != NULL)
+        {
+            BytecodeImage::WriteInt(stream, OBJECT_BLOCK);
+            BytecodeImage::WriteInt(stream,
+                                    AddBlock(object->AsBlock()->mBlock));
+        }
+        else
+        {
+            // Fibers are never added, so all that's left is strings.
+            BytecodeImage::WriteInt(stream, OBJECT_STRING);
+            BytecodeImage::WriteString(stream, object->AsString());
+        }
+    }
+
+    void Snapshot::WriteObjectBody(std::ostream & stream, Object * object)
+    {
+        WriteValue(stream, object->mParent);
+
+        DynamicObject * dynamic = object->AsDynamic();
+        if (dynamic != NULL)
+        {
+            const Shape * shape = dynamic->GetShape();
+            BytecodeImage::WriteInt(stream, shape->NumFields());
+            for (int i = 0; i < shape->NumFields(); i++)
+            {
+                BytecodeImage::WriteInt(stream,
+                                        mImage.MapString(shape->FieldName(i)));
+                WriteValue(stream, dynamic->GetSlot(i));
+            }
+
+            // Count the methods while writing them instead of trusting the
+            // table's count, which includes keys that were re-added.
+            int numMethods = 0;
+            std::stringstream methods;
+            for (int i = 0; i < dynamic->mMethods.NumSlots(); i++)
+            {
+                StringId name;
+                Value method;
+                if (!dynamic->mMethods.GetSlot(i, &name, &method)) continue;
+
+                BytecodeImage::WriteInt(methods, mImage.MapString(name));
+                WriteValue(methods, method);
+                numMethods++;
+            }
+
+            BytecodeImage::WriteInt(stream, numMethods);
+            stream << methods.str();
+            return;
+        }
+
+        ArrayObject * array = object->AsArray();
+        if (array != NULL)
+        {
+            BytecodeImage::WriteInt(stream, array->Elements().Count());
+            for (int i = 0; i < array->Elements().Count(); i++)
+            {
+                WriteValue(stream, array->Elements()[i]);
+            }
+            return;
+        }
+
+        DictionaryObject * dictionary = object->AsDictionary();
+        if (dictionary != NULL)
+        {
+            Dictionary<DictionaryKey, Value> & entries = dictionary->Entries();
+            BytecodeImage::WriteInt(stream, entries.Count());
+            for (int i = 0; i < entries.NumSlots(); i++)
+            {
+                DictionaryKey key;
+                Value entry;
+                if (!entries.GetSlot(i, &key, &entry)) continue;
+
+                WriteValue(stream, key.GetValue());
+                WriteValue(stream, entry);
+            }
+            return;
+        }
+
+        BlockObject * block = object->AsBlock();
+        if (block != NULL)
+        {
+            WriteValue(stream, block->mSelf);
+
+            BytecodeImage::WriteInt(stream, block->mUpvalues.Count());
+            for (int i = 0; i < block->mUpvalues.Count(); i++)
+            {
+                BytecodeImage::WriteInt(stream,
+                                        AddUpvalue(block->mUpvalues[i]));
+            }
+        }
+    }
+
+    bool Snapshot::ReadValue(std::istream & stream, Value * value)
+    {
+        switch (BytecodeImage::ReadInt(stream))
+        {
+            case VALUE_NULL:
+                *value = Value();
+                return true;
+
+            case VALUE_NUMBER:
+                *value = Value(BytecodeImage::ReadDouble(stream));
+                return true;
+
+            case VALUE_OBJECT:
+            {
+                int index = BytecodeImage::ReadInt(stream);
+                if ((index < 0) || (index >= mReadObjects.Count())) break;
+
+                *value = mReadObjects[index];
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool Snapshot::ReadObjectHeader(std::istream & stream, Value * value)
+    {
+        switch (BytecodeImage::ReadInt(stream))
+        {
+            case OBJECT_DYNAMIC:
+            {
+                String name = BytecodeImage::ReadString(stream);
+                String global = BytecodeImage::ReadString(stream);
+
+                // Reuse the interpreter's own object if it has one, so that
+                // it keeps its primitives and the interpreter's references to
+                // it stay valid.
+                int index = (global.Length() > 0) ?
+                            mInterpreter.FindGlobal(global) : -1;
+                if (index != -1)
+                {
+                    const Value & existing = mInterpreter.GetGlobal(index);
+                    if (existing.IsObject() && (existing.AsDynamic() != NULL))
+                    {
+                        *value = existing;
+                        return true;
+                    }
+                }
+
+                *value = mInterpreter.NewObject(Value(), name);
+                return true;
+            }
+
+            case OBJECT_STRING:
+                // Strings are immutable, so they can all come back as
+                // symbols, shared with any literals that match them.
+                *value = mInterpreter.StringLiteral(
+                    BytecodeImage::ReadString(stream));
+                return true;
+
+            case OBJECT_ARRAY:
+                *value = mInterpreter.NewArray(0);
+                return true;
+
+            case OBJECT_DICTIONARY:
+                *value = mInterpreter.NewDictionary();
+                return true;
+
+            case OBJECT_BLOCK:
+            {
+                int index = BytecodeImage::ReadInt(stream);
+                if ((index < 0) || (index >= mReadBlocks.Count())) break;
+
+                // Self is filled in with the rest of the block's body.
+                *value = mInterpreter.NewBlock(mReadBlocks[index], Value());
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool Snapshot::ReadObjectBody(std::istream & stream, const Value & value)
+    {
+        Object * object = value.AsObject();
+        if (!ReadValue(stream, &object->mParent)) return false;
+
+        DynamicObject * dynamic = object->AsDynamic();
+        if (dynamic != NULL)
+        {
+            int numFields = BytecodeImage::ReadInt(stream);
+            for (int i = 0; i < numFields; i++)
+            {
+                StringId name;
+                Value field;
+                if (!mImage.ReadStringId(stream, &name)) return false;
+                if (!ReadValue(stream, &field)) return false;
+
+                dynamic->SetField(name, field);
+            }
+
+            int numMethods = BytecodeImage::ReadInt(stream);
+            for (int i = 0; i < numMethods; i++)
+            {
+                StringId name;
+                Value method;
+                if (!mImage.ReadStringId(stream, &name)) return false;
+                if (!ReadValue(stream, &method)) return false;
+
+                dynamic->AddMethod(name, method);
+            }
+
+            return !stream.fail();
+        }
+
+        ArrayObject * array = object->AsArray();
+        if (array != NULL)
+        {
+            int count = BytecodeImage::ReadInt(stream);
+            for (int i = 0; i < count; i++)
+            {
+                Value element;
+                if (!ReadValue(stream, &element)) return false;
+
+                array->Elements().Add(element);
+            }
+
+            return !stream.fail();
+        }
+
+        DictionaryObject * dictionary = object->AsDictionary();
+        if (dictionary != NULL)
+        {
+            int count = BytecodeImage::ReadInt(stream);
+            for (int i = 0; i < count; i++)
+            {
+                Value key;
+                Value entry;
+                if (!ReadValue(stream, &key)) return false;
+                if (!ReadValue(stream, &entry)) return false;
+
+                dictionary->Entries().Insert(key, entry);
+            }
+
+            return !stream.fail();
+        }
+
+        BlockObject * block = object->AsBlock();
+        if (block != NULL)
+        {
+            if (!ReadValue(stream, &block->mSelf)) return false;
+
+            int numUpvalues = BytecodeImage::ReadInt(stream);
+            if (numUpvalues != block->mBlock->NumUpvalues()) return false;
+
+            for (int i = 0; i < numUpvalues; i++)
+            {
+                int index = BytecodeImage::ReadInt(stream);
+                if ((index < 0) || (index >= mReadUpvalues.Count())) return false;
+
+                block->AddUpvalue(mReadUpvalues[index]);
+            }
+        }
+
+        return !stream.fail();
+    }
+}
+
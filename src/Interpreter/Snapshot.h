@@ -0,0 +1,135 @@
+#pragma once
+
+#include <iostream>
+#include <sstream>
+#include <stdint.h>
+
+#include "Array.h"
+#include "Block.h"
+#include "BytecodeImage.h"
+#include "Macros.h"
+#include "Object.h"
+#include "Handle.h"
+#include "Upvalue.h"
+
+namespace Finch
+{
+    class Interpreter;
+
+    // Reads and writes heap snapshots. A snapshot captures the state of an
+    // interpreter after it has run some code, usually the core library: its
+    // globals and every object, block and upvalue reachable from them.
+    // Loading one into a freshly created interpreter puts it back in that
+    // state without running anything, so starting up is just a single pass
+    // over the file.
+    //
+    // Objects in a snapshot refer to each other by index instead of address,
+    // so a snapshot can be loaded anywhere, by any number of interpreters.
+    // Primitives aren't written since they're C++ functions. Instead, objects
+    // that are the values of globals remember the global's name. When loaded
+    // into an interpreter that already has a global with that name, like
+    // "Object" or "Strings", the snapshot's fields and methods are added to
+    // the existing object, keeping its primitives. Fibers can't be written,
+    // so references to them become nil.
+    //
+    // A snapshot contains:
+    //
+    // - The magic number and format version.
+    // - The string, global and method tables of the BytecodeImage that its
+    //   blocks and names use.
+    // - The compiled blocks.
+    // - The type of each object and what's needed to create it.
+    // - The upvalues' values.
+    // - The globals' names and values.
+    // - The parent, fields, methods and elements of each object.
+    class Snapshot
+    {
+    public:
+        // Writes everything reachable from the interpreter's globals.
+        static void Write(Interpreter & interpreter, std::ostream & stream);
+
+        // Reads a snapshot written by Write() into the interpreter. Returns
+        // false and reports an error through the host if it's invalid.
+        static bool Read(Interpreter & interpreter, std::istream & stream);
+
+        // Returns true if the stream starts with the magic number of a
+        // snapshot. Does not consume any of it.
+        static bool IsSnapshot(std::istream & stream);
+
+    private:
+        // Bumped whenever the format or BytecodeImage's format changes.
+        static const int VERSION = 8;
+
+        // Maps the addresses of written objects, blocks and upvalues to their
+        // indexes in the snapshot.
+        class IndexTable
+        {
+        public:
+            IndexTable();
+            ~IndexTable();
+
+            // Gets the index of the given pointer, or -1 if it hasn't been
+            // added.
+            int  Find(const void * pointer) const;
+            void Insert(const void * pointer, int index);
+
+        private:
+            struct Entry
+            {
+                const void * pointer;
+                int          index;
+            };
+
+            int Slot(const void * pointer) const;
+
+            Entry * mEntries;
+            int     mCapacity;
+            int     mCount;
+
+            NO_COPY(IndexTable);
+        };
+
+        Snapshot(Interpreter & interpreter);
+
+        // Gets the index of the given object, block or upvalue, adding it to
+        // be written if it hasn't been seen yet.
+        int  AddObject(Object * object, const String & global);
+        int  AddBlock(const Handle<Block> & block);
+        int  AddUpvalue(const Handle<Upvalue> & upvalue);
+
+        void WriteValue(std::ostream & stream, const Value & value);
+        void WriteObjectHeader(std::ostream & stream, Object * object,
+                               const String & global);
+        void WriteObjectBody(std::ostream & stream, Object * object);
+
+        bool ReadValue(std::istream & stream, Value * value);
+        bool ReadObjectHeader(std::istream & stream, Value * value);
+        bool ReadObjectBody(std::istream & stream, const Value & value);
+
+        Interpreter & mInterpreter;
+        BytecodeImage mImage;
+
+        // When writing, the objects found so far and the names of the
+        // globals they were found in.
+        Array<Object *>         mObjects;
+        Array<String>           mObjectGlobals;
+        IndexTable              mObjectIndexes;
+        IndexTable              mBlockIndexes;
+        IndexTable              mUpvalueIndexes;
+
+        // Blocks and upvalues are written as they're found, since they only
+        // refer to objects by index.
+        int                     mNumBlocks;
+        std::stringstream       mBlocks;
+        int                     mNumUpvalues;
+        std::stringstream       mUpvalues;
+
+        // When reading, what each index refers to.
+        Array<Value>            mReadObjects;
+        Array<Handle<Upvalue> >    mReadUpvalues;
+        Array<Handle<Block> >      mReadBlocks;
+
+        NO_COPY(Snapshot);
+    };
+}
+
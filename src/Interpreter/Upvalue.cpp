@@ -1,12 +1,13 @@
+#include "Heap.h"
 #include "Upvalue.h"
 
 namespace Finch
 {
-    Value Upvalue::Get(Array<Value> & stack) const
+    Value Upvalue::Get() const
     {
         if (IsOpen())
         {
-            return stack[mStackIndex];
+            return (*mStack)[mStackIndex];
         }
         else
         {
@@ -14,11 +15,11 @@ namespace Finch
         }
     }
     
-    void Upvalue::Set(Array<Value> & stack, const Value & value)
+    void Upvalue::Set(const Value & value)
     {
         if (IsOpen())
         {
-            stack[mStackIndex] = value;
+            (*mStack)[mStackIndex] = value;
         }
         else
         {
@@ -26,12 +27,13 @@ namespace Finch
         }
     }
     
-    void Upvalue::Close(Array<Value> & stack)
+    void Upvalue::Close()
     {
         // Capture the value.
-        mValue = stack[mStackIndex];
+        mValue = (*mStack)[mStackIndex];
         
         // Detach from the stack.
+        mStack = NULL;
         mStackIndex = -1;
     }
     
@@ -44,5 +46,9 @@ namespace Finch
     {
         return mStackIndex != -1;
     }
+    
+    void Upvalue::Mark(Heap & heap) const
+    {
+        heap.Mark(Get());
+    }
 }
-
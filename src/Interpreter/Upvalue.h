@@ -3,42 +3,54 @@
 #include <fstream>
 #include <iostream>
 
-#include "Array.h"
 #include "Macros.h"
 #include "Object.h"
-#include "Ref.h"
+#include "Handle.h"
+#include "RegisterStack.h"
 
 namespace Finch
 {
-    // TODO(bob): If we get rid of Ref<T> and use pointers and a more direct
-    // value representation, this can be much simpler and we can get rid of
-    // the weird passing in the stack thing.
-    class Upvalue
+    // A variable captured by a block. While the variable is still on the
+    // stack of the fiber that declared it, the upvalue is open and refers to
+    // it there. Once the variable goes out of scope, it is closed and the
+    // upvalue holds the value itself.
+    class Upvalue : public RefCounted
     {
     public:
         // Default constructor so we can use it in Array<T>.
         Upvalue()
-        :   mStackIndex(-1)
+        :   mStack(NULL),
+            mStackIndex(-1)
         {}
         
-        Upvalue(int stackIndex)
-        :   mStackIndex(stackIndex)
+        Upvalue(RegisterStack & stack, int stackIndex)
+        :   mStack(&stack),
+            mStackIndex(stackIndex)
         {}
         
-        Value Get(Array<Value> & stack) const;        
-        void Set(Array<Value> & stack, const Value & value);        
-        void Close(Array<Value> & stack);        
+        Value Get() const;
+        void Set(const Value & value);
+        void Close();
         int Index() const;        
         bool IsOpen() const;
 
-        Ref<Upvalue> Next() const { return mNext; }
-        void SetNext(Ref<Upvalue> upvalue) { mNext = upvalue; }
+        // Marks the captured value. An open upvalue's value is on a fiber's
+        // stack, but the block may outlive that fiber being reachable.
+        void Mark(Heap & heap) const;
+        
+        const Handle<Upvalue> & Next() const { return mNext; }
+        void SetNext(const Handle<Upvalue> & upvalue) { mNext = upvalue; }
+
+        USE_ALLOCATOR
 
     private:
         // TODO(bob): Can use a union for some of this.
+        // The stack of the fiber that declared the variable. Blocks can be
+        // called from other fibers, so this can't use the running one's.
+        RegisterStack * mStack;
         int mStackIndex;    // Will be -1 if Upvalue is closed.
         Value mValue; // Only use when Upvalue is closed.
-        Ref<Upvalue> mNext;
+        Handle<Upvalue> mNext;
     };
 }
 
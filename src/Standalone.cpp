@@ -0,0 +1,137 @@
+#include <fstream>
+#include <iostream>
+#include <sys/stat.h> // stat
+
+#include "Standalone.h"
+#include "ArgReader.h"
+#include "BytecodeImage.h"
+#include "Fiber.h"
+#include "FileLineReader.h"
+#include "Interpreter.h"
+
+namespace Finch
+{
+    Ref<ILineReader> Standalone::OpenFile(String filePath)
+    {
+        Ref<ILineReader> reader = Ref<ILineReader>(new FileLineReader(filePath));
+        
+        if (reader->EndOfLines())
+        {
+            // couldn't open
+            std::cout << "Couldn't open file \"" << filePath << "\"" << std::endl;
+            return Ref<ILineReader>();
+        }
+        
+        return reader;
+    }
+    
+    bool Standalone::InterpretFile(Interpreter & interpreter, String filePath)
+    {
+        std::ifstream image(filePath.CString(), std::ios::in | std::ios::binary);
+        if (image && BytecodeImage::IsImage(image))
+        {
+            return interpreter.InterpretImage(image, false);
+        }
+        
+        Ref<ILineReader> reader = OpenFile(filePath);
+        if (reader.IsNull()) return false;
+        
+        interpreter.Interpret(*reader, false);
+        return true;
+    }
+    
+    bool Standalone::CompileFile(Interpreter & interpreter, String sourcePath,
+                                 String imagePath)
+    {
+        Ref<ILineReader> reader = OpenFile(sourcePath);
+        if (reader.IsNull()) return false;
+        
+        std::ofstream image(imagePath.CString(),
+                            std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!image)
+        {
+            std::cout << "Couldn't write file \"" << imagePath << "\"" << std::endl;
+            return false;
+        }
+        
+        return interpreter.CompileImage(*reader, image);
+    }
+    
+    bool Standalone::IsNewer(String path, String thanPath)
+    {
+        struct stat info;
+        struct stat thanInfo;
+        if (stat(path.CString(), &info) != 0) return false;
+        if (stat(thanPath.CString(), &thanInfo) != 0) return true;
+        
+        return info.st_mtime >= thanInfo.st_mtime;
+    }
+    
+    bool Standalone::LoadSnapshotFile(Interpreter & interpreter, String path)
+    {
+        std::ifstream snapshot(path.CString(), std::ios::in | std::ios::binary);
+        if (!snapshot) return false;
+        
+        return interpreter.LoadSnapshot(snapshot);
+    }
+    
+    bool Standalone::WriteSnapshotFile(Interpreter & interpreter, String path)
+    {
+        std::ofstream snapshot(path.CString(),
+                               std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!snapshot)
+        {
+            std::cout << "Couldn't write file \"" << path << "\"" << std::endl;
+            return false;
+        }
+        
+        interpreter.WriteSnapshot(snapshot);
+        return true;
+    }
+    
+    Interpreter * Standalone::NewInterpreter(IInterpreterHost & host)
+    {
+        Interpreter * interpreter = new Interpreter(host);
+        interpreter->BindMethod("Ether", "load:", LoadFile);
+        return interpreter;
+    }
+    
+    Interpreter * Standalone::LoadCore(IInterpreterHost & host, String corePath,
+                                       bool fromSource)
+    {
+        String coreBase = corePath.Substring(0, corePath.Length() - 4);
+        String snapshotPath = coreBase + ".fns";
+        String imagePath = coreBase + ".fnb";
+        
+        Interpreter * interpreter = NewInterpreter(host);
+        if (!fromSource && IsNewer(snapshotPath, corePath))
+        {
+            if (LoadSnapshotFile(*interpreter, snapshotPath)) return interpreter;
+            
+            // A corrupt snapshot may have been partly restored, so the source
+            // gets a fresh interpreter.
+            delete interpreter;
+            interpreter = NewInterpreter(host);
+        }
+        
+        // An image from a different version of Finch is rejected before any of
+        // it runs, so the source can still be loaded after it.
+        if (!fromSource && IsNewer(imagePath, corePath) &&
+            InterpretFile(*interpreter, imagePath))
+        {
+            return interpreter;
+        }
+        
+        if (InterpretFile(*interpreter, corePath)) return interpreter;
+        
+        delete interpreter;
+        return NULL;
+    }
+    
+    PRIMITIVE(Standalone::LoadFile)
+    {
+        String filePath = args[0].AsString();
+        InterpretFile(fiber.GetInterpreter(), filePath);
+        return fiber.Nil();
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "FinchString.h"
+#include "ILineReader.h"
+#include "Object.h"
+#include "Ref.h"
+
+namespace Finch
+{
+    class IInterpreterHost;
+    class Interpreter;
+    
+    // The file handling used by Finch as a standalone application: running
+    // scripts and bytecode images, writing images and heap snapshots, and
+    // loading the core library from whichever of those is up to date.
+    class Standalone
+    {
+    public:
+        // Opens a source file. Returns a null reference if it couldn't be
+        // opened.
+        static Ref<ILineReader> OpenFile(String filePath);
+        
+        // Runs the given file, which may be either source or a bytecode
+        // image. Returns false if it couldn't be opened or is an image that
+        // was rejected.
+        static bool InterpretFile(Interpreter & interpreter, String filePath);
+        
+        // Compiles the given source file to a bytecode image without running
+        // it.
+        static bool CompileFile(Interpreter & interpreter, String sourcePath,
+                                String imagePath);
+        
+        // Returns true if the file at the first path exists and was modified
+        // no earlier than the one at the second.
+        static bool IsNewer(String path, String thanPath);
+        
+        // Restores the interpreter from a heap snapshot file.
+        static bool LoadSnapshotFile(Interpreter & interpreter, String path);
+        
+        // Writes a heap snapshot of the interpreter's current state.
+        static bool WriteSnapshotFile(Interpreter & interpreter, String path);
+        
+        // Creates an interpreter with the standalone-provided behavior.
+        static Interpreter * NewInterpreter(IInterpreterHost & host);
+        
+        // Creates an interpreter with the core library at the given path
+        // loaded. If there's an up-to-date heap snapshot of the core library
+        // next to it, this restores that instead to skip running it at all.
+        // Make one using:
+        // finch --snapshot lib/core.fns
+        // Failing that, an up-to-date bytecode image skips compiling it. Make
+        // one using:
+        // finch --compile lib/core.fin lib/core.fnb
+        // If fromSource is true, or the snapshot or image is rejected (for
+        // example because an earlier version of Finch wrote it), the source is
+        // used. Returns NULL if the core library couldn't be loaded.
+        static Interpreter * LoadCore(IInterpreterHost & host, String corePath,
+                                      bool fromSource);
+        
+    private:
+        static PRIMITIVE(LoadFile);
+    };
+}
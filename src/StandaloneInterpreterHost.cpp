@@ -1,4 +1,4 @@
-#include <new>
+#include <cstdlib>
 
 #include "StandaloneInterpreterHost.h"
 
@@ -6,13 +6,14 @@ namespace Finch
 {        
     void * StandaloneInterpreterHost::Allocate(size_t size)
     {
-        ASSERT(false, "Not implemented yet.");
-        return NULL;
+        void * data = malloc(size);
+        ASSERT_NOT_NULL(data);
+        return data;
     }
     
     void StandaloneInterpreterHost::Free(void * data)
     {
-        ASSERT(false, "Not implemented yet.");
+        free(data);
     }
     
     void StandaloneInterpreterHost::Output(const String & text)
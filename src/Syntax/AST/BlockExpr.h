@@ -25,6 +25,8 @@ namespace Finch
         const Array<String> & Params() const { return mParams; }
         Ref<Expr>             Body()   const { return mBody; }
         
+        virtual const BlockExpr * AsBlockExpr() const { return this; }
+        
         virtual void Trace(ostream & stream) const
         {
             stream << "{";
@@ -18,8 +18,10 @@ namespace Finch
 {
     using std::ostream;
     
+    class BlockExpr;
     class IExprCompiler;
     class IExprVisitor;
+    class NameExpr;
     class Object;
         
     class Expr
@@ -36,6 +38,11 @@ namespace Finch
         
         virtual ~Expr() {}
         
+        // Downcasts for the compiler, which needs to spot a few special forms.
+        // Return NULL if the expression isn't that kind.
+        virtual const BlockExpr * AsBlockExpr() const { return NULL; }
+        virtual const NameExpr *  AsNameExpr()  const { return NULL; }
+        
         // The visitor pattern.
         virtual void Accept(IExprCompiler & compiler, int dest) const = 0;
         
@@ -221,9 +221,11 @@ namespace Finch
         if (!keyword.IsNull())
         {
             isMessage = true;
-            return keyword;
+            object = keyword;
         }
         
+        // Only ever returning one local lets the compiler build it in place
+        // instead of copying it into the return value.
         return object;
     }
     
@@ -480,7 +482,7 @@ namespace Finch
             String name = Consume()->Text();
             
             // One arg.
-            Ref<Token> param = Consume(TOKEN_NAME,
+            Handle<Token> param = Consume(TOKEN_NAME,
                 "Expect parameter name after operator in a bind expression.");
             params.Add(param->Text());
             
@@ -496,7 +498,7 @@ namespace Finch
                 name += Consume()->Text();
                 
                 // Parse each keyword's parameter.
-                Ref<Token> param = Consume(TOKEN_NAME,
+                Handle<Token> param = Consume(TOKEN_NAME,
                     "Expect parameter name after keyword in a bind expression.");
                 params.Add(param->Text());
             }
@@ -13,11 +13,11 @@ namespace Finch
         return mReader.IsInfinite();
     }
     
-    Ref<Token> Lexer::ReadToken()
+    Handle<Token> Lexer::ReadToken()
     {
         while (true)
         {
-            if (IsDone()) return Ref<Token>(new Token(TOKEN_EOF));
+            if (IsDone()) return Handle<Token>(new Token(TOKEN_EOF));
             
             if (mNeedsLine)
             {
@@ -39,7 +39,7 @@ namespace Finch
                 case '\0':
                     // End of the line.
                     mNeedsLine = true;
-                    return Ref<Token>(new Token(TOKEN_LINE));
+                    return Handle<Token>(new Token(TOKEN_LINE));
                     
                 case '(': return SingleToken(TOKEN_LEFT_PAREN);
                 case ')': return SingleToken(TOKEN_RIGHT_PAREN);
@@ -61,11 +61,11 @@ namespace Finch
                     {
                         // "::".
                         Advance();
-                        return Ref<Token>(new Token(TOKEN_BIND));
+                        return Handle<Token>(new Token(TOKEN_BIND));
                     }
 
                     // Just a ":" by itself.
-                    return Ref<Token>(new Token(TOKEN_KEYWORD, ":"));
+                    return Handle<Token>(new Token(TOKEN_KEYWORD, ":"));
                 
                 case '-':
                     Advance();
@@ -79,7 +79,7 @@ namespace Finch
                         // Line comment, so ignore the rest of the line and
                         // emit the line token.
                         mNeedsLine = true;
-                        return Ref<Token>(new Token(TOKEN_LINE));
+                        return Handle<Token>(new Token(TOKEN_LINE));
                     }
                     else if (Peek() == '*')
                     {
@@ -102,7 +102,7 @@ namespace Finch
                     // If we got here, we don't know what it is. Just eat it so
                     // we don't get stuck.
                     Advance();
-                    return Ref<Token>(new Token(TOKEN_ERROR, String::Format(
+                    return Handle<Token>(new Token(TOKEN_ERROR, String::Format(
                         "Unrecognized character \"%c\".", c)));
             }
         }
@@ -184,28 +184,28 @@ namespace Finch
         }
     }
     
-    Ref<Token> Lexer::SingleToken(TokenType type)
+    Handle<Token> Lexer::SingleToken(TokenType type)
     {
         Advance();
-        return Ref<Token>(new Token(type));
+        return Handle<Token>(new Token(type));
     }
     
-    Ref<Token> Lexer::ReadString()
+    Handle<Token> Lexer::ReadString()
     {
         Advance();
         
         String text;
         while (true)
         {
-            if (IsDone()) return Ref<Token>(new Token(TOKEN_ERROR, "Unterminated string."));
+            if (IsDone()) return Handle<Token>(new Token(TOKEN_ERROR, "Unterminated string."));
             
             char c = Advance();
-            if (c == '"') return Ref<Token>(new Token(TOKEN_STRING, text));
+            if (c == '"') return Handle<Token>(new Token(TOKEN_STRING, text));
             
             // An escape sequence.
             if (c == '\\')
             {
-                if (IsDone()) return Ref<Token>(new Token(TOKEN_ERROR,
+                if (IsDone()) return Handle<Token>(new Token(TOKEN_ERROR,
                         "Unterminated string escape."));
                 
                 char e = Advance();
@@ -216,7 +216,7 @@ namespace Finch
                     case '\\': text += "\\"; break;
                     case 't': text += "\t"; break;
                     default:
-                        return Ref<Token>(new Token(TOKEN_ERROR, String::Format(
+                        return Handle<Token>(new Token(TOKEN_ERROR, String::Format(
                                 "Unrecognized escape sequence \"%c\".", e)));
                 }
             }
@@ -228,7 +228,7 @@ namespace Finch
         }
     }
     
-    Ref<Token> Lexer::ReadNumber()
+    Handle<Token> Lexer::ReadNumber()
     {
         Advance();
         while (IsDigit(Peek())) Advance();
@@ -242,10 +242,10 @@ namespace Finch
 
         String text = mLine.Substring(mStart, mPos - mStart);
         double number = atof(text.CString());
-        return Ref<Token>(new Token(TOKEN_NUMBER, number));
+        return Handle<Token>(new Token(TOKEN_NUMBER, number));
     }
     
-    Ref<Token> Lexer::ReadName()
+    Handle<Token> Lexer::ReadName()
     {
         while (IsOperator(Peek()) || IsAlpha(Peek()) || IsDigit(Peek()))
         {
@@ -265,14 +265,14 @@ namespace Finch
         
         String name = mLine.Substring(mStart, mPos - mStart);
         
-        if (name == "return") return Ref<Token>(new Token(TOKEN_RETURN));
-        if (name == "self") return Ref<Token>(new Token(TOKEN_SELF));
-        if (name == "undefined") return Ref<Token>(new Token(TOKEN_UNDEFINED));
+        if (name == "return") return Handle<Token>(new Token(TOKEN_RETURN));
+        if (name == "self") return Handle<Token>(new Token(TOKEN_SELF));
+        if (name == "undefined") return Handle<Token>(new Token(TOKEN_UNDEFINED));
         
-        return Ref<Token>(new Token(type, name));
+        return Handle<Token>(new Token(type, name));
     }
     
-    Ref<Token> Lexer::ReadOperator()
+    Handle<Token> Lexer::ReadOperator()
     {
         while (IsOperator(Peek()))
         {
@@ -288,10 +288,10 @@ namespace Finch
         
         String name = mLine.Substring(mStart, mPos - mStart);
         
-        if (name == "<-") return Ref<Token>(new Token(TOKEN_ARROW));
-        if (name == "<--") return Ref<Token>(new Token(TOKEN_LONG_ARROW));
+        if (name == "<-") return Handle<Token>(new Token(TOKEN_ARROW));
+        if (name == "<--") return Handle<Token>(new Token(TOKEN_LONG_ARROW));
         
-        return Ref<Token>(new Token(TOKEN_OPERATOR, name));
+        return Handle<Token>(new Token(TOKEN_OPERATOR, name));
     }
     
     void Lexer::AdvanceLine()
@@ -23,7 +23,7 @@ namespace Finch
         
         // Lexes and returns the next full Token read from the source. If the
         // ILineReader is out of lines, this will return an EOF Token.
-        virtual Ref<Token> ReadToken();
+        virtual Handle<Token> ReadToken();
         
     private:
         bool IsDone() const;
@@ -33,11 +33,11 @@ namespace Finch
         char Advance();
                 
         void SkipBlockComment();
-        Ref<Token> SingleToken(TokenType type);
-        Ref<Token> ReadString();
-        Ref<Token> ReadNumber();
-        Ref<Token> ReadName();
-        Ref<Token> ReadOperator();
+        Handle<Token> SingleToken(TokenType type);
+        Handle<Token> ReadString();
+        Handle<Token> ReadNumber();
+        Handle<Token> ReadName();
+        Handle<Token> ReadOperator();
         
         void AdvanceLine();
         
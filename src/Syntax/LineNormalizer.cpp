@@ -7,9 +7,9 @@ namespace Finch
         return mTokens.IsInfinite();
     }
     
-    Ref<Token> LineNormalizer::ReadToken()
+    Handle<Token> LineNormalizer::ReadToken()
     {
-        Ref<Token> token;
+        Handle<Token> token;
         
         while (token.IsNull())
         {
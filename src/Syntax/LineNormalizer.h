@@ -1,7 +1,7 @@
 #pragma once
 
 #include "Macros.h"
-#include "Ref.h"
+#include "Handle.h"
 #include "Token.h"
 #include "ITokenSource.h"
 
@@ -56,7 +56,7 @@ namespace Finch
         
         virtual bool IsInfinite() const;
         
-        virtual Ref<Token> ReadToken();
+        virtual Handle<Token> ReadToken();
         
     private:
         ITokenSource & mTokens;
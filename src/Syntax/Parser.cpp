@@ -57,14 +57,14 @@ namespace Finch
         }
     }
     
-    Ref<Token> Parser::Consume()
+    Handle<Token> Parser::Consume()
     {
         FillLookAhead(1);
         
         return mRead.Dequeue();
     }
     
-    Ref<Token> Parser::Consume(TokenType expected, const char * errorMessage)
+    Handle<Token> Parser::Consume(TokenType expected, const char * errorMessage)
     {
         if (LookAhead(expected))
         {
@@ -73,7 +73,7 @@ namespace Finch
         else
         {
             Error(errorMessage);
-            return Ref<Token>();
+            return Handle<Token>();
         }
     }
     
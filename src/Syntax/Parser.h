@@ -48,11 +48,11 @@ namespace Finch
         void Expect(TokenType expected, const char * errorMessage);
         
         // Consumes the current Token and advances the Parser.
-        Ref<Token> Consume();
+        Handle<Token> Consume();
         
         // Consumes the current Token if it matches the expected type.
         // Otherwise reports the given error message and returns a null Ref.
-        Ref<Token> Consume(TokenType expected, const char * errorMessage);
+        Handle<Token> Consume(TokenType expected, const char * errorMessage);
 
         // Reports the given error message relevant to the current token.
         void Error(const char * message);
@@ -66,7 +66,7 @@ namespace Finch
         ITokenSource & mTokens;
         
         // The 2 here is the maximum number of lookahead tokens.
-        Queue<Ref<Token>, 2> mRead;
+        Queue<Handle<Token>, 2> mRead;
         
         IErrorReporter & mErrorReporter;
         bool mHadError;
@@ -3,7 +3,7 @@
 #include <iostream>
 
 #include "Macros.h"
-#include "Ref.h"
+#include "Handle.h"
 #include "FinchString.h"
 
 namespace Finch
@@ -47,7 +47,7 @@ namespace Finch
     
     // A single meaningful Token of source code. Generated by the Lexer, and
     // consumed by the Parser.
-    class Token
+    class Token : public RefCounted
     {
     public:
         Token(TokenType type)
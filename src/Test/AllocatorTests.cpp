@@ -0,0 +1,135 @@
+#include <cstdlib>
+
+#include "AllocatorTests.h"
+#include "Allocator.h"
+#include "IInterpreterHost.h"
+
+namespace Finch
+{
+    // A host that just tracks how many chunks it has handed out.
+    class CountingHost : public IInterpreterHost
+    {
+    public:
+        CountingHost()
+        :   numLive(0)
+        {}
+        
+        virtual void * Allocate(size_t size)
+        {
+            numLive++;
+            return malloc(size);
+        }
+        
+        virtual void Free(void * data)
+        {
+            numLive--;
+            free(data);
+        }
+        
+        virtual void Output(const String & text) {}
+        virtual void Error(const String & message) {}
+        
+        int numLive;
+    };
+    
+    void AllocatorTests::Run()
+    {
+        TestSizeClasses();
+        TestReuse();
+        TestLarge();
+        TestSlabs();
+    }
+    
+    void AllocatorTests::TestSizeClasses()
+    {
+        CountingHost host;
+        Allocator allocator(host);
+        
+        void * a = allocator.Allocate(1);
+        void * b = allocator.Allocate(16);
+        void * c = allocator.Allocate(17);
+        void * d = allocator.Allocate(500);
+        
+        EXPECT_EQUAL(2, allocator.GetStats(0).numLive);
+        EXPECT_EQUAL(1, allocator.GetStats(1).numLive);
+        EXPECT_EQUAL(1, allocator.GetStats(Allocator::NUM_SIZE_CLASSES - 1).numLive);
+        EXPECT_EQUAL(16, allocator.GetStats(0).size);
+        EXPECT_EQUAL(512, allocator.GetStats(Allocator::NUM_SIZE_CLASSES - 1).size);
+        
+        // Chunks should be eight-byte aligned.
+        EXPECT_EQUAL(0, static_cast<int>(reinterpret_cast<size_t>(a) % 8));
+        EXPECT_EQUAL(0, static_cast<int>(reinterpret_cast<size_t>(c) % 8));
+        
+        Allocator::Free(a);
+        Allocator::Free(b);
+        Allocator::Free(c);
+        Allocator::Free(d);
+        
+        EXPECT_EQUAL(0, allocator.GetStats(0).numLive);
+        EXPECT_EQUAL(2, allocator.GetStats(0).numAllocations);
+        EXPECT_EQUAL(0, allocator.GetStats(1).numLive);
+    }
+    
+    void AllocatorTests::TestReuse()
+    {
+        CountingHost host;
+        Allocator allocator(host);
+        
+        void * a = allocator.Allocate(40);
+        Allocator::Free(a);
+        
+        // A freed chunk should be handed out again for the same size class.
+        void * b = allocator.Allocate(48);
+        EXPECT(a == b);
+        
+        Allocator::Free(b);
+        
+        // Freeing NULL does nothing.
+        Allocator::Free(NULL);
+    }
+    
+    void AllocatorTests::TestLarge()
+    {
+        CountingHost host;
+        Allocator allocator(host);
+        
+        const AllocatorStats & stats =
+            allocator.GetStats(Allocator::NUM_SIZE_CLASSES);
+        
+        void * a = allocator.Allocate(10000);
+        EXPECT_EQUAL(1, host.numLive);
+        EXPECT_EQUAL(1, stats.numLive);
+        EXPECT_EQUAL(0, stats.numSlabs);
+        
+        // Large chunks go right back to the host.
+        Allocator::Free(a);
+        EXPECT_EQUAL(0, host.numLive);
+        EXPECT_EQUAL(0, stats.numLive);
+        EXPECT_EQUAL(1, stats.numAllocations);
+    }
+    
+    void AllocatorTests::TestSlabs()
+    {
+        CountingHost host;
+        
+        {
+            Allocator allocator(host);
+            
+            // Enough 512 byte chunks to need more than one slab.
+            for (int i = 0; i < 100; i++)
+            {
+                allocator.Allocate(512);
+            }
+            
+            const AllocatorStats & stats =
+                allocator.GetStats(Allocator::NUM_SIZE_CLASSES - 1);
+            EXPECT_EQUAL(100, stats.numLive);
+            EXPECT(stats.numSlabs > 1);
+            EXPECT_EQUAL(stats.numSlabs, host.numLive);
+        }
+        
+        // Destroying the allocator returns every slab.
+        EXPECT_EQUAL(0, host.numLive);
+    }
+}
+
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "Test.h"
+
+namespace Finch
+{
+    class AllocatorTests : public Test
+    {
+    public:
+        static void Run();
+        
+    private:
+        static void TestSizeClasses();
+        static void TestReuse();
+        static void TestLarge();
+        static void TestSlabs();
+    };
+}
+
@@ -0,0 +1,109 @@
+#include <sstream>
+
+#include "BytecodeImageTests.h"
+#include "BytecodeImage.h"
+#include "Interpreter.h"
+#include "TestHost.h"
+
+namespace Finch
+{
+    // Defines globals, methods, fields and closures, so that the image
+    // needs every kind of table entry and constant. The interpreters in
+    // these tests don't load the core library, so this only uses
+    // primitives.
+    static const char * sSource =
+        "greeting <- \"hello, \"\n"
+        "counter <- [ _count <- 0\n"
+        "  bump { _count <- _count + 1.5 } ]\n"
+        "counter bump\n"
+        "make <- {|s| { *primitive* string-concat: greeting and: s } }\n"
+        "*primitive* write: (make call: \"image\") call\n"
+        "*primitive* write: counter bump\n";
+
+    void BytecodeImageTests::Run()
+    {
+        TestRoundTrip();
+        TestRejectsCorruptImage();
+        TestRejectsOtherVersion();
+        TestRejectsSource();
+    }
+
+    // Compiles the test source to an image using a separate interpreter.
+    static std::string CompileSource()
+    {
+        TestHost host;
+        Interpreter interpreter(host);
+        SourceLineReader reader(sSource);
+
+        std::stringstream image;
+        interpreter.CompileImage(reader, image);
+        return image.str();
+    }
+
+    void BytecodeImageTests::TestRoundTrip()
+    {
+        std::string image = CompileSource();
+
+        // Compiling doesn't run anything.
+        std::stringstream stream(image);
+        EXPECT(BytecodeImage::IsImage(stream));
+
+        // An interpreter that has never seen the source runs it the same as
+        // interpreting it directly.
+        TestHost host;
+        Interpreter interpreter(host);
+        EXPECT(interpreter.InterpretImage(stream, false));
+        EXPECT_EQUAL("hello, image3", host.GetOutput());
+        EXPECT_EQUAL("", host.GetErrors());
+
+        TestHost sourceHost;
+        Interpreter sourceInterpreter(sourceHost);
+        SourceLineReader reader(sSource);
+        sourceInterpreter.Interpret(reader, false);
+        EXPECT_EQUAL(sourceHost.GetOutput(), host.GetOutput());
+    }
+
+    void BytecodeImageTests::TestRejectsCorruptImage()
+    {
+        std::string image = CompileSource();
+
+        // Every truncation is rejected without running any of it.
+        for (size_t length = 0; length < image.length(); length++)
+        {
+            TestHost host;
+            Interpreter interpreter(host);
+            std::stringstream stream(image.substr(0, length));
+            EXPECT(!interpreter.InterpretImage(stream, false));
+            EXPECT_EQUAL("", host.GetOutput());
+            EXPECT(host.GetErrors().Length() > 0);
+        }
+    }
+
+    void BytecodeImageTests::TestRejectsOtherVersion()
+    {
+        std::string image = CompileSource();
+
+        // The version comes right after the magic number.
+        image[4]++;
+
+        TestHost host;
+        Interpreter interpreter(host);
+        std::stringstream stream(image);
+        EXPECT(BytecodeImage::IsImage(stream));
+        EXPECT(!interpreter.InterpretImage(stream, false));
+        EXPECT_EQUAL("", host.GetOutput());
+        EXPECT_EQUAL("Bytecode image was written by a different version of Finch.",
+                     host.GetErrors());
+    }
+
+    void BytecodeImageTests::TestRejectsSource()
+    {
+        TestHost host;
+        Interpreter interpreter(host);
+        std::stringstream stream(sSource);
+        EXPECT(!BytecodeImage::IsImage(stream));
+        EXPECT(!interpreter.InterpretImage(stream, false));
+        EXPECT_EQUAL("", host.GetOutput());
+        EXPECT_EQUAL("Not a bytecode image.", host.GetErrors());
+    }
+}
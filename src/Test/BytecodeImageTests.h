@@ -0,0 +1,18 @@
+#pragma once
+
+#include "Test.h"
+
+namespace Finch
+{
+    class BytecodeImageTests : public Test
+    {
+    public:
+        static void Run();
+
+    private:
+        static void TestRoundTrip();
+        static void TestRejectsCorruptImage();
+        static void TestRejectsOtherVersion();
+        static void TestRejectsSource();
+    };
+}
@@ -0,0 +1,125 @@
+#include "CompilerTests.h"
+#include "Block.h"
+#include "Compiler.h"
+#include "FinchParser.h"
+#include "IErrorReporter.h"
+#include "Interpreter.h"
+#include "Lexer.h"
+#include "LineNormalizer.h"
+#include "TestHost.h"
+
+namespace Finch
+{
+    // Counts parse errors so that a test can't pass by compiling nothing.
+    class CountingErrorReporter : public IErrorReporter
+    {
+    public:
+        CountingErrorReporter()
+        :   numErrors(0)
+        {}
+        
+        virtual void Error(String message) { numErrors++; }
+        
+        int numErrors;
+    };
+    
+    // Parses and compiles the source to a top-level block without running
+    // it.
+    static Handle<Block> Compile(Interpreter & interpreter, const char * source)
+    {
+        SourceLineReader reader(source);
+        Lexer lexer(reader);
+        LineNormalizer normalizer(lexer);
+        CountingErrorReporter errors;
+        FinchParser parser(normalizer, errors);
+        
+        Ref<Expr> expr = parser.Parse();
+        if (expr.IsNull() || (errors.numErrors > 0)) return Handle<Block>();
+        
+        return Compiler::CompileTopLevel(interpreter, *expr);
+    }
+    
+    void CompilerTests::Run()
+    {
+        TestEqualConstantsShareAnEntry();
+        TestDistinctConstantsDoNot();
+        TestStringLiteralsAreShared();
+    }
+    
+    void CompilerTests::TestEqualConstantsShareAnEntry()
+    {
+        TestHost host;
+        Interpreter interpreter(host);
+        
+        Handle<Block> block = Compile(interpreter,
+            "a <- 1.5\n"
+            "b <- \"str\"\n"
+            "c <- 1.5\n"
+            "d <- \"str\"\n"
+            "e <- #[1.5, \"str\", 1.5]\n");
+        EXPECT(!block.IsNull());
+        
+        EXPECT_EQUAL(2, block->NumConstants());
+        EXPECT_EQUAL(1.5, block->GetConstant(0).AsNumber());
+        EXPECT_EQUAL("str", block->GetConstant(1).AsString());
+    }
+    
+    void CompilerTests::TestDistinctConstantsDoNot()
+    {
+        TestHost host;
+        Interpreter interpreter(host);
+        
+        // Constants are compared by their bits, so zero and negative zero
+        // stay apart even though they're ==, and so do strings that only
+        // differ in case.
+        Handle<Block> block = Compile(interpreter,
+            "a <- 0\n"
+            "b <- -0\n"
+            "c <- \"str\"\n"
+            "d <- \"Str\"\n");
+        EXPECT(!block.IsNull());
+        
+        EXPECT_EQUAL(4, block->NumConstants());
+        for (int i = 0; i < block->NumConstants(); i++)
+        {
+            for (int j = i + 1; j < block->NumConstants(); j++)
+            {
+                EXPECT(block->GetConstant(i) != block->GetConstant(j));
+            }
+        }
+    }
+    
+    void CompilerTests::TestStringLiteralsAreShared()
+    {
+        TestHost host;
+        Interpreter interpreter(host);
+        
+        Handle<Block> block = Compile(interpreter,
+            "a <- { \"str\" }\n"
+            "b <- { { \"str\" } }\n");
+        EXPECT(!block.IsNull());
+        EXPECT_EQUAL(2, block->NumBlocks());
+        
+        // Each block has its own constant pool, but the literal in each one
+        // is the same object.
+        const Handle<Block> & a = block->GetBlock(0);
+        const Handle<Block> & b = block->GetBlock(1)->GetBlock(0);
+        EXPECT_EQUAL(1, a->NumConstants());
+        EXPECT_EQUAL(1, b->NumConstants());
+        EXPECT(a->GetConstant(0) == b->GetConstant(0));
+        EXPECT(a->GetConstant(0) == interpreter.StringLiteral("str"));
+        
+        // So is the same literal in code compiled later.
+        Handle<Block> later = Compile(interpreter, "c <- \"str\"\n");
+        EXPECT(!later.IsNull());
+        EXPECT_EQUAL(1, later->NumConstants());
+        EXPECT(a->GetConstant(0) == later->GetConstant(0));
+        
+        // But not in another interpreter.
+        TestHost otherHost;
+        Interpreter other(otherHost);
+        Handle<Block> elsewhere = Compile(other, "c <- \"str\"\n");
+        EXPECT(!elsewhere.IsNull());
+        EXPECT(a->GetConstant(0) != elsewhere->GetConstant(0));
+    }
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "Test.h"
+
+namespace Finch
+{
+    class CompilerTests : public Test
+    {
+    public:
+        static void Run();
+
+    private:
+        static void TestEqualConstantsShareAnEntry();
+        static void TestDistinctConstantsDoNot();
+        static void TestStringLiteralsAreShared();
+    };
+}
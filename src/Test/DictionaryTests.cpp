@@ -0,0 +1,193 @@
+#include "DictionaryTests.h"
+#include "Dictionary.h"
+#include "FinchString.h"
+
+namespace Finch
+{
+    // A key whose hash code only uses the lowest bits, so that keys can be
+    // made to collide.
+    class SmallKey
+    {
+    public:
+        SmallKey()
+        :   mValue(-1)
+        {}
+        
+        SmallKey(int value)
+        :   mValue(value)
+        {}
+        
+        unsigned int HashCode() const { return mValue & 3; }
+        
+        bool operator ==(const SmallKey & other) const
+        {
+            return mValue == other.mValue;
+        }
+        
+    private:
+        int mValue;
+    };
+    
+    void DictionaryTests::Run()
+    {
+        TestInsertFind();
+        TestReplace();
+        TestRemove();
+        TestCollisions();
+        TestGrow();
+        TestClear();
+    }
+    
+    void DictionaryTests::TestInsertFind()
+    {
+        Dictionary<String, int> dictionary;
+        int value = 0;
+        
+        EXPECT_EQUAL(0, dictionary.Count());
+        EXPECT(!dictionary.Find("a", &value));
+        
+        dictionary.Insert("a", 1);
+        dictionary.Insert("b", 2);
+        
+        EXPECT_EQUAL(2, dictionary.Count());
+        EXPECT(dictionary.Find("a", &value));
+        EXPECT_EQUAL(1, value);
+        EXPECT(dictionary.Find("b", &value));
+        EXPECT_EQUAL(2, value);
+        EXPECT(!dictionary.Find("c", &value));
+    }
+    
+    void DictionaryTests::TestReplace()
+    {
+        Dictionary<String, int> dictionary;
+        int value = 0;
+        
+        // inserting an existing key replaces it instead of adding another
+        dictionary.Insert("a", 1);
+        dictionary.Insert("a", 2);
+        
+        EXPECT_EQUAL(1, dictionary.Count());
+        EXPECT(dictionary.Find("a", &value));
+        EXPECT_EQUAL(2, value);
+        
+        EXPECT(dictionary.Replace("a", 3));
+        EXPECT(!dictionary.Replace("b", 4));
+        
+        EXPECT_EQUAL(1, dictionary.Count());
+        EXPECT(dictionary.Find("a", &value));
+        EXPECT_EQUAL(3, value);
+        EXPECT(!dictionary.Find("b", &value));
+    }
+    
+    void DictionaryTests::TestRemove()
+    {
+        Dictionary<String, int> dictionary;
+        int value = 0;
+        
+        dictionary.Insert("a", 1);
+        dictionary.Insert("b", 2);
+        
+        EXPECT(dictionary.Remove("a"));
+        EXPECT(!dictionary.Remove("a"));
+        EXPECT(!dictionary.Remove("c"));
+        
+        EXPECT_EQUAL(1, dictionary.Count());
+        EXPECT(!dictionary.Find("a", &value));
+        EXPECT(dictionary.Find("b", &value));
+        EXPECT_EQUAL(2, value);
+        
+        dictionary.Insert("a", 3);
+        EXPECT_EQUAL(2, dictionary.Count());
+        EXPECT(dictionary.Find("a", &value));
+        EXPECT_EQUAL(3, value);
+    }
+    
+    void DictionaryTests::TestCollisions()
+    {
+        Dictionary<SmallKey, int> dictionary;
+        int value = 0;
+        
+        // these all hash to the same slot
+        dictionary.Insert(SmallKey(0), 10);
+        dictionary.Insert(SmallKey(4), 14);
+        dictionary.Insert(SmallKey(8), 18);
+        
+        // removing the middle of a probe chain shouldn't hide the end of it
+        EXPECT(dictionary.Remove(SmallKey(4)));
+        EXPECT(dictionary.Find(SmallKey(8), &value));
+        EXPECT_EQUAL(18, value);
+        EXPECT(!dictionary.Find(SmallKey(4), &value));
+        
+        // re-inserting a key past a removed one shouldn't duplicate it
+        dictionary.Insert(SmallKey(8), 28);
+        EXPECT_EQUAL(2, dictionary.Count());
+        EXPECT(dictionary.Remove(SmallKey(8)));
+        EXPECT(!dictionary.Find(SmallKey(8), &value));
+        
+        EXPECT(dictionary.Find(SmallKey(0), &value));
+        EXPECT_EQUAL(10, value);
+        
+        // removing and adding over and over reuses the removed slots
+        for (int i = 100; i < 1000; i++)
+        {
+            dictionary.Insert(SmallKey(i), i);
+            dictionary.Remove(SmallKey(i));
+        }
+        
+        EXPECT_EQUAL(1, dictionary.Count());
+        EXPECT(dictionary.NumSlots() <= 32);
+    }
+    
+    void DictionaryTests::TestGrow()
+    {
+        Dictionary<SmallKey, int> dictionary;
+        int value = 0;
+        
+        for (int i = 0; i < 100; i++)
+        {
+            dictionary.Insert(SmallKey(i), i * 2);
+        }
+        
+        EXPECT_EQUAL(100, dictionary.Count());
+        
+        for (int i = 0; i < 100; i++)
+        {
+            EXPECT(dictionary.Find(SmallKey(i), &value));
+            EXPECT_EQUAL(i * 2, value);
+        }
+        
+        // every item can be reached by walking the slots
+        int count = 0;
+        int sum = 0;
+        for (int i = 0; i < dictionary.NumSlots(); i++)
+        {
+            SmallKey key;
+            if (dictionary.GetSlot(i, &key, &value))
+            {
+                count++;
+                sum += value;
+            }
+        }
+        
+        EXPECT_EQUAL(100, count);
+        EXPECT_EQUAL(9900, sum);
+    }
+    
+    void DictionaryTests::TestClear()
+    {
+        Dictionary<String, int> dictionary;
+        int value = 0;
+        
+        dictionary.Insert("a", 1);
+        dictionary.Clear();
+        
+        EXPECT_EQUAL(0, dictionary.Count());
+        EXPECT(!dictionary.Find("a", &value));
+        
+        // still usable after clearing
+        dictionary.Insert("a", 2);
+        EXPECT(dictionary.Find("a", &value));
+        EXPECT_EQUAL(2, value);
+    }
+}
+
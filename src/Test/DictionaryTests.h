@@ -0,0 +1,21 @@
+#pragma once
+
+#include "Test.h"
+
+namespace Finch
+{
+    class DictionaryTests : public Test
+    {
+    public:
+        static void Run();
+        
+    private:
+        static void TestInsertFind();
+        static void TestReplace();
+        static void TestRemove();
+        static void TestCollisions();
+        static void TestGrow();
+        static void TestClear();
+    };
+}
+
@@ -0,0 +1,114 @@
+#include "HandleTests.h"
+#include "Handle.h"
+#include "Ref.h"
+
+namespace Finch
+{
+    class Counted : public RefCounted
+    {
+    public:
+        Counted(int value)
+        :   mValue(value)
+        {
+            sLive++;
+        }
+
+        ~Counted()
+        {
+            sLive--;
+        }
+
+        int Value() const { return mValue; }
+
+        static int Live() { return sLive; }
+
+    private:
+        int mValue;
+
+        static int sLive;
+    };
+
+    int Counted::sLive = 0;
+
+    void HandleTests::Run()
+    {
+        TestOwnership();
+        TestAssignment();
+        TestMove();
+    }
+
+    void HandleTests::TestOwnership()
+    {
+        EXPECT_EQUAL(sizeof(void *), sizeof(Handle<Counted>));
+
+        {
+            Handle<Counted> h1(new Counted(1234));
+            EXPECT_EQUAL(1234, h1->Value());
+            EXPECT_EQUAL(1, Counted::Live());
+
+            {
+                Handle<Counted> h2 = h1;
+                Handle<Counted> h3 = h1;
+                Handle<Counted> h4 = h2;
+                EXPECT(h4 == h1);
+            }
+
+            EXPECT_EQUAL(1, Counted::Live());
+        }
+
+        EXPECT_EQUAL(0, Counted::Live());
+
+        Handle<Counted> empty;
+        EXPECT(empty.IsNull());
+    }
+
+    void HandleTests::TestAssignment()
+    {
+        {
+            Handle<Counted> h1;
+
+            {
+                Handle<Counted> h2(new Counted(1));
+                h1 = h2;
+            }
+
+            EXPECT_EQUAL(1, Counted::Live());
+            EXPECT_EQUAL(1, h1->Value());
+
+            // replacing the last reference frees the old object
+            h1 = Handle<Counted>(new Counted(2));
+            EXPECT_EQUAL(1, Counted::Live());
+            EXPECT_EQUAL(2, h1->Value());
+
+            // assigning to itself keeps it alive
+            h1 = h1;
+            EXPECT_EQUAL(1, Counted::Live());
+
+            h1.Clear();
+            EXPECT(h1.IsNull());
+            EXPECT_EQUAL(0, Counted::Live());
+        }
+
+        EXPECT_EQUAL(0, Counted::Live());
+    }
+
+    void HandleTests::TestMove()
+    {
+#if __cplusplus >= 201103L
+        Handle<Counted> h1(new Counted(3));
+        Handle<Counted> h2(static_cast<Handle<Counted> &&>(h1));
+        EXPECT(h1.IsNull());
+        EXPECT_EQUAL(3, h2->Value());
+        EXPECT_EQUAL(1, Counted::Live());
+
+        Handle<Counted> h3(new Counted(4));
+        h3 = static_cast<Handle<Counted> &&>(h2);
+        EXPECT(h2.IsNull());
+        EXPECT_EQUAL(3, h3->Value());
+        EXPECT_EQUAL(1, Counted::Live());
+
+        h3.Clear();
+        EXPECT_EQUAL(0, Counted::Live());
+#endif
+    }
+}
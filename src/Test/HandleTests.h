@@ -0,0 +1,17 @@
+#pragma once
+
+#include "Test.h"
+
+namespace Finch
+{
+    class HandleTests : public Test
+    {
+    public:
+        static void Run();
+
+    private:
+        static void TestOwnership();
+        static void TestAssignment();
+        static void TestMove();
+    };
+}
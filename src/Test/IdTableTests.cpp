@@ -0,0 +1,200 @@
+#include "IdTableTests.h"
+#include "Dictionary.h"
+
+namespace Finch
+{
+    void IdTableTests::Run()
+    {
+        TestInsertFind();
+        TestReplace();
+        TestRemove();
+        TestCollisions();
+        TestGrow();
+        TestClear();
+        TestFindKeyForValue();
+    }
+
+    void IdTableTests::TestInsertFind()
+    {
+        IdTable<int> table;
+        int value = 0;
+
+        EXPECT_EQUAL(0, table.Count());
+        EXPECT(!table.Find(0, &value));
+
+        table.Insert(3, 30);
+        table.Insert(0, 10);
+
+        EXPECT_EQUAL(2, table.Count());
+        EXPECT(table.Find(3, &value));
+        EXPECT_EQUAL(30, value);
+        EXPECT(table.Find(0, &value));
+        EXPECT_EQUAL(10, value);
+        EXPECT(!table.Find(1, &value));
+    }
+
+    void IdTableTests::TestReplace()
+    {
+        IdTable<int> table;
+        int value = 0;
+
+        // inserting an existing key replaces it instead of adding another,
+        // before and after the table grows
+        for (int size = 1; size <= 20; size++)
+        {
+            table.Clear();
+            for (int i = 0; i < size; i++) table.Insert(i, i);
+
+            table.Insert(0, 100);
+            EXPECT_EQUAL(size, table.Count());
+            EXPECT(table.Find(0, &value));
+            EXPECT_EQUAL(100, value);
+        }
+
+        EXPECT(table.Replace(1, 101));
+        EXPECT(!table.Replace(50, 150));
+
+        EXPECT_EQUAL(20, table.Count());
+        EXPECT(table.Find(1, &value));
+        EXPECT_EQUAL(101, value);
+        EXPECT(!table.Find(50, &value));
+    }
+
+    void IdTableTests::TestRemove()
+    {
+        IdTable<int> table;
+        int value = 0;
+
+        table.Insert(1, 10);
+        table.Insert(2, 20);
+        table.Insert(3, 30);
+
+        // removing an item keeps the rest
+        EXPECT(table.Remove(1));
+        EXPECT(!table.Remove(1));
+        EXPECT(!table.Remove(4));
+
+        EXPECT_EQUAL(2, table.Count());
+        EXPECT(!table.Find(1, &value));
+        EXPECT(table.Find(2, &value));
+        EXPECT_EQUAL(20, value);
+        EXPECT(table.Find(3, &value));
+        EXPECT_EQUAL(30, value);
+
+        table.Insert(1, 11);
+        EXPECT_EQUAL(3, table.Count());
+        EXPECT(table.Find(1, &value));
+        EXPECT_EQUAL(11, value);
+    }
+
+    void IdTableTests::TestCollisions()
+    {
+        IdTable<int> table;
+        int value = 0;
+
+        // a table with only a few items uses 16 slots
+        for (int i = 100; i < 105; i++) table.Insert(i, i);
+
+        // these all land in the same slot
+        table.Insert(0, 0);
+        table.Insert(16, 16);
+        table.Insert(32, 32);
+
+        // removing the middle of a probe chain shouldn't hide the end of it
+        EXPECT(table.Remove(16));
+        EXPECT(table.Find(32, &value));
+        EXPECT_EQUAL(32, value);
+        EXPECT(!table.Find(16, &value));
+
+        // re-inserting a key past a removed one shouldn't duplicate it
+        table.Insert(32, 64);
+        EXPECT_EQUAL(7, table.Count());
+        EXPECT(table.Remove(32));
+        EXPECT(!table.Find(32, &value));
+
+        EXPECT(table.Find(0, &value));
+        EXPECT_EQUAL(0, value);
+
+        // removing and adding over and over reuses the removed slots
+        for (int i = 200; i < 1200; i++)
+        {
+            table.Insert(i, i);
+            table.Remove(i);
+        }
+
+        EXPECT_EQUAL(6, table.Count());
+        EXPECT(table.NumSlots() <= 32);
+    }
+
+    void IdTableTests::TestGrow()
+    {
+        IdTable<int> table;
+        int value = 0;
+
+        for (int i = 0; i < 100; i++) table.Insert(i * 7, i);
+
+        EXPECT_EQUAL(100, table.Count());
+
+        for (int i = 0; i < 100; i++)
+        {
+            EXPECT(table.Find(i * 7, &value));
+            EXPECT_EQUAL(i, value);
+        }
+
+        // every item can be reached by walking the slots
+        int count = 0;
+        int sum = 0;
+        for (int i = 0; i < table.NumSlots(); i++)
+        {
+            StringId key;
+            if (table.GetSlot(i, &key, &value))
+            {
+                EXPECT_EQUAL(value * 7, key);
+                count++;
+                sum += value;
+            }
+        }
+
+        EXPECT_EQUAL(100, count);
+        EXPECT_EQUAL(4950, sum);
+    }
+
+    void IdTableTests::TestClear()
+    {
+        IdTable<int> table;
+        int value = 0;
+
+        for (int i = 0; i < 20; i++) table.Insert(i, i);
+        table.Clear();
+
+        EXPECT_EQUAL(0, table.Count());
+        EXPECT(!table.Find(1, &value));
+
+        // still usable after clearing, and clearing twice is fine
+        table.Insert(1, 2);
+        EXPECT(table.Find(1, &value));
+        EXPECT_EQUAL(2, value);
+
+        table.Clear();
+        table.Clear();
+        EXPECT_EQUAL(0, table.Count());
+    }
+
+    void IdTableTests::TestFindKeyForValue()
+    {
+        IdTable<int> table;
+
+        // empty slots hold the default value, which shouldn't be found
+        EXPECT_EQUAL(NO_STRING, table.FindKeyForValue(0));
+
+        table.Insert(5, 0);
+        table.Insert(6, 1);
+        EXPECT_EQUAL(5, table.FindKeyForValue(0));
+        EXPECT_EQUAL(6, table.FindKeyForValue(1));
+
+        for (int i = 10; i < 30; i++) table.Insert(i, i);
+        table.Remove(20);
+        EXPECT_EQUAL(21, table.FindKeyForValue(21));
+        EXPECT_EQUAL(NO_STRING, table.FindKeyForValue(20));
+    }
+}
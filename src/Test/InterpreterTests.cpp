@@ -0,0 +1,119 @@
+#include "InterpreterTests.h"
+#include "Interpreter.h"
+#include "TestHost.h"
+
+namespace Finch
+{
+    void InterpreterTests::Run()
+    {
+        TestBlocksAreFreed();
+        TestFieldStorage();
+        TestMethodEpochs();
+    }
+
+    static int CountAllocations(Interpreter & interpreter)
+    {
+        int count = 0;
+        for (int i = 0; i <= Allocator::NUM_SIZE_CLASSES; i++)
+        {
+            count += interpreter.GetAllocator().GetStats(i).numAllocations;
+        }
+
+        return count;
+    }
+
+    void InterpreterTests::TestBlocksAreFreed()
+    {
+        TestHost host;
+        Interpreter interpreter(host);
+
+        // Creates block objects from nested blocks, both in the heap and on
+        // the fiber's stack, and reads an undefined global. Each run replaces
+        // the globals the last one set, so after the first couple of runs,
+        // running it again shouldn't leave anything more behind.
+        const char * source =
+            "make <- { |n| { n } }\n"
+            "a <- 0\n"
+            "b <- #[{ 1 }, { 2 }, { a <-- a + 1 }]\n"
+            "b add: { 4 }\n"
+            "(b at: 2) call\n"
+            "(make call: 3) call\n"
+            "undefined-global\n";
+
+        int numLive[Allocator::NUM_SIZE_CLASSES + 1];
+        for (int run = 0; run < 4; run++)
+        {
+            SourceLineReader reader(source);
+            interpreter.Interpret(reader, false);
+            interpreter.CollectGarbage();
+
+            // The blocks the compiler creates and the storage they own come
+            // from the allocator, so a leaked one stays live in its size
+            // class.
+            for (int i = 0; i <= Allocator::NUM_SIZE_CLASSES; i++)
+            {
+                int live = interpreter.GetAllocator().GetStats(i).numLive;
+                if (run > 1) EXPECT_EQUAL(numLive[i], live);
+                numLive[i] = live;
+            }
+        }
+    }
+
+    void InterpreterTests::TestFieldStorage()
+    {
+        TestHost host;
+        Interpreter interpreter(host);
+
+        const int numFields = 100;
+        StringId names[numFields];
+        for (int i = 0; i < numFields; i++)
+        {
+            names[i] = interpreter.AddString(String::Format("field%d", i));
+        }
+
+        Value first = interpreter.NewObject(interpreter.Nil());
+        for (int i = 0; i < numFields; i++)
+        {
+            first.SetField(names[i], Value(static_cast<double>(i)));
+        }
+
+        // A second object with the same fields reuses the first one's
+        // shapes, so the only storage it needs besides itself is for its
+        // fields. That should come from the interpreter's allocator and grow
+        // geometrically instead of once per field.
+        int before = CountAllocations(interpreter);
+        Value second = interpreter.NewObject(interpreter.Nil());
+        for (int i = 0; i < numFields; i++)
+        {
+            second.SetField(names[i], Value(static_cast<double>(i * 2)));
+        }
+
+        int allocations = CountAllocations(interpreter) - before;
+        EXPECT(allocations > 1);
+        EXPECT(allocations <= 10);
+
+        for (int i = 0; i < numFields; i++)
+        {
+            EXPECT_EQUAL(i, first.GetField(names[i]).AsNumber());
+            EXPECT_EQUAL(i * 2, second.GetField(names[i]).AsNumber());
+        }
+    }
+
+    void InterpreterTests::TestMethodEpochs()
+    {
+        TestHost host;
+        Interpreter first(host);
+        Interpreter second(host);
+
+        int firstEpoch = first.MethodEpoch();
+        int secondEpoch = second.MethodEpoch();
+
+        // adding a method only makes the caches of the interpreter that owns
+        // the object stale
+        SourceLineReader reader("Ether :: ( epoch-test-method { 1 } )\n");
+        first.Interpret(reader, false);
+
+        EXPECT(first.MethodEpoch() != firstEpoch);
+        EXPECT_EQUAL(secondEpoch, second.MethodEpoch());
+    }
+}
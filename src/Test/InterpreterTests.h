@@ -0,0 +1,17 @@
+#pragma once
+
+#include "Test.h"
+
+namespace Finch
+{
+    class InterpreterTests : public Test
+    {
+    public:
+        static void Run();
+
+    private:
+        static void TestBlocksAreFreed();
+        static void TestFieldStorage();
+        static void TestMethodEpochs();
+    };
+}
@@ -137,7 +137,7 @@ namespace Finch
                 TOKEN_LINE, TOKEN_EOF);
     }
     
-    Ref<Token> LexerTests::LexOne(const char * text)
+    Handle<Token> LexerTests::LexOne(const char * text)
     {
         FixedLineReader reader(text);
         Lexer lexer(reader);
@@ -156,7 +156,7 @@ namespace Finch
         while (true)
         {
             TokenType type = static_cast<TokenType>(va_arg(args, int));
-            Ref<Token> token = lexer.ReadToken();
+            Handle<Token> token = lexer.ReadToken();
             EXPECT_EQUAL(type, token->Type());
             
             if (type == TOKEN_EOF) break;
@@ -1,6 +1,6 @@
 #pragma once
 
-#include "Ref.h"
+#include "Handle.h"
 #include "Test.h"
 
 namespace Finch
@@ -13,7 +13,7 @@ namespace Finch
         static void Run();
         
     private:
-        static Ref<Token> LexOne(const char * text);
+        static Handle<Token> LexOne(const char * text);
         static void TestLex(const char * text, ...);
     };
 }
@@ -0,0 +1,301 @@
+#include "OptimizerTests.h"
+#include "Block.h"
+#include "Interpreter.h"
+#include "Optimizer.h"
+#include "TestHost.h"
+
+namespace Finch
+{
+    // Each test writes the same hand-made code into two blocks, optimizes
+    // one of them and checks that calling either gives the same result.
+    // Writing the code by hand, instead of compiling source, pins down
+    // exactly what each pass is given.
+    typedef void (*WriteCode)(Interpreter & interpreter, Block & block);
+    
+    static Handle<Block> NewBlock(Interpreter & interpreter, int numParams,
+                                  int numRegisters, WriteCode write)
+    {
+        Array<String> params;
+        for (int i = 0; i < numParams; i++)
+        {
+            params.Add(String::Format("param%d", i));
+        }
+        
+        Handle<Block> block = Handle<Block>(new (interpreter.GetAllocator())
+            Block(Block::BLOCK_METHOD_ID, params));
+        block->SetNumRegisters(numRegisters);
+        write(interpreter, *block);
+        return block;
+    }
+    
+    // Binds the block to a global, sends it the given message and gets
+    // what it returns along with any errors.
+    static String Call(Interpreter & interpreter, TestHost & host,
+                       const Handle<Block> & block, const char * message)
+    {
+        interpreter.SetGlobal(interpreter.DefineGlobal("test-block"),
+                              interpreter.NewBlock(block, interpreter.Nil()));
+        
+        String source = String("*primitive* write: (test-block ") +
+                        message + ")\n";
+        SourceLineReader reader(source.CString());
+        
+        host.Clear();
+        interpreter.Interpret(reader, false);
+        return host.GetOutput() + host.GetErrors();
+    }
+    
+    static int Constant(Interpreter & interpreter, Block & block,
+                        const char * value)
+    {
+        return block.AddConstant(interpreter.StringLiteral(value));
+    }
+    
+    static int Constant(Block & block, double value)
+    {
+        return block.AddConstant(Value(value));
+    }
+    
+    static int CountOps(const Block & block, OpCode op)
+    {
+        Array<DecodedInstruction> code;
+        block.Decode(code);
+        
+        int count = 0;
+        for (int i = 0; i < code.Count(); i++)
+        {
+            if (code[i].op == op) count++;
+        }
+        
+        return count;
+    }
+    
+    void OptimizerTests::Run()
+    {
+        TestPropagateCopies();
+        TestRemoveDeadStores();
+        TestThreadJumps();
+        TestCompactRegisters();
+        TestFindBorrowedParams();
+    }
+    
+    // Shuffles two numbers through a chain of moves before adding them.
+    static void WriteCopies(Interpreter & interpreter, Block & block)
+    {
+        block.Write(OP_CONSTANT, Constant(block, 10), 0);
+        block.Write(OP_MOVE, 0, 1);
+        block.Write(OP_MOVE, 1, 2);
+        block.Write(OP_CONSTANT, Constant(block, 5), 3);
+        block.Write(OP_MOVE, 2, 4);
+        block.Write(OP_MOVE, 3, 5);
+        block.Write(OP_MESSAGE_1, interpreter.AddString("+"), 4, 6);
+        block.Write(OP_MOVE, 6, 7);
+        block.Write(OP_END, 7);
+    }
+    
+    // Copies a number into a register below a send, stores the original in
+    // a global so the copy is still needed, then calls the parameter and
+    // returns the copy. The callee's frame starts right above the receiver,
+    // so the original is overwritten by the call.
+    static void WriteClobberedCopy(Interpreter & interpreter, Block & block)
+    {
+        block.Write(OP_CONSTANT, Constant(block, 7), 3);
+        block.Write(OP_MOVE, 3, 1);
+        block.Write(OP_SET_GLOBAL, interpreter.DefineGlobal("original"), 3);
+        block.Write(OP_MOVE, 0, 2);
+        block.Write(OP_MESSAGE_0, interpreter.AddString("call"), 2, 2);
+        block.Write(OP_MOVE, 1, 4);
+        block.Write(OP_END, 4);
+    }
+    
+    void OptimizerTests::TestPropagateCopies()
+    {
+        TestHost host;
+        Interpreter interpreter(host);
+        
+        Handle<Block> plain = NewBlock(interpreter, 0, 8, WriteCopies);
+        Handle<Block> optimized = NewBlock(interpreter, 0, 8, WriteCopies);
+        Optimizer::Optimize(*optimized);
+        
+        EXPECT_EQUAL("15", Call(interpreter, host, plain, "call"));
+        EXPECT_EQUAL("15", Call(interpreter, host, optimized, "call"));
+        
+        // The receiver and argument still need to be next to each other, so
+        // only the moves that nothing needs are gone.
+        EXPECT_EQUAL(5, CountOps(*plain, OP_MOVE));
+        EXPECT(CountOps(*optimized, OP_MOVE) < 2);
+        EXPECT(optimized->NumRegisters() < plain->NumRegisters());
+        
+        // A copy isn't a copy any more once a send has overwritten what it's
+        // a copy of.
+        plain = NewBlock(interpreter, 1, 5, WriteClobberedCopy);
+        optimized = NewBlock(interpreter, 1, 5, WriteClobberedCopy);
+        Optimizer::Optimize(*optimized);
+        
+        const char * message = "call: { \"clobbered\" }";
+        EXPECT_EQUAL("7", Call(interpreter, host, plain, message));
+        EXPECT_EQUAL("7", Call(interpreter, host, optimized, message));
+    }
+    
+    // Writes registers that are never read, along with a global that is.
+    static void WriteDeadStores(Interpreter & interpreter, Block & block)
+    {
+        block.Write(OP_CONSTANT, Constant(interpreter, block, "dead"), 0);
+        block.Write(OP_CONSTANT, Constant(interpreter, block, "live"), 0);
+        block.Write(OP_CONSTANT, Constant(interpreter, block, "unread"), 1);
+        block.Write(OP_MOVE, 1, 1);
+        block.Write(OP_CONSTANT, Constant(interpreter, block, "global"), 2);
+        block.Write(OP_SET_GLOBAL, interpreter.DefineGlobal("written"), 2);
+        block.Write(OP_END, 0);
+    }
+    
+    void OptimizerTests::TestRemoveDeadStores()
+    {
+        TestHost host;
+        Interpreter interpreter(host);
+        
+        Handle<Block> plain = NewBlock(interpreter, 0, 3, WriteDeadStores);
+        Handle<Block> optimized = NewBlock(interpreter, 0, 3, WriteDeadStores);
+        Optimizer::Optimize(*optimized);
+        
+        EXPECT_EQUAL("live", Call(interpreter, host, plain, "call"));
+        EXPECT_EQUAL("live", Call(interpreter, host, optimized, "call"));
+        
+        // Setting a global isn't a dead store even though nothing here reads
+        // it.
+        int global = interpreter.FindGlobal("written");
+        interpreter.SetGlobal(global, interpreter.Nil());
+        Call(interpreter, host, optimized, "call");
+        EXPECT(interpreter.GetGlobal(global) ==
+               interpreter.StringLiteral("global"));
+        
+        EXPECT_EQUAL(4, CountOps(*plain, OP_CONSTANT));
+        EXPECT_EQUAL(2, CountOps(*optimized, OP_CONSTANT));
+        EXPECT_EQUAL(0, CountOps(*optimized, OP_MOVE));
+        EXPECT_EQUAL(1, CountOps(*optimized, OP_SET_GLOBAL));
+    }
+    
+    // An if/else where the else branch starts with a jump to a jump, and
+    // the then branch jumps to the end.
+    static void WriteJumps(Interpreter & interpreter, Block & block)
+    {
+        int toElse = block.WriteJump(OP_JUMP_IF_FALSE, 0);
+        block.Write(OP_CONSTANT, Constant(interpreter, block, "then"), 1);
+        int toEnd = block.WriteJump(OP_JUMP);
+        block.PatchJump(toElse);
+        int hop = block.WriteJump(OP_JUMP);
+        block.PatchJump(hop);
+        block.Write(OP_CONSTANT, Constant(interpreter, block, "else"), 1);
+        block.PatchJump(toEnd);
+        block.Write(OP_END, 1);
+    }
+    
+    void OptimizerTests::TestThreadJumps()
+    {
+        TestHost host;
+        Interpreter interpreter(host);
+        
+        Handle<Block> plain = NewBlock(interpreter, 1, 2, WriteJumps);
+        Handle<Block> optimized = NewBlock(interpreter, 1, 2, WriteJumps);
+        Optimizer::Optimize(*optimized);
+        
+        EXPECT_EQUAL("then", Call(interpreter, host, plain, "call: true"));
+        EXPECT_EQUAL("else", Call(interpreter, host, plain, "call: false"));
+        EXPECT_EQUAL("then", Call(interpreter, host, optimized, "call: true"));
+        EXPECT_EQUAL("else", Call(interpreter, host, optimized, "call: false"));
+        
+        // No jump lands on another jump or on the end.
+        Array<DecodedInstruction> code;
+        optimized->Decode(code);
+        for (int i = 0; i < code.Count(); i++)
+        {
+            if (!Block::IsJump(code[i].op)) continue;
+            
+            EXPECT(code[code[i].a].op != OP_JUMP);
+            EXPECT(code[code[i].a].op != OP_END);
+        }
+        
+        EXPECT_EQUAL(2, CountOps(*optimized, OP_END));
+        EXPECT_EQUAL(0, CountOps(*optimized, OP_JUMP));
+    }
+    
+    // Uses a few registers out of many, with a send in the middle that needs
+    // its argument right after its receiver and a value below the receiver
+    // that lives across it.
+    static void WriteSparseRegisters(Interpreter & interpreter, Block & block)
+    {
+        StringId add = interpreter.AddString("+");
+        block.Write(OP_CONSTANT, Constant(block, 2), 3);
+        block.Write(OP_CONSTANT, Constant(block, 3), 10);
+        block.Write(OP_CONSTANT, Constant(block, 4), 11);
+        block.Write(OP_MESSAGE_1, add, 10, 15);
+        block.Write(OP_MOVE, 3, 16);
+        block.Write(OP_MESSAGE_1, add, 15, 19);
+        block.Write(OP_END, 19);
+    }
+    
+    void OptimizerTests::TestCompactRegisters()
+    {
+        TestHost host;
+        Interpreter interpreter(host);
+        
+        Handle<Block> plain = NewBlock(interpreter, 0, 20,
+                                       WriteSparseRegisters);
+        Handle<Block> optimized = NewBlock(interpreter, 0, 20,
+                                           WriteSparseRegisters);
+        Optimizer::Optimize(*optimized);
+        
+        EXPECT_EQUAL("9", Call(interpreter, host, plain, "call"));
+        EXPECT_EQUAL("9", Call(interpreter, host, optimized, "call"));
+        
+        EXPECT_EQUAL(20, plain->NumRegisters());
+        EXPECT(optimized->NumRegisters() <= 6);
+    }
+    
+    // Calls the first parameter with the second, and stores the third in a
+    // global.
+    static void WriteParamUses(Interpreter & interpreter, Block & block)
+    {
+        block.Write(OP_MOVE, 0, 3);
+        block.Write(OP_MOVE, 1, 4);
+        block.Write(OP_MESSAGE_1, interpreter.AddString("call:"), 3, 5);
+        block.Write(OP_SET_GLOBAL, interpreter.DefineGlobal("kept"), 2);
+        block.Write(OP_CONSTANT, Constant(block, 1), 6);
+        block.Write(OP_MESSAGE_0, interpreter.AddString("sqrt"), 6, 6);
+        block.Write(OP_END, 5);
+    }
+    
+    void OptimizerTests::TestFindBorrowedParams()
+    {
+        TestHost host;
+        Interpreter interpreter(host);
+        
+        Handle<Block> plain = NewBlock(interpreter, 3, 7, WriteParamUses);
+        Handle<Block> optimized = NewBlock(interpreter, 3, 7, WriteParamUses);
+        Optimizer::Optimize(*optimized);
+        
+        // Only sending messages to a parameter or passing it to a send lets
+        // a block on the caller's stack be passed for it. Storing it
+        // anywhere doesn't.
+        EXPECT_EQUAL(0, plain->BorrowedParams());
+        EXPECT(optimized->BorrowsParam(0));
+        EXPECT(optimized->BorrowsParam(1));
+        EXPECT(!optimized->BorrowsParam(2));
+        
+        // Only the send that passes them on checks what it calls.
+        EXPECT_EQUAL(1, CountOps(*optimized, OP_BORROW));
+        
+        // Blocks passed for the first two come from the call's stack, and
+        // one is passed on to the other. The third must be on the heap since
+        // the global keeps it.
+        const char * message =
+            "call: {|b| b call } : { \"passed\" } : { \"kept\" }";
+        EXPECT_EQUAL("passed", Call(interpreter, host, plain, message));
+        EXPECT_EQUAL("passed", Call(interpreter, host, optimized, message));
+        
+        SourceLineReader reader("*primitive* write: kept call\n");
+        host.Clear();
+        interpreter.Interpret(reader, false);
+        EXPECT_EQUAL("kept", host.GetOutput());
+    }
+}
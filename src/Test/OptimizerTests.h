@@ -0,0 +1,19 @@
+#pragma once
+
+#include "Test.h"
+
+namespace Finch
+{
+    class OptimizerTests : public Test
+    {
+    public:
+        static void Run();
+
+    private:
+        static void TestPropagateCopies();
+        static void TestRemoveDeadStores();
+        static void TestThreadJumps();
+        static void TestCompactRegisters();
+        static void TestFindBorrowedParams();
+    };
+}
@@ -0,0 +1,117 @@
+#include <cstdlib>
+
+#include "RegisterStackTests.h"
+#include "Allocator.h"
+#include "IInterpreterHost.h"
+#include "RegisterStack.h"
+
+namespace Finch
+{
+    // A host that only provides memory.
+    class RegisterStackHost : public IInterpreterHost
+    {
+    public:
+        virtual void * Allocate(size_t size) { return malloc(size); }
+        virtual void Free(void * data) { free(data); }
+        
+        virtual void Output(const String & text) {}
+        virtual void Error(const String & message) {}
+    };
+    
+    void RegisterStackTests::Run()
+    {
+        TestReserve();
+        TestGrow();
+        TestMaxSize();
+        TestClear();
+    }
+    
+    void RegisterStackTests::TestReserve()
+    {
+        RegisterStackHost host;
+        Allocator allocator(host);
+        RegisterStack stack(allocator, 1000);
+        
+        EXPECT_EQUAL(0, stack.Count());
+        
+        EXPECT(stack.Reserve(10));
+        EXPECT_EQUAL(10, stack.Count());
+        
+        // new registers start out null
+        for (int i = 0; i < 10; i++) EXPECT(stack[i].IsNull());
+        
+        stack[3] = Value(3.0);
+        EXPECT(stack.At(3) == &stack[3]);
+        
+        // reserving fewer registers leaves the rest alone
+        EXPECT(stack.Reserve(5));
+        EXPECT_EQUAL(10, stack.Count());
+        EXPECT(stack[3] == Value(3.0));
+    }
+    
+    void RegisterStackTests::TestGrow()
+    {
+        RegisterStackHost host;
+        Allocator allocator(host);
+        RegisterStack stack(allocator, 100000);
+        
+        EXPECT(stack.Reserve(10));
+        for (int i = 0; i < 10; i++) stack[i] = Value(static_cast<double>(i));
+        
+        // growing keeps the values, even if they move
+        EXPECT(stack.Reserve(5000));
+        EXPECT_EQUAL(5000, stack.Count());
+        
+        for (int i = 0; i < 10; i++)
+        {
+            EXPECT(stack[i] == Value(static_cast<double>(i)));
+        }
+        
+        for (int i = 10; i < 5000; i++) EXPECT(stack[i].IsNull());
+    }
+    
+    void RegisterStackTests::TestMaxSize()
+    {
+        RegisterStackHost host;
+        Allocator allocator(host);
+        RegisterStack stack(allocator, 300);
+        
+        EXPECT_EQUAL(300, stack.MaxSize());
+        
+        EXPECT(stack.Reserve(200));
+        stack[199] = Value(1.0);
+        
+        // can't go past the maximum, and failing leaves it unchanged
+        EXPECT(!stack.Reserve(301));
+        EXPECT_EQUAL(200, stack.Count());
+        EXPECT(stack[199] == Value(1.0));
+        
+        // but can use all of it
+        EXPECT(stack.Reserve(300));
+        EXPECT_EQUAL(300, stack.Count());
+        EXPECT(stack[199] == Value(1.0));
+    }
+    
+    void RegisterStackTests::TestClear()
+    {
+        RegisterStackHost host;
+        Allocator allocator(host);
+        RegisterStack stack(allocator, 1000);
+        
+        EXPECT(stack.Reserve(8));
+        for (int i = 0; i < 8; i++) stack[i] = Value(1.0);
+        
+        stack.Clear(2, 5);
+        
+        EXPECT(stack[1] == Value(1.0));
+        for (int i = 2; i < 5; i++) EXPECT(stack[i].IsNull());
+        EXPECT(stack[5] == Value(1.0));
+        
+        // clearing nothing is fine
+        stack.Clear(6, 6);
+        stack.Clear(7, 3);
+        EXPECT(stack[6] == Value(1.0));
+        EXPECT_EQUAL(8, stack.Count());
+    }
+}
+
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "Test.h"
+
+namespace Finch
+{
+    class RegisterStackTests : public Test
+    {
+    public:
+        static void Run();
+        
+    private:
+        static void TestReserve();
+        static void TestGrow();
+        static void TestMaxSize();
+        static void TestClear();
+    };
+}
+
@@ -0,0 +1,112 @@
+#include <sstream>
+
+#include "SnapshotTests.h"
+#include "Interpreter.h"
+#include "Snapshot.h"
+#include "TestHost.h"
+
+namespace Finch
+{
+    // Leaves behind objects with fields and methods, a closure over a
+    // global and an array that shares an object with a global. The
+    // interpreters in these tests don't load the core library, so this only
+    // uses primitives.
+    static const char * sSource =
+        "greeting <- \"hello, \"\n"
+        "counter <- [ _count <- 0\n"
+        "  bump { _count <- _count + 1 } ]\n"
+        "counter bump\n"
+        "make <- {|s| { *primitive* string-concat: greeting and: s } }\n"
+        "world <- make call: \"snapshot\"\n"
+        "items <- #[counter, world]\n";
+
+    // Uses everything the source left behind.
+    static const char * sCheck =
+        "*primitive* write: world call\n"
+        "*primitive* write: counter bump\n"
+        "*primitive* write: (items at: 0) bump\n"
+        "*primitive* write: (items at: 1) call\n";
+
+    void SnapshotTests::Run()
+    {
+        TestRoundTrip();
+        TestRejectsCorruptSnapshot();
+        TestRejectsOtherVersion();
+        TestRejectsImage();
+    }
+
+    // Runs the test source and snapshots the interpreter it left behind.
+    static std::string WriteSnapshot()
+    {
+        TestHost host;
+        Interpreter interpreter(host);
+        SourceLineReader reader(sSource);
+        interpreter.Interpret(reader, false);
+
+        std::stringstream snapshot;
+        interpreter.WriteSnapshot(snapshot);
+        return snapshot.str();
+    }
+
+    void SnapshotTests::TestRoundTrip()
+    {
+        std::stringstream stream(WriteSnapshot());
+        EXPECT(Snapshot::IsSnapshot(stream));
+
+        // An interpreter that has never run the source picks up where the
+        // one that did left off.
+        TestHost host;
+        Interpreter interpreter(host);
+        EXPECT(interpreter.LoadSnapshot(stream));
+
+        SourceLineReader reader(sCheck);
+        interpreter.Interpret(reader, false);
+        EXPECT_EQUAL("hello, snapshot23hello, snapshot", host.GetOutput());
+        EXPECT_EQUAL("", host.GetErrors());
+    }
+
+    void SnapshotTests::TestRejectsCorruptSnapshot()
+    {
+        std::string snapshot = WriteSnapshot();
+
+        // Every truncation is rejected. It may have been partly restored by
+        // then, which is why LoadCore() starts over with a new interpreter.
+        for (size_t length = 0; length < snapshot.length(); length++)
+        {
+            TestHost host;
+            Interpreter interpreter(host);
+            std::stringstream stream(snapshot.substr(0, length));
+            EXPECT(!interpreter.LoadSnapshot(stream));
+            EXPECT(host.GetErrors().Length() > 0);
+        }
+    }
+
+    void SnapshotTests::TestRejectsOtherVersion()
+    {
+        std::string snapshot = WriteSnapshot();
+
+        // The version comes right after the magic number.
+        snapshot[4]++;
+
+        TestHost host;
+        Interpreter interpreter(host);
+        std::stringstream stream(snapshot);
+        EXPECT(Snapshot::IsSnapshot(stream));
+        EXPECT(!interpreter.LoadSnapshot(stream));
+        EXPECT_EQUAL("Heap snapshot was written by a different version of Finch.",
+                     host.GetErrors());
+    }
+
+    void SnapshotTests::TestRejectsImage()
+    {
+        TestHost host;
+        Interpreter interpreter(host);
+        SourceLineReader reader(sSource);
+
+        std::stringstream stream;
+        interpreter.CompileImage(reader, stream);
+        EXPECT(!Snapshot::IsSnapshot(stream));
+        EXPECT(!interpreter.LoadSnapshot(stream));
+        EXPECT_EQUAL("Not a heap snapshot.", host.GetErrors());
+    }
+}
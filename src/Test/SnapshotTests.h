@@ -0,0 +1,18 @@
+#pragma once
+
+#include "Test.h"
+
+namespace Finch
+{
+    class SnapshotTests : public Test
+    {
+    public:
+        static void Run();
+
+    private:
+        static void TestRoundTrip();
+        static void TestRejectsCorruptSnapshot();
+        static void TestRejectsOtherVersion();
+        static void TestRejectsImage();
+    };
+}
@@ -0,0 +1,201 @@
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <unistd.h> // rmdir
+#include <utime.h>
+
+#include "StandaloneTests.h"
+#include "Interpreter.h"
+#include "Standalone.h"
+#include "TestHost.h"
+
+namespace Finch
+{
+    // The core library files LoadCore() looks at, and a source file to
+    // compile the image from. Each test starts with none of them and writes
+    // the ones it needs to a temporary directory.
+    static const char * sFiles[] = {
+        "core.fin", "core.fnb", "core.fns", "image.fin"
+    };
+
+    static String sDirectory;
+
+    static String PathTo(const char * file)
+    {
+        return sDirectory + "/" + file;
+    }
+
+    static void WriteFile(const char * file, const char * contents)
+    {
+        std::ofstream stream(PathTo(file).CString(),
+                             std::ios::out | std::ios::binary | std::ios::trunc);
+        stream << contents;
+    }
+
+    // Writes a core library that notes where it was loaded from.
+    static void WriteSource()
+    {
+        WriteFile("core.fin", "loaded-from <- \"source\"\n");
+    }
+
+    static void WriteImage()
+    {
+        WriteFile("image.fin", "loaded-from <- \"image\"\n");
+
+        TestHost host;
+        Interpreter * interpreter = Standalone::NewInterpreter(host);
+        Standalone::CompileFile(*interpreter, PathTo("image.fin"),
+                                PathTo("core.fnb"));
+        delete interpreter;
+    }
+
+    static void WriteSnapshot()
+    {
+        TestHost host;
+        Interpreter * interpreter = Standalone::NewInterpreter(host);
+        SourceLineReader reader("loaded-from <- \"snapshot\"\n");
+        interpreter->Interpret(reader, false);
+        Standalone::WriteSnapshotFile(*interpreter, PathTo("core.fns"));
+        delete interpreter;
+    }
+
+    // Makes the file look like it was modified after the others.
+    static void Touch(const char * file)
+    {
+        struct utimbuf times;
+        times.actime = time(NULL) + 10;
+        times.modtime = times.actime;
+        utime(PathTo(file).CString(), &times);
+    }
+
+    // Loads the core library and gets where it came from, or "" if it
+    // couldn't be loaded. Anything reported along the way ends up in errors.
+    static String LoadCore(bool fromSource, String * errors)
+    {
+        TestHost host;
+        Interpreter * interpreter = Standalone::LoadCore(
+            host, PathTo("core.fin"), fromSource);
+        if (interpreter != NULL)
+        {
+            SourceLineReader reader("*primitive* write: loaded-from\n");
+            interpreter->Interpret(reader, false);
+            delete interpreter;
+        }
+
+        *errors = host.GetErrors();
+        return host.GetOutput();
+    }
+
+    static void Cleanup()
+    {
+        for (size_t i = 0; i < sizeof(sFiles) / sizeof(sFiles[0]); i++)
+        {
+            remove(PathTo(sFiles[i]).CString());
+        }
+    }
+
+    void StandaloneTests::Run()
+    {
+        char directory[] = "/tmp/finch-tests-XXXXXX";
+        if (mkdtemp(directory) == NULL)
+        {
+            EXPECT_MSG(false, "Couldn't create a temporary directory.");
+            return;
+        }
+
+        sDirectory = directory;
+
+        TestLoadsSource();
+        Cleanup();
+        TestPrefersSnapshot();
+        Cleanup();
+        TestPrefersImage();
+        Cleanup();
+        TestIgnoresStaleFiles();
+        Cleanup();
+        TestFromSource();
+        Cleanup();
+        TestRejectedSnapshotFallsBack();
+        Cleanup();
+        TestRejectedImageFallsBack();
+        Cleanup();
+
+        rmdir(directory);
+    }
+
+    void StandaloneTests::TestLoadsSource()
+    {
+        WriteSource();
+
+        String errors;
+        EXPECT_EQUAL("source", LoadCore(false, &errors));
+        EXPECT_EQUAL("", errors);
+    }
+
+    void StandaloneTests::TestPrefersSnapshot()
+    {
+        WriteSource();
+        WriteImage();
+        WriteSnapshot();
+
+        String errors;
+        EXPECT_EQUAL("snapshot", LoadCore(false, &errors));
+        EXPECT_EQUAL("", errors);
+    }
+
+    void StandaloneTests::TestPrefersImage()
+    {
+        WriteSource();
+        WriteImage();
+
+        String errors;
+        EXPECT_EQUAL("image", LoadCore(false, &errors));
+        EXPECT_EQUAL("", errors);
+    }
+
+    void StandaloneTests::TestIgnoresStaleFiles()
+    {
+        WriteSource();
+        WriteImage();
+        WriteSnapshot();
+        Touch("core.fin");
+
+        String errors;
+        EXPECT_EQUAL("source", LoadCore(false, &errors));
+        EXPECT_EQUAL("", errors);
+    }
+
+    void StandaloneTests::TestFromSource()
+    {
+        WriteSource();
+        WriteImage();
+        WriteSnapshot();
+
+        String errors;
+        EXPECT_EQUAL("source", LoadCore(true, &errors));
+        EXPECT_EQUAL("", errors);
+    }
+
+    void StandaloneTests::TestRejectedSnapshotFallsBack()
+    {
+        WriteSource();
+        WriteImage();
+        WriteFile("core.fns", "FNCSnot a snapshot");
+
+        String errors;
+        EXPECT_EQUAL("image", LoadCore(false, &errors));
+        EXPECT(errors.Length() > 0);
+    }
+
+    void StandaloneTests::TestRejectedImageFallsBack()
+    {
+        WriteSource();
+        WriteFile("core.fnb", "FNCHnot an image");
+        WriteFile("core.fns", "FNCSnot a snapshot");
+
+        String errors;
+        EXPECT_EQUAL("source", LoadCore(false, &errors));
+        EXPECT(errors.Length() > 0);
+    }
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "Test.h"
+
+namespace Finch
+{
+    class StandaloneTests : public Test
+    {
+    public:
+        static void Run();
+
+    private:
+        static void TestLoadsSource();
+        static void TestPrefersSnapshot();
+        static void TestPrefersImage();
+        static void TestIgnoresStaleFiles();
+        static void TestFromSource();
+        static void TestRejectedSnapshotFallsBack();
+        static void TestRejectedImageFallsBack();
+    };
+}
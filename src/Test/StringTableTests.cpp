@@ -0,0 +1,69 @@
+#include "StringTableTests.h"
+#include "StringTable.h"
+
+namespace Finch
+{
+    void StringTableTests::Run()
+    {
+        TestAdd();
+        TestFind();
+        TestGrow();
+    }
+    
+    void StringTableTests::TestAdd()
+    {
+        StringTable table;
+        
+        StringId a = table.Add("foo");
+        StringId b = table.Add("bar");
+        
+        EXPECT(a != b);
+        EXPECT_EQUAL(2, table.Count());
+        
+        // Adding an equal string returns the existing ID, even if it's a
+        // different String object.
+        EXPECT_EQUAL(a, table.Add(String("f") + "oo"));
+        EXPECT_EQUAL(b, table.Add("bar"));
+        EXPECT_EQUAL(2, table.Count());
+        
+        // The empty string can be interned too.
+        StringId empty = table.Add("");
+        EXPECT_EQUAL(empty, table.Add(String()));
+        EXPECT_EQUAL(3, table.Count());
+    }
+    
+    void StringTableTests::TestFind()
+    {
+        StringTable table;
+        
+        StringId a = table.Add("foo:bar:");
+        StringId b = table.Add("+");
+        
+        EXPECT_EQUAL("foo:bar:", table.Find(a));
+        EXPECT_EQUAL("+", table.Find(b));
+    }
+    
+    void StringTableTests::TestGrow()
+    {
+        StringTable table;
+        
+        // Add enough strings to force the hash index to be resized a few
+        // times and make sure the IDs survive it.
+        for (int i = 0; i < 1000; i++)
+        {
+            EXPECT_EQUAL(i, table.Add(String::Format("name%d", i)));
+        }
+        
+        EXPECT_EQUAL(1000, table.Count());
+        
+        for (int i = 0; i < 1000; i++)
+        {
+            String name = String::Format("name%d", i);
+            EXPECT_EQUAL(i, table.Add(name));
+            EXPECT_EQUAL(name, table.Find(i));
+        }
+        
+        EXPECT_EQUAL(1000, table.Count());
+    }
+}
+
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "Test.h"
+
+namespace Finch
+{
+    class StringTableTests : public Test
+    {
+    public:
+        static void Run();
+        
+    private:
+        static void TestAdd();
+        static void TestFind();
+        static void TestGrow();
+    };
+}
+
@@ -15,6 +15,8 @@ namespace Finch
         TestComparison();
         TestSubstring();
         TestReplace();
+        TestLongConcatenation();
+        TestRopeRebalancing();
     }
     
     void StringTests::TestEmpty()
@@ -169,5 +171,106 @@ namespace Finch
 
         EXPECT_EQUAL("xbaybazba", String("xcyczc").Replace("c", "ba"));
     }
+    
+    void StringTests::TestLongConcatenation()
+    {
+        String chunk = "0123456789012345678901234567890123456789";
+        
+        // long enough to be a rope
+        {
+            String a = chunk + chunk;
+            EXPECT_EQUAL(80, a.Length());
+            EXPECT_EQUAL('9', a[49]);
+            EXPECT_EQUAL(40, a.IndexOf("90123", 35) + 1);
+            EXPECT_EQUAL(String(a.CString()).HashCode(), a.HashCode());
+            EXPECT_EQUAL(chunk, a.Substring(40));
+        }
+        
+        // halves stay valid after the rope is flattened
+        {
+            String left = chunk + "left";
+            String right = chunk + "right";
+            String both = left + right;
+            
+            EXPECT_EQUAL(89, both.Length());
+            EXPECT_EQUAL(chunk + "left" + chunk + "right", both);
+            EXPECT_EQUAL(44, left.Length());
+            EXPECT_EQUAL(String(chunk.CString()) + "right", right);
+        }
+        
+        // building a string a piece at a time goes past the rope depth limit
+        {
+            String built;
+            for (int i = 0; i < 1000; i++) built += "ab";
+            
+            EXPECT_EQUAL(2000, built.Length());
+            EXPECT_EQUAL('a', built[1000]);
+            EXPECT_EQUAL('b', built[1999]);
+            EXPECT_EQUAL(-1, built.IndexOf("aa"));
+            
+            String copy = built;
+            built += "c";
+            EXPECT_EQUAL(2000, copy.Length());
+            EXPECT_EQUAL('c', built[2000]);
+        }
+    }
+    
+    void StringTests::TestRopeRebalancing()
+    {
+        // appending one piece at a time stays a shallow rope and never
+        // copies what's already there
+        {
+            String built;
+            while (built.Length() < String::MinRopeLength) built += "ab";
+            String start = built;
+            
+            for (int i = built.Length() / 2; i < 100000; i++) built += "ab";
+            
+            EXPECT_EQUAL(200000, built.Length());
+            EXPECT(built.mData->depth <= String::MaxRopeDepth);
+            EXPECT(built.mData->chars == NULL);
+            
+            // the start is still the first piece of the rope
+            Handle<String::StringData> node = built.mData;
+            while (!node->left.IsNull() && (node != start.mData))
+            {
+                node = node->left;
+            }
+            
+            EXPECT(node == start.mData);
+            
+            EXPECT_EQUAL('a', built[0]);
+            EXPECT_EQUAL('b', built[199999]);
+            EXPECT_EQUAL(-1, built.IndexOf("aa"));
+        }
+        
+        // so does prepending
+        {
+            String built;
+            for (int i = 0; i < 100000; i++) built = String("ab") + built;
+            
+            EXPECT_EQUAL(200000, built.Length());
+            EXPECT(built.mData->depth <= String::MaxRopeDepth);
+            EXPECT(built.mData->chars == NULL);
+            EXPECT_EQUAL(-1, built.IndexOf("bb"));
+        }
+        
+        // strings that share pieces with a rebalanced one are untouched
+        {
+            String built;
+            String halfway;
+            for (int i = 0; i < 1000; i++)
+            {
+                built += String::Format("%03d", i);
+                if (i == 499) halfway = built;
+            }
+            
+            EXPECT_EQUAL(1500, halfway.Length());
+            EXPECT_EQUAL(3000, built.Length());
+            EXPECT_EQUAL(halfway, built.Substring(0, 1500));
+            EXPECT_EQUAL("499", halfway.Substring(1497));
+            EXPECT_EQUAL("500999", built.Substring(1500, 3) +
+                                   built.Substring(2997));
+        }
+    }
 }
-
@@ -20,6 +20,8 @@ namespace Finch
         static void TestComparison();
         static void TestSubstring();
         static void TestReplace();
+        static void TestLongConcatenation();
+        static void TestRopeRebalancing();
     };
 }
 
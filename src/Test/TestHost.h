@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdlib>
+#include <cstring>
+
+#include "FinchString.h"
+#include "IInterpreterHost.h"
+#include "ILineReader.h"
+
+namespace Finch
+{
+    // An interpreter host for tests. Instead of printing them, it collects
+    // everything the interpreter outputs and any errors it reports so that
+    // tests can check them.
+    class TestHost : public IInterpreterHost
+    {
+    public:
+        virtual void * Allocate(size_t size) { return malloc(size); }
+        virtual void Free(void * data) { free(data); }
+
+        virtual void Output(const String & text) { mOutput += text; }
+        virtual void Error(const String & message) { mErrors += message; }
+
+        const String & GetOutput() const { return mOutput; }
+        const String & GetErrors() const { return mErrors; }
+
+        // Forgets what has been collected so far.
+        void Clear()
+        {
+            mOutput = "";
+            mErrors = "";
+        }
+
+    private:
+        String mOutput;
+        String mErrors;
+    };
+
+    // Reads source code that's given as a single string, a line at a time.
+    class SourceLineReader : public ILineReader
+    {
+    public:
+        SourceLineReader(const char * source)
+        :   mSource(source)
+        {}
+
+        virtual bool IsInfinite() const { return false; }
+        virtual bool EndOfLines() const { return mSource == NULL; }
+
+        virtual String NextLine()
+        {
+            const char * end = strchr(mSource, '\n');
+            if (end == NULL)
+            {
+                String line = mSource;
+                mSource = NULL;
+                return line;
+            }
+
+            String line = String(mSource).Substring(0, end - mSource);
+            mSource = end + 1;
+            return line;
+        }
+
+    private:
+        const char * mSource;
+    };
+}
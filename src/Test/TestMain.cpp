@@ -1,10 +1,22 @@
 #include <iostream>
 
+#include "AllocatorTests.h"
 #include "ArrayTests.h"
+#include "BytecodeImageTests.h"
+#include "CompilerTests.h"
+#include "DictionaryTests.h"
+#include "HandleTests.h"
+#include "IdTableTests.h"
+#include "InterpreterTests.h"
 #include "LexerTests.h"
+#include "OptimizerTests.h"
 #include "QueueTests.h"
 #include "RefTests.h"
+#include "RegisterStackTests.h"
+#include "SnapshotTests.h"
 #include "StackTests.h"
+#include "StandaloneTests.h"
+#include "StringTableTests.h"
 #include "StringTests.h"
 #include "TokenTests.h"
 
@@ -13,11 +25,23 @@ int main (int argc, char * const argv[])
 {
     using namespace Finch;
     
+    AllocatorTests::Run();
     ArrayTests::Run();
+    BytecodeImageTests::Run();
+    CompilerTests::Run();
+    DictionaryTests::Run();
+    HandleTests::Run();
+    IdTableTests::Run();
+    InterpreterTests::Run();
     LexerTests::Run();
+    OptimizerTests::Run();
     QueueTests::Run();
     RefTests::Run();
+    RegisterStackTests::Run();
+    SnapshotTests::Run();
     StackTests::Run();
+    StandaloneTests::Run();
+    StringTableTests::Run();
     StringTests::Run();
     TokenTests::Run();
     
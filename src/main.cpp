@@ -1,14 +1,16 @@
+#include <cstdio>
 #include <cstring>
 #include <iostream>
+#include <sstream>
 #include <stdlib.h> // realpath
 #include <sys/param.h> // PATH_MAX
 
-#include "FileLineReader.h"
 #include "FinchString.h"
 #include "Interpreter.h"
-#include "Fiber.h"
+#include "Optimizer.h"
 #include "Ref.h"
 #include "ReplLineReader.h"
+#include "Standalone.h"
 #include "StandaloneInterpreterHost.h"
 
 using namespace Finch;
@@ -16,50 +18,31 @@ using namespace Finch;
 using std::cout;
 using std::endl;
 
-Ref<ILineReader> OpenFile(String filePath);
-bool InterpretFile(Interpreter & interpreter, String filePath);
-PRIMITIVE(LoadFile);
+bool ShowOptimizerStats(Interpreter & interpreter, String sourcePath);
+int Run(Interpreter & interpreter, int argc, char * const argv[]);
 
-//### bob: should move this stuff into a "standalone" class
-Ref<ILineReader> OpenFile(String filePath)
+// Compiles the given source file without running it and shows how much the
+// optimizer shrank its code and call frames.
+bool ShowOptimizerStats(Interpreter & interpreter, String sourcePath)
 {
-    Ref<ILineReader> reader = Ref<ILineReader>(new FileLineReader(filePath));
-    
-    if (reader->EndOfLines())
-    {
-        // couldn't open
-        std::cout << "Couldn't open file \"" << filePath << "\"" << std::endl;
-        return Ref<ILineReader>();
-    }
-    
-    return reader;
-}
-
-bool InterpretFile(Interpreter & interpreter, String filePath)
-{
-    Ref<ILineReader> reader = OpenFile(filePath);
+    Ref<ILineReader> reader = Standalone::OpenFile(sourcePath);
     if (reader.IsNull()) return false;
     
-    interpreter.Interpret(*reader, false);
-    return true;
-}
-
-PRIMITIVE(LoadFile)
-{
-    String filePath = args[0].AsString();
-    Ref<ILineReader> reader = OpenFile(filePath);
+    Optimizer::ResetStats();
+    std::stringstream image;
+    if (!interpreter.CompileImage(*reader, image)) return false;
     
-    fiber.GetInterpreter().Interpret(*reader, false);
-    return fiber.Nil();
+    const OptimizerStats & stats = Optimizer::GetStats();
+    cout << "Instructions: " << stats.instructionsBefore << " -> "
+         << stats.instructionsAfter << endl;
+    cout << "Registers:    " << stats.registersBefore << " -> "
+         << stats.registersAfter << endl;
+    return true;
 }
 
 int main (int argc, char * const argv[])
 {    
     StandaloneInterpreterHost host;
-    Interpreter               interpreter(host);
-
-    // Set up the standalone-provided behavior.
-    interpreter.BindMethod("Ether", "load:", LoadFile);
 
     // Figure out the absolute path to the core library, relative to the
     // executable. Assumes a directory layout like:
@@ -68,17 +51,52 @@ int main (int argc, char * const argv[])
     // - lib/core.fin
     char coreLibPath[PATH_MAX];
     char fullPath[PATH_MAX];
-    strncpy(coreLibPath, argv[0], PATH_MAX);
-    strncat(coreLibPath, "/../../../lib/core.fin", PATH_MAX);
-    realpath(coreLibPath, fullPath);
-
-    // Load the core library.
-    if (!InterpretFile(interpreter, fullPath))
+    snprintf(coreLibPath, PATH_MAX, "%s/../../../lib/core.fin", argv[0]);
+    if (realpath(coreLibPath, fullPath) == NULL)
+    {
+        cout << "Could not load core library." << endl;
+        return 2;
+    }
+    
+    // A new snapshot is always made from the source, so that a stale
+    // snapshot or image can be replaced.
+    bool writeSnapshot = (argc == 3) && (strcmp(argv[1], "--snapshot") == 0);
+    
+    Interpreter * interpreter = Standalone::LoadCore(host, fullPath,
+                                                    writeSnapshot);
+    if (interpreter == NULL)
     {
         cout << "Could not load core library." << endl;
         return 2;
     }
     
+    int result = Run(*interpreter, argc, argv);
+    delete interpreter;
+    return result;
+}
+
+// Does what the command line asks for with the core library loaded.
+int Run(Interpreter & interpreter, int argc, char * const argv[])
+{
+    // Write a heap snapshot of the interpreter with the core library loaded.
+    if ((argc == 3) && (strcmp(argv[1], "--snapshot") == 0))
+    {
+        return Standalone::WriteSnapshotFile(interpreter, argv[2]) ? 0 : 1;
+    }
+    
+    // Compile a source file to a bytecode image. This happens after loading
+    // the core library so that the compiler knows about its globals.
+    if ((argc == 4) && (strcmp(argv[1], "--compile") == 0))
+    {
+        return Standalone::CompileFile(interpreter, argv[2], argv[3]) ? 0 : 1;
+    }
+    
+    // Show how the optimizer did on a source file.
+    if ((argc == 3) && (strcmp(argv[1], "--optimizer-stats") == 0))
+    {
+        return ShowOptimizerStats(interpreter, argv[2]) ? 0 : 1;
+    }
+    
     if (argc == 1)
     {
         // With no arguments (arg zero is app), run in interactive mode.
@@ -97,7 +115,7 @@ int main (int argc, char * const argv[])
     {
         // One argument, load and execute the given script.
         String fileName = argv[1];
-        return InterpretFile(interpreter, fileName) ? 0 : 1;
+        return Standalone::InterpretFile(interpreter, fileName) ? 0 : 1;
     }
     
     return 0;